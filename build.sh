@@ -12,7 +12,7 @@ case "$build_type" in
     debug)
         ;;
     release)
-        FLAGS="IBNET_DISABLE_STATISTICS"
+        FLAGS="IBNET_STATS_LEVEL=1"
         ;;
     *)
         echo "Invalid build type \"$build_type\" specified"
@@ -33,11 +33,17 @@
 // #define IBNET_LOG_TRACE_INCLUDE
 
 /**
- * Compiler flag to disable statistics
+ * Level of statistics to compile (see stats/Level.hpp):
+ * 0 = off, 1 = counters only, 2 = coarse timings, 3 = full timelines (default)
  *
- * When executing benchmarks, you should disable any statistics because
- * there are a lot of them used for debugging and to analyze the control flow
- * to detect possible bottlenecks or unoptimized paths.
+ * When executing benchmarks, you should use level 1 or 0 because the timings
+ * of levels 2 and 3 are used to analyze the control flow to detect possible
+ * bottlenecks or unoptimized paths and cost a timer read per section.
+ */
+// #define IBNET_STATS_LEVEL 1
+
+/**
+ * Compiler flag to disable statistics (same as IBNET_STATS_LEVEL 0)
  */
 // #define IBNET_DISABLE_STATISTICS
 
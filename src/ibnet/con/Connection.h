@@ -26,6 +26,7 @@ namespace ibnet {
 namespace con {
 
 typedef uint16_t ConnectionId;
+static const uint16_t CONNECTION_ID_INVALID = 0xFFFF;
 
 // forward declration for friendship
 class ConnectionManager;
@@ -159,7 +160,8 @@ public:
 
 protected:
     const NodeId m_ownNodeId;
-    const ConnectionId m_connectionId;
+    // not const, connections can be created before they are assigned
+    ConnectionId m_connectionId;
     ConnectionState* m_refState;
     RemoteConnectionHeader m_remoteConnectionHeader;
 };
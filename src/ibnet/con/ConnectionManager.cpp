@@ -18,6 +18,7 @@
 
 #include "ConnectionManager.h"
 
+#include "ibnet/sys/HazardRegistry.h"
 #include "ibnet/sys/IllegalStateException.h"
 #include "ibnet/sys/Logger.hpp"
 #include "ibnet/sys/Random.h"
@@ -30,10 +31,12 @@
 namespace ibnet {
 namespace con {
 
+thread_local uint32_t ConnectionManager::ms_countedHandles = 0;
+
 ConnectionManager::ConnectionManager(const std::string& name,
         NodeId ownNodeId, const NodeConf& nodeConf,
         uint32_t connectionCreationTimeoutMs, uint32_t maxNumConnections,
-        core::IbDevice* refDevice, core::IbProtDom* refProtDom,
+        uint8_t numSetupWorkers, core::IbDevice* refDevice, core::IbProtDom* refProtDom,
         ExchangeManager* refExchangeManager, JobManager* refJobManager,
         DiscoveryManager* refDiscoveryManager) :
         m_name(name),
@@ -47,10 +50,13 @@ ConnectionManager::ConnectionManager(const std::string& name,
         m_refJobManager(refJobManager),
         m_refDiscoveryManager(refDiscoveryManager),
         m_listener(nullptr),
-        m_connectionStates(),
-        m_connections(),
+        m_connectionStates(new ConnectionState[maxNumConnections]),
+        m_connections(new Connection*[maxNumConnections]),
         m_openConnections(0),
+        m_availableConnectionIdsLock(),
         m_availableConnectionIds(),
+        m_connectionIds(),
+        m_setupWorkers(),
         m_flagShutdown(false),
         m_conDataExchgPaketType(m_refExchangeManager->GeneratePaketTypeId()),
         m_createConnectionJobType(m_refJobManager->GenerateJobTypeId()),
@@ -59,14 +65,22 @@ ConnectionManager::ConnectionManager(const std::string& name,
 {
     IBNET_LOG_TRACE_FUNC;
     IBNET_LOG_INFO("[%s] Initializing connection manager, ownNodeId %X, "
-            "creation timeout %d, max connections %d, node config %s", m_name,
-            ownNodeId, connectionCreationTimeoutMs, maxNumConnections, nodeConf);
+            "creation timeout %d, max connections %d, setup workers %d, node config %s", m_name,
+            ownNodeId, connectionCreationTimeoutMs, maxNumConnections, numSetupWorkers, nodeConf);
 
     if (ownNodeId == NODE_ID_INVALID) {
         throw sys::IllegalStateException("Invalid own node id provided");
     }
 
-    for (uint32_t i = 0; i < NODE_ID_MAX_NUM_NODES; i++) {
+    if (numSetupWorkers == 0) {
+        throw sys::IllegalStateException("Number of connection setup workers must be > 0");
+    }
+
+    if (maxNumConnections == 0 || maxNumConnections > CONNECTION_ID_INVALID) {
+        throw sys::IllegalStateException("Invalid max number of connections: %d", maxNumConnections);
+    }
+
+    for (uint32_t i = 0; i < m_maxNumConnections; i++) {
         m_connections[i] = nullptr;
     }
 
@@ -76,11 +90,14 @@ ConnectionManager::ConnectionManager(const std::string& name,
         m_availableConnectionIds.push_back((uint16_t) i);
     }
 
-    m_refExchangeManager->AddDispatcher(m_conDataExchgPaketType, this);
+    // connection jobs are processed by the setup workers, the job manager
+    // is left to discovery
+    for (uint8_t i = 0; i < numSetupWorkers; i++) {
+        m_setupWorkers.push_back(new SetupWorker(this, i));
+        m_setupWorkers.back()->Start();
+    }
 
-    m_refJobManager->AddDispatcher(m_createConnectionJobType, this);
-    m_refJobManager->AddDispatcher(m_connectConnectionJobType, this);
-    m_refJobManager->AddDispatcher(m_closeConnectionJobType, this);
+    m_refExchangeManager->AddDispatcher(m_conDataExchgPaketType, this);
 
     IBNET_LOG_DEBUG("[%s] Initializing connection manager done", m_name);
 }
@@ -90,28 +107,44 @@ ConnectionManager::~ConnectionManager()
     IBNET_LOG_TRACE_FUNC;
     IBNET_LOG_INFO("[%s] Shutting down connection manager...", m_name);
 
+    // no-op if already called by the implementation
+    _CloseAllConnections();
+
+    m_refExchangeManager->RemoveDispatcher(m_conDataExchgPaketType, this);
+
+    for (auto& it : m_setupWorkers) {
+        it->Shutdown();
+    }
+
+    for (auto& it : m_setupWorkers) {
+        it->Stop();
+        delete it;
+    }
+
+    delete[] m_connections;
+    delete[] m_connectionStates;
+
+    IBNET_LOG_DEBUG("[%s] Shutting down connection manager done", m_name);
+}
+
+void ConnectionManager::_CloseAllConnections()
+{
     m_flagShutdown.store(true, std::memory_order_relaxed);
 
     // close opened connections
-    for (auto& m_connection : m_connections) {
-        if (m_connection) {
-            __AddJobCloseConnection(m_connection->GetRemoteNodeId(),
+    for (uint32_t i = 0; i < m_maxNumConnections; i++) {
+        if (m_connections[i]) {
+            __AddJobCloseConnection(m_connections[i]->GetRemoteNodeId(),
                     true, true);
         }
     }
 
     // wait until all jobs are processed
-    while (!m_refJobManager->IsQueueEmpty()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (auto& it : m_setupWorkers) {
+        while (!it->IsIdle()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
     }
-
-    m_refExchangeManager->RemoveDispatcher(m_conDataExchgPaketType, this);
-
-    m_refJobManager->RemoveDispatcher(m_createConnectionJobType, this);
-    m_refJobManager->RemoveDispatcher(m_connectConnectionJobType, this);
-    m_refJobManager->RemoveDispatcher(m_closeConnectionJobType, this);
-
-    IBNET_LOG_DEBUG("[%s] Shutting down connection manager done", m_name);
 }
 
 Connection* ConnectionManager::GetConnection(NodeId nodeId)
@@ -126,50 +159,29 @@ Connection* ConnectionManager::GetConnection(NodeId nodeId)
                 m_name);
     }
 
-    // keep track of "handles" issued
-    int32_t available = m_connectionStates[nodeId].m_available.fetch_add(1,
-            std::memory_order_acquire);
+    ConnectionId connectionId = m_connectionIds.Get(nodeId);
 
-    if (available >= ConnectionState::CONNECTION_AVAILABLE) {
-        return m_connections[nodeId];
-    }
+    if (connectionId != CONNECTION_ID_INVALID) {
+        Connection* connection = __AcquireConnection(nodeId, connectionId);
 
-    // connection not available, reset fetch
-    while (true) {
-        if (m_connectionStates[nodeId].m_available.compare_exchange_strong(
-                available, ConnectionState::CONNECTION_NOT_AVAILABLE,
-                std::memory_order_relaxed)) {
-            break;
-        }
-
-        if (available >= ConnectionState::CONNECTION_AVAILABLE) {
-            break;
+        if (connection) {
+            return connection;
         }
     }
 
-    IBNET_LOG_TRACE("[%s] GetConnection: 0x%X, avail: %d", m_name, nodeId,
-            available + 1);
+    IBNET_LOG_TRACE("[%s] GetConnection: 0x%X, not available", m_name, nodeId);
+
+    connectionId = __AssignConnectionId(nodeId);
+
+    if (connectionId == CONNECTION_ID_INVALID) {
+        throw sys::IllegalStateException("[%s] Creating connection to %X, out of connection ids (max %d)",
+                m_name, nodeId, m_maxNumConnections);
+    }
 
     // This is used to trigger periodic re-transmits for the connection exchg
     // data. Only the first thread triggering the creation job has to do
     // this for the current connection getting created
-    bool triggerPeriodicRecreation = false;
-
-    // avoid flooding the job queue with creation jobs, only the first thread
-    // has to add the job
-    if (m_connectionStates[nodeId].m_state.load(std::memory_order_relaxed) != ConnectionState::e_StateConnected) {
-        uint8_t state = ConnectionState::e_StateNotAvailable;
-        m_connectionStates[nodeId].m_state.compare_exchange_strong(state, ConnectionState::e_StateInCreation,
-            std::memory_order_relaxed);
-
-        bool expected = false;
-
-        if (m_connectionStates[nodeId].m_triggerReExchange.compare_exchange_strong(expected, true,
-                std::memory_order_relaxed)) {
-            triggerPeriodicRecreation = true;
-            __AddJobCreateConnection(nodeId);
-        }
-    }
+    bool triggerPeriodicRecreation = __TriggerConnectionCreation(nodeId, connectionId);
 
     std::chrono::high_resolution_clock::time_point start;
     std::chrono::high_resolution_clock::time_point startRetry;
@@ -179,21 +191,24 @@ Connection* ConnectionManager::GetConnection(NodeId nodeId)
     startRetry = start;
 
     do {
-        available = m_connectionStates[nodeId].m_available
-                .load(std::memory_order_acquire);
-
-        if (available >= ConnectionState::CONNECTION_AVAILABLE) {
-            m_connectionStates[nodeId].m_available
-                    .fetch_add(1, std::memory_order_acquire);
-
-            // sanity check
-            if (m_connections[nodeId] == nullptr) {
-                throw sys::IllegalStateException(
-                        "[%s] Invalid connection state on GetConnection, node id "
-                                "0x%X", m_name, nodeId);
+        // released if the connection was closed in the meantime, e.g. by
+        // another thread timing out on creation
+        if (m_connectionIds.Get(nodeId) != connectionId) {
+            connectionId = __AssignConnectionId(nodeId);
+
+            if (connectionId == CONNECTION_ID_INVALID) {
+                throw sys::IllegalStateException("[%s] Creating connection to %X, out of connection ids (max %d)",
+                        m_name, nodeId, m_maxNumConnections);
             }
 
-            return m_connections[nodeId];
+            triggerPeriodicRecreation = __TriggerConnectionCreation(nodeId, connectionId);
+        }
+
+        ConnectionState& state = m_connectionStates[connectionId];
+        Connection* connection = __AcquireConnection(nodeId, connectionId);
+
+        if (connection) {
+            return connection;
         }
 
         std::this_thread::yield();
@@ -209,8 +224,8 @@ Connection* ConnectionManager::GetConnection(NodeId nodeId)
                 // either if no connection allocated at all (because it wasn't
                 // discovered so far) or connected created but exchg is not
                 // complete (e.g. dropped UDP packages)
-                if (!m_connections[nodeId] || (m_connections[nodeId] &&
-                        !m_connectionStates[nodeId].ConnectionExchgComplete())) {
+                if (!m_connections[connectionId] || (m_connections[connectionId] &&
+                        !state.ConnectionExchgComplete())) {
                     __AddJobCreateConnection(nodeId);
                 }
 
@@ -223,24 +238,46 @@ Connection* ConnectionManager::GetConnection(NodeId nodeId)
     if (triggerPeriodicRecreation) {
         // reset state if not created, yet
         uint8_t state = ConnectionState::e_StateInCreation;
-        m_connectionStates[nodeId].m_state.compare_exchange_strong(state,
+        m_connectionStates[connectionId].m_state.compare_exchange_strong(state,
                 ConnectionState::e_StateNotAvailable, std::memory_order_relaxed);
 
         bool expected = true;
-        m_connectionStates[nodeId].m_triggerReExchange.compare_exchange_strong(expected, false,
+        m_connectionStates[connectionId].m_triggerReExchange.compare_exchange_strong(expected, false,
                 std::memory_order_relaxed);
+
+        // nothing allocated for the node, yet. release the connection id
+        // (by the node's setup worker, ordered with the node's jobs)
+        if (!m_connections[connectionId]) {
+            __AddJobCloseConnection(nodeId, true, false);
+        }
     }
 
     std::chrono::duration<uint64_t, std::nano> delta(end - start);
 
     throw sys::TimeoutException("[%s] Creating connection connection to %X, timeout: %d ms, state %d", m_name,
-            nodeId, delta.count() / 1000 / 1000, m_connectionStates[nodeId].m_state.load(std::memory_order_relaxed));
+            nodeId, delta.count() / 1000 / 1000,
+            m_connectionStates[connectionId].m_state.load(std::memory_order_relaxed));
 }
 
 void ConnectionManager::ReturnConnection(Connection* connection)
 {
-    m_connectionStates[connection->GetRemoteNodeId()].m_available.fetch_sub(1,
-            std::memory_order_relaxed);
+    ConnectionState& state = m_connectionStates[connection->GetConnectionId()];
+
+    if (sys::HazardRegistry::Release(&state)) {
+        return;
+    }
+
+    // handle not held in a hazard slot of the calling thread: must be
+    // counted on the shared state by this thread. otherwise, the handle was
+    // acquired by another thread which still holds it in its slot
+    if (ms_countedHandles == 0) {
+        throw sys::IllegalStateException("[%s] Returning connection to %X "
+                "from a thread that did not get it", m_name,
+                connection->GetRemoteNodeId());
+    }
+
+    ms_countedHandles--;
+    state.m_available.fetch_sub(1, std::memory_order_relaxed);
 }
 
 void ConnectionManager::CloseConnection(NodeId nodeId, bool force)
@@ -298,17 +335,34 @@ void ConnectionManager::_DispatchJob(const JobQueue::Job* job)
     }
 }
 
+NodeId ConnectionManager::__GetJobNodeId(const JobQueue::Job* job) const
+{
+    if (job->m_type == m_createConnectionJobType) {
+        return static_cast<const JobCreateConnection*>(job)->m_targetNodeId;
+    } else if (job->m_type == m_connectConnectionJobType) {
+        return static_cast<const JobConnectConnection*>(job)->m_remoteConnectionHeader.m_nodeId;
+    } else {
+        return static_cast<const JobCloseConnection*>(job)->m_nodeId;
+    }
+}
+
+void ConnectionManager::__AddJob(JobQueue::Job* job)
+{
+    // all jobs of a node are processed by the same worker to keep them in
+    // order
+    m_setupWorkers[__GetJobNodeId(job) % m_setupWorkers.size()]->AddJob(job);
+}
+
 void ConnectionManager::__AddJobCreateConnection(NodeId destNodeId)
 {
-    m_refJobManager->AddJob(new JobCreateConnection(m_createConnectionJobType,
-            destNodeId));
+    __AddJob(new JobCreateConnection(m_createConnectionJobType, destNodeId));
 }
 
 void ConnectionManager::__AddJobConnectConnection(
         const RemoteConnectionHeader& remoteConnectionHeader,
         const uint8_t* remoteConnectionData, size_t remoteConnectionDatSize)
 {
-    m_refJobManager->AddJob(new JobConnectConnection(m_connectConnectionJobType,
+    __AddJob(new JobConnectConnection(m_connectConnectionJobType,
             remoteConnectionHeader, remoteConnectionData,
             remoteConnectionDatSize));
 }
@@ -316,7 +370,7 @@ void ConnectionManager::__AddJobConnectConnection(
 void ConnectionManager::__AddJobCloseConnection(NodeId nodeId, bool force,
         bool shutdown)
 {
-    m_refJobManager->AddJob(new JobCloseConnection(m_closeConnectionJobType,
+    __AddJob(new JobCloseConnection(m_closeConnectionJobType,
             nodeId, force, shutdown));
 }
 
@@ -328,6 +382,13 @@ void ConnectionManager::__JobDispatchCreateConnection(
     IBNET_LOG_DEBUG("[%s] Create connection, target node id 0x%X",
             m_name, job.m_targetNodeId);
 
+    ConnectionId connectionId = m_connectionIds.Get(job.m_targetNodeId);
+
+    // creation timed out or connection closed in the meantime
+    if (connectionId == CONNECTION_ID_INVALID) {
+        return;
+    }
+
     try {
         // try to get remote node connection info from discovery man to
         // check if already discovered
@@ -340,17 +401,13 @@ void ConnectionManager::__JobDispatchCreateConnection(
     }
 
     // only create connection if not created or in creation
-    if (m_connectionStates[job.m_targetNodeId].m_state
+    if (m_connectionStates[connectionId].m_state
             .load(std::memory_order_relaxed) ==
             ConnectionState::e_StateInCreation) {
-        __AllocateConnection(job.m_targetNodeId);
+        __AllocateConnection(job.m_targetNodeId, connectionId);
     }
 
-    __SendConnectionExchgData(job.m_targetNodeId,
-            m_connectionStates[job.m_targetNodeId].m_exchgFlags
-                    .load(std::memory_order_relaxed),
-            m_connectionStates[job.m_targetNodeId].m_remoteExchgFlags
-                    .load(std::memory_order_relaxed),
+    __QueueConnectionExchgData(job.m_targetNodeId,
             discoveryRemoteNodeInfo.GetAddress().GetAddress());
 }
 
@@ -360,6 +417,7 @@ void ConnectionManager::__JobDispatchConnectConnection(
     IBNET_LOG_TRACE_FUNC;
 
     NodeConf::Entry discoveryRemoteNodeInfo;
+    NodeId remoteNodeId = job.m_remoteConnectionHeader.m_nodeId;
 
     IBNET_LOG_DEBUG("[%s] Connect connection job, data size %d, header: %s",
             m_name, job.m_remoteConnectionDataSize, job.m_remoteConnectionHeader);
@@ -368,103 +426,100 @@ void ConnectionManager::__JobDispatchConnectConnection(
         // try to get remote node connection info from discovery man to
         // check if already discovered
         discoveryRemoteNodeInfo = m_refDiscoveryManager->GetNodeInfo(
-                job.m_remoteConnectionHeader.m_nodeId);
+                remoteNodeId);
     } catch (...) {
         IBNET_LOG_WARN("[%s] Cannot create connection to remote 0x%X, "
-                "not discovered, yet", m_name,
-                job.m_remoteConnectionHeader.m_nodeId);
+                "not discovered, yet", m_name, remoteNodeId);
         return;
     }
 
+    // remote might initiate the connection
+    ConnectionId connectionId = __AssignConnectionId(remoteNodeId);
+
+    if (connectionId == CONNECTION_ID_INVALID) {
+        IBNET_LOG_WARN("[%s] Cannot create connection to remote 0x%X, "
+                "out of connection ids (max %d)", m_name, remoteNodeId, m_maxNumConnections);
+        return;
+    }
+
+    ConnectionState& state = m_connectionStates[connectionId];
+
     // ensure connection is allocated
-    __AllocateConnection(job.m_remoteConnectionHeader.m_nodeId);
+    __AllocateConnection(remoteNodeId, connectionId);
 
     // sanity check
-    if (m_connectionStates[job.m_remoteConnectionHeader.m_nodeId].m_state
-            .load(std::memory_order_relaxed) <
+    if (state.m_state.load(std::memory_order_relaxed) <
             ConnectionState::e_StateCreated) {
         throw sys::IllegalStateException("Connected not created state, node id "
-                "0x%X", job.m_remoteConnectionHeader.m_nodeId);
+                "0x%X", remoteNodeId);
     }
 
     // update remote exchg flags
-    m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-            .m_remoteExchgFlags.store(job.m_remoteConnectionHeader.m_exchgFlags,
+    state.m_remoteExchgFlags.store(job.m_remoteConnectionHeader.m_exchgFlags,
             std::memory_order_relaxed);
 
     // connect to remote if we aren't connected, yet
-    if (!m_connectionStates[job.m_remoteConnectionHeader.m_nodeId].
-            IsConnectedToRemote()) {
-        m_connections[job.m_remoteConnectionHeader.m_nodeId]->Connect(
+    if (!state.IsConnectedToRemote()) {
+        m_connections[connectionId]->Connect(
                 job.m_remoteConnectionHeader, job.m_remoteConnectionData,
                 job.m_remoteConnectionDataSize);
 
-        m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-                .SetConnectedToRemote();
+        state.SetConnectedToRemote();
 
         IBNET_LOG_INFO("[%s] Connected QP to remote %s, own state: %s", m_name,
-                job.m_remoteConnectionHeader,
-                m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]);
+                job.m_remoteConnectionHeader, state);
     }
 
     // apply remote connection state (i.e. remote signals that it is
     // already connected to our current instance
-    if (!m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-            .IsRemoteConnected() &&
+    if (!state.IsRemoteConnected() &&
             ConnectionState::IsRemoteConnectedToCurrent(
                     job.m_remoteConnectionHeader.m_exchgFlags)) {
-        m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-                .SetRemoteConnected();
+        state.SetRemoteConnected();
     }
 
     uint8_t expectedState = ConnectionState::e_StateCreated;
 
     // finish connection of current instance if the current instance and
     // remote are fully connected and we come from the creation state
-    if (m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-            .ConnectionExchgComplete() &&
-            m_connectionStates[job.m_remoteConnectionHeader.m_nodeId].m_state
-                    .compare_exchange_strong(expectedState,
-                            ConnectionState::e_StateConnected, std::memory_order_relaxed)) {
+    if (state.ConnectionExchgComplete() &&
+            state.m_state.compare_exchange_strong(expectedState,
+                    ConnectionState::e_StateConnected, std::memory_order_relaxed)) {
         // check if the current node didn't figure out that the remote
         // died and was restarted (current node acting as receiver only).
         // this results in still owning old queue pair information
         // which cannot be re-used with the new remote
-        if (m_connections[job.m_remoteConnectionHeader.m_nodeId]->
-                GetRemoteConnectionManIdent() !=
+        if (m_connections[connectionId]->GetRemoteConnectionManIdent() !=
                 job.m_remoteConnectionHeader.m_conManIdent) {
 
             // different connection manager though same node id
             // -> application restarted, kill old connection
             IBNET_LOG_DEBUG("[%s] Detected zombie connection to node 0x%X"
-                    " (%X != %X), killing...", m_name,
-                    job.m_remoteConnectionHeader.m_nodeId,
-                    m_connections[job.m_remoteConnectionHeader.m_nodeId]->
-                            GetRemoteConnectionManIdent());
+                    " (%X != %X), killing...", m_name, remoteNodeId,
+                    m_connections[connectionId]->GetRemoteConnectionManIdent());
 
-            __AddJobCloseConnection(job.m_remoteConnectionHeader.m_nodeId,
-                    true, false);
-            __AddJobCreateConnection(job.m_remoteConnectionHeader.m_nodeId);
+            // executed right away by the node's setup worker, keeping the
+            // order with jobs already queued for the node
+            __JobDispatchCloseConnection(JobCloseConnection(m_closeConnectionJobType,
+                    remoteNodeId, true, false));
+            __JobDispatchCreateConnection(JobCreateConnection(m_createConnectionJobType,
+                    remoteNodeId));
 
             return;
         }
 
-        m_openConnections++;
+        m_openConnections.fetch_add(1, std::memory_order_relaxed);
 
-        m_connectionStates[job.m_remoteConnectionHeader.m_nodeId].m_available
-                .store(ConnectionState::CONNECTION_AVAILABLE,
-                        std::memory_order_release);
+        state.m_available.store(ConnectionState::CONNECTION_AVAILABLE,
+                std::memory_order_release);
 
         IBNET_LOG_INFO("[%s] Connection completed with remote %s, state: %s",
-                m_name, job.m_remoteConnectionHeader.m_nodeId,
-                m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]);
+                m_name, remoteNodeId, state);
 
-        _ConnectionOpened(
-                *m_connections[job.m_remoteConnectionHeader.m_nodeId]);
+        _ConnectionOpened(*m_connections[connectionId]);
 
         if (m_listener) {
-            m_listener->NodeConnected(*m_connections[
-                    job.m_remoteConnectionHeader.m_nodeId]);
+            m_listener->NodeConnected(*m_connections[connectionId]);
         }
 
         return;
@@ -473,22 +528,14 @@ void ConnectionManager::__JobDispatchConnectConnection(
     // send exchg data to remote if either we are not done with the connection
     // exchange or if we got exchg data from the remote with an outdated
     // states of ours
-    if (!m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-            .ConnectionExchgComplete() ||
-            m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-                    .m_exchgFlags.load(std::memory_order_relaxed) !=
+    if (!state.ConnectionExchgComplete() ||
+            state.m_exchgFlags.load(std::memory_order_relaxed) !=
                     job.m_remoteConnectionHeader.m_exchgFlagsRemote) {
         IBNET_LOG_DEBUG(
                 "[%s] Connection exchange not completed thus far (state %s), "
-                        "sending exchg data to 0x%X", m_name,
-                m_connectionStates[job.m_remoteConnectionHeader.m_nodeId],
-                job.m_remoteConnectionHeader.m_nodeId);
-
-        __SendConnectionExchgData(job.m_remoteConnectionHeader.m_nodeId,
-                m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-                        .m_exchgFlags.load(std::memory_order_relaxed),
-                m_connectionStates[job.m_remoteConnectionHeader.m_nodeId]
-                        .m_remoteExchgFlags.load(std::memory_order_relaxed),
+                        "sending exchg data to 0x%X", m_name, state, remoteNodeId);
+
+        __QueueConnectionExchgData(remoteNodeId,
                 discoveryRemoteNodeInfo.GetAddress().GetAddress());
     }
 }
@@ -499,50 +546,55 @@ void ConnectionManager::__JobDispatchCloseConnection(
     IBNET_LOG_INFO("[%s] Closing connection of 0x%X, force %d", m_name,
             job.m_nodeId, job.m_force);
 
+    ConnectionId connectionId = m_connectionIds.Get(job.m_nodeId);
 
-    int32_t counter = m_connectionStates[job.m_nodeId].m_available.exchange(
-            ConnectionState::CONNECTION_CLOSING, std::memory_order_relaxed);
+    // no connection (requested) for the node
+    if (connectionId == CONNECTION_ID_INVALID) {
+        return;
+    }
 
-    if (!job.m_force) {
-        // wait until remaining threads returned the connection
-        while (true) {
-            int32_t tmp = m_connectionStates[job.m_nodeId].m_available.load(
-                    std::memory_order_relaxed);
+    // connection id assigned but connection not created, e.g. creation
+    // timed out. connections are only allocated by the node's setup worker
+    if (m_connections[connectionId] == nullptr) {
+        __ReleaseConnectionId(job.m_nodeId, connectionId);
+        return;
+    }
 
-            if (ConnectionState::CONNECTION_CLOSING - counter == tmp) {
-                break;
-            }
+    ConnectionState& state = m_connectionStates[connectionId];
+
+    int32_t counter = state.m_available.exchange(
+            ConnectionState::CONNECTION_CLOSING, std::memory_order_relaxed);
+
+    // wait until remaining threads returned the connection, also if forced
+    // (force only skips emptying the queues): deleting a connection still
+    // used by another thread (e.g. a dispatcher posting to its QP) is a use
+    // after free
+    while (true) {
+        int32_t tmp = state.m_available.load(std::memory_order_relaxed);
 
-            std::this_thread::yield();
+        if (ConnectionState::CONNECTION_CLOSING - counter == tmp) {
+            break;
         }
-    }
 
-    // remove connection
-    Connection* connection = m_connections[job.m_nodeId];
-    m_connections[job.m_nodeId] = nullptr;
+        std::this_thread::yield();
+    }
 
-    // check if someone else was faster and removed it already
-    if (connection == nullptr) {
-        return;
+    while (sys::HazardRegistry::IsProtected(&state)) {
+        std::this_thread::yield();
     }
 
-    connection->Close(job.m_force);
-    m_connectionStates[job.m_nodeId].m_exchgFlags.store(0,
-            std::memory_order_relaxed);
-    m_connectionStates[job.m_nodeId].m_remoteExchgFlags.store(0,
-            std::memory_order_relaxed);
-    m_connectionStates[job.m_nodeId].m_state.store(
-            ConnectionState::e_StateNotAvailable, std::memory_order_relaxed);
+    // remove connection
+    Connection* connection = m_connections[connectionId];
+    m_connections[connectionId] = nullptr;
 
-    // re-use connection id
-    m_availableConnectionIds.push_back(connection->GetConnectionId());
+    connection->Close(job.m_force);
 
     delete connection;
 
-    m_openConnections--;
+    m_openConnections.fetch_sub(1, std::memory_order_relaxed);
 
-    m_connectionStates[job.m_nodeId].m_available.store(
-            ConnectionState::CONNECTION_NOT_AVAILABLE, std::memory_order_relaxed);
+    // resets the connection's state, re-use connection id
+    __ReleaseConnectionId(job.m_nodeId, connectionId);
 
     m_refDiscoveryManager->Invalidate(job.m_nodeId, job.m_shutdown);
 
@@ -556,24 +608,148 @@ void ConnectionManager::__JobDispatchCloseConnection(
             job.m_nodeId, job.m_force);
 }
 
-bool ConnectionManager::__AllocateConnection(NodeId remoteNodeId)
+Connection* ConnectionManager::__AcquireConnection(NodeId nodeId,
+        ConnectionId connectionId)
 {
-    // allocate connection if necessary
-    if (m_connections[remoteNodeId] == nullptr) {
-        ConnectionId connectionId = m_availableConnectionIds.back();
-        m_availableConnectionIds.pop_back();
+    ConnectionState& state = m_connectionStates[connectionId];
+
+    // publish the handle in a slot of the calling thread and validate the
+    // state afterwards. the close job invalidates the state first and checks
+    // the slots of all threads afterwards
+    std::atomic<const void*>* slot = sys::HazardRegistry::Acquire(&state);
+
+    if (slot) {
+        if (state.m_available.load(std::memory_order_acquire) >=
+                ConnectionState::CONNECTION_AVAILABLE) {
+            Connection* connection = m_connections[connectionId];
+
+            // the connection id might have been re-assigned to another node
+            // since looking it up
+            if (connection->GetRemoteNodeId() == nodeId) {
+                return connection;
+            }
+        }
+
+        sys::HazardRegistry::Release(slot);
+
+        return nullptr;
+    }
+
+    // all slots of the calling thread in use (e.g. many connections held
+    // at the same time), fall back to counting handles on the shared state
+    int32_t available = state.m_available.load(std::memory_order_relaxed);
 
-        Connection* connection = _CreateConnection(connectionId);
-        connection->m_refState = &m_connectionStates[remoteNodeId];
+    while (available >= ConnectionState::CONNECTION_AVAILABLE) {
+        if (state.m_available.compare_exchange_weak(available, available + 1,
+                std::memory_order_acquire, std::memory_order_relaxed)) {
+            Connection* connection = m_connections[connectionId];
+
+            if (connection->GetRemoteNodeId() == nodeId) {
+                ms_countedHandles++;
+                return connection;
+            }
+
+            state.m_available.fetch_sub(1, std::memory_order_relaxed);
+
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+bool ConnectionManager::__TriggerConnectionCreation(NodeId nodeId,
+        ConnectionId connectionId)
+{
+    ConnectionState& state = m_connectionStates[connectionId];
+
+    // avoid flooding the job queue with creation jobs, only the first thread
+    // has to add the job
+    if (state.m_state.load(std::memory_order_relaxed) != ConnectionState::e_StateConnected) {
+        uint8_t expectedState = ConnectionState::e_StateNotAvailable;
+        state.m_state.compare_exchange_strong(expectedState, ConnectionState::e_StateInCreation,
+                std::memory_order_relaxed);
+
+        bool expected = false;
+
+        if (state.m_triggerReExchange.compare_exchange_strong(expected, true,
+                std::memory_order_relaxed)) {
+            __AddJobCreateConnection(nodeId);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ConnectionId ConnectionManager::__AssignConnectionId(NodeId nodeId)
+{
+    ConnectionId connectionId = m_connectionIds.Get(nodeId);
+
+    if (connectionId != CONNECTION_ID_INVALID) {
+        return connectionId;
+    }
+
+    std::lock_guard<std::mutex> l(m_availableConnectionIdsLock);
+
+    // assigned by another thread in the meantime
+    connectionId = m_connectionIds.Get(nodeId);
+
+    if (connectionId != CONNECTION_ID_INVALID) {
+        return connectionId;
+    }
+
+    if (m_availableConnectionIds.empty()) {
+        return CONNECTION_ID_INVALID;
+    }
+
+    connectionId = m_availableConnectionIds.back();
+    m_availableConnectionIds.pop_back();
+
+    m_connectionIds.Set(nodeId, connectionId);
+
+    IBNET_LOG_DEBUG("[%s] Assigned connection id %d to node 0x%X", m_name,
+            connectionId, nodeId);
+
+    return connectionId;
+}
+
+void ConnectionManager::__ReleaseConnectionId(NodeId nodeId,
+        ConnectionId connectionId)
+{
+    ConnectionState& state = m_connectionStates[connectionId];
+
+    // reset before the id can be assigned to another node
+    state.m_exchgFlags.store(0, std::memory_order_relaxed);
+    state.m_remoteExchgFlags.store(0, std::memory_order_relaxed);
+    state.m_triggerReExchange.store(false, std::memory_order_relaxed);
+    state.m_state.store(ConnectionState::e_StateNotAvailable,
+            std::memory_order_relaxed);
+    state.m_available.store(ConnectionState::CONNECTION_NOT_AVAILABLE,
+            std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> l(m_availableConnectionIdsLock);
+
+    m_connectionIds.Set(nodeId, CONNECTION_ID_INVALID);
+    m_availableConnectionIds.push_back(connectionId);
+}
+
+bool ConnectionManager::__AllocateConnection(NodeId remoteNodeId,
+        ConnectionId connectionId)
+{
+    // allocate connection if necessary
+    if (m_connections[connectionId] == nullptr) {
+        Connection* connection = _CreateConnection(connectionId, remoteNodeId);
+        connection->m_refState = &m_connectionStates[connectionId];
 
         // connection setup done, make visible
-        m_connections[remoteNodeId] = connection;
+        m_connections[connectionId] = connection;
 
-        m_connectionStates[remoteNodeId].m_state.store(
+        m_connectionStates[connectionId].m_state.store(
                 ConnectionState::e_StateCreated, std::memory_order_relaxed);
 
-        IBNET_LOG_DEBUG("[%s] Allocated new connection to remote 0x%X", m_name,
-                remoteNodeId);
+        IBNET_LOG_DEBUG("[%s] Allocated new connection to remote 0x%X, "
+                "connection id %d", m_name, remoteNodeId, connectionId);
 
         return true;
     }
@@ -581,8 +757,36 @@ bool ConnectionManager::__AllocateConnection(NodeId remoteNodeId)
     return false;
 }
 
+void ConnectionManager::__QueueConnectionExchgData(NodeId remoteNodeId,
+        uint32_t remoteNodeIPV4)
+{
+    // sent once the current batch of the setup worker is processed, with
+    // the latest state. only called by the node's setup worker
+    m_setupWorkers[remoteNodeId % m_setupWorkers.size()]->QueueExchgData(
+            remoteNodeId, remoteNodeIPV4);
+}
+
+void ConnectionManager::__FlushConnectionExchgData(const NodeId* nodeIds,
+        const uint32_t* remoteNodeIPV4s, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        ConnectionId connectionId = m_connectionIds.Get(nodeIds[i]);
+
+        // closed after the exchange data was queued
+        if (connectionId == CONNECTION_ID_INVALID || !m_connections[connectionId]) {
+            continue;
+        }
+
+        __SendConnectionExchgData(nodeIds[i], connectionId,
+                m_connectionStates[connectionId].m_exchgFlags.load(std::memory_order_relaxed),
+                m_connectionStates[connectionId].m_remoteExchgFlags.load(std::memory_order_relaxed),
+                remoteNodeIPV4s[i]);
+    }
+}
+
 void ConnectionManager::__SendConnectionExchgData(NodeId remoteNodeId,
-        uint8_t exchgFalgs, uint8_t exchgFlagsRemote, uint32_t remoteNodeIPV4)
+        ConnectionId connectionId, uint8_t exchgFalgs, uint8_t exchgFlagsRemote,
+        uint32_t remoteNodeIPV4)
 {
     // send QP data to remote if connection established (remote might still
     // have to do that) or if we are still lacking the data
@@ -599,15 +803,121 @@ void ConnectionManager::__SendConnectionExchgData(NodeId remoteNodeId,
     header->m_lid = _GetRefDevice()->GetLid();
     header->m_conManIdent = m_connectionCtxIdent;
 
-    m_connections[remoteNodeId]->
+    m_connections[connectionId]->
             CreateConnectionExchangeData(data, maxSizeData, &actualSizeData);
 
-    IBNET_LOG_DEBUG("[%s] Send connection exchg data, to remote node %s: %s",
-            m_name, sys::AddressIPV4(remoteNodeIPV4), *header);
+    IBNET_LOG_DEBUG("[%s] Send connection exchg data, to remote node 0x%X %s: %s",
+            m_name, remoteNodeId, sys::AddressIPV4(remoteNodeIPV4), *header);
 
     m_refExchangeManager->SendData(m_conDataExchgPaketType, remoteNodeIPV4,
             sendBuffer, sizeof(RemoteConnectionHeader) + actualSizeData);
 }
 
+ConnectionManager::SetupWorker::SetupWorker(
+        ConnectionManager* refConnectionManager, uint8_t id) :
+        ThreadLoop(refConnectionManager->m_name + "-Setup-" + std::to_string(id)),
+        m_refConnectionManager(refConnectionManager),
+        m_queue(1024),
+        m_jobsPending(0),
+        m_threadId(),
+        m_jobsDeferred(),
+        m_exchgDataPendingNodeIds(),
+        m_exchgDataPendingIPV4(),
+        m_numExchgDataPending(0)
+{
+}
+
+void ConnectionManager::SetupWorker::QueueExchgData(NodeId nodeId,
+        uint32_t remoteNodeIPV4)
+{
+    // multiple jobs of a node in a batch, sent once with the latest state
+    for (uint32_t i = 0; i < m_numExchgDataPending; i++) {
+        if (m_exchgDataPendingNodeIds[i] == nodeId) {
+            m_exchgDataPendingIPV4[i] = remoteNodeIPV4;
+            return;
+        }
+    }
+
+    // at most one node per job of a batch
+    if (m_numExchgDataPending < MAX_BATCH_SIZE) {
+        m_exchgDataPendingNodeIds[m_numExchgDataPending] = nodeId;
+        m_exchgDataPendingIPV4[m_numExchgDataPending] = remoteNodeIPV4;
+        m_numExchgDataPending++;
+    }
+}
+
+void ConnectionManager::SetupWorker::AddJob(JobQueue::Job* job)
+{
+    m_jobsPending.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_queue.PushBack(job)) {
+        return;
+    }
+
+    if (std::this_thread::get_id() == m_threadId) {
+        m_jobsDeferred.push_back(job);
+        return;
+    }
+
+    IBNET_LOG_WARN("[%s] Connection setup queue of %s full, waiting...",
+            m_refConnectionManager->m_name, GetName());
+
+    if (!m_queue.WaitPushBack(job)) {
+        // shutting down
+        m_jobsPending.fetch_sub(1, std::memory_order_release);
+        delete job;
+    }
+}
+
+void ConnectionManager::SetupWorker::_BeforeRunLoop()
+{
+    m_threadId = std::this_thread::get_id();
+}
+
+JobQueue::Job* ConnectionManager::SetupWorker::__NextJob()
+{
+    // jobs the worker added itself (queue full) first, otherwise jobs added
+    // for the same node afterwards overtake them
+    if (!m_jobsDeferred.empty()) {
+        JobQueue::Job* job = m_jobsDeferred.front();
+        m_jobsDeferred.erase(m_jobsDeferred.begin());
+        return job;
+    }
+
+    return m_queue.PopFront();
+}
+
+void ConnectionManager::SetupWorker::_RunLoop()
+{
+    JobQueue::Job* job = __NextJob();
+
+    if (!job) {
+        job = m_queue.WaitPopFront(1000);
+
+        if (!job) {
+            return;
+        }
+    }
+
+    uint32_t count = 0;
+
+    // process a batch of jobs and send the exchange data of the batch's
+    // nodes once, afterwards
+    do {
+        count++;
+
+        m_refConnectionManager->_DispatchJob(job);
+
+        delete job;
+
+        m_jobsPending.fetch_sub(1, std::memory_order_release);
+    } while (count < MAX_BATCH_SIZE && (job = __NextJob()));
+
+    m_refConnectionManager->__FlushConnectionExchgData(m_exchgDataPendingNodeIds,
+            m_exchgDataPendingIPV4, m_numExchgDataPending);
+
+    m_numExchgDataPending = 0;
+}
+
 }
 }
\ No newline at end of file
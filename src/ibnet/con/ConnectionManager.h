@@ -19,9 +19,15 @@
 #ifndef IBNET_CON_CONNECTIONMANAGER_H
 #define IBNET_CON_CONNECTIONMANAGER_H
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include "ibnet/core/IbDevice.h"
 #include "ibnet/core/IbProtDom.h"
 
+#include "ibnet/sys/ThreadLoop.h"
+
 #include "Connection.h"
 #include "ConnectionListener.h"
 #include "DiscoveryManager.h"
@@ -29,11 +35,12 @@
 #include "NodeConf.h"
 #include "NodeId.h"
 #include "JobManager.h"
+#include "NodeConnectionIdMap.h"
 
 namespace ibnet {
 namespace con {
 
-class ConnectionManager : public ExchangeDispatcher, JobDispatcher
+class ConnectionManager : public ExchangeDispatcher, public JobDispatcher
 {
 public:
     /**
@@ -44,6 +51,9 @@ public:
      * @param nodeConf Node config to use
      * @param connectionCreationTimeoutMs Timeout for connection creation in ms
      * @param maxNumConnections Max number of connections to manage
+     * @param numSetupWorkers Number of threads creating, connecting and
+     *        closing connections. Jobs of different nodes are processed
+     *        concurrently, jobs of a single node in order
      * @param refDevice Pointer to the IbDevice (managed by caller)
      * @param refProtDom Pointer to the IbProtDom (managed by caller)
      * @param refExchangeManager Pointer to exchange manager to use for
@@ -55,9 +65,10 @@ public:
      */
     ConnectionManager(const std::string& name, NodeId ownNodeId,
             const NodeConf& nodeConf, uint32_t connectionCreationTimeoutMs,
-            uint32_t maxNumConnections, core::IbDevice* refDevice,
-            core::IbProtDom* refProtDom, ExchangeManager* refExchangeManager,
-            JobManager* refJobManager, DiscoveryManager* refDiscoveryManager);
+            uint32_t maxNumConnections, uint8_t numSetupWorkers,
+            core::IbDevice* refDevice, core::IbProtDom* refProtDom,
+            ExchangeManager* refExchangeManager, JobManager* refJobManager,
+            DiscoveryManager* refDiscoveryManager);
 
     /**
      * Destructor
@@ -91,8 +102,25 @@ public:
      */
     bool IsConnectionAvailable(NodeId nodeId)
     {
-        return m_connectionStates[nodeId].m_available.load(
-                std::memory_order_relaxed) >= ConnectionState::CONNECTION_AVAILABLE;
+        ConnectionId connectionId = m_connectionIds.Get(nodeId);
+
+        return connectionId != CONNECTION_ID_INVALID &&
+                m_connectionStates[connectionId].m_available.load(
+                        std::memory_order_relaxed) >= ConnectionState::CONNECTION_AVAILABLE;
+    }
+
+    /**
+     * Get the connection id assigned to a node. Connection ids are dense
+     * (< max number of connections) and re-assigned once a connection is
+     * closed. Lock free
+     *
+     * @param nodeId Node id
+     * @return Connection id or CONNECTION_ID_INVALID if no connection is
+     *         assigned to the node
+     */
+    ConnectionId GetConnectionId(NodeId nodeId) const
+    {
+        return m_connectionIds.Get(nodeId);
     }
 
     /**
@@ -103,6 +131,10 @@ public:
      * closed or the max number of connections is exceeded and the connection
      * must be closed to make space for a new connection.
      *
+     * The handle is tracked per thread (see sys::HazardRegistry). It MUST
+     * be returned (ReturnConnection) by the same thread that got it and
+     * must not be handed over to other threads.
+     *
      * @param nodeId Get the connection of the specified node
      * @return If successful, a reference to the established connection.
      *         The caller does not have to manage the memory.
@@ -114,6 +146,10 @@ public:
      * Return a connection that was retrieved on the GetConnection call.
      * This MUST be called for every GetConnection call to ensure
      * consistency when keeping track of currently used connections.
+     * Must be called by the thread that called GetConnection. Returning
+     * a connection from a different thread throws an exception (the
+     * handle stays held by the acquiring thread and blocks closing the
+     * connection until that thread returns it)
      *
      * @param connection Connection to return
      */
@@ -145,6 +181,25 @@ protected:
         return m_refProtDom;
     }
 
+    DiscoveryManager* _GetRefDiscoveryManager() const
+    {
+        return m_refDiscoveryManager;
+    }
+
+    JobManager* _GetRefJobManager() const
+    {
+        return m_refJobManager;
+    }
+
+    /**
+     * Force close all opened connections and wait until closed. Call this
+     * in the destructor of an implementation before destroying resources
+     * the connections depend on (e.g. shared queues). Otherwise, the
+     * connections are closed by the destructor of this class once the
+     * implementation is already destroyed
+     */
+    void _CloseAllConnections();
+
 protected:
     void _DispatchExchangeData(uint32_t sourceIPV4,
             const ExchangeManager::PaketHeader* paketHeader,
@@ -153,8 +208,20 @@ protected:
     void _DispatchJob(const JobQueue::Job* job) override;
 
 protected:
-    virtual Connection* _CreateConnection(ConnectionId connectionId) = 0;
+    /**
+     * Create a new (implementation specific) connection object
+     *
+     * @param connectionId Connection id to assign to the new connection
+     * @param remoteNodeId Node id of the remote the connection is created for
+     * @return New connection object (memory managed by the connection manager)
+     */
+    virtual Connection* _CreateConnection(ConnectionId connectionId,
+            NodeId remoteNodeId) = 0;
 
+    /**
+     * Called once a connection is fully connected. Called concurrently for
+     * different nodes if multiple setup workers are used
+     */
     virtual void _ConnectionOpened(Connection& connection)
     {
     };
@@ -163,6 +230,75 @@ protected:
     {
     };
 
+private:
+    /**
+     * Worker of the connection setup pipeline. Each node is assigned to a
+     * single worker which processes the node's jobs in order. Exchange data
+     * to send is collected for a batch of jobs and sent once per node
+     */
+    class SetupWorker : public sys::ThreadLoop
+    {
+    public:
+        static const uint32_t MAX_BATCH_SIZE = 32;
+
+        SetupWorker(ConnectionManager* refConnectionManager, uint8_t id);
+
+        ~SetupWorker() override = default;
+
+        /**
+         * Queue sending the connection exchange data to a node after the
+         * current batch. Must be called by the worker itself
+         */
+        void QueueExchgData(NodeId nodeId, uint32_t remoteNodeIPV4);
+
+        /**
+         * Add a job for a node assigned to this worker. Blocks if the
+         * worker's queue is full
+         */
+        void AddJob(JobQueue::Job* job);
+
+        /**
+         * Check if all jobs added were processed
+         */
+        bool IsIdle() const
+        {
+            return m_jobsPending.load(std::memory_order_acquire) == 0;
+        }
+
+        /**
+         * Signal the worker to exit and wake it up, without joining
+         */
+        void Shutdown()
+        {
+            ExitLoop();
+            m_queue.Close();
+        }
+
+    protected:
+        void _BeforeRunLoop() override;
+
+        void _RunLoop() override;
+
+    private:
+        JobQueue::Job* __NextJob();
+
+    private:
+        ConnectionManager* m_refConnectionManager;
+
+        JobQueue m_queue;
+        std::atomic<uint32_t> m_jobsPending;
+        std::thread::id m_threadId;
+        // jobs added by the worker itself (can't block on its own queue),
+        // processed before any job of the queue
+        std::vector<JobQueue::Job*> m_jobsDeferred;
+
+        // nodes to send the exchange data to after the current batch, in
+        // order of their first job in the batch
+        NodeId m_exchgDataPendingNodeIds[MAX_BATCH_SIZE];
+        uint32_t m_exchgDataPendingIPV4[MAX_BATCH_SIZE];
+        uint32_t m_numExchgDataPending;
+    };
+
 private:
     struct JobCreateConnection : public JobQueue::Job
     {
@@ -232,14 +368,26 @@ private:
 private:
     ConnectionListener* m_listener;
 
-    ConnectionState m_connectionStates[NODE_ID_MAX_NUM_NODES];
-    Connection* m_connections[NODE_ID_MAX_NUM_NODES];
-    uint16_t m_openConnections;
+    // indexed by connection id
+    ConnectionState* m_connectionStates;
+    Connection** m_connections;
+    std::atomic<uint16_t> m_openConnections;
 
+    // connection ids are assigned to nodes on the first request of a
+    // connection (local or remote) and released once the connection is
+    // closed
+    std::mutex m_availableConnectionIdsLock;
     std::vector<ConnectionId> m_availableConnectionIds;
+    NodeConnectionIdMap m_connectionIds;
+
+    std::vector<SetupWorker*> m_setupWorkers;
 
     std::atomic<bool> m_flagShutdown;
 
+    // handles of the calling thread counted on the shared state (no free
+    // hazard slot), to detect connections returned by the wrong thread
+    static thread_local uint32_t ms_countedHandles;
+
 private:
     ExchangeManager::PaketType m_conDataExchgPaketType;
 
@@ -247,6 +395,10 @@ private:
     JobQueue::JobType m_connectConnectionJobType;
     JobQueue::JobType m_closeConnectionJobType;
 
+    NodeId __GetJobNodeId(const JobQueue::Job* job) const;
+
+    void __AddJob(JobQueue::Job* job);
+
     void __AddJobCreateConnection(NodeId destNodeId);
 
     void __AddJobConnectConnection(
@@ -261,9 +413,22 @@ private:
 
     void __JobDispatchCloseConnection(const JobCloseConnection& job);
 
-    bool __AllocateConnection(NodeId remoteNodeId);
+    Connection* __AcquireConnection(NodeId nodeId, ConnectionId connectionId);
+
+    bool __TriggerConnectionCreation(NodeId nodeId, ConnectionId connectionId);
+
+    ConnectionId __AssignConnectionId(NodeId nodeId);
+
+    void __ReleaseConnectionId(NodeId nodeId, ConnectionId connectionId);
+
+    bool __AllocateConnection(NodeId remoteNodeId, ConnectionId connectionId);
+
+    void __QueueConnectionExchgData(NodeId remoteNodeId, uint32_t remoteNodeIPV4);
+
+    void __FlushConnectionExchgData(const NodeId* nodeIds,
+            const uint32_t* remoteNodeIPV4s, uint32_t count);
 
-    void __SendConnectionExchgData(NodeId remoteNodeId,
+    void __SendConnectionExchgData(NodeId remoteNodeId, ConnectionId connectionId,
             uint8_t exchgFalgs, uint8_t exchgFlagsRemote, uint32_t remoteNodeIPV4);
 };
 
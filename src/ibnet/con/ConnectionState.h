@@ -32,9 +32,15 @@ namespace con {
  * stages of state a connection has to go through when creating/establishing
  * a new connection or closing an existing one.
  *
+ * Aligned to a cache line: states of different connections are stored in
+ * a single array and must not share a line. Handles to a connection are
+ * tracked in hazard slots of the threads using it (see
+ * sys::HazardRegistry), m_available is only written on state changes and
+ * if a thread runs out of slots.
+ *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 07.02.2018
  */
-struct ConnectionState
+struct alignas(64) ConnectionState
 {
     static const int32_t CONNECTION_NOT_AVAILABLE = INT32_MIN;
     static const int32_t CONNECTION_AVAILABLE = 0;
@@ -69,6 +75,8 @@ struct ConnectionState
     // in order to determine when to terminate the connection data exchange
     // and being certain that all data is exchanged
     std::atomic<uint8_t> m_remoteExchgFlags;
+    // >= CONNECTION_AVAILABLE if available plus number of handles not held
+    // in hazard slots
     std::atomic<int32_t> m_available;
 
     /**
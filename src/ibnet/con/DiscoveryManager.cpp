@@ -18,7 +18,12 @@
 
 #include "DiscoveryManager.h"
 
+#include <cstddef>
+#include <cstring>
+
 #include "ibnet/sys/Network.h"
+#include "ibnet/sys/Random.h"
+#include "ibnet/sys/SystemInfo.h"
 
 #include "NodeNotAvailableException.h"
 
@@ -34,8 +39,18 @@ DiscoveryManager::DiscoveryManager(NodeId ownNodeId, const NodeConf& nodeConf,
         m_lock(),
         m_infoToGet(),
         m_nodeInfo(),
+        m_discoveredNodes(),
+        m_hostIdHashes(),
+        m_requireDirect(),
+        m_random(sys::Random::Generate32()),
+        m_lastRound(),
+        m_ownResponse(),
+        m_ownHostIdHash(0),
+        m_colocated(),
         m_discoverReqExchgPaketType(m_refExchangeManager->GeneratePaketTypeId()),
         m_discoverRespExchgPaketType(m_refExchangeManager->GeneratePaketTypeId()),
+        m_gossipReqExchgPaketType(m_refExchangeManager->GeneratePaketTypeId()),
+        m_gossipRespExchgPaketType(m_refExchangeManager->GeneratePaketTypeId()),
         m_discoverJobType(m_refJobManager->GenerateJobTypeId()),
         m_discoverOnIdleJobType(m_refJobManager->GenerateJobTypeId()),
         m_discoveredJobType(m_refJobManager->GenerateJobTypeId())
@@ -44,6 +59,18 @@ DiscoveryManager::DiscoveryManager(NodeId ownNodeId, const NodeConf& nodeConf,
             ownNodeId);
 
     std::string ownHostname = sys::Network::GetHostname();
+    std::string hostId = sys::SystemInfo::GetHostId();
+
+    strncpy(m_ownResponse.m_hostId, hostId.c_str(), sizeof(m_ownResponse.m_hostId) - 1);
+    m_ownHostIdHash = __HashHostId(&m_ownResponse, sizeof(m_ownResponse));
+
+    for (auto& nodeInfo : m_nodeInfo) {
+        nodeInfo.store(nullptr, std::memory_order_relaxed);
+    }
+
+    for (auto& colocated : m_colocated) {
+        colocated.store(false, std::memory_order_relaxed);
+    }
 
     for (auto& it : nodeConf.GetEntries()) {
 
@@ -55,6 +82,8 @@ DiscoveryManager::DiscoveryManager(NodeId ownNodeId, const NodeConf& nodeConf,
 
     m_refExchangeManager->AddDispatcher(m_discoverReqExchgPaketType, this);
     m_refExchangeManager->AddDispatcher(m_discoverRespExchgPaketType, this);
+    m_refExchangeManager->AddDispatcher(m_gossipReqExchgPaketType, this);
+    m_refExchangeManager->AddDispatcher(m_gossipRespExchgPaketType, this);
 
     m_refJobManager->AddDispatcher(m_discoverJobType, this);
     m_refJobManager->AddDispatcher(m_discoverOnIdleJobType, this);
@@ -70,6 +99,8 @@ DiscoveryManager::~DiscoveryManager()
 
     m_refExchangeManager->RemoveDispatcher(m_discoverReqExchgPaketType, this);
     m_refExchangeManager->RemoveDispatcher(m_discoverRespExchgPaketType, this);
+    m_refExchangeManager->RemoveDispatcher(m_gossipReqExchgPaketType, this);
+    m_refExchangeManager->RemoveDispatcher(m_gossipRespExchgPaketType, this);
 
     m_refJobManager->RemoveDispatcher(m_discoverJobType, this);
     m_refJobManager->RemoveDispatcher(m_discoverOnIdleJobType, this);
@@ -80,10 +111,7 @@ DiscoveryManager::~DiscoveryManager()
     }
 
     for (auto& it : m_nodeInfo) {
-
-        if (it != nullptr) {
-            delete it;
-        }
+        delete it.load(std::memory_order_relaxed);
     }
 }
 
@@ -109,20 +137,42 @@ const NodeConf::Entry& DiscoveryManager::GetNodeInfo(NodeId nodeId)
 {
     IBNET_LOG_TRACE_FUNC;
 
-    std::lock_guard<std::mutex> l(m_lock);
+    // entries are not deleted before the manager is destroyed, no need to
+    // protect them from being freed while in use
+    NodeConf::Entry* entry = m_nodeInfo[nodeId].load(std::memory_order_acquire);
 
-    if (!m_nodeInfo[nodeId]) {
+    if (!entry) {
         throw NodeNotAvailableException(nodeId);
     }
 
-    return *m_nodeInfo[nodeId];
+    return *entry;
 }
 
 void DiscoveryManager::Invalidate(NodeId nodeId, bool shutdown)
 {
     m_lock.lock();
-    m_infoToGet.push_back(m_nodeInfo[nodeId]);
-    m_nodeInfo[nodeId] = nullptr;
+
+    NodeConf::Entry* entry = m_nodeInfo[nodeId].exchange(nullptr, std::memory_order_acq_rel);
+
+    if (entry) {
+        m_infoToGet.push_back(entry);
+
+        // other nodes might not have noticed, yet, and keep gossiping
+        // about the node
+        m_requireDirect.insert(entry->GetAddress().GetAddress());
+
+        for (auto it = m_discoveredNodes.begin(); it != m_discoveredNodes.end(); it++) {
+            if (*it == nodeId) {
+                *it = m_discoveredNodes.back();
+                m_discoveredNodes.pop_back();
+                break;
+            }
+        }
+
+        m_hostIdHashes.erase(nodeId);
+    }
+
+    m_colocated[nodeId].store(false, std::memory_order_release);
     m_lock.unlock();
 
     // add job to re-discover if system is not shutting down
@@ -141,17 +191,47 @@ void DiscoveryManager::_DispatchExchangeData(uint32_t sourceIPV4,
 {
     if (paketHeader->m_type == m_discoverReqExchgPaketType) {
         __ExchgSendDiscoveryResp(sourceIPV4);
+
+        bool undiscovered;
+
+        {
+            std::lock_guard<std::mutex> l(m_lock);
+            undiscovered = __IsUndiscovered(sourceIPV4);
+        }
+
+        // requests of older versions don't carry a host id
+        if (paketHeader->m_length >= sizeof(DiscoveryResponse) && undiscovered) {
+            auto* request = static_cast<const DiscoveryResponse*>(data);
+
+            __JobAddDiscovered(sourceIPV4, paketHeader->m_sourceNodeId,
+                    __IsColocated(request, paketHeader->m_length),
+                    __HashHostId(request, paketHeader->m_length));
+        }
     } else if (paketHeader->m_type == m_discoverRespExchgPaketType) {
-        __JobAddDiscovered(sourceIPV4, paketHeader->m_sourceNodeId);
+        // responses of older versions don't carry a host id
+        auto* response = static_cast<const DiscoveryResponse*>(data);
+
+        __JobAddDiscovered(sourceIPV4, paketHeader->m_sourceNodeId,
+                __IsColocated(response, paketHeader->m_length),
+                __HashHostId(response, paketHeader->m_length));
+    } else if (paketHeader->m_type == m_gossipReqExchgPaketType) {
+        // push-pull: reply with own digest
+        __ExchgSendGossip(m_gossipRespExchgPaketType, sourceIPV4);
+
+        __MergeDigest(sourceIPV4, paketHeader->m_sourceNodeId,
+                static_cast<const GossipDigest*>(data), paketHeader->m_length);
+    } else if (paketHeader->m_type == m_gossipRespExchgPaketType) {
+        __MergeDigest(sourceIPV4, paketHeader->m_sourceNodeId,
+                static_cast<const GossipDigest*>(data), paketHeader->m_length);
     }
 }
 
 void DiscoveryManager::_DispatchJob(const JobQueue::Job* job)
 {
     if (job->m_type == m_discoverJobType) {
-        __ExecuteDiscovery();
+        __ExecuteDiscovery(true);
     } else if (job->m_type == m_discoverOnIdleJobType) {
-        __ExecuteDiscovery();
+        __ExecuteDiscovery(false);
     } else if (job->m_type == m_discoveredJobType) {
         auto* jobDiscovered = dynamic_cast<const JobDiscovered*>(job);
 
@@ -163,12 +243,33 @@ void DiscoveryManager::_DispatchJob(const JobQueue::Job* job)
         for (auto it = m_infoToGet.begin(); it != m_infoToGet.end(); it++) {
             if ((*it)->GetAddress().GetAddress() ==
                     jobDiscovered->m_targetIPV4) {
-                IBNET_LOG_INFO("Discovered node %s as node id 0x%X",
+                // own entry not filtered by hostname, e.g. multiple instances
+                // on a single host using different loopback addresses
+                if (jobDiscovered->m_nodeIdDiscovered == m_ownNodeId) {
+                    IBNET_LOG_DEBUG("Discovered self at %s, removing entry",
+                            (*it)->GetAddress().GetAddressStr());
+
+                    delete *it;
+                    m_infoToGet.erase(it);
+                    break;
+                }
+
+                IBNET_LOG_INFO("Discovered node %s as node id 0x%X%s",
                         (*it)->GetAddress().GetAddressStr(),
-                        jobDiscovered->m_nodeIdDiscovered);
+                        jobDiscovered->m_nodeIdDiscovered,
+                        jobDiscovered->m_colocated ? " (co-located)" : "");
 
                 // store remote node information
-                m_nodeInfo[jobDiscovered->m_nodeIdDiscovered] = *it;
+                if (!m_nodeInfo[jobDiscovered->m_nodeIdDiscovered].load(std::memory_order_relaxed)) {
+                    m_discoveredNodes.push_back(jobDiscovered->m_nodeIdDiscovered);
+                }
+
+                m_hostIdHashes[jobDiscovered->m_nodeIdDiscovered] = jobDiscovered->m_hostIdHash;
+                m_requireDirect.erase(jobDiscovered->m_targetIPV4);
+
+                m_colocated[jobDiscovered->m_nodeIdDiscovered].store(
+                        jobDiscovered->m_colocated, std::memory_order_release);
+                m_nodeInfo[jobDiscovered->m_nodeIdDiscovered].store(*it, std::memory_order_release);
 
                 m_infoToGet.erase(it);
 
@@ -194,12 +295,138 @@ void DiscoveryManager::_DispatchJob(const JobQueue::Job* job)
 
 void DiscoveryManager::__ExchgSendDiscoveryReq(uint32_t destIPV4)
 {
-    m_refExchangeManager->SendData(m_discoverReqExchgPaketType, destIPV4);
+    // carry the host id to enable the remote to discover us as well
+    m_refExchangeManager->SendData(m_discoverReqExchgPaketType, destIPV4,
+            &m_ownResponse, sizeof(m_ownResponse));
 }
 
 void DiscoveryManager::__ExchgSendDiscoveryResp(uint32_t destIPV4)
 {
-    m_refExchangeManager->SendData(m_discoverRespExchgPaketType, destIPV4);
+    m_refExchangeManager->SendData(m_discoverRespExchgPaketType, destIPV4,
+            &m_ownResponse, sizeof(m_ownResponse));
+}
+
+void DiscoveryManager::__ExchgSendGossip(ExchangeManager::PaketType type, uint32_t destIPV4)
+{
+    GossipDigest digest;
+
+    memcpy(&digest.m_sender, &m_ownResponse, sizeof(m_ownResponse));
+    digest.m_numEntries = 0;
+
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+
+        size_t numNodes = m_discoveredNodes.size();
+
+        // random subset if the digest can't hold all discovered nodes
+        for (size_t i = 0; i < numNodes && digest.m_numEntries < GOSSIP_MAX_DIGEST_ENTRIES; i++) {
+            std::swap(m_discoveredNodes[i], m_discoveredNodes[i + m_random() % (numNodes - i)]);
+
+            NodeId nodeId = m_discoveredNodes[i];
+            DigestEntry& entry = digest.m_entries[digest.m_numEntries++];
+
+            entry.m_nodeId = nodeId;
+            entry.m_ipv4 = m_nodeInfo[nodeId].load(std::memory_order_relaxed)->GetAddress().GetAddress();
+            entry.m_hostIdHash = m_hostIdHashes[nodeId];
+        }
+    }
+
+    m_refExchangeManager->SendData(type, destIPV4, &digest,
+            offsetof(GossipDigest, m_entries) + digest.m_numEntries * sizeof(DigestEntry));
+}
+
+void DiscoveryManager::__MergeDigest(uint32_t sourceIPV4, NodeId sourceNodeId,
+        const GossipDigest* digest, uint32_t length)
+{
+    if (length < offsetof(GossipDigest, m_entries)) {
+        IBNET_LOG_WARN("Received invalid gossip digest from %s, length %d",
+                sys::AddressIPV4(sourceIPV4), length);
+        return;
+    }
+
+    uint32_t numEntries = std::min<uint32_t>(digest->m_numEntries,
+            (length - offsetof(GossipDigest, m_entries)) / sizeof(DigestEntry));
+
+    bool senderUndiscovered;
+    std::vector<DigestEntry> discovered;
+    std::vector<uint32_t> requestDirect;
+
+    {
+        std::lock_guard<std::mutex> l(m_lock);
+
+        senderUndiscovered = __IsUndiscovered(sourceIPV4);
+
+        for (uint32_t i = 0; i < numEntries; i++) {
+            const DigestEntry& entry = digest->m_entries[i];
+
+            if (entry.m_nodeId == m_ownNodeId || !__IsUndiscovered(entry.m_ipv4)) {
+                continue;
+            }
+
+            // a co-located node must confirm its host id directly, invalidated
+            // nodes must confirm that they are alive
+            if (entry.m_hostIdHash == 0 || entry.m_hostIdHash == m_ownHostIdHash) {
+                requestDirect.push_back(entry.m_ipv4);
+            } else if (m_requireDirect.find(entry.m_ipv4) == m_requireDirect.end()) {
+                discovered.push_back(entry);
+            }
+        }
+    }
+
+    // sender contacted us directly
+    if (senderUndiscovered) {
+        __JobAddDiscovered(sourceIPV4, sourceNodeId, __IsColocated(&digest->m_sender, length),
+                __HashHostId(&digest->m_sender, length));
+    }
+
+    // nodes with the same host id hash are requested directly, others are
+    // not co-located
+    for (auto& it : discovered) {
+        __JobAddDiscovered(it.m_ipv4, it.m_nodeId, false, it.m_hostIdHash);
+    }
+
+    for (auto& it : requestDirect) {
+        __ExchgSendDiscoveryReq(it);
+    }
+}
+
+bool DiscoveryManager::__IsColocated(const DiscoveryResponse* sender, uint32_t length) const
+{
+    // pakets of older versions don't carry a host id
+    if (length < sizeof(DiscoveryResponse)) {
+        return false;
+    }
+
+    return !strncmp(sender->m_hostId, m_ownResponse.m_hostId, sizeof(m_ownResponse.m_hostId));
+}
+
+bool DiscoveryManager::__IsUndiscovered(uint32_t ipv4) const
+{
+    for (auto& it : m_infoToGet) {
+        if (it->GetAddress().GetAddress() == ipv4) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t DiscoveryManager::__HashHostId(const DiscoveryResponse* sender, uint32_t length)
+{
+    if (length < sizeof(DiscoveryResponse)) {
+        return 0;
+    }
+
+    // FNV-1a, stable across builds
+    uint64_t hash = 0xCBF29CE484222325;
+
+    for (size_t i = 0; i < sizeof(sender->m_hostId) && sender->m_hostId[i] != '\0'; i++) {
+        hash ^= static_cast<uint8_t>(sender->m_hostId[i]);
+        hash *= 0x100000001B3;
+    }
+
+    // 0 is reserved for unknown
+    return hash != 0 ? hash : 1;
 }
 
 void DiscoveryManager::__JobAddDiscover()
@@ -208,27 +435,64 @@ void DiscoveryManager::__JobAddDiscover()
 }
 
 void DiscoveryManager::__JobAddDiscovered(uint32_t sourceIPV4,
-        NodeId sourceNodeIdDiscovered)
+        NodeId sourceNodeIdDiscovered, bool colocated, uint64_t hostIdHash)
 {
     m_refJobManager->AddJob(new JobDiscovered(m_discoveredJobType, sourceIPV4,
-            sourceNodeIdDiscovered));
+            sourceNodeIdDiscovered, colocated, hostIdHash));
 }
 
-void DiscoveryManager::__ExecuteDiscovery()
+void DiscoveryManager::__ExecuteDiscovery(bool force)
 {
-    IBNET_LOG_TRACE("Requesting node info of %d nodes", m_infoToGet.size());
+    std::vector<uint32_t> gossipTargets;
+    std::vector<uint32_t> directTargets;
 
-    m_lock.lock();
+    {
+        std::lock_guard<std::mutex> l(m_lock);
 
-    // request remote node's information if not received, yet
-    for (auto& it : m_infoToGet) {
-        IBNET_LOG_DEBUG("Requesting node info from %s",
-                it->GetAddress().GetAddressStr());
+        auto now = std::chrono::steady_clock::now();
+
+        // idle jobs are executed whenever a job worker runs out of jobs
+        if (!force && now - m_lastRound < std::chrono::milliseconds(GOSSIP_ROUND_INTERVAL_MS)) {
+            return;
+        }
 
-        __ExchgSendDiscoveryReq(it->GetAddress().GetAddress());
+        m_lastRound = now;
+
+        size_t numNodes = m_discoveredNodes.size();
+
+        for (size_t i = 0; i < numNodes && i < GOSSIP_FANOUT; i++) {
+            std::swap(m_discoveredNodes[i], m_discoveredNodes[i + m_random() % (numNodes - i)]);
+            gossipTargets.push_back(m_nodeInfo[m_discoveredNodes[i]].load(
+                    std::memory_order_relaxed)->GetAddress().GetAddress());
+        }
+
+        size_t numInfoToGet = m_infoToGet.size();
+
+        // request a few random nodes directly, the remaining ones are
+        // discovered from digests. order of the list does not matter
+        for (size_t i = 0; i < numInfoToGet; i++) {
+            if (i < GOSSIP_FANOUT) {
+                std::swap(m_infoToGet[i], m_infoToGet[i + m_random() % (numInfoToGet - i)]);
+                directTargets.push_back(m_infoToGet[i]->GetAddress().GetAddress());
+            } else if (m_requireDirect.find(m_infoToGet[i]->GetAddress().GetAddress()) !=
+                    m_requireDirect.end()) {
+                directTargets.push_back(m_infoToGet[i]->GetAddress().GetAddress());
+            }
+        }
     }
 
-    m_lock.unlock();
+    IBNET_LOG_TRACE("Gossip round, %d gossip targets, %d direct requests",
+            gossipTargets.size(), directTargets.size());
+
+    for (auto& it : gossipTargets) {
+        __ExchgSendGossip(m_gossipReqExchgPaketType, it);
+    }
+
+    for (auto& it : directTargets) {
+        IBNET_LOG_DEBUG("Requesting node info from %s", sys::AddressIPV4(it));
+
+        __ExchgSendDiscoveryReq(it);
+    }
 }
 
 }
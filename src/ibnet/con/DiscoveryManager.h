@@ -19,7 +19,12 @@
 #ifndef IBNET_CON_DISCOVERYMANAGER_H
 #define IBNET_CON_DISCOVERYMANAGER_H
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "DiscoveryListener.h"
 #include "ExchangeDispatcher.h"
@@ -32,12 +37,33 @@ namespace ibnet {
 namespace con {
 
 /**
- * Statistic operation calculating a ratio of two units
+ * Discovers the node ids of the nodes of the node configuration.
+ *
+ * Discovery uses a push-pull gossip protocol: every round, the manager
+ * sends a digest of (a random subset of) the nodes it has discovered to
+ * a few random discovered nodes, which merge it and reply with their own
+ * digest. Nodes learned from digests are discovered without contacting
+ * them directly. Only a few undiscovered nodes are requested directly per
+ * round. Thus, discovery converges in O(log N) rounds without sending
+ * requests to every node. Co-located nodes and invalidated nodes have to
+ * answer a direct request to be discovered (host id and liveness).
+ *
+ * Reading discovered node information is lock free.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 29.01.2018
  */
 class DiscoveryManager : public ExchangeDispatcher, JobDispatcher
 {
+public:
+    // number of nodes to send a digest to and number of undiscovered nodes to
+    // request directly per round
+    static const uint32_t GOSSIP_FANOUT = 3;
+    // max number of discovered nodes sent with a digest (fits a single
+    // exchange datagram without IP fragmentation)
+    static const uint16_t GOSSIP_MAX_DIGEST_ENTRIES = 64;
+    // min time between two rounds triggered by idle job workers
+    static const uint32_t GOSSIP_ROUND_INTERVAL_MS = 200;
+
 public:
     /**
      * Constructor
@@ -68,10 +94,24 @@ public:
      *
      * @param nodeId Node id of the node
      * @return A NodeConf Entry if the node was already discovered or
-     *         NodeNotAvailableException if not available or not discovered, yet
+     *         NodeNotAvailableException if not available or not discovered, yet.
+     *         Entries stay valid until the manager is destroyed. Lock free
      */
     const NodeConf::Entry& GetNodeInfo(NodeId nodeId);
 
+    /**
+     * Check if a discovered node runs on the same host as the current
+     * instance (same kernel instance, see SystemInfo::GetHostId), e.g. to
+     * use a transport based on shared memory
+     *
+     * @param nodeId Node id of the node
+     * @return True if the node was discovered and is co-located, false otherwise
+     */
+    bool IsColocated(NodeId nodeId) const
+    {
+        return m_colocated[nodeId].load(std::memory_order_acquire);
+    }
+
     /**
      * Set a listener
      *
@@ -100,16 +140,48 @@ protected:
     void _DispatchJob(const JobQueue::Job* job) override;
 
 private:
+    /**
+     * Payload of a discovery response (and request)
+     */
+    struct DiscoveryResponse
+    {
+        char m_hostId[64];
+    } __attribute__((__packed__));
+
+    /**
+     * Discovered node sent with a gossip digest
+     */
+    struct DigestEntry
+    {
+        NodeId m_nodeId;
+        uint32_t m_ipv4;
+        uint64_t m_hostIdHash;
+    } __attribute__((__packed__));
+
+    /**
+     * Payload of a gossip request and response
+     */
+    struct GossipDigest
+    {
+        DiscoveryResponse m_sender;
+        uint16_t m_numEntries;
+        DigestEntry m_entries[GOSSIP_MAX_DIGEST_ENTRIES];
+    } __attribute__((__packed__));
+
     struct JobDiscovered : public JobQueue::Job
     {
         const uint32_t m_targetIPV4;
         const NodeId m_nodeIdDiscovered;
+        const bool m_colocated;
+        const uint64_t m_hostIdHash;
 
         JobDiscovered(JobQueue::JobType type, uint32_t targetIPV4,
-                NodeId nodeIdDiscovered) :
+                NodeId nodeIdDiscovered, bool colocated, uint64_t hostIdHash) :
                 JobQueue::Job(type),
                 m_targetIPV4(targetIPV4),
-                m_nodeIdDiscovered(nodeIdDiscovered)
+                m_nodeIdDiscovered(nodeIdDiscovered),
+                m_colocated(colocated),
+                m_hostIdHash(hostIdHash)
         {
         }
     };
@@ -122,13 +194,29 @@ private:
 
     DiscoveryListener* m_listener;
 
+    // protects writing node information, readers of m_nodeInfo and
+    // m_colocated don't lock. entries are moved between m_infoToGet and
+    // m_nodeInfo but not deleted before destruction
     std::mutex m_lock;
     std::vector<NodeConf::Entry*> m_infoToGet;
-    NodeConf::Entry* m_nodeInfo[NODE_ID_MAX_NUM_NODES];
+    std::atomic<NodeConf::Entry*> m_nodeInfo[NODE_ID_MAX_NUM_NODES];
+    std::vector<NodeId> m_discoveredNodes;
+    // host id hashes of discovered nodes for digests (0 if unknown)
+    std::unordered_map<NodeId, uint64_t> m_hostIdHashes;
+    // addresses of invalidated nodes, not trusting digests for these
+    std::unordered_set<uint32_t> m_requireDirect;
+    std::mt19937 m_random;
+    std::chrono::steady_clock::time_point m_lastRound;
+
+    DiscoveryResponse m_ownResponse;
+    uint64_t m_ownHostIdHash;
+    std::atomic<bool> m_colocated[NODE_ID_MAX_NUM_NODES];
 
 private:
     ExchangeManager::PaketType m_discoverReqExchgPaketType;
     ExchangeManager::PaketType m_discoverRespExchgPaketType;
+    ExchangeManager::PaketType m_gossipReqExchgPaketType;
+    ExchangeManager::PaketType m_gossipRespExchgPaketType;
 
     JobQueue::JobType m_discoverJobType;
     JobQueue::JobType m_discoverOnIdleJobType;
@@ -138,11 +226,24 @@ private:
 
     void __ExchgSendDiscoveryResp(uint32_t destIPV4);
 
+    void __ExchgSendGossip(ExchangeManager::PaketType type, uint32_t destIPV4);
+
+    void __MergeDigest(uint32_t sourceIPV4, NodeId sourceNodeId,
+            const GossipDigest* digest, uint32_t length);
+
+    bool __IsColocated(const DiscoveryResponse* sender, uint32_t length) const;
+
+    // caller must hold m_lock
+    bool __IsUndiscovered(uint32_t ipv4) const;
+
+    static uint64_t __HashHostId(const DiscoveryResponse* sender, uint32_t length);
+
     void __JobAddDiscover();
 
-    void __JobAddDiscovered(uint32_t sourceIPV4, NodeId sourceNodeIdDiscovered);
+    void __JobAddDiscovered(uint32_t sourceIPV4, NodeId sourceNodeIdDiscovered,
+            bool colocated, uint64_t hostIdHash);
 
-    void __ExecuteDiscovery();
+    void __ExecuteDiscovery(bool force);
 };
 
 }
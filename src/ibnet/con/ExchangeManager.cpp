@@ -18,7 +18,14 @@
 
 #include "ExchangeManager.h"
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstring>
+
 #include "ibnet/sys/IllegalStateException.h"
+#include "ibnet/sys/SystemException.h"
 
 #include "ExchangeDispatcher.h"
 
@@ -27,25 +34,50 @@
 namespace ibnet {
 namespace con {
 
-ExchangeManager::ExchangeManager(con::NodeId ownNodeId, uint16_t socketPort) :
+ExchangeManager::ExchangeManager(con::NodeId ownNodeId, uint16_t socketPort,
+        uint32_t bindIpv4) :
         ThreadLoop("ExchangeManager"),
         m_ownNodeId(ownNodeId),
-        m_socket(new sys::SocketUDP(socketPort)),
-        m_recvBuffer(new uint8_t[MAX_PAKET_SIZE]),
-        m_noDataAvailable(false),
+        m_socket(new sys::SocketUDP(socketPort, bindIpv4)),
+        m_recvBuffers(),
+        m_recvLengths(),
+        m_recvAddrs(),
+        m_wakeFd(eventfd(0, EFD_NONBLOCK)),
+        m_sendQueueLock(),
+        m_sendQueue(),
+        m_sendQueueTargets(),
+        m_sendQueueFlush(),
         m_paketTypeIdCounter(0),
         m_dispatcherLock(),
         m_dispatcher()
 {
+    if (m_wakeFd < 0) {
+        delete m_socket;
+        throw sys::SystemException("Creating eventfd for exchange manager failed: %s", strerror(errno));
+    }
+
+    for (auto& it : m_recvBuffers) {
+        it = new uint8_t[MAX_PAKET_SIZE];
+    }
+
     Start();
 }
 
 ExchangeManager::~ExchangeManager()
 {
+    // the thread might be blocked waiting for data
+    ExitLoop();
+    __Wake();
+
     Stop();
 
     delete m_socket;
-    delete[] m_recvBuffer;
+
+    for (auto& it : m_recvBuffers) {
+        delete[] it;
+    }
+
+    close(m_wakeFd);
 }
 
 ExchangeManager::PaketType ExchangeManager::GeneratePaketTypeId()
@@ -77,39 +109,126 @@ void ExchangeManager::SendData(PaketType type, uint32_t targetIPV4,
                 "Send data size exceeds max paket size: %d", sendSize);
     }
 
-    uint8_t sendBuffer[MAX_PAKET_SIZE];
-    auto* header = (PaketHeader*) &sendBuffer[0];
+    PaketHeader header;
 
-    header->m_magic = PAKET_MAGIC;
-    header->m_type = type;
-    header->m_sourceNodeId = m_ownNodeId;
+    header.m_magic = PAKET_MAGIC;
+    header.m_type = type;
+    header.m_sourceNodeId = m_ownNodeId;
+    header.m_length = data ? length : 0;
 
-    if (data) {
-        header->m_length = length;
-        memcpy(sendBuffer + sizeof(PaketHeader), data, length);
-    } else {
-        header->m_length = 0;
-    }
+    bool wake;
+
+    {
+        std::lock_guard<std::mutex> l(m_sendQueueLock);
+
+        // the exchange thread is woken up once per flush of the queue only
+        wake = m_sendQueue.empty();
+
+        auto it = m_sendQueueTargets.find(targetIPV4);
+
+        if (it == m_sendQueueTargets.end() ||
+                m_sendQueue[it->second].m_data.size() + sizeof(PaketHeader) +
+                        header.m_length > MAX_COALESCED_DATAGRAM_SIZE) {
+            m_sendQueue.push_back({targetIPV4, {}});
+            m_sendQueueTargets[targetIPV4] = m_sendQueue.size() - 1;
+        }
+
+        std::vector<uint8_t>& datagram = m_sendQueue[m_sendQueueTargets[targetIPV4]].m_data;
+
+        auto* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+        datagram.insert(datagram.end(), headerBytes, headerBytes + sizeof(PaketHeader));
 
-    ssize_t ret = m_socket->Send(&sendBuffer, sendSize, targetIPV4,
-            m_socket->GetPort());
+        if (header.m_length > 0) {
+            auto* dataBytes = static_cast<const uint8_t*>(data);
+            datagram.insert(datagram.end(), dataBytes, dataBytes + header.m_length);
+        }
+    }
 
-    if (ret != static_cast<ssize_t>(sendSize)) {
-        IBNET_LOG_ERROR("Sending exchg data type %d, length %d to %s failed",
-                type, length, sys::AddressIPV4(targetIPV4));
+    if (wake) {
+        __Wake();
     }
 }
 
 void ExchangeManager::_RunLoop()
 {
-    uint32_t recvAddr = 0;
+    __FlushSendQueue();
+
+    int res = m_socket->ReceiveBatch(reinterpret_cast<void**>(m_recvBuffers),
+            MAX_PAKET_SIZE, m_recvLengths, m_recvAddrs, RECV_BATCH_SIZE);
+
+    if (res <= 0) {
+        __WaitForData();
+        return;
+    }
+
+    for (int i = 0; i < res; i++) {
+        __DispatchDatagram(m_recvAddrs[i], m_recvBuffers[i], m_recvLengths[i]);
+    }
+}
+
+void ExchangeManager::_AfterRunLoop()
+{
+    // don't drop pakets queued right before shutdown (e.g. closing
+    // connections)
+    __FlushSendQueue();
+}
+
+void ExchangeManager::__FlushSendQueue()
+{
+    {
+        std::lock_guard<std::mutex> l(m_sendQueueLock);
+
+        if (m_sendQueue.empty()) {
+            return;
+        }
+
+        // swap to keep the buffers allocated and send outside of the lock
+        m_sendQueue.swap(m_sendQueueFlush);
+        m_sendQueueTargets.clear();
+    }
+
+    void* buffers[sys::SocketUDP::MAX_BATCH_SIZE];
+    size_t sizes[sys::SocketUDP::MAX_BATCH_SIZE];
+    uint32_t addrs[sys::SocketUDP::MAX_BATCH_SIZE];
 
-    ssize_t res = m_socket->Receive(m_recvBuffer, MAX_PAKET_SIZE, &recvAddr);
+    size_t pos = 0;
 
-    if (res < static_cast<ssize_t>(sizeof(PaketHeader))) {
-        m_noDataAvailable = true;
-    } else {
-        auto header = (PaketHeader*) (m_recvBuffer);
+    while (pos < m_sendQueueFlush.size()) {
+        uint32_t count = 0;
+
+        while (count < sys::SocketUDP::MAX_BATCH_SIZE && pos + count < m_sendQueueFlush.size()) {
+            Datagram& datagram = m_sendQueueFlush[pos + count];
+
+            buffers[count] = datagram.m_data.data();
+            sizes[count] = datagram.m_data.size();
+            addrs[count] = datagram.m_targetIPV4;
+            count++;
+        }
+
+        int ret = m_socket->SendBatch(buffers, sizes, addrs, m_socket->GetPort(), count);
+
+        if (ret <= 0) {
+            IBNET_LOG_ERROR("Sending exchg data to %s failed, dropping %d datagrams",
+                    sys::AddressIPV4(addrs[0]), count);
+
+            // unreliable anyway, skip the datagram that failed
+            ret = 1;
+        }
+
+        pos += ret;
+    }
+
+    m_sendQueueFlush.clear();
+}
+
+void ExchangeManager::__DispatchDatagram(uint32_t recvAddr,
+        const uint8_t* buffer, size_t length)
+{
+    size_t pos = 0;
+
+    // a datagram might contain multiple coalesced pakets
+    while (pos + sizeof(PaketHeader) <= length) {
+        auto header = (const PaketHeader*) (buffer + pos);
 
         IBNET_LOG_TRACE(
                 "Received paket from %s, magic 0x%X, type %d, nodeId 0x%X, "
@@ -118,39 +237,71 @@ void ExchangeManager::_RunLoop()
 
         std::lock_guard<std::mutex> l(m_dispatcherLock);
 
-        if (header->m_magic == PAKET_MAGIC &&
-                header->m_type < m_paketTypeIdCounter &&
-                sizeof(PaketHeader) + header->m_length <= MAX_PAKET_SIZE) {
+        if (header->m_magic != PAKET_MAGIC ||
+                header->m_type >= m_paketTypeIdCounter ||
+                pos + sizeof(PaketHeader) + header->m_length > length) {
+            IBNET_LOG_WARN("Received invalid paket from %s, magic 0x%X, "
+                    "type %d, nodeId 0x%X, length %d", sys::AddressIPV4(recvAddr),
+                    header->m_magic, header->m_type, header->m_sourceNodeId,
+                    header->m_length);
 
-            if (!m_dispatcher[header->m_type].empty()) {
+            // can't find the start of the next paket
+            return;
+        }
 
-                void* data = nullptr;
+        if (!m_dispatcher[header->m_type].empty()) {
+            void* data = nullptr;
 
-                if (header->m_length > 0) {
-                    data = (void*) (((uintptr_t) m_recvBuffer) +
-                            sizeof(PaketHeader));
-                }
+            if (header->m_length > 0) {
+                data = (void*) (buffer + pos + sizeof(PaketHeader));
+            }
 
-                for (auto& it : m_dispatcher[header->m_type]) {
-                    it->_DispatchExchangeData(recvAddr, header, data);
-                }
-            } else {
-                IBNET_LOG_WARN("No dispatcher available for paket type %d",
-                        header->m_type);
+            for (auto& it : m_dispatcher[header->m_type]) {
+                it->_DispatchExchangeData(recvAddr, header, data);
             }
         } else {
-            IBNET_LOG_WARN("Received invalid paket from %s, magic 0x%X, "
-                    "type %d, nodeId 0x%X, length %d", sys::AddressIPV4(recvAddr),
-                    header->m_magic, header->m_type, header->m_sourceNodeId,
-                    header->m_length);
+            IBNET_LOG_WARN("No dispatcher available for paket type %d",
+                    header->m_type);
         }
+
+        pos += sizeof(PaketHeader) + header->m_length;
+    }
+}
+
+void ExchangeManager::__WaitForData()
+{
+    pollfd fds[2];
+
+    fds[0].fd = m_socket->GetFd();
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = m_wakeFd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+        IBNET_LOG_ERROR("Waiting for exchange data failed: %s", strerror(errno));
+        return;
     }
 
-    if (m_noDataAvailable) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (fds[1].revents & POLLIN) {
+        uint64_t val;
+
+        // reset the eventfd's counter before flushing the send queue
+        if (read(m_wakeFd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+            IBNET_LOG_ERROR("Reading eventfd of exchange manager failed: %s", strerror(errno));
+        }
     }
 }
 
+void ExchangeManager::__Wake()
+{
+    uint64_t val = 1;
 
+    if (write(m_wakeFd, &val, sizeof(val)) < 0) {
+        IBNET_LOG_ERROR("Waking up exchange manager failed: %s", strerror(errno));
+    }
+}
+
+}
 }
-}
\ No newline at end of file
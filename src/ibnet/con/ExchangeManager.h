@@ -19,6 +19,10 @@
 #ifndef IBNET_CON_EXCHANGEMANAGER_H
 #define IBNET_CON_EXCHANGEMANAGER_H
 
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "ibnet/sys/SocketUDP.h"
 #include "ibnet/sys/ThreadLoop.h"
 
@@ -35,6 +39,12 @@ class ExchangeDispatcher;
  * This class is providing a side channel (UDP socket) to exchange data
  * (e.g. connection data) with a remote node.
  *
+ * Pakets to send are queued and sent by the exchange thread in batches
+ * (sendmmsg). Pakets to the same destination queued in the meantime are
+ * coalesced into a single datagram. Incoming datagrams are received in
+ * batches as well (recvmmsg) and the thread blocks on the socket if no data
+ * is available.
+ *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 29.01.2018
  */
 class ExchangeManager : public sys::ThreadLoop
@@ -45,6 +55,13 @@ public:
 
     static const size_t MAX_PAKET_SIZE = 1024 * 64;
 
+    // pakets are only coalesced up to this size to avoid IP fragmentation
+    // (ethernet MTU - IP and UDP headers). a lost fragment loses all pakets
+    // of a datagram
+    static const size_t MAX_COALESCED_DATAGRAM_SIZE = 1472;
+
+    static const uint32_t RECV_BATCH_SIZE = 16;
+
 public:
     /**
      * Paket header for sending/receiving exchange data
@@ -64,8 +81,9 @@ public:
      *
      * @param ownNodeId Node id of the currenet instance
      * @param socketPort Port to open the socket on for exchange data
+     * @param bindIpv4 Local address to bind the socket to (0 for any)
      */
-    ExchangeManager(con::NodeId ownNodeId, uint16_t socketPort);
+    ExchangeManager(con::NodeId ownNodeId, uint16_t socketPort, uint32_t bindIpv4 = 0);
 
     /**
      * Destructor
@@ -112,7 +130,8 @@ public:
     /**
      * Send exchange data to a target node. Note that the data is sent
      * over an unreliable connection. Thus, there is no guarantee it will
-     * arrive.
+     * arrive. The data is copied and sent asynchronously by the exchange
+     * thread. Thread safe
      *
      * @param type Type of the paket to send
      * @param targetIPV4 IPV4 address of the target node
@@ -126,17 +145,44 @@ public:
 protected:
     void _RunLoop() override;
 
+    void _AfterRunLoop() override;
+
+private:
+    struct Datagram
+    {
+        uint32_t m_targetIPV4;
+        std::vector<uint8_t> m_data;
+    };
+
 private:
     const con::NodeId m_ownNodeId;
 
     sys::SocketUDP* m_socket;
-    uint8_t* m_recvBuffer;
+    uint8_t* m_recvBuffers[RECV_BATCH_SIZE];
+    size_t m_recvLengths[RECV_BATCH_SIZE];
+    uint32_t m_recvAddrs[RECV_BATCH_SIZE];
+
+    int m_wakeFd;
 
-    bool m_noDataAvailable;
+    std::mutex m_sendQueueLock;
+    std::vector<Datagram> m_sendQueue;
+    // target ipv4 -> index of the datagram in the send queue that pakets
+    // to that target are appended to
+    std::unordered_map<uint32_t, size_t> m_sendQueueTargets;
+    std::vector<Datagram> m_sendQueueFlush;
 
     uint8_t m_paketTypeIdCounter;
     std::mutex m_dispatcherLock;
     std::vector<std::vector<ExchangeDispatcher*>> m_dispatcher;
+
+private:
+    void __FlushSendQueue();
+
+    void __DispatchDatagram(uint32_t recvAddr, const uint8_t* buffer, size_t length);
+
+    void __WaitForData();
+
+    void __Wake();
 };
 
 }
@@ -23,32 +23,50 @@
 namespace ibnet {
 namespace con {
 
-JobManager::JobManager() :
-        ThreadLoop("JobManager"),
-        m_queue(1024),
+JobManager::JobManager(uint8_t numWorkers, uint32_t queueSize) :
+        m_queue(queueSize),
         m_idleJob(nullptr),
         m_jobIdTypeCounter(0),
         m_dispatcherLock(),
-        m_dispatcher()
+        m_dispatcher(),
+        m_idleJobLock(),
+        m_workers()
 {
-    Start();
+    if (numWorkers == 0) {
+        throw sys::IllegalStateException("Number of job workers must be > 0");
+    }
+
+    for (uint8_t i = 0; i < numWorkers; i++) {
+        m_workers.push_back(new Worker(this, i));
+        m_workers.back()->Start();
+    }
 }
 
 JobManager::~JobManager()
 {
-    Stop();
+    for (auto& it : m_workers) {
+        it->Shutdown();
+    }
+
+    // wake up all idle workers
+    m_queue.Close();
+
+    for (auto& it : m_workers) {
+        it->Stop();
+        delete it;
+    }
 
     delete m_idleJob;
 }
 
 JobQueue::JobType JobManager::GenerateJobTypeId()
 {
+    std::lock_guard<std::shared_mutex> l(m_dispatcherLock);
+
     if (m_jobIdTypeCounter == JobQueue::JOB_TYPE_INVALID) {
         throw sys::IllegalStateException("Out of job type ids");
     }
 
-    std::lock_guard<std::mutex> l(m_dispatcherLock);
-
     JobQueue::JobType type = m_jobIdTypeCounter++;
 
     m_dispatcher.resize(m_jobIdTypeCounter);
@@ -60,14 +78,15 @@ void JobManager::AddJob(JobQueue::Job* job)
 {
     IBNET_LOG_TRACE("Add job %d", job->m_type);
 
-    while (!m_queue.PushBack(job)) {
+    if (!m_queue.PushBack(job)) {
         IBNET_LOG_WARN("Job queue full, waiting...");
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
 
-    // thread may be sleeping, wake up
-    std::unique_lock<std::mutex> lock(m_jobLock);
-    m_jobCondition.notify_all();
+        // woken up once a worker removed a job
+        if (!m_queue.WaitPushBack(job)) {
+            IBNET_LOG_DEBUG("Job manager shutting down, dropping job %d", job->m_type);
+            delete job;
+        }
+    }
 }
 
 bool JobManager::IsQueueEmpty()
@@ -75,7 +94,7 @@ bool JobManager::IsQueueEmpty()
     return m_queue.IsEmpty();
 }
 
-void JobManager::_RunLoop()
+void JobManager::__RunWorker()
 {
     JobQueue::Job* job;
 
@@ -85,42 +104,41 @@ void JobManager::_RunLoop()
     // creation and avoiding that discovery jobs are prioritized and cause
     // connection creation timeouts
     if (!job) {
-        m_idleJobLock.lock();
-
-        if (m_idleJob) {
-            IBNET_LOG_TRACE("Dispatching idle job type %d", m_idleJob->m_type);
-
-            std::lock_guard<std::mutex> l(m_dispatcherLock);
+        // a single worker executes the idle job, others go to sleep
+        if (m_idleJobLock.try_lock()) {
+            if (m_idleJob) {
+                IBNET_LOG_TRACE("Dispatching idle job type %d", m_idleJob->m_type);
 
-            for (auto& it : m_dispatcher[m_idleJob->m_type]) {
-                it->_DispatchJob(m_idleJob);
+                // re-use idle job, don't delete
+                __Dispatch(m_idleJob);
             }
 
-            // re-use idle job, don't delete
+            m_idleJobLock.unlock();
         }
 
-        m_idleJobLock.unlock();
+        // reduce CPU load and get woken up if a new job is available
+        job = m_queue.WaitPopFront(1000);
 
-        std::unique_lock<std::mutex> l(m_jobLock);
-
-        if (m_queue.IsEmpty()) {
-            // reduce CPU load and get woken up if a new job is available
-            m_jobCondition.wait_for(l, std::chrono::milliseconds(1000));
+        if (!job) {
+            return;
         }
-    } else {
-        IBNET_LOG_TRACE("Dispatching job type %d", job->m_type);
+    }
 
-        m_dispatcherLock.lock();
+    IBNET_LOG_TRACE("Dispatching job type %d", job->m_type);
 
-        for (auto& it : m_dispatcher[job->m_type]) {
-            it->_DispatchJob(job);
-        }
+    __Dispatch(job);
 
-        m_dispatcherLock.unlock();
+    delete job;
+}
 
-        delete job;
+void JobManager::__Dispatch(const JobQueue::Job* job)
+{
+    std::shared_lock<std::shared_mutex> l(m_dispatcherLock);
+
+    for (auto& it : m_dispatcher[job->m_type]) {
+        it->_DispatchJob(job);
     }
 }
 
 }
-}
\ No newline at end of file
+}
@@ -19,7 +19,10 @@
 #ifndef IBNET_CON_JOBTHREAD_H
 #define IBNET_CON_JOBTHREAD_H
 
-#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
 #include "ibnet/sys/ThreadLoop.h"
 
 #include "JobDispatcher.h"
@@ -29,23 +32,29 @@ namespace ibnet {
 namespace con {
 
 /**
- * The JobManager is running a dedicated worker thread which dispatches
- * queued jobs to a set of pre-registered dispatchers (callbacks).
+ * The JobManager is running one or multiple dedicated worker threads which
+ * dispatch queued jobs to a set of pre-registered dispatchers (callbacks).
+ * With multiple workers, jobs are dispatched concurrently and the dispatchers
+ * must be thread safe.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 29.01.2018
  */
-class JobManager : public sys::ThreadLoop
+class JobManager
 {
 public:
     /**
      * Constructor
+     *
+     * @param numWorkers Number of worker threads dispatching jobs
+     * @param queueSize Max number of jobs queued. Adding jobs blocks if the
+     *        queue is full
      */
-    JobManager();
+    explicit JobManager(uint8_t numWorkers = 1, uint32_t queueSize = 1024);
 
     /**
      * Destructor
      */
-    ~JobManager() override;
+    ~JobManager();
 
     /**
      * Generate a new tyoe id for a job to add to the queue
@@ -62,7 +71,7 @@ public:
      */
     void AddDispatcher(JobQueue::JobType type, JobDispatcher* dispatcher)
     {
-        std::lock_guard<std::mutex> l(m_dispatcherLock);
+        std::lock_guard<std::shared_mutex> l(m_dispatcherLock);
         m_dispatcher[type].push_back(dispatcher);
     }
 
@@ -74,7 +83,7 @@ public:
      */
     void RemoveDispatcher(JobQueue::JobType type, JobDispatcher* dispatcher)
     {
-        std::lock_guard<std::mutex> l(m_dispatcherLock);
+        std::lock_guard<std::shared_mutex> l(m_dispatcherLock);
 
         for (auto it = m_dispatcher[type].begin();
                 it != m_dispatcher[type].end(); it++) {
@@ -88,16 +97,16 @@ public:
     /**
      * Add a job to the queue
      *
-     * @param job Job to add. The dedicated work thread is executing
+     * @param job Job to add. One of the worker threads is executing
      *        the job once it reaches the front of the queue. Memory
      *        allocated for the job is managed and free'd by the
-     *        JobManager.
+     *        JobManager. Blocks if the queue is full
      */
     void AddJob(JobQueue::Job* job);
 
     /**
      * Set an idle job which is executed periodically when the job
-     * queue is empty.
+     * queue is empty (by a single worker at a time).
      *
      * @param job Idle job to set. NULL is valid and removes a
      *        previously set idle job. Memory allocated for the
@@ -115,20 +124,51 @@ public:
      */
     bool IsQueueEmpty();
 
-protected:
-    void _RunLoop() override;
+private:
+    class Worker : public sys::ThreadLoop
+    {
+    public:
+        Worker(JobManager* refJobManager, uint8_t id) :
+                ThreadLoop("JobManager-" + std::to_string(id)),
+                m_refJobManager(refJobManager)
+        {
+        }
+
+        ~Worker() override = default;
+
+        /**
+         * Signal the worker to exit its loop without joining it
+         */
+        void Shutdown()
+        {
+            ExitLoop();
+        }
+
+    protected:
+        void _RunLoop() override
+        {
+            m_refJobManager->__RunWorker();
+        }
+
+    private:
+        JobManager* m_refJobManager;
+    };
 
 private:
     JobQueue m_queue;
     JobQueue::Job* m_idleJob;
 
     uint8_t m_jobIdTypeCounter;
-    std::mutex m_dispatcherLock;
+    std::shared_mutex m_dispatcherLock;
     std::vector<std::vector<JobDispatcher*>> m_dispatcher;
 
     std::mutex m_idleJobLock;
-    std::mutex m_jobLock;
-    std::condition_variable m_jobCondition;
+
+    std::vector<Worker*> m_workers;
+
+    void __RunWorker();
+
+    void __Dispatch(const JobQueue::Job* job);
 };
 
 }
@@ -18,85 +18,218 @@
 
 #include "JobQueue.h"
 
-#include <thread>
+#include <chrono>
+#include <climits>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace ibnet {
 namespace con {
 
 JobQueue::JobQueue(uint32_t size) :
         m_size(size),
+        m_slots(new Slot[size]),
+        m_closed(false),
+        m_pushCounter(0),
+        m_consumersWaiting(0),
+        m_popCounter(0),
+        m_producersWaiting(0),
         m_front(0),
-        m_back(0),
-        m_backRes(0),
-        m_queue(new Job* [size])
+        m_back(0)
 {
-
+    for (uint32_t i = 0; i < m_size; i++) {
+        m_slots[i].m_seq.store(i, std::memory_order_relaxed);
+        m_slots[i].m_job = nullptr;
+    }
 }
 
 JobQueue::~JobQueue()
 {
-    uint32_t front = m_front.load(std::memory_order_relaxed);
-    uint32_t back = m_back.load(std::memory_order_relaxed);
+    Job* job;
 
-    while (front % m_size != back % m_size) {
-        delete m_queue[front];
-        front++;
+    while ((job = PopFront())) {
+        delete job;
     }
 
-    delete[] m_queue;
+    delete[] m_slots;
 }
 
 bool JobQueue::PushBack(Job* job)
 {
-    uint32_t backRes = m_backRes.load(std::memory_order_relaxed);
-    uint32_t front;
+    uint64_t pos = m_back.load(std::memory_order_relaxed);
+    Slot* slot;
 
     while (true) {
-        front = m_front.load(std::memory_order_relaxed);
+        slot = &m_slots[pos % m_size];
+        uint64_t seq = slot->m_seq.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - pos);
 
-        if (backRes + 1 % m_size == front % m_size) {
+        if (diff == 0) {
+            if (m_back.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // slot not consumed, yet
             return false;
+        } else {
+            // other producer was faster
+            pos = m_back.load(std::memory_order_relaxed);
         }
+    }
 
-        if (m_backRes.compare_exchange_weak(backRes, backRes + 1,
-                std::memory_order_relaxed)) {
-            m_queue[backRes % m_size] = job;
+    slot->m_job = job;
+    slot->m_seq.store(pos + 1, std::memory_order_release);
 
-            // wait for any preceding reservations to complete before updating
-            // back
-            while (!m_back.compare_exchange_weak(backRes, backRes + 1,
-                    std::memory_order_release)) {
-                std::this_thread::yield();
-            }
+    m_pushCounter.fetch_add(1, std::memory_order_seq_cst);
+
+    if (m_consumersWaiting.load(std::memory_order_seq_cst) > 0) {
+        __FutexWake(&m_pushCounter, 1);
+    }
+
+    return true;
+}
+
+bool JobQueue::WaitPushBack(Job* job)
+{
+    while (!PushBack(job)) {
+        uint32_t counter = m_popCounter.load(std::memory_order_seq_cst);
+
+        m_producersWaiting.fetch_add(1, std::memory_order_seq_cst);
 
+        // re-check after announcing to avoid a lost wake up
+        if (PushBack(job)) {
+            m_producersWaiting.fetch_sub(1, std::memory_order_relaxed);
             return true;
         }
+
+        if (m_closed.load(std::memory_order_acquire)) {
+            m_producersWaiting.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        __FutexWait(&m_popCounter, counter, 0);
+
+        m_producersWaiting.fetch_sub(1, std::memory_order_relaxed);
     }
+
+    return true;
 }
 
 JobQueue::Job* JobQueue::PopFront()
 {
-    Job* job;
-    uint32_t front = m_front.load(std::memory_order_relaxed);
-    uint32_t back = m_back.load(std::memory_order_relaxed);
+    uint64_t pos = m_front.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    while (true) {
+        slot = &m_slots[pos % m_size];
+        uint64_t seq = slot->m_seq.load(std::memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - (pos + 1));
 
-    if (front % m_size == back % m_size) {
-        return nullptr;
+        if (diff == 0) {
+            if (m_front.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // slot not filled, yet
+            return nullptr;
+        } else {
+            // other consumer was faster
+            pos = m_front.load(std::memory_order_relaxed);
+        }
     }
 
-    job = m_queue[front % m_size];
+    Job* job = slot->m_job;
+
+    // free the slot for the next round
+    slot->m_seq.store(pos + m_size, std::memory_order_release);
+
+    m_popCounter.fetch_add(1, std::memory_order_seq_cst);
+
+    if (m_producersWaiting.load(std::memory_order_seq_cst) > 0) {
+        __FutexWake(&m_popCounter, 1);
+    }
 
-    m_front.fetch_add(1, std::memory_order_release);
     return job;
 }
 
+JobQueue::Job* JobQueue::WaitPopFront(uint32_t timeoutMs)
+{
+    Job* job = PopFront();
+
+    if (job) {
+        return job;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while (true) {
+        uint32_t counter = m_pushCounter.load(std::memory_order_seq_cst);
+
+        m_consumersWaiting.fetch_add(1, std::memory_order_seq_cst);
+
+        // re-check after announcing to avoid a lost wake up
+        job = PopFront();
+
+        if (job || m_closed.load(std::memory_order_acquire)) {
+            m_consumersWaiting.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (now >= deadline) {
+            m_consumersWaiting.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        // round up to not spin on less than a ms remaining
+        __FutexWait(&m_pushCounter, counter, static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1));
+
+        m_consumersWaiting.fetch_sub(1, std::memory_order_relaxed);
+
+        job = PopFront();
+
+        if (job) {
+            return job;
+        }
+    }
+}
+
+void JobQueue::Close()
+{
+    m_closed.store(true, std::memory_order_release);
+
+    m_pushCounter.fetch_add(1, std::memory_order_seq_cst);
+    m_popCounter.fetch_add(1, std::memory_order_seq_cst);
+
+    __FutexWake(&m_pushCounter, INT_MAX);
+    __FutexWake(&m_popCounter, INT_MAX);
+}
+
 bool JobQueue::IsEmpty() const
 {
-    uint32_t front = m_front.load(std::memory_order_relaxed);
-    uint32_t back = m_back.load(std::memory_order_relaxed);
+    return m_front.load(std::memory_order_relaxed) >= m_back.load(std::memory_order_relaxed);
+}
 
-    return front % m_size == back % m_size;
+void JobQueue::__FutexWait(std::atomic<uint32_t>* addr, uint32_t val, uint32_t timeoutMs)
+{
+    struct timespec timeout = {};
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000 * 1000;
+
+    // returns immediately if the counter changed. EINTR and EAGAIN are
+    // handled by the callers re-checking the queue
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, val,
+            timeoutMs > 0 ? &timeout : nullptr, nullptr, 0);
 }
 
+void JobQueue::__FutexWake(std::atomic<uint32_t>* addr, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+}
 }
-}
\ No newline at end of file
@@ -27,7 +27,10 @@ namespace ibnet {
 namespace con {
 
 /**
- * FIFO queue for the JobManager
+ * Bounded FIFO queue for the JobManager. Lock free, multiple producers and
+ * multiple consumers (each slot carries a sequence number marking it as
+ * free or filled for the current round). Producers and consumers can block
+ * (futex) if the queue is full/empty instead of polling
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 29.01.2018
  */
@@ -61,7 +64,7 @@ public:
     explicit JobQueue(uint32_t size);
 
     /**
-     * Destructor
+     * Destructor. Deletes all jobs still queued
      */
     ~JobQueue();
 
@@ -73,6 +76,14 @@ public:
      */
     bool PushBack(Job* job);
 
+    /**
+     * Add a job to the queue. Blocks until there is space available
+     *
+     * @param job Job to add
+     * @return True if adding successful, false if the queue was closed
+     */
+    bool WaitPushBack(Job* job);
+
     /**
      * Get a job from the front of the queue
      *
@@ -80,19 +91,54 @@ public:
      */
     Job* PopFront();
 
+    /**
+     * Get a job from the front of the queue. Blocks until a job is available,
+     * the timeout expired or the queue was closed
+     *
+     * @param timeoutMs Max time to wait (in ms)
+     * @return Pointer to a job or NULL on timeout or if the queue was closed
+     */
+    Job* WaitPopFront(uint32_t timeoutMs);
+
+    /**
+     * Close the queue, i.e. wake up and return all waiting producers and
+     * consumers (shutdown). Jobs can still be added and removed
+     * without blocking
+     */
+    void Close();
+
     /**
      * Check if the queue is empty
      */
     bool IsEmpty() const;
 
+private:
+    struct Slot
+    {
+        // pos of the round the slot can be filled at, pos + 1 once filled
+        std::atomic<uint64_t> m_seq;
+        Job* m_job;
+    };
+
 private:
     const uint32_t m_size;
+    Slot* m_slots;
+
+    std::atomic<bool> m_closed;
+
+    // futex words, incremented on every push/pop, and number of threads
+    // waiting on them (no syscall if nobody's waiting)
+    std::atomic<uint32_t> m_pushCounter __attribute__((aligned(64)));
+    std::atomic<uint32_t> m_consumersWaiting;
+    std::atomic<uint32_t> m_popCounter __attribute__((aligned(64)));
+    std::atomic<uint32_t> m_producersWaiting;
+
+    std::atomic<uint64_t> m_front __attribute__((aligned(64)));
+    std::atomic<uint64_t> m_back __attribute__((aligned(64)));
 
-    std::atomic<uint32_t> m_front;
-    std::atomic<uint32_t> m_back;
-    std::atomic<uint32_t> m_backRes;
+    static void __FutexWait(std::atomic<uint32_t>* addr, uint32_t val, uint32_t timeoutMs);
 
-    Job** m_queue;
+    static void __FutexWake(std::atomic<uint32_t>* addr, int count);
 };
 
 }
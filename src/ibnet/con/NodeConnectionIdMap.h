@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_CON_NODECONNECTIONIDMAP_H
+#define IBNET_CON_NODECONNECTIONIDMAP_H
+
+#include <atomic>
+
+#include "Connection.h"
+#include "NodeId.h"
+
+namespace ibnet {
+namespace con {
+
+/**
+ * Maps node ids to the (dense) connection ids assigned to them. Two level
+ * table, pages of entries are allocated once a node id of the page is
+ * assigned. Thus, the map stays small if only few node ids are used though
+ * they are spread over the whole node id range.
+ *
+ * Reading is lock free. Writes must be serialized by the caller.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class NodeConnectionIdMap
+{
+public:
+    static const uint32_t PAGE_SIZE = 256;
+    static const uint32_t NUM_PAGES = (NODE_ID_MAX_NUM_NODES + PAGE_SIZE) / PAGE_SIZE;
+
+    /**
+     * Constructor
+     */
+    NodeConnectionIdMap() :
+            m_pages()
+    {
+        for (auto& it : m_pages) {
+            it.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Destructor
+     */
+    ~NodeConnectionIdMap()
+    {
+        for (auto& it : m_pages) {
+            delete[] it.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Get the connection id assigned to a node
+     *
+     * @param nodeId Node id
+     * @return Connection id or CONNECTION_ID_INVALID if none is assigned
+     */
+    ConnectionId Get(NodeId nodeId) const
+    {
+        std::atomic<ConnectionId>* page = m_pages[nodeId / PAGE_SIZE].load(std::memory_order_acquire);
+
+        if (!page) {
+            return CONNECTION_ID_INVALID;
+        }
+
+        return page[nodeId % PAGE_SIZE].load(std::memory_order_acquire);
+    }
+
+    /**
+     * Assign a connection id to a node. Not thread safe
+     *
+     * @param nodeId Node id
+     * @param connectionId Connection id to assign or CONNECTION_ID_INVALID
+     *        to remove the assignment
+     */
+    void Set(NodeId nodeId, ConnectionId connectionId)
+    {
+        std::atomic<ConnectionId>* page = m_pages[nodeId / PAGE_SIZE].load(std::memory_order_relaxed);
+
+        if (!page) {
+            page = new std::atomic<ConnectionId>[PAGE_SIZE];
+
+            for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+                page[i].store(CONNECTION_ID_INVALID, std::memory_order_relaxed);
+            }
+
+            m_pages[nodeId / PAGE_SIZE].store(page, std::memory_order_release);
+        }
+
+        page[nodeId % PAGE_SIZE].store(connectionId, std::memory_order_release);
+    }
+
+private:
+    std::atomic<std::atomic<ConnectionId>*> m_pages[NUM_PAGES];
+};
+
+}
+}
+
+#endif //IBNET_CON_NODECONNECTIONIDMAP_H
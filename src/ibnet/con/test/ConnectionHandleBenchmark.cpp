@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <thread>
+#include <vector>
+
+#include <backwards/backward.hpp>
+
+#include "ibnet/sys/Logger.hpp"
+#include "ibnet/sys/Network.h"
+#include "ibnet/sys/Random.h"
+#include "ibnet/sys/Timer.hpp"
+
+#include "ibnet/core/IbDevice.h"
+#include "ibnet/core/IbProtDom.h"
+
+#include "ibnet/con/NodeConfArgListReader.h"
+
+#include "DummyConnectionManager.h"
+
+static bool g_loop = true;
+
+static std::atomic<bool> g_start(false);
+
+/**
+ * Get and return connections like a send dispatcher or application thread
+ * sending data to multiple nodes
+ *
+ * @param conMan Connection manager to hammer
+ * @param remoteNodeIds Nodes to get the connections of (round robin)
+ * @param handles Number of connections to hold at the same time per
+ *        operation (exceeding the hazard slots per thread falls back to
+ *        counting handles on the shared state)
+ * @param ops Number of get/return operations to execute
+ * @param failed Counter for failed GetConnection calls
+ */
+static void BenchmarkThread(ibnet::con::ConnectionManager* conMan,
+        const std::vector<ibnet::con::NodeId>* remoteNodeIds, uint32_t handles,
+        uint32_t ops, std::atomic<uint64_t>* failed)
+{
+    std::vector<ibnet::con::Connection*> connections(handles, nullptr);
+    uint64_t failedLocal = 0;
+    size_t next = 0;
+
+    while (!g_start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    for (uint32_t i = 0; i < ops; i++) {
+        for (uint32_t j = 0; j < handles; j++) {
+            try {
+                connections[j] = conMan->GetConnection((*remoteNodeIds)[next]);
+            } catch (const ibnet::sys::Exception& e) {
+                connections[j] = nullptr;
+                failedLocal++;
+            }
+
+            next = (next + 1) % remoteNodeIds->size();
+        }
+
+        for (uint32_t j = 0; j < handles; j++) {
+            if (connections[j]) {
+                conMan->ReturnConnection(connections[j]);
+            }
+        }
+    }
+
+    failed->fetch_add(failedLocal, std::memory_order_relaxed);
+}
+
+static void SignalHandler(int signal)
+{
+    if (signal == SIGINT) {
+        g_loop = false;
+    }
+}
+
+/**
+ * Main entry point
+ *
+ * @param argc Argc
+ * @param argv Argc
+ * @return Exit code
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        printf("Usage: %s [-A <bind address>] [-H <handles held per op>] "
+                "<ops per thread> <max threads> <hostnames nodes> ...\n", argv[0]);
+        printf("  -A: Bind the exchange socket to a local address which is also "
+                "listed in the nodes (multiple instances on a single host)\n");
+        printf("  -H: Number of connections held at the same time by a thread "
+                "per operation (default 1)\n");
+        printf("Run an instance on every node listed. Keeps running after the "
+                "benchmark until SIGINT to answer remotes still connecting\n");
+        return -1;
+    }
+
+    backward::SignalHandling sh;
+
+    ibnet::sys::Random::Init();
+    ibnet::sys::Logger::Setup();
+
+    signal(SIGINT, SignalHandler);
+
+    // cmd args processing
+
+    std::string bindAddress;
+    uint32_t handles = 1;
+    int argPos = 1;
+
+    while (argPos < argc && argv[argPos][0] == '-') {
+        std::string opt = argv[argPos++];
+
+        if (opt == "-A" && argPos < argc) {
+            bindAddress = argv[argPos++];
+        } else if (opt == "-H" && argPos < argc) {
+            handles = static_cast<uint32_t>(std::atol(argv[argPos++]));
+        } else {
+            printf("ERROR Invalid option %s\n", opt.c_str());
+            return -1;
+        }
+    }
+
+    if (argc - argPos < 3 || handles == 0) {
+        printf("ERROR Missing ops, max threads or nodes\n");
+        return -1;
+    }
+
+    auto ops = static_cast<uint32_t>(std::atol(argv[argPos]));
+    auto maxThreads = static_cast<uint32_t>(std::atol(argv[argPos + 1]));
+
+    std::vector<std::string> hostnamesSorted;
+    ibnet::con::NodeConfArgListReader nodeConfArgListReader(
+            (uint32_t) (argc - argPos - 2), &argv[argPos + 2]);
+    ibnet::con::NodeConf nodeConf = nodeConfArgListReader.Read();
+
+    for (int i = argPos + 2; i < argc; i++) {
+        hostnamesSorted.push_back(std::string(argv[i]));
+    }
+
+    std::sort(hostnamesSorted.begin(), hostnamesSorted.end());
+
+    ibnet::con::NodeId ownNodeId = ibnet::con::NODE_ID_INVALID;
+    const std::string ownHostname = ibnet::sys::Network::GetHostname();
+    std::vector<ibnet::con::NodeId> remoteNodeIds;
+
+    // auto assign a node id by using the sorted hostname list
+
+    for (uint16_t i = 0; i < hostnamesSorted.size(); i++) {
+        if (ownNodeId == ibnet::con::NODE_ID_INVALID &&
+                (ownHostname == hostnamesSorted[i] || bindAddress == hostnamesSorted[i])) {
+            ownNodeId = i;
+        } else {
+            remoteNodeIds.push_back(i);
+        }
+    }
+
+    if (ownNodeId == ibnet::con::NODE_ID_INVALID || remoteNodeIds.empty()) {
+        printf("ERROR Could not assign node id to current host %s or no remote "
+                "nodes listed\n", ownHostname.c_str());
+        return -1;
+    }
+
+    printf("Own node id: 0x%X\n", ownNodeId);
+
+    // ib and connection manager setup
+
+    auto* device = new ibnet::core::IbDevice();
+    auto* protDom = new ibnet::core::IbProtDom(*device, "ConHandleBenchmark");
+
+    auto* exchangeManager = new ibnet::con::ExchangeManager(
+            ownNodeId, 5730, bindAddress.empty() ? 0 :
+                    ibnet::sys::AddressIPV4(bindAddress).GetAddress());
+    auto* jobManager = new ibnet::con::JobManager();
+
+    auto* discoveryManager = new ibnet::con::DiscoveryManager(
+            ownNodeId, nodeConf, exchangeManager, jobManager);
+
+    auto* connectionManager = new ibnet::con::DummyConnectionManager(ownNodeId,
+            nodeConf, 5000, std::max<uint32_t>(100, static_cast<uint32_t>(hostnamesSorted.size())),
+            1, device, protDom, exchangeManager, jobManager, discoveryManager);
+
+    // connect to all nodes first, measure the handles of open connections only
+
+    printf("Connecting to %zu node(s)...\n", remoteNodeIds.size());
+
+    for (auto nodeId : remoteNodeIds) {
+        while (g_loop) {
+            try {
+                connectionManager->ReturnConnection(connectionManager->GetConnection(nodeId));
+                break;
+            } catch (const ibnet::sys::Exception& e) {
+                printf("!!! Exception: %s\n", e.what());
+            }
+        }
+    }
+
+    // powers of two up to (and including) the max thread count
+
+    std::vector<uint32_t> threadCounts;
+
+    for (uint32_t i = 1; i < maxThreads; i *= 2) {
+        threadCounts.push_back(i);
+    }
+
+    threadCounts.push_back(maxThreads);
+
+    printf("threads, handles, ops/s, avg ns per get/return, failed\n");
+
+    for (auto numThreads : threadCounts) {
+        if (!g_loop) {
+            break;
+        }
+
+        std::vector<std::thread> threads;
+        std::atomic<uint64_t> failed(0);
+        ibnet::sys::Timer totalTimer;
+
+        g_start.store(false, std::memory_order_relaxed);
+
+        for (uint32_t i = 0; i < numThreads; i++) {
+            threads.emplace_back(BenchmarkThread, connectionManager, &remoteNodeIds, handles, ops,
+                    &failed);
+        }
+
+        totalTimer.Start();
+        g_start.store(true, std::memory_order_release);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        totalTimer.Stop();
+
+        uint64_t totalOps = static_cast<uint64_t>(ops) * handles * numThreads;
+
+        printf("%d, %d, %f, %f, %lu\n", numThreads, handles, totalOps / totalTimer.GetTimeSec(),
+                static_cast<double>(totalTimer.GetTimeNs()) * numThreads / totalOps,
+                failed.load(std::memory_order_relaxed));
+    }
+
+    printf("Benchmark done, waiting for SIGINT...\n");
+
+    while (g_loop) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    printf("Cleanup...\n");
+
+    delete connectionManager;
+    delete discoveryManager;
+    delete jobManager;
+    delete exchangeManager;
+
+    delete protDom;
+    delete device;
+
+    ibnet::sys::Logger::Shutdown();
+
+    return 0;
+}
@@ -30,17 +30,28 @@
 #include "DummyConnection.h"
 #include "DummyConnectionManager.h"
 
+static bool g_loop = true;
+
+// bootstrap benchmark: each client thread connects to a disjoint set of
+// nodes and the time until all nodes are connected is printed. keeps running
+// to answer remotes still connecting
+static bool g_bootstrapBenchmark = false;
+static std::atomic<uint16_t> g_connectedNodes(0);
+static std::chrono::high_resolution_clock::time_point g_start;
+
 class ClientThread : public ibnet::sys::ThreadLoop
 {
 public:
-    ClientThread(uint32_t id, ibnet::con::NodeId ownNodeID,
+    ClientThread(uint32_t id, uint32_t numThreads, ibnet::con::NodeId ownNodeID,
             const std::vector<std::string>& hostnamesSorted,
             ibnet::con::ConnectionManager* refConMan) :
             ThreadLoop("ClientThread-" + std::to_string(id)),
             m_id(id),
+            m_numThreads(numThreads),
             m_ownNodeId(ownNodeID),
             m_hostnamesSorted(hostnamesSorted),
-            m_refConnectionManager(refConMan)
+            m_refConnectionManager(refConMan),
+            m_connected(hostnamesSorted.size(), false)
     {
     };
 
@@ -49,6 +60,11 @@ public:
 protected:
     void _RunLoop() override
     {
+        if (g_bootstrapBenchmark) {
+            __RunBootstrapBenchmark();
+            return;
+        }
+
         // -1: don't count own node
         uint16_t notConnected =
                 static_cast<uint16_t>(m_hostnamesSorted.size() - 1);
@@ -91,9 +107,45 @@ protected:
 
 private:
     const uint32_t m_id;
+    const uint32_t m_numThreads;
     const ibnet::con::NodeId m_ownNodeId;
     std::vector<std::string> m_hostnamesSorted;
     ibnet::con::ConnectionManager* m_refConnectionManager;
+    std::vector<bool> m_connected;
+
+    void __RunBootstrapBenchmark()
+    {
+        for (uint16_t i = 0; i < m_hostnamesSorted.size(); i++) {
+            ibnet::con::NodeId remoteNodeId = i;
+
+            if (remoteNodeId == m_ownNodeId || remoteNodeId % m_numThreads != m_id ||
+                    m_connected[i]) {
+                continue;
+            }
+
+            try {
+                ibnet::con::Connection* connection =
+                        m_refConnectionManager->GetConnection(remoteNodeId);
+                m_refConnectionManager->ReturnConnection(connection);
+            } catch (const ibnet::sys::Exception& e) {
+                printf("!!! Exception: %s\n", e.what());
+                continue;
+            }
+
+            m_connected[i] = true;
+
+            // -1: don't count own node
+            if (static_cast<size_t>(g_connectedNodes.fetch_add(1) + 1) == m_hostnamesSorted.size() - 1) {
+                auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::high_resolution_clock::now() - g_start);
+
+                printf("***** ALL CONNECTED: %zu nodes, %lu ms *****\n",
+                        m_hostnamesSorted.size(), static_cast<uint64_t>(delta.count()));
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
 };
 
 class Listener : public ibnet::con::DiscoveryListener,
@@ -125,8 +177,6 @@ public:
     }
 };
 
-static bool g_loop = true;
-
 static void SignalHandler(int signal)
 {
     if (signal == SIGINT) {
@@ -137,7 +187,12 @@ static void SignalHandler(int signal)
 int main(int argc, char** argv)
 {
     if (argc < 3) {
-        printf("Usage: %s <num client threads> <hostnames nodes> ...\n", argv[0]);
+        printf("Usage: %s [-A <bind address>] [-W <num setup workers>] [-b] "
+                "<num client threads> <hostnames nodes> ...\n", argv[0]);
+        printf("  -A: Bind the exchange socket to a local address which is also "
+                "listed in the nodes (multiple instances on a single host)\n");
+        printf("  -W: Number of connection setup workers (default 1)\n");
+        printf("  -b: Measure the time until all nodes are connected\n");
         return -1;
     }
 
@@ -152,14 +207,38 @@ int main(int argc, char** argv)
 
     // cmd args processing
 
-    auto clientThreads = static_cast<uint32_t>(std::atol(argv[1]));
+    std::string bindAddress;
+    uint8_t numSetupWorkers = 1;
+    int argPos = 1;
+
+    while (argPos < argc && argv[argPos][0] == '-') {
+        std::string opt = argv[argPos++];
+
+        if (opt == "-b") {
+            g_bootstrapBenchmark = true;
+        } else if (opt == "-A" && argPos < argc) {
+            bindAddress = argv[argPos++];
+        } else if (opt == "-W" && argPos < argc) {
+            numSetupWorkers = static_cast<uint8_t>(std::atoi(argv[argPos++]));
+        } else {
+            printf("ERROR Invalid option %s\n", opt.c_str());
+            return -1;
+        }
+    }
+
+    if (argc - argPos < 2) {
+        printf("ERROR Missing number of client threads or nodes\n");
+        return -1;
+    }
+
+    auto clientThreads = static_cast<uint32_t>(std::atol(argv[argPos]));
 
     std::vector<std::string> hostnamesSorted;
     ibnet::con::NodeConfArgListReader nodeConfArgListReader(
-            (uint32_t) (argc - 2), &argv[2]);
+            (uint32_t) (argc - argPos - 1), &argv[argPos + 1]);
     ibnet::con::NodeConf nodeConf = nodeConfArgListReader.Read();
 
-    for (int i = 2; i < argc; i++) {
+    for (int i = argPos + 1; i < argc; i++) {
         hostnamesSorted.push_back(std::string(argv[i]));
     }
 
@@ -172,7 +251,7 @@ int main(int argc, char** argv)
 
     uint16_t counter = 0;
     for (auto& it : hostnamesSorted) {
-        if (ownHostname == it) {
+        if (ownHostname == it || bindAddress == it) {
             ownNodeId = counter;
             break;
         }
@@ -198,7 +277,8 @@ int main(int argc, char** argv)
     auto* listener = new Listener();
 
     auto* exchangeManager = new ibnet::con::ExchangeManager(
-            ownNodeId, 5730);
+            ownNodeId, 5730, bindAddress.empty() ? 0 :
+                    ibnet::sys::AddressIPV4(bindAddress).GetAddress());
     auto* jobManager = new ibnet::con::JobManager();
 
     auto* discoveryManager = new ibnet::con::DiscoveryManager(
@@ -206,7 +286,8 @@ int main(int argc, char** argv)
     discoveryManager->SetListener(listener);
 
     auto* connectionManager = new ibnet::con::DummyConnectionManager(ownNodeId,
-            nodeConf, 5000, 100, device, protDom, exchangeManager, jobManager,
+            nodeConf, 5000, std::max<uint32_t>(100, static_cast<uint32_t>(hostnamesSorted.size())),
+            numSetupWorkers, device, protDom, exchangeManager, jobManager,
             discoveryManager);
     connectionManager->SetListener(listener);
 
@@ -214,8 +295,10 @@ int main(int argc, char** argv)
 
     std::vector<ClientThread*> threads;
 
+    g_start = std::chrono::high_resolution_clock::now();
+
     for (uint32_t i = 0; i < clientThreads; i++) {
-        auto thread = new ClientThread(i, ownNodeId,
+        auto thread = new ClientThread(i, clientThreads, ownNodeId,
                 hostnamesSorted, connectionManager);
 
         thread->Start();
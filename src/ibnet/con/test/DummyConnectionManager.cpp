@@ -26,18 +26,18 @@ namespace con {
 DummyConnectionManager::DummyConnectionManager(
         NodeId ownNodeId, const NodeConf& nodeConf,
         uint32_t connectionCreationTimeoutMs, uint32_t maxNumConnections,
-        core::IbDevice* refDevice, core::IbProtDom* refProtDom,
+        uint8_t numSetupWorkers, core::IbDevice* refDevice, core::IbProtDom* refProtDom,
         ExchangeManager* refExchangeManager, JobManager* refJobManager,
         DiscoveryManager* refDiscoveryManager) :
         ConnectionManager("Dummy", ownNodeId, nodeConf, connectionCreationTimeoutMs,
-                maxNumConnections, refDevice, refProtDom, refExchangeManager,
+                maxNumConnections, numSetupWorkers, refDevice, refProtDom, refExchangeManager,
                 refJobManager, refDiscoveryManager)
 {
 
 }
 
 con::Connection* DummyConnectionManager::_CreateConnection(
-        con::ConnectionId connectionId)
+        con::ConnectionId connectionId, con::NodeId remoteNodeId)
 {
     return new DummyConnection(_GetOwnNodeId(), connectionId);
 }
@@ -40,6 +40,7 @@ public:
      * @param nodeConf Node config to use
      * @param connectionCreationTimeoutMs Timeout for connection creation in ms
      * @param maxNumConnections Max number of connections to manage
+     * @param numSetupWorkers Number of threads processing connection jobs
      * @param refDevice Pointer to the IbDevice (managed by caller)
      * @param refProtDom Pointer to the IbProtDom (managed by caller)
      * @param refExchangeManager Pointer to exchange manager to use for
@@ -51,7 +52,7 @@ public:
      */
     DummyConnectionManager(NodeId ownNodeId, const NodeConf& nodeConf,
             uint32_t connectionCreationTimeoutMs, uint32_t maxNumConnections,
-            core::IbDevice* refDevice, core::IbProtDom* refProtDom,
+            uint8_t numSetupWorkers, core::IbDevice* refDevice, core::IbProtDom* refProtDom,
             ExchangeManager* refExchangeManager, JobManager* refJobManager,
             DiscoveryManager* refDiscoveryManager);
 
@@ -61,7 +62,8 @@ public:
     ~DummyConnectionManager() override = default;
 
 protected:
-    con::Connection* _CreateConnection(con::ConnectionId connectionId) override;
+    con::Connection* _CreateConnection(con::ConnectionId connectionId,
+            con::NodeId remoteNodeId) override;
 };
 
 }
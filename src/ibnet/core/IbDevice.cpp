@@ -17,6 +17,9 @@
  */
 
 #include "IbDevice.h"
+
+#include <fstream>
+
 #include "IbPerfLib/IbPortCompat.h"
 
 #include "ibnet/sys/Assert.h"
@@ -24,6 +27,8 @@
 #include "ibnet/sys/StringUtils.h"
 
 #include "IbException.h"
+#include "IbSoftVerbs.h"
+#include "IbVerbs.h"
 
 #define DEFAULT_IB_PORT 1
 
@@ -65,6 +70,8 @@ IbDevice::IbDevice() :
         m_ibDevName("INVALID"),
         m_lid(0xFFFF),
         m_deviceAttr(),
+        m_maxInlineData(0),
+        m_numaNode(-1),
         m_portState(e_PortStateInvalid),
         m_maxMtuSize(e_MtuSizeInvalid),
         m_activeMtuSize(e_MtuSizeInvalid),
@@ -74,12 +81,70 @@ IbDevice::IbDevice() :
         m_ibCtx(nullptr),
         m_perfCounter(nullptr),
         m_diagPerfCounter(nullptr)
+{
+    IBNET_LOG_INFO("Opening device...");
+
+    if (IbVerbs::GetBackend() == IbVerbs::e_BackendSoft) {
+        __OpenSoftDevice();
+    } else {
+        __OpenHardwareDevice();
+    }
+
+    // update once for base information
+    UpdateState();
+
+    if (IbVerbs::QueryDevice(m_ibCtx, &m_deviceAttr)) {
+        throw IbException("Querying device attributes failed: %s", strerror(errno));
+    }
+
+    __LogDeviceAttributes();
+
+    m_maxInlineData = __ProbeMaxInlineData();
+
+    IBNET_LOG_DEBUG("Max inline data (bytes): %d", m_maxInlineData);
+
+    m_numaNode = __ReadNumaNode();
+
+    IBNET_LOG_DEBUG("NUMA node: %d", m_numaNode);
+
+    // no hardware counters available for the emulated device
+    if (!IbSoftVerbs::IsSoftContext(m_ibCtx)) {
+        __InitPerfCounters();
+    }
+
+    IBNET_LOG_INFO("Opened device %s", *this);
+}
+
+IbDevice::~IbDevice()
+{
+    IBNET_ASSERT_PTR(m_ibCtx);
+
+    IBNET_LOG_INFO("Closing device %s", *this);
+
+    IbVerbs::CloseDevice(m_ibCtx);
+
+    if (m_perfCounter) {
+        delete m_perfCounter;
+    }
+    
+    if (m_diagPerfCounter) {
+        delete m_diagPerfCounter;
+    }
+
+    m_ibDevGuid = 0xFFFF;
+    m_ibDevName = "INVALID";
+    m_lid = 0xFFFF;
+    m_linkWidth = e_LinkWidthInvalid;
+    m_linkSpeed = e_LinkSpeedInvalid;
+    m_linkState = e_LinkStateInvalid;
+    m_ibCtx = nullptr;
+}
+
+void IbDevice::__OpenHardwareDevice()
 {
     int num_devices = 0;
     ibv_device** dev_list = nullptr;
 
-    IBNET_LOG_INFO("Opening device...");
-
     // device enumeration
     dev_list = ibv_get_device_list(&num_devices);
 
@@ -119,23 +184,29 @@ IbDevice::IbDevice() :
 
     // cleanup device list
     ibv_free_device_list(dev_list);
+}
 
-    // update once for base information
-    UpdateState();
+void IbDevice::__OpenSoftDevice()
+{
+    m_ibCtx = IbSoftVerbs::OpenDevice();
 
-    if (ibv_query_device(m_ibCtx, &m_deviceAttr)) {
-        throw IbException("Querying device attributes failed: %s", strerror(errno));
+    if (m_ibCtx == nullptr) {
+        throw IbException("Opening soft verbs device failed: %s", strerror(errno));
     }
 
-    __LogDeviceAttributes();
+    m_ibDevGuid = IbSoftVerbs::GetGuid(m_ibCtx);
+    m_ibDevName = m_ibCtx->device->name;
+}
 
+void IbDevice::__InitPerfCounters()
+{
     try {
         ibv_port_attr attr = {};
         int result;
 
         memset(&attr, 0, sizeof(struct ibv_port_attr));
 
-        result = ibv_query_port(m_ibCtx, DEFAULT_IB_PORT, &attr);
+        result = IbVerbs::QueryPort(m_ibCtx, DEFAULT_IB_PORT, &attr);
 
         if (result != 0) {
             throw IbException("Querying port for device information failed: %s",
@@ -157,33 +228,6 @@ IbDevice::IbDevice() :
 
         IBNET_LOG_WARN("Initializing IbPerfLib failed: %s", e.what());
     }
-
-    IBNET_LOG_INFO("Opened device %s", *this);
-}
-
-IbDevice::~IbDevice()
-{
-    IBNET_ASSERT_PTR(m_ibCtx);
-
-    IBNET_LOG_INFO("Closing device %s", *this);
-
-    ibv_close_device(m_ibCtx);
-
-    if (m_perfCounter) {
-        delete m_perfCounter;
-    }
-    
-    if (m_diagPerfCounter) {
-        delete m_diagPerfCounter;
-    }
-
-    m_ibDevGuid = 0xFFFF;
-    m_ibDevName = "INVALID";
-    m_lid = 0xFFFF;
-    m_linkWidth = e_LinkWidthInvalid;
-    m_linkSpeed = e_LinkSpeedInvalid;
-    m_linkState = e_LinkStateInvalid;
-    m_ibCtx = nullptr;
 }
 
 void IbDevice::UpdateState()
@@ -195,7 +239,7 @@ void IbDevice::UpdateState()
 
     memset(&attr, 0, sizeof(struct ibv_port_attr));
 
-    result = ibv_query_port(m_ibCtx, DEFAULT_IB_PORT, &attr);
+    result = IbVerbs::QueryPort(m_ibCtx, DEFAULT_IB_PORT, &attr);
 
     if (result != 0) {
         throw IbException("Querying port for device information failed: %s",
@@ -312,5 +356,70 @@ void IbDevice::__LogDeviceAttributes()
     IBNET_LOG_DEBUG("%s", str);
 }
 
+uint32_t IbDevice::__ProbeMaxInlineData()
+{
+    // the max inline size is not part of the device attributes. it can
+    // only be determined by creating a queue pair which is done with a
+    // temporary pd and cq here. start big and decrease on failure
+    uint32_t maxInlineData = 0;
+
+    ibv_pd* pd = IbVerbs::AllocPD(m_ibCtx);
+
+    if (pd == nullptr) {
+        IBNET_LOG_WARN("Probing max inline data failed, allocating pd: %s", strerror(errno));
+        return 0;
+    }
+
+    ibv_cq* cq = IbVerbs::CreateCQ(m_ibCtx, 1, nullptr, nullptr, 0);
+
+    if (cq == nullptr) {
+        IBNET_LOG_WARN("Probing max inline data failed, creating cq: %s", strerror(errno));
+        IbVerbs::DeallocPD(pd);
+        return 0;
+    }
+
+    for (uint32_t size = 1024; size > 0; size /= 2) {
+        ibv_qp_init_attr attr = {};
+        memset(&attr, 0, sizeof(ibv_qp_init_attr));
+
+        attr.send_cq = cq;
+        attr.recv_cq = cq;
+        attr.qp_type = IBV_QPT_RC;
+        attr.cap.max_send_wr = 1;
+        attr.cap.max_recv_wr = 1;
+        attr.cap.max_send_sge = 1;
+        attr.cap.max_recv_sge = 1;
+        attr.cap.max_inline_data = size;
+
+        ibv_qp* qp = IbVerbs::CreateQP(pd, &attr);
+
+        if (qp != nullptr) {
+            // the provider might round up, take the actual value
+            maxInlineData = attr.cap.max_inline_data;
+            IbVerbs::DestroyQP(qp);
+            break;
+        }
+    }
+
+    IbVerbs::DestroyCQ(cq);
+    IbVerbs::DeallocPD(pd);
+
+    return maxInlineData;
+}
+
+int IbDevice::__ReadNumaNode()
+{
+    std::ifstream file("/sys/class/infiniband/" + m_ibDevName + "/device/numa_node");
+    int node = -1;
+
+    if (!file.is_open() || !(file >> node)) {
+        IBNET_LOG_WARN("Reading NUMA node of device %s from sysfs failed", m_ibDevName);
+        return -1;
+    }
+
+    // -1: no NUMA system or node not reported by the firmware
+    return node;
+}
+
 }
 }
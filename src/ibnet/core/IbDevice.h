@@ -269,6 +269,22 @@ public:
         return static_cast<uint32_t>(m_deviceAttr.max_sge);
     }
 
+    /**
+     * Get the max number of bytes that can be posted inline with a send WRQ
+     * on a RC queue pair (probed on device open, 0 if not supported)
+     */
+    uint32_t GetMaxInlineData() const {
+        return m_maxInlineData;
+    }
+
+    /**
+     * Get the NUMA node the device is attached to (read from sysfs on
+     * device open, -1 if unknown or not a NUMA system)
+     */
+    int GetNumaNode() const {
+        return m_numaNode;
+    }
+
     /**
      * Get the InfiniBand context provided by the opened device
      */
@@ -312,7 +328,8 @@ public:
                 << ", MaxMTU " << ms_mtuSizeStr[o.m_maxMtuSize]
                 << ", ActiveMTU " << ms_mtuSizeStr[o.m_maxMtuSize]
                 << ", Port " << ms_portStateStr[o.m_portState]
-                << ", Link " << ms_linkStateStr[o.m_linkState];
+                << ", Link " << ms_linkStateStr[o.m_linkState]
+                << ", NUMA " << std::dec << o.m_numaNode;
     }
 
 private:
@@ -326,6 +343,8 @@ private:
     uint16_t m_lid;
 
     ibv_device_attr m_deviceAttr;
+    uint32_t m_maxInlineData;
+    int m_numaNode;
 
     PortState m_portState;
     MtuSize m_maxMtuSize;
@@ -339,7 +358,17 @@ private:
     IbPerfLib::IbPerfCounter *m_perfCounter;
     IbPerfLib::IbDiagPerfCounter *m_diagPerfCounter;
 
+    void __OpenHardwareDevice();
+
+    void __OpenSoftDevice();
+
+    void __InitPerfCounters();
+
     void __LogDeviceAttributes();
+
+    uint32_t __ProbeMaxInlineData();
+
+    int __ReadNumaNode();
 };
 
 }
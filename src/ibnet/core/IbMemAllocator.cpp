@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbMemAllocator.h"
+
+#include <cstring>
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ibnet/sys/Logger.hpp"
+
+#include "IbException.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace ibnet {
+namespace core {
+
+IbMemAllocator::IbMemAllocator(PageSize pageSize, int numaNode) :
+        m_pageSize(pageSize),
+        m_numaNode(numaNode),
+        m_lock(),
+        m_allocations(),
+        m_allocatedBytes(0),
+        m_hugePageFallbacks(0)
+{
+    if (m_pageSize != e_PageSizeDefault && m_pageSize != e_PageSize2MB && m_pageSize != e_PageSize1GB) {
+        throw IbException("Unsupported page size %d MB", m_pageSize);
+    }
+
+    IBNET_LOG_INFO("Page size %d MB (0 = default), NUMA node %d", m_pageSize, m_numaNode);
+}
+
+IbMemAllocator::~IbMemAllocator()
+{
+    for (auto& it : m_allocations) {
+        IBNET_LOG_WARN("Memory %p, size %d still allocated on cleanup", it.first, it.second);
+        munmap(it.first, it.second);
+    }
+}
+
+void* IbMemAllocator::Alloc(uint64_t size)
+{
+    uint64_t hugePageSize = static_cast<uint64_t>(m_pageSize) * 1024 * 1024;
+    void* addr = nullptr;
+    uint64_t mappedSize = 0;
+
+    std::lock_guard<std::mutex> l(m_lock);
+
+    // don't waste (up to) a whole huge page on small allocations
+    if (m_pageSize != e_PageSizeDefault && size >= hugePageSize) {
+        mappedSize = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+        addr = __MapHugePages(mappedSize, hugePageSize);
+
+        if (addr == nullptr && m_hugePageFallbacks++ == 0) {
+            IBNET_LOG_WARN("Allocating %d bytes backed by %d MB huge pages failed (%s), falling back to "
+                    "default pages. Check if enough huge pages are reserved (/proc/sys/vm/nr_hugepages)",
+                    size, m_pageSize, strerror(errno));
+        }
+    }
+
+    if (addr == nullptr) {
+        auto pageSize = static_cast<uint64_t>(getpagesize());
+
+        mappedSize = (size + pageSize - 1) / pageSize * pageSize;
+        addr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (addr == MAP_FAILED) {
+            throw IbException("Allocating %d bytes failed: %s", size, strerror(errno));
+        }
+
+        // at least try to get transparent huge pages
+        if (m_pageSize != e_PageSizeDefault) {
+            madvise(addr, mappedSize, MADV_HUGEPAGE);
+        }
+    }
+
+    __BindNumaNode(addr, mappedSize);
+
+    m_allocations.insert(std::make_pair(addr, mappedSize));
+    m_allocatedBytes += mappedSize;
+
+    return addr;
+}
+
+void IbMemAllocator::Free(void* addr)
+{
+    std::lock_guard<std::mutex> l(m_lock);
+
+    auto it = m_allocations.find(addr);
+
+    if (it == m_allocations.end()) {
+        throw IbException("Freeing memory %p not allocated by allocator", addr);
+    }
+
+    if (munmap(it->first, it->second) != 0) {
+        IBNET_LOG_ERROR("Unmapping memory %p, size %d failed: %s", it->first, it->second, strerror(errno));
+    }
+
+    m_allocatedBytes -= it->second;
+    m_allocations.erase(it);
+}
+
+void* IbMemAllocator::__MapHugePages(uint64_t size, uint64_t hugePageSize)
+{
+    int sizeShift = hugePageSize == 1024 * 1024 * 1024 ? 30 : 21;
+
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (sizeShift << MAP_HUGE_SHIFT), -1, 0);
+
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    return addr;
+}
+
+void IbMemAllocator::__BindNumaNode(void* addr, uint64_t size)
+{
+    if (m_numaNode < 0) {
+        return;
+    }
+
+    // preferred and not strict binding: fall back to other nodes if
+    // the local node is out of memory. the pages are not touched, yet,
+    // the policy applies once they get faulted in on registration
+    const uint32_t maxNodes = 1024;
+    unsigned long nodeMask[maxNodes / (sizeof(unsigned long) * 8)] = {};
+
+    if (static_cast<uint32_t>(m_numaNode) >= maxNodes) {
+        IBNET_LOG_WARN("NUMA node %d out of range, not binding memory", m_numaNode);
+        return;
+    }
+
+    nodeMask[m_numaNode / (sizeof(unsigned long) * 8)] |= 1UL << (m_numaNode % (sizeof(unsigned long) * 8));
+
+    if (syscall(SYS_mbind, addr, size, MPOL_PREFERRED, nodeMask, maxNodes, 0) != 0) {
+        IBNET_LOG_WARN("Binding memory %p, size %d to NUMA node %d failed: %s", addr, size, m_numaNode,
+                strerror(errno));
+    }
+}
+
+}
+}
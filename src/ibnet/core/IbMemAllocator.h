@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_CORE_IBMEMALLOCATOR_H
+#define IBNET_CORE_IBMEMALLOCATOR_H
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+namespace ibnet {
+namespace core {
+
+/**
+ * Allocator for the backing memory of regions registered with a protection
+ * domain. Registering memory pins every single page and the HCA has to
+ * translate each page on access. Backing large regions (e.g. the receive
+ * buffer pool or send buffers) with huge pages reduces registration time
+ * and translation cache misses on the HCA. Furthermore, the memory can be
+ * bound to the NUMA node the HCA is attached to. If huge pages are not
+ * available (e.g. none reserved by the OS), the allocator falls back to
+ * default pages (with transparent huge pages advised). Thread safe.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 17.10.2018
+ */
+class IbMemAllocator
+{
+public:
+    /**
+     * Page size to back allocations with
+     */
+    enum PageSize
+    {
+        e_PageSizeDefault = 0,
+        e_PageSize2MB = 2,
+        e_PageSize1GB = 1024,
+    };
+
+    /**
+     * Constructor
+     *
+     * @param pageSize Page size to back allocations with. Allocations smaller
+     *        than a huge page are always backed by default pages
+     * @param numaNode NUMA node to bind the allocated memory to (preferred,
+     *        -1 to not bind memory)
+     */
+    IbMemAllocator(PageSize pageSize, int numaNode);
+
+    /**
+     * Destructor
+     */
+    ~IbMemAllocator();
+
+    /**
+     * Allocate memory. The memory is page aligned and not initialized.
+     *
+     * @param size Size of the memory to allocate in bytes
+     * @return Pointer to the allocated memory
+     */
+    void* Alloc(uint64_t size);
+
+    /**
+     * Free memory allocated with Alloc
+     *
+     * @param addr Address of the memory returned by Alloc
+     */
+    void Free(void* addr);
+
+    /**
+     * Get the page size allocations are backed with
+     */
+    PageSize GetPageSize() const
+    {
+        return m_pageSize;
+    }
+
+    /**
+     * Get the NUMA node the memory is bound to (-1 if not bound)
+     */
+    int GetNumaNode() const
+    {
+        return m_numaNode;
+    }
+
+    /**
+     * Enable output to an out stream
+     */
+    friend std::ostream& operator<<(std::ostream& os, const IbMemAllocator& o)
+    {
+        return os << "m_pageSize " << o.m_pageSize << " MB, m_numaNode " << o.m_numaNode <<
+                ", m_allocations " << o.m_allocations.size() << ", m_allocatedBytes " <<
+                o.m_allocatedBytes << ", m_hugePageFallbacks " << o.m_hugePageFallbacks;
+    }
+
+private:
+    const PageSize m_pageSize;
+    const int m_numaNode;
+
+    std::mutex m_lock;
+    // key: address, value: size of the mapping
+    std::map<void*, uint64_t> m_allocations;
+    uint64_t m_allocatedBytes;
+    uint32_t m_hugePageFallbacks;
+
+private:
+    void* __MapHugePages(uint64_t size, uint64_t hugePageSize);
+
+    void __BindNumaNode(void* addr, uint64_t size);
+};
+
+}
+}
+
+#endif // IBNET_CORE_IBMEMALLOCATOR_H
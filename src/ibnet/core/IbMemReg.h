@@ -29,6 +29,7 @@
 #include "ibnet/sys/StringUtils.h"
 
 #include "IbException.h"
+#include "IbMemAllocator.h"
 
 namespace ibnet {
 namespace core {
@@ -59,11 +60,29 @@ public:
             m_addr(addr),
             m_size(size),
             m_freeOnCleanup(freeOnCleanup),
+            m_refAllocator(nullptr),
             m_ibMemReg(nullptr)
     {
         IBNET_ASSERT_PTR(addr);
     }
 
+    /**
+     * Constructor. Allocates the memory of the region using an allocator
+     * (e.g. backed by huge pages) which is free'd with destruction of this object
+     *
+     * @param size Size of the memory region to allocate
+     * @param refAllocator Allocator to allocate and free the memory with
+     *          (managed by caller, must outlive the region)
+     */
+    IbMemReg(uint64_t size, IbMemAllocator* refAllocator) :
+            m_addr(refAllocator->Alloc(size)),
+            m_size(size),
+            m_freeOnCleanup(true),
+            m_refAllocator(refAllocator),
+            m_ibMemReg(nullptr)
+    {
+    }
+
     /**
      * Constructor
      *
@@ -76,6 +95,7 @@ public:
             m_addr(addr),
             m_size(size),
             m_freeOnCleanup(false),
+            m_refAllocator(nullptr),
             m_ibMemReg(refParentMemory->m_ibMemReg)
     {
         IBNET_ASSERT_PTR(addr);
@@ -93,7 +113,11 @@ public:
     ~IbMemReg()
     {
         if (m_freeOnCleanup) {
-            free(m_addr);
+            if (m_refAllocator) {
+                m_refAllocator->Free(m_addr);
+            } else {
+                free(m_addr);
+            }
         }
     }
 
@@ -188,6 +212,7 @@ private:
     void* m_addr;
     uint64_t m_size;
     bool m_freeOnCleanup;
+    IbMemAllocator* m_refAllocator;
 
     ibv_mr* m_ibMemReg;
 };
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbMemRegCache.h"
+
+#include "ibnet/sys/Logger.hpp"
+
+namespace ibnet {
+namespace core {
+
+IbMemRegCache::IbMemRegCache(IbProtDom* refProtDom, uint32_t maxCachedRegions) :
+        m_refProtDom(refProtDom),
+        m_maxCachedRegions(maxCachedRegions),
+        m_lock(),
+        m_regions(),
+        m_useCounter(0),
+        m_hits(0),
+        m_misses(0)
+{
+
+}
+
+IbMemRegCache::~IbMemRegCache()
+{
+    for (auto& it : m_regions) {
+        if (it.second.m_refCount > 0) {
+            IBNET_LOG_WARN("Memory region still referenced on cleanup: %s", *it.second.m_memReg);
+        }
+
+        m_refProtDom->Deregister(it.second.m_memReg);
+        delete it.second.m_memReg;
+    }
+}
+
+IbMemReg* IbMemRegCache::Acquire(void* addr, uint64_t size)
+{
+    std::lock_guard<std::mutex> l(m_lock);
+
+    auto start = (uintptr_t) addr;
+
+    // check the region with the closest start address
+    auto it = m_regions.upper_bound(start);
+
+    if (it != m_regions.begin()) {
+        it--;
+
+        if (it->first + it->second.m_memReg->GetSize() >= start + size) {
+            it->second.m_refCount++;
+            it->second.m_lastUse = m_useCounter++;
+            m_hits++;
+
+            return it->second.m_memReg;
+        }
+    }
+
+    m_misses++;
+
+    if (m_regions.size() >= m_maxCachedRegions) {
+        __EvictUnreferenced();
+    }
+
+    auto* memReg = new IbMemReg(addr, size, false);
+
+    try {
+        m_refProtDom->Register(memReg);
+    } catch (...) {
+        delete memReg;
+        throw;
+    }
+
+    m_regions.insert(std::make_pair(start, Entry {memReg, 1, m_useCounter++}));
+
+    return memReg;
+}
+
+void IbMemRegCache::Release(IbMemReg* refMemReg)
+{
+    std::lock_guard<std::mutex> l(m_lock);
+
+    auto range = m_regions.equal_range((uintptr_t) refMemReg->GetAddress());
+
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second.m_memReg == refMemReg) {
+            if (it->second.m_refCount == 0) {
+                throw IbException("Releasing unreferenced memory region %s", *refMemReg);
+            }
+
+            it->second.m_refCount--;
+            return;
+        }
+    }
+
+    throw IbException("Releasing memory region not managed by cache: %s", *refMemReg);
+}
+
+void IbMemRegCache::Invalidate(void* addr, uint64_t size)
+{
+    std::lock_guard<std::mutex> l(m_lock);
+
+    auto start = (uintptr_t) addr;
+    auto it = m_regions.begin();
+
+    // rare operation, no need to optimize the lookup
+    while (it != m_regions.end() && it->first < start + size) {
+        if (it->first + it->second.m_memReg->GetSize() <= start) {
+            it++;
+            continue;
+        }
+
+        if (it->second.m_refCount > 0) {
+            throw IbException("Invalidating referenced memory region %s", *it->second.m_memReg);
+        }
+
+        auto tmp = it++;
+        __Remove(tmp);
+    }
+}
+
+void IbMemRegCache::__EvictUnreferenced()
+{
+    auto lru = m_regions.end();
+
+    for (auto it = m_regions.begin(); it != m_regions.end(); it++) {
+        if (it->second.m_refCount == 0 &&
+                (lru == m_regions.end() || it->second.m_lastUse < lru->second.m_lastUse)) {
+            lru = it;
+        }
+    }
+
+    // all regions in use: exceed the limit instead of blocking the caller
+    if (lru == m_regions.end()) {
+        IBNET_LOG_WARN("All %d cached memory regions referenced, exceeding limit", m_regions.size());
+        return;
+    }
+
+    __Remove(lru);
+}
+
+void IbMemRegCache::__Remove(std::multimap<uintptr_t, Entry>::iterator it)
+{
+    m_refProtDom->Deregister(it->second.m_memReg);
+    delete it->second.m_memReg;
+    m_regions.erase(it);
+}
+
+}
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_CORE_IBMEMREGCACHE_H
+#define IBNET_CORE_IBMEMREGCACHE_H
+
+#include <map>
+#include <mutex>
+
+#include "IbMemReg.h"
+#include "IbProtDom.h"
+
+namespace ibnet {
+namespace core {
+
+/**
+ * Cache for memory regions registered with a protection domain. Registering
+ * memory is expensive (pinning, HCA translation table updates). Buffers handed
+ * to the HCA over and over again (e.g. user buffers sent without copying them
+ * to a send buffer first) are registered once and looked up on further use.
+ * The cache does not manage the memory of the regions (allocation and free'ing
+ * is up to the caller). Unreferenced regions are evicted (least recently used
+ * first) if the max number of cached regions is exceeded. Thread safe.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 17.10.2018
+ */
+class IbMemRegCache
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param refProtDom Pointer to the protection domain to register the regions with
+     *        (managed by caller)
+     * @param maxCachedRegions Max number of (unreferenced) regions to keep registered
+     */
+    IbMemRegCache(IbProtDom* refProtDom, uint32_t maxCachedRegions);
+
+    /**
+     * Destructor. Deregisters all cached regions
+     */
+    ~IbMemRegCache();
+
+    /**
+     * Get a registered memory region which contains the specified area. If no
+     * cached region contains the area, the area is registered and added to the
+     * cache. The region must be returned using Release once it is not used
+     * anymore (e.g. the send operation completed).
+     *
+     * @param addr Start address of the area
+     * @param size Size of the area in bytes
+     * @return Pointer to a registered memory region containing the area (managed
+     *         by the cache). Use the address of the region to calculate the offset
+     *         of the area
+     */
+    IbMemReg* Acquire(void* addr, uint64_t size);
+
+    /**
+     * Release a region acquired using Acquire
+     *
+     * @param refMemReg Region to release
+     */
+    void Release(IbMemReg* refMemReg);
+
+    /**
+     * Deregister and remove all cached regions overlapping with the specified
+     * area. Call this before free'ing or remapping memory which might have been
+     * registered by the cache.
+     *
+     * @param addr Start address of the area
+     * @param size Size of the area in bytes
+     */
+    void Invalidate(void* addr, uint64_t size);
+
+    /**
+     * Get the number of lookups served by the cache
+     */
+    uint64_t GetHits() const
+    {
+        return m_hits;
+    }
+
+    /**
+     * Get the number of lookups which required registering a new region
+     */
+    uint64_t GetMisses() const
+    {
+        return m_misses;
+    }
+
+    /**
+     * Enable output to an out stream
+     */
+    friend std::ostream& operator<<(std::ostream& os, const IbMemRegCache& o)
+    {
+        return os << "m_regions " << o.m_regions.size() << ", m_maxCachedRegions " <<
+                o.m_maxCachedRegions << ", m_hits " << o.m_hits << ", m_misses " << o.m_misses;
+    }
+
+private:
+    struct Entry
+    {
+        IbMemReg* m_memReg;
+        uint32_t m_refCount;
+        uint64_t m_lastUse;
+    };
+
+private:
+    IbProtDom* m_refProtDom;
+    const uint32_t m_maxCachedRegions;
+
+    std::mutex m_lock;
+    // key: start address of the region
+    std::multimap<uintptr_t, Entry> m_regions;
+    uint64_t m_useCounter;
+
+    uint64_t m_hits;
+    uint64_t m_misses;
+
+private:
+    void __EvictUnreferenced();
+
+    void __Remove(std::multimap<uintptr_t, Entry>::iterator it);
+};
+
+}
+}
+
+#endif // IBNET_CORE_IBMEMREGCACHE_H
@@ -20,6 +20,8 @@
 
 #include "ibnet/sys/Logger.hpp"
 
+#include "IbVerbs.h"
+
 namespace ibnet {
 namespace core {
 
@@ -32,7 +34,7 @@ IbProtDom::IbProtDom(IbDevice& device, const std::string& name) :
     IBNET_LOG_INFO("[%s] Allocating protection domain", m_name);
 
     // allocate protection domain
-    m_ibProtDom = ibv_alloc_pd(device.GetIBCtx());
+    m_ibProtDom = IbVerbs::AllocPD(device.GetIBCtx());
 
     if (m_ibProtDom == nullptr) {
         throw IbException("Allocating protection domain %s failed", m_name);
@@ -47,15 +49,15 @@ IbProtDom::~IbProtDom()
 
     if (m_totalMemRegistered > 0) {
         IBNET_LOG_WARN("[%s] Memory is still registered with the protection "
-                "domain, total: %d", m_name, m_totalMemRegistered);
+                "domain, total: %d", m_name, m_totalMemRegistered.load());
     }
 
-    ibv_dealloc_pd(m_ibProtDom);
+    IbVerbs::DeallocPD(m_ibProtDom);
 
     IBNET_LOG_DEBUG("[%s] Destroying protection domain done", m_name);
 }
 
-void IbProtDom::Register(IbMemReg* refMemReg)
+void IbProtDom::Register(IbMemReg* refMemReg, int accessFlags)
 {
     IBNET_ASSERT(refMemReg != nullptr);
     IBNET_ASSERT(refMemReg->m_size != 0);
@@ -68,8 +70,8 @@ void IbProtDom::Register(IbMemReg* refMemReg)
     IBNET_LOG_TRACE("[%s] Registering memory region %p, size %d",
             m_name, refMemReg->m_addr, refMemReg->m_size);
 
-    refMemReg->m_ibMemReg = ibv_reg_mr(m_ibProtDom, refMemReg->m_addr,
-            refMemReg->m_size, IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE);
+    refMemReg->m_ibMemReg = IbVerbs::RegMR(m_ibProtDom, refMemReg->m_addr,
+            refMemReg->m_size, accessFlags);
 
     if (refMemReg->m_ibMemReg == nullptr) {
         throw IbException("[%s] Registering memory region failed: %s",
@@ -88,7 +90,7 @@ void IbProtDom::Deregister(IbMemReg* refMemReg)
     IBNET_LOG_TRACE("[%s] Deregistering memory region %p, size %d",
             m_name, memReg.GetAddress(), memReg.GetSize());
 
-    int ret = ibv_dereg_mr(refMemReg->m_ibMemReg);
+    int ret = IbVerbs::DeregMR(refMemReg->m_ibMemReg);
 
     if (ret != 0) {
         throw IbException("[%s] Deregistering memory region failed: %s",
@@ -19,6 +19,7 @@
 #ifndef IBNET_CORE_IBPROTDOM_H
 #define IBNET_CORE_IBPROTDOM_H
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 
@@ -62,8 +63,10 @@ public:
      *          memory pinning set (CAP_IPC_LOCK). This is not necessary if
      *          you are running your application as root.
      * @param refMemReg Pointer to memory region to register (caller has to manage pointer)
+     * @param accessFlags Access flags for the region (ibv_access_flags)
      */
-    void Register(IbMemReg* refMemReg);
+    void Register(IbMemReg* refMemReg,
+            int accessFlags = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE);
 
     /**
      * Deregister an already registered memory region. Ensure to call this for every
@@ -111,8 +114,9 @@ private:
     const std::string m_name;
     ibv_pd* m_ibProtDom;
 
-    uint64_t m_memoryRegionsRegistered;
-    uint64_t m_totalMemRegistered;
+    // regions of connections are registered concurrently
+    std::atomic<uint64_t> m_memoryRegionsRegistered;
+    std::atomic<uint64_t> m_totalMemRegistered;
 };
 
 }
@@ -0,0 +1,1522 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbSoftVerbs.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ibnet/sys/Logger.hpp"
+
+namespace ibnet {
+namespace core {
+
+namespace {
+
+const char* const SOCKET_NAME_PREFIX = "ibnet-soft-verbs-";
+// unicast LID range
+const uint16_t LID_MIN = 1;
+const uint16_t LID_MAX = 0xBFFF;
+const uint64_t GUID_PREFIX = 0x1B5E000000000000;
+
+const uint32_t MAX_QP_WR = 16384;
+const uint32_t MAX_SRQ_WR = 65535;
+const uint32_t MAX_SGE = 32;
+const uint32_t MAX_INLINE_DATA = 1024;
+const int MAX_CQE = 1 << 22;
+const int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+enum MsgType : uint32_t
+{
+    e_MsgRequest = 0,
+    e_MsgAck = 1,
+};
+
+/**
+ * Header of a work request transferred to the remote and of the
+ * acknowledgement sent back. Followed by the payload (data of a send or
+ * write request, data of a read acknowledgement)
+ */
+struct MsgHeader
+{
+    uint32_t m_type;
+    uint32_t m_dstQpn;
+    uint32_t m_srcQpn;
+    uint32_t m_srcLid;
+    uint32_t m_opcode;
+    uint32_t m_immData;
+    uint32_t m_status;
+    uint32_t m_length;
+    uint32_t m_rkey;
+    uint64_t m_remoteAddr;
+};
+
+struct RecvWr
+{
+    uint64_t m_wrId;
+    std::vector<ibv_sge> m_sgList;
+};
+
+struct OutstandingWr
+{
+    uint64_t m_wrId;
+    ibv_wr_opcode m_opcode;
+    bool m_signaled;
+    uint32_t m_length;
+    // read: local target of the data
+    std::vector<ibv_sge> m_sgList;
+};
+
+/**
+ * Stream to another context
+ */
+struct Peer
+{
+    uint16_t m_lid;
+    int m_fd;
+    std::mutex m_sendLock;
+};
+
+/**
+ * Stream from another context
+ */
+struct Incoming
+{
+    int m_fd;
+    // request which couldn't be executed (no receive posted), yet
+    bool m_pending;
+    MsgHeader m_header;
+    std::vector<uint8_t> m_payload;
+};
+
+// the verbs structs must be the first members to cast between them
+
+struct SoftCompChannel
+{
+    ibv_comp_channel m_channel;
+    std::mutex m_lock;
+    std::deque<ibv_cq*> m_events;
+};
+
+struct SoftCQ
+{
+    ibv_cq m_cq;
+    std::mutex m_lock;
+    std::deque<ibv_wc> m_wcs;
+    bool m_armed;
+};
+
+struct SoftSRQ
+{
+    ibv_srq m_srq;
+    std::mutex m_lock;
+    uint32_t m_maxWr;
+    uint32_t m_maxSge;
+    std::deque<RecvWr> m_wrs;
+};
+
+struct SoftQP
+{
+    ibv_qp m_qp;
+    std::mutex m_lock;
+    uint32_t m_maxSendWr;
+    uint32_t m_maxRecvWr;
+    uint32_t m_maxSendSge;
+    uint32_t m_maxRecvSge;
+    uint32_t m_maxInlineData;
+    bool m_sigAll;
+    uint16_t m_remoteLid;
+    uint32_t m_remoteQpn;
+    Peer* m_peer;
+    std::deque<OutstandingWr> m_outstanding;
+    // acknowledgements of requests flushed on entering the error state
+    size_t m_discardAcks;
+    std::deque<RecvWr> m_recvWrs;
+};
+
+struct SoftMR
+{
+    ibv_mr m_mr;
+    int m_access;
+};
+
+struct SoftContext
+{
+    ibv_context m_ctx;
+    ibv_device m_device;
+    uint16_t m_lid;
+    int m_listenFd;
+    int m_wakeFd;
+    std::atomic<bool> m_run;
+    std::thread m_progressThread;
+
+    // protects the maps and lists below, held by the progress
+    // thread while executing a request or acknowledgement
+    std::mutex m_lock;
+    std::unordered_map<uint32_t, SoftQP*> m_qps;
+    // key: rkey
+    std::unordered_map<uint32_t, SoftMR*> m_mrs;
+    std::unordered_map<uint16_t, Peer*> m_peers;
+    std::vector<Incoming*> m_incoming;
+    uint32_t m_nextQpn;
+    uint32_t m_nextKey;
+    uint32_t m_nextHandle;
+};
+
+inline SoftContext* ToSoft(ibv_context* ctx)
+{
+    return reinterpret_cast<SoftContext*>(ctx);
+}
+
+socklen_t SocketAddress(uint16_t lid, sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    // abstract namespace (leading \0), removed automatically on close
+    int len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s%d", SOCKET_NAME_PREFIX, lid);
+
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + len);
+}
+
+void SetSocketBufferSizes(int fd)
+{
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+}
+
+bool ReadFull(int fd, void* buffer, size_t length)
+{
+    auto* ptr = static_cast<uint8_t*>(buffer);
+
+    while (length > 0) {
+        ssize_t ret = recv(fd, ptr, length, 0);
+
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        ptr += ret;
+        length -= ret;
+    }
+
+    return true;
+}
+
+bool WriteFull(int fd, iovec* iov, size_t iovCount)
+{
+    while (iovCount > 0) {
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+
+        ssize_t ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        auto written = static_cast<size_t>(ret);
+
+        while (iovCount > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+
+        if (iovCount > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+void WakeProgressThread(SoftContext* ctx)
+{
+    uint64_t val = 1;
+
+    if (write(ctx->m_wakeFd, &val, sizeof(val)) < 0) {
+        IBNET_LOG_ERROR("Waking progress thread failed: %s", strerror(errno));
+    }
+}
+
+void PushWorkCompletion(ibv_cq* cq, const ibv_wc& wc)
+{
+    auto* softCq = reinterpret_cast<SoftCQ*>(cq);
+    bool notify = false;
+
+    {
+        std::lock_guard<std::mutex> l(softCq->m_lock);
+
+        if (softCq->m_wcs.size() >= static_cast<size_t>(cq->cqe)) {
+            IBNET_LOG_ERROR("CQ overrun (%d entries), dropping work completion %d", cq->cqe, wc.wr_id);
+            return;
+        }
+
+        softCq->m_wcs.push_back(wc);
+
+        if (softCq->m_armed && cq->channel) {
+            softCq->m_armed = false;
+            notify = true;
+        }
+    }
+
+    if (notify) {
+        auto* channel = reinterpret_cast<SoftCompChannel*>(cq->channel);
+        uint64_t val = 1;
+
+        std::lock_guard<std::mutex> l(channel->m_lock);
+
+        channel->m_events.push_back(cq);
+
+        if (write(channel->m_channel.fd, &val, sizeof(val)) < 0) {
+            IBNET_LOG_ERROR("Signaling completion channel failed: %s", strerror(errno));
+        }
+    }
+}
+
+bool Scatter(const std::vector<ibv_sge>& sgList, const uint8_t* data, uint32_t length)
+{
+    for (auto& sge : sgList) {
+        if (length == 0) {
+            break;
+        }
+
+        uint32_t chunk = sge.length < length ? sge.length : length;
+
+        memcpy(reinterpret_cast<void*>(sge.addr), data, chunk);
+
+        data += chunk;
+        length -= chunk;
+    }
+
+    return length == 0;
+}
+
+bool HasRecvWr(SoftQP* qp)
+{
+    if (qp->m_qp.srq) {
+        auto* srq = reinterpret_cast<SoftSRQ*>(qp->m_qp.srq);
+        std::lock_guard<std::mutex> l(srq->m_lock);
+        return !srq->m_wrs.empty();
+    }
+
+    std::lock_guard<std::mutex> l(qp->m_lock);
+    return !qp->m_recvWrs.empty();
+}
+
+RecvWr TakeRecvWr(SoftQP* qp)
+{
+    RecvWr wr;
+
+    if (qp->m_qp.srq) {
+        auto* srq = reinterpret_cast<SoftSRQ*>(qp->m_qp.srq);
+        std::lock_guard<std::mutex> l(srq->m_lock);
+        wr = std::move(srq->m_wrs.front());
+        srq->m_wrs.pop_front();
+    } else {
+        std::lock_guard<std::mutex> l(qp->m_lock);
+        wr = std::move(qp->m_recvWrs.front());
+        qp->m_recvWrs.pop_front();
+    }
+
+    return wr;
+}
+
+SoftMR* LookupRemoteMR(SoftContext* ctx, uint32_t rkey, uint64_t addr, uint32_t length, int access)
+{
+    auto it = ctx->m_mrs.find(rkey);
+
+    if (it == ctx->m_mrs.end() || !(it->second->m_access & access)) {
+        return nullptr;
+    }
+
+    auto start = reinterpret_cast<uintptr_t>(it->second->m_mr.addr);
+
+    if (addr < start || addr + length > start + it->second->m_mr.length) {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+/**
+ * Execute a request received from a remote. Called by the progress thread
+ * with the context lock held
+ *
+ * @return False if the request has to be retried (no receive posted)
+ */
+bool ExecuteRequest(SoftContext* ctx, Incoming* incoming)
+{
+    MsgHeader& req = incoming->m_header;
+    MsgHeader ack = {};
+    std::vector<uint8_t> ackPayload;
+
+    ack.m_type = e_MsgAck;
+    ack.m_dstQpn = req.m_srcQpn;
+    ack.m_srcQpn = req.m_dstQpn;
+    ack.m_srcLid = ctx->m_lid;
+    ack.m_opcode = req.m_opcode;
+    ack.m_status = IBV_WC_SUCCESS;
+
+    auto it = ctx->m_qps.find(req.m_dstQpn);
+    SoftQP* qp = it != ctx->m_qps.end() ? it->second : nullptr;
+
+    if (qp == nullptr || qp->m_qp.state < IBV_QPS_RTR || qp->m_qp.state > IBV_QPS_SQD) {
+        // hardware drops requests to unknown QPs (e.g. destroyed by the
+        // remote) or QPs not able to receive, the requester runs out of retries
+        ack.m_status = IBV_WC_RETRY_EXC_ERR;
+    } else {
+        ibv_wc wc = {};
+        bool recvCompletion = false;
+
+        wc.status = IBV_WC_SUCCESS;
+        wc.byte_len = req.m_length;
+        wc.qp_num = qp->m_qp.qp_num;
+        wc.src_qp = req.m_srcQpn;
+        wc.slid = static_cast<uint16_t>(req.m_srcLid);
+
+        switch (req.m_opcode) {
+            case IBV_WR_SEND:
+            case IBV_WR_SEND_WITH_IMM: {
+                if (!HasRecvWr(qp)) {
+                    return false;
+                }
+
+                RecvWr wr = TakeRecvWr(qp);
+
+                wc.wr_id = wr.m_wrId;
+                wc.opcode = IBV_WC_RECV;
+
+                // no writes to buffers deregistered since posting (e.g. freed
+                // by a forced close)
+                bool registered = true;
+
+                for (auto& sge : wr.m_sgList) {
+                    if (!LookupRemoteMR(ctx, sge.lkey, sge.addr, sge.length, IBV_ACCESS_LOCAL_WRITE)) {
+                        registered = false;
+                        break;
+                    }
+                }
+
+                if (!registered) {
+                    wc.status = IBV_WC_LOC_PROT_ERR;
+                    ack.m_status = IBV_WC_REM_OP_ERR;
+                } else if (!Scatter(wr.m_sgList, incoming->m_payload.data(), req.m_length)) {
+                    wc.status = IBV_WC_LOC_LEN_ERR;
+                    ack.m_status = IBV_WC_REM_INV_REQ_ERR;
+                }
+
+                if (req.m_opcode == IBV_WR_SEND_WITH_IMM) {
+                    wc.wc_flags = IBV_WC_WITH_IMM;
+                    wc.imm_data = req.m_immData;
+                }
+
+                recvCompletion = true;
+                break;
+            }
+
+            case IBV_WR_RDMA_WRITE:
+            case IBV_WR_RDMA_WRITE_WITH_IMM: {
+                if (!LookupRemoteMR(ctx, req.m_rkey, req.m_remoteAddr, req.m_length, IBV_ACCESS_REMOTE_WRITE)) {
+                    ack.m_status = IBV_WC_REM_ACCESS_ERR;
+                    break;
+                }
+
+                // the receive is consumed with the data, check before placing it
+                if (req.m_opcode == IBV_WR_RDMA_WRITE_WITH_IMM && !HasRecvWr(qp)) {
+                    return false;
+                }
+
+                memcpy(reinterpret_cast<void*>(req.m_remoteAddr), incoming->m_payload.data(), req.m_length);
+
+                // data visible before the completion or any later write (e.g. a
+                // ring's tail polled by the application)
+                std::atomic_thread_fence(std::memory_order_release);
+
+                if (req.m_opcode == IBV_WR_RDMA_WRITE_WITH_IMM) {
+                    RecvWr wr = TakeRecvWr(qp);
+
+                    wc.wr_id = wr.m_wrId;
+                    wc.opcode = IBV_WC_RECV_RDMA_WITH_IMM;
+                    wc.wc_flags = IBV_WC_WITH_IMM;
+                    wc.imm_data = req.m_immData;
+                    recvCompletion = true;
+                }
+
+                break;
+            }
+
+            case IBV_WR_RDMA_READ: {
+                if (!LookupRemoteMR(ctx, req.m_rkey, req.m_remoteAddr, req.m_length, IBV_ACCESS_REMOTE_READ)) {
+                    ack.m_status = IBV_WC_REM_ACCESS_ERR;
+                    break;
+                }
+
+                ackPayload.resize(req.m_length);
+                memcpy(ackPayload.data(), reinterpret_cast<void*>(req.m_remoteAddr), req.m_length);
+                ack.m_length = req.m_length;
+                break;
+            }
+
+            default:
+                ack.m_status = IBV_WC_REM_INV_REQ_ERR;
+                break;
+        }
+
+        if (recvCompletion) {
+            PushWorkCompletion(qp->m_qp.recv_cq, wc);
+        }
+    }
+
+    iovec iov[2];
+    iov[0].iov_base = &ack;
+    iov[0].iov_len = sizeof(ack);
+    iov[1].iov_base = ackPayload.data();
+    iov[1].iov_len = ackPayload.size();
+
+    if (!WriteFull(incoming->m_fd, iov, ackPayload.empty() ? 1 : 2)) {
+        IBNET_LOG_ERROR("Sending acknowledgement to lid 0x%X failed: %s", req.m_srcLid, strerror(errno));
+    }
+
+    return true;
+}
+
+/**
+ * Move a QP to the error state. Like on hardware, all outstanding work
+ * requests are flushed (signaled or not). Called with the QP's lock held,
+ * push the completions of the flushed requests (PushSendCompletion) after
+ * releasing it
+ *
+ * @param qp QP to move to the error state
+ * @param flushed Returns the outstanding work requests flushed
+ */
+void SetErrorState(SoftQP* qp, std::deque<OutstandingWr>& flushed)
+{
+    qp->m_qp.state = IBV_QPS_ERR;
+
+    // transferred already, the remote acknowledges them anyway
+    qp->m_discardAcks += qp->m_outstanding.size();
+
+    flushed.swap(qp->m_outstanding);
+    qp->m_outstanding.clear();
+}
+
+/**
+ * Push the completion of a work request posted locally to the send CQ
+ */
+void PushSendCompletion(SoftQP* qp, const OutstandingWr& wr, ibv_wc_status status)
+{
+    ibv_wc wc = {};
+
+    wc.wr_id = wr.m_wrId;
+    wc.status = status;
+    wc.byte_len = wr.m_length;
+    wc.qp_num = qp->m_qp.qp_num;
+
+    switch (wr.m_opcode) {
+        case IBV_WR_RDMA_WRITE:
+        case IBV_WR_RDMA_WRITE_WITH_IMM:
+            wc.opcode = IBV_WC_RDMA_WRITE;
+            break;
+
+        case IBV_WR_RDMA_READ:
+            wc.opcode = IBV_WC_RDMA_READ;
+            break;
+
+        default:
+            wc.opcode = IBV_WC_SEND;
+            break;
+    }
+
+    PushWorkCompletion(qp->m_qp.send_cq, wc);
+}
+
+/**
+ * Process an acknowledgement of a work request posted locally. Called by the
+ * progress thread with the context lock held
+ */
+bool ProcessAck(SoftContext* ctx, Peer* peer)
+{
+    MsgHeader ack;
+    std::vector<uint8_t> payload;
+
+    if (!ReadFull(peer->m_fd, &ack, sizeof(ack))) {
+        return false;
+    }
+
+    if (ack.m_length > 0) {
+        payload.resize(ack.m_length);
+
+        if (!ReadFull(peer->m_fd, payload.data(), ack.m_length)) {
+            return false;
+        }
+    }
+
+    auto it = ctx->m_qps.find(ack.m_dstQpn);
+
+    // QP destroyed in the meantime
+    if (it == ctx->m_qps.end()) {
+        return true;
+    }
+
+    SoftQP* qp = it->second;
+    OutstandingWr wr;
+    auto status = static_cast<ibv_wc_status>(ack.m_status);
+    std::deque<OutstandingWr> flushed;
+
+    {
+        std::lock_guard<std::mutex> l(qp->m_lock);
+
+        // completed with a flush error already
+        if (qp->m_discardAcks > 0) {
+            qp->m_discardAcks--;
+            return true;
+        }
+
+        if (qp->m_outstanding.empty()) {
+            IBNET_LOG_ERROR("Acknowledgement for qp 0x%X without outstanding work request", ack.m_dstQpn);
+            return true;
+        }
+
+        wr = std::move(qp->m_outstanding.front());
+        qp->m_outstanding.pop_front();
+
+        // the data read is placed only if the local memory is still
+        // registered (e.g. not freed by a forced close)
+        if (wr.m_opcode == IBV_WR_RDMA_READ && status == IBV_WC_SUCCESS) {
+            for (auto& sge : wr.m_sgList) {
+                if (!LookupRemoteMR(ctx, sge.lkey, sge.addr, sge.length, IBV_ACCESS_LOCAL_WRITE)) {
+                    status = IBV_WC_LOC_PROT_ERR;
+                    break;
+                }
+            }
+        }
+
+        if (status != IBV_WC_SUCCESS) {
+            SetErrorState(qp, flushed);
+        }
+    }
+
+    if (wr.m_opcode == IBV_WR_RDMA_READ && status == IBV_WC_SUCCESS) {
+        Scatter(wr.m_sgList, payload.data(), ack.m_length);
+    }
+
+    if (wr.m_signaled || status != IBV_WC_SUCCESS) {
+        PushSendCompletion(qp, wr, status);
+    }
+
+    for (auto& it2 : flushed) {
+        PushSendCompletion(qp, it2, IBV_WC_WR_FLUSH_ERR);
+    }
+
+    return true;
+}
+
+/**
+ * Fail a QP on a lost stream. No acknowledgements arrive for the
+ * outstanding work requests anymore, i.e. like exceeding the transport
+ * retries on hardware: the first request fails with a retry error, the
+ * remaining ones are flushed
+ *
+ * @param qp QP to fail (QP lock not held)
+ */
+void FailTransport(SoftQP* qp)
+{
+    std::deque<OutstandingWr> flushed;
+
+    {
+        std::lock_guard<std::mutex> l(qp->m_lock);
+
+        SetErrorState(qp, flushed);
+
+        // lost with the stream
+        qp->m_discardAcks = 0;
+    }
+
+    if (flushed.empty()) {
+        return;
+    }
+
+    PushSendCompletion(qp, flushed.front(), IBV_WC_RETRY_EXC_ERR);
+
+    for (size_t i = 1; i < flushed.size(); i++) {
+        PushSendCompletion(qp, flushed[i], IBV_WC_WR_FLUSH_ERR);
+    }
+}
+
+/**
+ * Fail the QPs with work requests outstanding on a closed stream (see
+ * FailTransport). QPs without outstanding requests fail on their next
+ * post. Caller must hold the context lock
+ */
+void FailOutstanding(SoftContext* ctx, Peer* peer)
+{
+    for (auto& it : ctx->m_qps) {
+        SoftQP* qp = it.second;
+
+        {
+            std::lock_guard<std::mutex> l(qp->m_lock);
+
+            if (qp->m_peer != peer || qp->m_outstanding.empty()) {
+                continue;
+            }
+        }
+
+        FailTransport(qp);
+    }
+}
+
+bool ReadRequest(Incoming* incoming)
+{
+    if (!ReadFull(incoming->m_fd, &incoming->m_header, sizeof(MsgHeader))) {
+        return false;
+    }
+
+    // read requests don't carry any payload
+    if (incoming->m_header.m_opcode == IBV_WR_RDMA_READ) {
+        incoming->m_payload.clear();
+        return true;
+    }
+
+    incoming->m_payload.resize(incoming->m_header.m_length);
+
+    return ReadFull(incoming->m_fd, incoming->m_payload.data(), incoming->m_header.m_length);
+}
+
+void ProgressThread(SoftContext* ctx)
+{
+    enum Type
+    {
+        e_Wake,
+        e_Listen,
+        e_Incoming,
+        e_Peer
+    };
+
+    struct Ref
+    {
+        Type m_type;
+        void* m_ptr;
+    };
+
+    std::vector<pollfd> fds;
+    std::vector<Ref> refs;
+
+    while (ctx->m_run.load(std::memory_order_relaxed)) {
+        bool pending = false;
+
+        fds.clear();
+        refs.clear();
+
+        {
+            std::lock_guard<std::mutex> l(ctx->m_lock);
+
+            fds.push_back({ctx->m_wakeFd, POLLIN, 0});
+            refs.push_back({e_Wake, nullptr});
+            fds.push_back({ctx->m_listenFd, POLLIN, 0});
+            refs.push_back({e_Listen, nullptr});
+
+            for (auto& it : ctx->m_incoming) {
+                // keep order: don't read further requests until the pending one is executed
+                if (it->m_pending) {
+                    pending = true;
+                    continue;
+                }
+
+                fds.push_back({it->m_fd, POLLIN, 0});
+                refs.push_back({e_Incoming, it});
+            }
+
+            for (auto& it : ctx->m_peers) {
+                if (it.second->m_fd < 0) {
+                    continue;
+                }
+
+                fds.push_back({it.second->m_fd, POLLIN, 0});
+                refs.push_back({e_Peer, it.second});
+            }
+        }
+
+        int ret = poll(fds.data(), fds.size(), pending ? 1 : 100);
+
+        if (ret < 0 && errno != EINTR) {
+            IBNET_LOG_ERROR("Polling soft verbs streams failed: %s", strerror(errno));
+            continue;
+        }
+
+        std::lock_guard<std::mutex> l(ctx->m_lock);
+
+        // retry requests waiting for a receive to be posted
+        for (auto& it : ctx->m_incoming) {
+            if (it->m_pending && ExecuteRequest(ctx, it)) {
+                it->m_pending = false;
+            }
+        }
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            switch (refs[i].m_type) {
+                case e_Wake: {
+                    uint64_t val;
+
+                    if (read(ctx->m_wakeFd, &val, sizeof(val)) < 0) {
+                        IBNET_LOG_ERROR("Reading wake fd failed: %s", strerror(errno));
+                    }
+
+                    break;
+                }
+
+                case e_Listen: {
+                    int fd = accept(ctx->m_listenFd, nullptr, nullptr);
+
+                    if (fd < 0) {
+                        IBNET_LOG_ERROR("Accepting soft verbs stream failed: %s", strerror(errno));
+                        break;
+                    }
+
+                    SetSocketBufferSizes(fd);
+
+                    auto* incoming = new Incoming();
+                    incoming->m_fd = fd;
+                    incoming->m_pending = false;
+
+                    ctx->m_incoming.push_back(incoming);
+                    break;
+                }
+
+                case e_Incoming: {
+                    auto* incoming = static_cast<Incoming*>(refs[i].m_ptr);
+
+                    if (!ReadRequest(incoming)) {
+                        // remote context closed
+                        close(incoming->m_fd);
+
+                        for (auto it = ctx->m_incoming.begin(); it != ctx->m_incoming.end(); it++) {
+                            if (*it == incoming) {
+                                ctx->m_incoming.erase(it);
+                                break;
+                            }
+                        }
+
+                        delete incoming;
+                        break;
+                    }
+
+                    incoming->m_pending = !ExecuteRequest(ctx, incoming);
+                    break;
+                }
+
+                case e_Peer: {
+                    auto* peer = static_cast<Peer*>(refs[i].m_ptr);
+
+                    if (!ProcessAck(ctx, peer)) {
+                        IBNET_LOG_WARN("Stream to lid 0x%X closed", peer->m_lid);
+
+                        // still referenced by QPs, reconnected on the next
+                        // connection setup with the lid
+                        {
+                            std::lock_guard<std::mutex> ls(peer->m_sendLock);
+                            close(peer->m_fd);
+                            peer->m_fd = -1;
+                        }
+
+                        FailOutstanding(ctx, peer);
+                    }
+
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/**
+ * Get the stream to another context, connect if not connected, yet. Caller
+ * must hold the context lock
+ */
+Peer* GetPeer(SoftContext* ctx, uint16_t lid)
+{
+    auto it = ctx->m_peers.find(lid);
+
+    if (it != ctx->m_peers.end() && it->second->m_fd >= 0) {
+        return it->second;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    sockaddr_un addr;
+    socklen_t len = SocketAddress(lid, &addr);
+
+    SetSocketBufferSizes(fd);
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return nullptr;
+    }
+
+    Peer* peer;
+
+    if (it != ctx->m_peers.end()) {
+        peer = it->second;
+
+        std::lock_guard<std::mutex> l(peer->m_sendLock);
+        peer->m_fd = fd;
+    } else {
+        peer = new Peer();
+        peer->m_lid = lid;
+        peer->m_fd = fd;
+
+        ctx->m_peers[lid] = peer;
+    }
+
+    // add the new stream to the poll set
+    WakeProgressThread(ctx);
+
+    return peer;
+}
+
+int PollCQ(ibv_cq* cq, int numEntries, ibv_wc* wc)
+{
+    auto* softCq = reinterpret_cast<SoftCQ*>(cq);
+
+    std::lock_guard<std::mutex> l(softCq->m_lock);
+
+    int count = 0;
+
+    while (count < numEntries && !softCq->m_wcs.empty()) {
+        wc[count++] = softCq->m_wcs.front();
+        softCq->m_wcs.pop_front();
+    }
+
+    return count;
+}
+
+int ReqNotifyCQ(ibv_cq* cq, int solicitedOnly)
+{
+    auto* softCq = reinterpret_cast<SoftCQ*>(cq);
+
+    std::lock_guard<std::mutex> l(softCq->m_lock);
+
+    softCq->m_armed = true;
+
+    return 0;
+}
+
+int PostSend(ibv_qp* qp, ibv_send_wr* wr, ibv_send_wr** badWr)
+{
+    auto* softQp = reinterpret_cast<SoftQP*>(qp);
+
+    for (; wr != nullptr; wr = wr->next) {
+        if ((qp->state != IBV_QPS_RTS && qp->state != IBV_QPS_ERR) || softQp->m_peer == nullptr) {
+            *badWr = wr;
+            return EINVAL;
+        }
+
+        if (wr->opcode != IBV_WR_SEND && wr->opcode != IBV_WR_SEND_WITH_IMM && wr->opcode != IBV_WR_RDMA_WRITE &&
+                wr->opcode != IBV_WR_RDMA_WRITE_WITH_IMM && wr->opcode != IBV_WR_RDMA_READ) {
+            *badWr = wr;
+            return EINVAL;
+        }
+
+        if (static_cast<uint32_t>(wr->num_sge) > softQp->m_maxSendSge) {
+            *badWr = wr;
+            return EINVAL;
+        }
+
+        MsgHeader header = {};
+        iovec iov[1 + MAX_SGE];
+
+        header.m_type = e_MsgRequest;
+        header.m_dstQpn = softQp->m_remoteQpn;
+        header.m_srcQpn = qp->qp_num;
+        header.m_srcLid = ToSoft(qp->context)->m_lid;
+        header.m_opcode = wr->opcode;
+        header.m_immData = wr->imm_data;
+        header.m_status = IBV_WC_SUCCESS;
+        header.m_rkey = wr->wr.rdma.rkey;
+        header.m_remoteAddr = wr->wr.rdma.remote_addr;
+
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+
+        for (int i = 0; i < wr->num_sge; i++) {
+            header.m_length += wr->sg_list[i].length;
+            iov[i + 1].iov_base = reinterpret_cast<void*>(wr->sg_list[i].addr);
+            iov[i + 1].iov_len = wr->sg_list[i].length;
+        }
+
+        if ((wr->send_flags & IBV_SEND_INLINE) && header.m_length > softQp->m_maxInlineData) {
+            *badWr = wr;
+            return EINVAL;
+        }
+
+        OutstandingWr outstanding;
+        outstanding.m_wrId = wr->wr_id;
+        outstanding.m_opcode = wr->opcode;
+        outstanding.m_signaled = softQp->m_sigAll || (wr->send_flags & IBV_SEND_SIGNALED);
+        outstanding.m_length = header.m_length;
+
+        if (wr->opcode == IBV_WR_RDMA_READ) {
+            outstanding.m_sgList.assign(wr->sg_list, wr->sg_list + wr->num_sge);
+        }
+
+        // like on hardware, posting to a QP in the error state succeeds and
+        // the request is flushed right away
+        if (qp->state == IBV_QPS_ERR) {
+            PushSendCompletion(softQp, outstanding, IBV_WC_WR_FLUSH_ERR);
+            continue;
+        }
+
+        // keep the order of posting and transferring for multiple posting threads
+        std::lock_guard<std::mutex> l(softQp->m_peer->m_sendLock);
+
+        {
+            std::lock_guard<std::mutex> lq(softQp->m_lock);
+
+            if (softQp->m_outstanding.size() >= softQp->m_maxSendWr) {
+                *badWr = wr;
+                return ENOMEM;
+            }
+
+            // before transferring, the acknowledgement might arrive before this returns
+            softQp->m_outstanding.push_back(std::move(outstanding));
+        }
+
+        // the payload of a read is the data read remotely
+        bool success = WriteFull(softQp->m_peer->m_fd, iov,
+                wr->opcode == IBV_WR_RDMA_READ ? 1 : static_cast<size_t>(1 + wr->num_sge));
+
+        // stream closed (by the remote): the request is posted but fails
+        // with the outstanding ones, no error on posting like on hardware
+        if (!success) {
+            IBNET_LOG_ERROR("Transferring work request to lid 0x%X failed: %s", softQp->m_remoteLid,
+                    strerror(errno));
+
+            FailTransport(softQp);
+        }
+    }
+
+    return 0;
+}
+
+int PostRecv(ibv_qp* qp, ibv_recv_wr* wr, ibv_recv_wr** badWr)
+{
+    auto* softQp = reinterpret_cast<SoftQP*>(qp);
+
+    if (qp->srq != nullptr) {
+        *badWr = wr;
+        return EINVAL;
+    }
+
+    std::lock_guard<std::mutex> l(softQp->m_lock);
+
+    for (; wr != nullptr; wr = wr->next) {
+        if (softQp->m_recvWrs.size() >= softQp->m_maxRecvWr ||
+                static_cast<uint32_t>(wr->num_sge) > softQp->m_maxRecvSge) {
+            *badWr = wr;
+            return ENOMEM;
+        }
+
+        softQp->m_recvWrs.push_back({wr->wr_id, std::vector<ibv_sge>(wr->sg_list, wr->sg_list + wr->num_sge)});
+    }
+
+    return 0;
+}
+
+int PostSRQRecv(ibv_srq* srq, ibv_recv_wr* wr, ibv_recv_wr** badWr)
+{
+    auto* softSrq = reinterpret_cast<SoftSRQ*>(srq);
+
+    std::lock_guard<std::mutex> l(softSrq->m_lock);
+
+    for (; wr != nullptr; wr = wr->next) {
+        if (softSrq->m_wrs.size() >= softSrq->m_maxWr ||
+                static_cast<uint32_t>(wr->num_sge) > softSrq->m_maxSge) {
+            *badWr = wr;
+            return ENOMEM;
+        }
+
+        softSrq->m_wrs.push_back({wr->wr_id, std::vector<ibv_sge>(wr->sg_list, wr->sg_list + wr->num_sge)});
+    }
+
+    return 0;
+}
+
+}
+
+ibv_context* IbSoftVerbs::OpenDevice()
+{
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listenFd < 0) {
+        return nullptr;
+    }
+
+    // first free lid on this host
+    uint16_t lid = LID_MIN;
+
+    for (; lid <= LID_MAX; lid++) {
+        sockaddr_un addr;
+        socklen_t len = SocketAddress(lid, &addr);
+
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), len) == 0) {
+            break;
+        }
+    }
+
+    if (lid > LID_MAX || listen(listenFd, 128) != 0) {
+        close(listenFd);
+        errno = EADDRINUSE;
+        return nullptr;
+    }
+
+    auto* ctx = new SoftContext();
+
+    ctx->m_ctx.device = &ctx->m_device;
+    ctx->m_ctx.ops.poll_cq = PollCQ;
+    ctx->m_ctx.ops.req_notify_cq = ReqNotifyCQ;
+    ctx->m_ctx.ops.post_send = PostSend;
+    ctx->m_ctx.ops.post_recv = PostRecv;
+    ctx->m_ctx.ops.post_srq_recv = PostSRQRecv;
+    ctx->m_ctx.cmd_fd = -1;
+    ctx->m_ctx.async_fd = -1;
+    ctx->m_ctx.num_comp_vectors = 1;
+
+    snprintf(ctx->m_device.name, sizeof(ctx->m_device.name), "soft%d", lid);
+    snprintf(ctx->m_device.dev_name, sizeof(ctx->m_device.dev_name), "soft%d", lid);
+    ctx->m_device.node_type = IBV_NODE_CA;
+    ctx->m_device.transport_type = IBV_TRANSPORT_IB;
+
+    ctx->m_lid = lid;
+    ctx->m_listenFd = listenFd;
+    ctx->m_wakeFd = eventfd(0, EFD_CLOEXEC);
+    ctx->m_run.store(true);
+    ctx->m_nextQpn = 0x100;
+    ctx->m_nextKey = 1;
+    ctx->m_nextHandle = 1;
+
+    ctx->m_progressThread = std::thread(ProgressThread, ctx);
+
+    IBNET_LOG_INFO("Opened soft verbs device %s, lid 0x%X", ctx->m_device.name, lid);
+
+    return &ctx->m_ctx;
+}
+
+int IbSoftVerbs::CloseDevice(ibv_context* ctx)
+{
+    SoftContext* softCtx = ToSoft(ctx);
+
+    softCtx->m_run.store(false);
+    WakeProgressThread(softCtx);
+    softCtx->m_progressThread.join();
+
+    close(softCtx->m_listenFd);
+    close(softCtx->m_wakeFd);
+
+    for (auto& it : softCtx->m_incoming) {
+        close(it->m_fd);
+        delete it;
+    }
+
+    for (auto& it : softCtx->m_peers) {
+        if (it.second->m_fd >= 0) {
+            close(it.second->m_fd);
+        }
+
+        delete it.second;
+    }
+
+    delete softCtx;
+
+    return 0;
+}
+
+bool IbSoftVerbs::IsSoftContext(const ibv_context* ctx)
+{
+    return ctx->ops.poll_cq == PollCQ;
+}
+
+uint64_t IbSoftVerbs::GetGuid(const ibv_context* ctx)
+{
+    return GUID_PREFIX | reinterpret_cast<const SoftContext*>(ctx)->m_lid;
+}
+
+int IbSoftVerbs::QueryDevice(ibv_context* ctx, ibv_device_attr* attr)
+{
+    memset(attr, 0, sizeof(ibv_device_attr));
+
+    snprintf(attr->fw_ver, sizeof(attr->fw_ver), "ibnet-soft");
+    attr->node_guid = GetGuid(ctx);
+    attr->sys_image_guid = attr->node_guid;
+    attr->max_mr_size = UINT64_MAX;
+    attr->page_size_cap = static_cast<uint64_t>(getpagesize());
+    attr->max_qp = 65536;
+    attr->max_qp_wr = MAX_QP_WR;
+    attr->max_sge = MAX_SGE;
+    attr->max_sge_rd = MAX_SGE;
+    attr->max_cq = 65536;
+    attr->max_cqe = MAX_CQE;
+    attr->max_mr = 1 << 20;
+    attr->max_pd = 1024;
+    attr->max_qp_rd_atom = 16;
+    attr->max_res_rd_atom = 16 * 65536;
+    attr->max_qp_init_rd_atom = 16;
+    attr->max_srq = 1024;
+    attr->max_srq_wr = MAX_SRQ_WR;
+    attr->max_srq_sge = MAX_SGE;
+    attr->max_pkeys = 1;
+    attr->phys_port_cnt = 1;
+
+    return 0;
+}
+
+int IbSoftVerbs::QueryPort(ibv_context* ctx, uint8_t portNum, ibv_port_attr* attr)
+{
+    if (portNum != 1) {
+        return EINVAL;
+    }
+
+    memset(attr, 0, sizeof(ibv_port_attr));
+
+    attr->state = IBV_PORT_ACTIVE;
+    attr->max_mtu = IBV_MTU_4096;
+    attr->active_mtu = IBV_MTU_4096;
+    attr->gid_tbl_len = 1;
+    attr->max_msg_sz = 0x80000000;
+    attr->pkey_tbl_len = 1;
+    attr->lid = ToSoft(ctx)->m_lid;
+    attr->sm_lid = 1;
+    // 4X, 25 gbps, LinkUp
+    attr->active_width = 2;
+    attr->active_speed = 32;
+    attr->phys_state = 5;
+    attr->link_layer = IBV_LINK_LAYER_INFINIBAND;
+
+    return 0;
+}
+
+ibv_pd* IbSoftVerbs::AllocPD(ibv_context* ctx)
+{
+    SoftContext* softCtx = ToSoft(ctx);
+
+    auto* pd = new ibv_pd();
+    pd->context = ctx;
+
+    std::lock_guard<std::mutex> l(softCtx->m_lock);
+    pd->handle = softCtx->m_nextHandle++;
+
+    return pd;
+}
+
+int IbSoftVerbs::DeallocPD(ibv_pd* pd)
+{
+    delete pd;
+    return 0;
+}
+
+ibv_mr* IbSoftVerbs::RegMR(ibv_pd* pd, void* addr, size_t length, int access)
+{
+    SoftContext* softCtx = ToSoft(pd->context);
+
+    auto* mr = new SoftMR();
+    mr->m_mr.context = pd->context;
+    mr->m_mr.pd = pd;
+    mr->m_mr.addr = addr;
+    mr->m_mr.length = length;
+    mr->m_access = access;
+
+    std::lock_guard<std::mutex> l(softCtx->m_lock);
+
+    mr->m_mr.handle = softCtx->m_nextHandle++;
+    mr->m_mr.lkey = softCtx->m_nextKey++;
+    mr->m_mr.rkey = mr->m_mr.lkey;
+
+    softCtx->m_mrs[mr->m_mr.rkey] = mr;
+
+    return &mr->m_mr;
+}
+
+int IbSoftVerbs::DeregMR(ibv_mr* mr)
+{
+    SoftContext* softCtx = ToSoft(mr->context);
+
+    std::lock_guard<std::mutex> l(softCtx->m_lock);
+
+    if (softCtx->m_mrs.erase(mr->rkey) == 0) {
+        return EINVAL;
+    }
+
+    delete reinterpret_cast<SoftMR*>(mr);
+
+    return 0;
+}
+
+ibv_comp_channel* IbSoftVerbs::CreateCompChannel(ibv_context* ctx)
+{
+    // semaphore: one read per event, see GetCQEvent
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE);
+
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    auto* channel = new SoftCompChannel();
+    channel->m_channel.context = ctx;
+    channel->m_channel.fd = fd;
+
+    return &channel->m_channel;
+}
+
+int IbSoftVerbs::DestroyCompChannel(ibv_comp_channel* channel)
+{
+    close(channel->fd);
+    delete reinterpret_cast<SoftCompChannel*>(channel);
+
+    return 0;
+}
+
+ibv_cq* IbSoftVerbs::CreateCQ(ibv_context* ctx, int cqe, void* cqContext, ibv_comp_channel* channel,
+        int compVector)
+{
+    if (cqe < 1 || cqe > MAX_CQE) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    auto* cq = new SoftCQ();
+    cq->m_cq.context = ctx;
+    cq->m_cq.channel = channel;
+    cq->m_cq.cq_context = cqContext;
+    cq->m_cq.cqe = cqe;
+    cq->m_armed = false;
+
+    return &cq->m_cq;
+}
+
+int IbSoftVerbs::DestroyCQ(ibv_cq* cq)
+{
+    delete reinterpret_cast<SoftCQ*>(cq);
+    return 0;
+}
+
+int IbSoftVerbs::GetCQEvent(ibv_comp_channel* channel, ibv_cq** cq, void** cqContext)
+{
+    auto* softChannel = reinterpret_cast<SoftCompChannel*>(channel);
+    uint64_t val;
+
+    // blocks or fails with EAGAIN depending on the fd's flags
+    if (read(channel->fd, &val, sizeof(val)) < 0) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> l(softChannel->m_lock);
+
+    *cq = softChannel->m_events.front();
+    *cqContext = (*cq)->cq_context;
+    softChannel->m_events.pop_front();
+
+    return 0;
+}
+
+void IbSoftVerbs::AckCQEvents(ibv_cq* cq, unsigned int numEvents)
+{
+    // nothing to do, events are not counted
+}
+
+ibv_srq* IbSoftVerbs::CreateSRQ(ibv_pd* pd, ibv_srq_init_attr* attr)
+{
+    if (attr->attr.max_wr > MAX_SRQ_WR || attr->attr.max_sge > MAX_SGE) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    auto* srq = new SoftSRQ();
+    srq->m_srq.context = pd->context;
+    srq->m_srq.srq_context = attr->srq_context;
+    srq->m_srq.pd = pd;
+    srq->m_maxWr = attr->attr.max_wr;
+    srq->m_maxSge = attr->attr.max_sge;
+
+    return &srq->m_srq;
+}
+
+int IbSoftVerbs::DestroySRQ(ibv_srq* srq)
+{
+    SoftContext* softCtx = ToSoft(srq->context);
+
+    {
+        std::lock_guard<std::mutex> l(softCtx->m_lock);
+
+        // like hardware, refuse while QPs are still attached
+        for (auto& qp : softCtx->m_qps) {
+            if (qp.second->m_qp.srq == srq) {
+                return EBUSY;
+            }
+        }
+    }
+
+    delete reinterpret_cast<SoftSRQ*>(srq);
+    return 0;
+}
+
+ibv_qp* IbSoftVerbs::CreateQP(ibv_pd* pd, ibv_qp_init_attr* attr)
+{
+    SoftContext* softCtx = ToSoft(pd->context);
+
+    if (attr->qp_type != IBV_QPT_RC) {
+        errno = EOPNOTSUPP;
+        return nullptr;
+    }
+
+    if (attr->cap.max_send_wr > MAX_QP_WR || attr->cap.max_recv_wr > MAX_QP_WR ||
+            attr->cap.max_send_sge > MAX_SGE || attr->cap.max_recv_sge > MAX_SGE ||
+            attr->cap.max_inline_data > MAX_INLINE_DATA) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    auto* qp = new SoftQP();
+    qp->m_qp.context = pd->context;
+    qp->m_qp.qp_context = attr->qp_context;
+    qp->m_qp.pd = pd;
+    qp->m_qp.send_cq = attr->send_cq;
+    qp->m_qp.recv_cq = attr->recv_cq;
+    qp->m_qp.srq = attr->srq;
+    qp->m_qp.state = IBV_QPS_RESET;
+    qp->m_qp.qp_type = attr->qp_type;
+    qp->m_maxSendWr = attr->cap.max_send_wr;
+    qp->m_maxRecvWr = attr->cap.max_recv_wr;
+    qp->m_maxSendSge = attr->cap.max_send_sge;
+    qp->m_maxRecvSge = attr->cap.max_recv_sge;
+    qp->m_maxInlineData = attr->cap.max_inline_data;
+    qp->m_sigAll = attr->sq_sig_all != 0;
+    qp->m_remoteLid = 0;
+    qp->m_remoteQpn = 0;
+    qp->m_peer = nullptr;
+    qp->m_discardAcks = 0;
+
+    std::lock_guard<std::mutex> l(softCtx->m_lock);
+
+    qp->m_qp.handle = softCtx->m_nextHandle++;
+    qp->m_qp.qp_num = softCtx->m_nextQpn++ & 0xFFFFFF;
+
+    softCtx->m_qps[qp->m_qp.qp_num] = qp;
+
+    return &qp->m_qp;
+}
+
+int IbSoftVerbs::ModifyQP(ibv_qp* qp, ibv_qp_attr* attr, int attrMask)
+{
+    SoftContext* softCtx = ToSoft(qp->context);
+    auto* softQp = reinterpret_cast<SoftQP*>(qp);
+
+    std::lock_guard<std::mutex> l(softCtx->m_lock);
+
+    if (attrMask & IBV_QP_AV) {
+        softQp->m_remoteLid = attr->ah_attr.dlid;
+    }
+
+    if (attrMask & IBV_QP_DEST_QPN) {
+        softQp->m_remoteQpn = attr->dest_qp_num;
+    }
+
+    if (attrMask & IBV_QP_STATE) {
+        if (attr->qp_state == IBV_QPS_RTR) {
+            Peer* peer = GetPeer(softCtx, softQp->m_remoteLid);
+
+            if (peer == nullptr) {
+                IBNET_LOG_ERROR("Connecting to soft verbs device with lid 0x%X failed: %s", softQp->m_remoteLid,
+                        strerror(errno));
+                return errno;
+            }
+
+            softQp->m_peer = peer;
+        }
+
+        std::deque<OutstandingWr> flushed;
+
+        {
+            std::lock_guard<std::mutex> lq(softQp->m_lock);
+
+            if (attr->qp_state == IBV_QPS_ERR) {
+                SetErrorState(softQp, flushed);
+            } else {
+                qp->state = attr->qp_state;
+            }
+        }
+
+        for (auto& it : flushed) {
+            PushSendCompletion(softQp, it, IBV_WC_WR_FLUSH_ERR);
+        }
+    }
+
+    return 0;
+}
+
+int IbSoftVerbs::DestroyQP(ibv_qp* qp)
+{
+    SoftContext* softCtx = ToSoft(qp->context);
+
+    {
+        std::lock_guard<std::mutex> l(softCtx->m_lock);
+        softCtx->m_qps.erase(qp->qp_num);
+    }
+
+    delete reinterpret_cast<SoftQP*>(qp);
+
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_CORE_IBSOFTVERBS_H
+#define IBNET_CORE_IBSOFTVERBS_H
+
+#include <infiniband/verbs.h>
+
+namespace ibnet {
+namespace core {
+
+/**
+ * Software emulation of the subset of verbs used by ibnet (PD, MR, CQ with
+ * completion channels, SRQ, RC QP with SEND(_WITH_IMM), RDMA_WRITE(_WITH_IMM)
+ * and RDMA_READ). Allows running the full stack (e.g. msgrc) without an HCA,
+ * e.g. for regression tests and benchmarks of the dispatchers on CI machines
+ * or multiple processes on a single host as a local cluster stand-in.
+ *
+ * Each opened context is assigned a LID unique on the host and listens on
+ * an abstract unix domain socket named after it. A QP transitioning to RTR
+ * connects to the remote's context (one stream per pair of contexts). Work
+ * requests are transferred over the stream and executed by a progress thread
+ * of the remote context which places the data, generates receive completions
+ * and acknowledges the work request. Send completions are generated on
+ * acknowledgement, i.e. in order and once the data is placed remotely as on
+ * a real RC QP. A SEND with no receive posted is retried (like RNR retry
+ * with infinite retry count).
+ *
+ * The data path calls are installed as ops of the context, i.e. the inline
+ * ibv_post_send, ibv_post_srq_recv, ibv_poll_cq and ibv_req_notify_cq work
+ * as is. Control path calls must be routed through IbVerbs. Single host only.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 17.10.2018
+ */
+class IbSoftVerbs
+{
+public:
+    /**
+     * Open a new emulated device (context). Starts the progress thread
+     *
+     * @return Context of the device, nullptr on error (errno set)
+     */
+    static ibv_context* OpenDevice();
+
+    /**
+     * Close a context opened with OpenDevice
+     */
+    static int CloseDevice(ibv_context* ctx);
+
+    /**
+     * Check if a context is an emulated one
+     */
+    static bool IsSoftContext(const ibv_context* ctx);
+
+    /**
+     * Get the GUID of an emulated device
+     */
+    static uint64_t GetGuid(const ibv_context* ctx);
+
+    static int QueryDevice(ibv_context* ctx, ibv_device_attr* attr);
+
+    static int QueryPort(ibv_context* ctx, uint8_t portNum, ibv_port_attr* attr);
+
+    static ibv_pd* AllocPD(ibv_context* ctx);
+
+    static int DeallocPD(ibv_pd* pd);
+
+    static ibv_mr* RegMR(ibv_pd* pd, void* addr, size_t length, int access);
+
+    static int DeregMR(ibv_mr* mr);
+
+    static ibv_comp_channel* CreateCompChannel(ibv_context* ctx);
+
+    static int DestroyCompChannel(ibv_comp_channel* channel);
+
+    static ibv_cq* CreateCQ(ibv_context* ctx, int cqe, void* cqContext, ibv_comp_channel* channel,
+            int compVector);
+
+    static int DestroyCQ(ibv_cq* cq);
+
+    static int GetCQEvent(ibv_comp_channel* channel, ibv_cq** cq, void** cqContext);
+
+    static void AckCQEvents(ibv_cq* cq, unsigned int numEvents);
+
+    static ibv_srq* CreateSRQ(ibv_pd* pd, ibv_srq_init_attr* attr);
+
+    static int DestroySRQ(ibv_srq* srq);
+
+    static ibv_qp* CreateQP(ibv_pd* pd, ibv_qp_init_attr* attr);
+
+    static int ModifyQP(ibv_qp* qp, ibv_qp_attr* attr, int attrMask);
+
+    static int DestroyQP(ibv_qp* qp);
+
+private:
+    IbSoftVerbs() = default;
+
+    ~IbSoftVerbs() = default;
+};
+
+}
+}
+
+#endif // IBNET_CORE_IBSOFTVERBS_H
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbVerbs.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "IbException.h"
+#include "IbSoftVerbs.h"
+
+namespace ibnet {
+namespace core {
+
+IbVerbs::Backend IbVerbs::GetBackend()
+{
+    const char* env = getenv("IBNET_VERBS_BACKEND");
+
+    if (env == nullptr || !strcmp(env, "hw")) {
+        return e_BackendHardware;
+    }
+
+    if (!strcmp(env, "soft")) {
+        return e_BackendSoft;
+    }
+
+    throw IbException("Invalid verbs backend IBNET_VERBS_BACKEND=%s, valid: hw, soft", env);
+}
+
+int IbVerbs::CloseDevice(ibv_context* ctx)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::CloseDevice(ctx);
+    }
+
+    return ibv_close_device(ctx);
+}
+
+int IbVerbs::QueryDevice(ibv_context* ctx, ibv_device_attr* attr)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::QueryDevice(ctx, attr);
+    }
+
+    return ibv_query_device(ctx, attr);
+}
+
+int IbVerbs::QueryPort(ibv_context* ctx, uint8_t portNum, ibv_port_attr* attr)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::QueryPort(ctx, portNum, attr);
+    }
+
+    return ibv_query_port(ctx, portNum, attr);
+}
+
+ibv_pd* IbVerbs::AllocPD(ibv_context* ctx)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::AllocPD(ctx);
+    }
+
+    return ibv_alloc_pd(ctx);
+}
+
+int IbVerbs::DeallocPD(ibv_pd* pd)
+{
+    if (IbSoftVerbs::IsSoftContext(pd->context)) {
+        return IbSoftVerbs::DeallocPD(pd);
+    }
+
+    return ibv_dealloc_pd(pd);
+}
+
+ibv_mr* IbVerbs::RegMR(ibv_pd* pd, void* addr, size_t length, int access)
+{
+    if (IbSoftVerbs::IsSoftContext(pd->context)) {
+        return IbSoftVerbs::RegMR(pd, addr, length, access);
+    }
+
+    return ibv_reg_mr(pd, addr, length, access);
+}
+
+int IbVerbs::DeregMR(ibv_mr* mr)
+{
+    if (IbSoftVerbs::IsSoftContext(mr->context)) {
+        return IbSoftVerbs::DeregMR(mr);
+    }
+
+    return ibv_dereg_mr(mr);
+}
+
+ibv_comp_channel* IbVerbs::CreateCompChannel(ibv_context* ctx)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::CreateCompChannel(ctx);
+    }
+
+    return ibv_create_comp_channel(ctx);
+}
+
+int IbVerbs::DestroyCompChannel(ibv_comp_channel* channel)
+{
+    if (IbSoftVerbs::IsSoftContext(channel->context)) {
+        return IbSoftVerbs::DestroyCompChannel(channel);
+    }
+
+    return ibv_destroy_comp_channel(channel);
+}
+
+ibv_cq* IbVerbs::CreateCQ(ibv_context* ctx, int cqe, void* cqContext, ibv_comp_channel* channel,
+        int compVector)
+{
+    if (IbSoftVerbs::IsSoftContext(ctx)) {
+        return IbSoftVerbs::CreateCQ(ctx, cqe, cqContext, channel, compVector);
+    }
+
+    return ibv_create_cq(ctx, cqe, cqContext, channel, compVector);
+}
+
+int IbVerbs::DestroyCQ(ibv_cq* cq)
+{
+    if (IbSoftVerbs::IsSoftContext(cq->context)) {
+        return IbSoftVerbs::DestroyCQ(cq);
+    }
+
+    return ibv_destroy_cq(cq);
+}
+
+int IbVerbs::GetCQEvent(ibv_comp_channel* channel, ibv_cq** cq, void** cqContext)
+{
+    if (IbSoftVerbs::IsSoftContext(channel->context)) {
+        return IbSoftVerbs::GetCQEvent(channel, cq, cqContext);
+    }
+
+    return ibv_get_cq_event(channel, cq, cqContext);
+}
+
+void IbVerbs::AckCQEvents(ibv_cq* cq, unsigned int numEvents)
+{
+    if (IbSoftVerbs::IsSoftContext(cq->context)) {
+        IbSoftVerbs::AckCQEvents(cq, numEvents);
+        return;
+    }
+
+    ibv_ack_cq_events(cq, numEvents);
+}
+
+ibv_srq* IbVerbs::CreateSRQ(ibv_pd* pd, ibv_srq_init_attr* attr)
+{
+    if (IbSoftVerbs::IsSoftContext(pd->context)) {
+        return IbSoftVerbs::CreateSRQ(pd, attr);
+    }
+
+    return ibv_create_srq(pd, attr);
+}
+
+int IbVerbs::DestroySRQ(ibv_srq* srq)
+{
+    if (IbSoftVerbs::IsSoftContext(srq->context)) {
+        return IbSoftVerbs::DestroySRQ(srq);
+    }
+
+    return ibv_destroy_srq(srq);
+}
+
+ibv_qp* IbVerbs::CreateQP(ibv_pd* pd, ibv_qp_init_attr* attr)
+{
+    if (IbSoftVerbs::IsSoftContext(pd->context)) {
+        return IbSoftVerbs::CreateQP(pd, attr);
+    }
+
+    return ibv_create_qp(pd, attr);
+}
+
+int IbVerbs::ModifyQP(ibv_qp* qp, ibv_qp_attr* attr, int attrMask)
+{
+    if (IbSoftVerbs::IsSoftContext(qp->context)) {
+        return IbSoftVerbs::ModifyQP(qp, attr, attrMask);
+    }
+
+    return ibv_modify_qp(qp, attr, attrMask);
+}
+
+int IbVerbs::DestroyQP(ibv_qp* qp)
+{
+    if (IbSoftVerbs::IsSoftContext(qp->context)) {
+        return IbSoftVerbs::DestroyQP(qp);
+    }
+
+    return ibv_destroy_qp(qp);
+}
+
+}
+}
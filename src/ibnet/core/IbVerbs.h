@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_CORE_IBVERBS_H
+#define IBNET_CORE_IBVERBS_H
+
+#include <infiniband/verbs.h>
+
+namespace ibnet {
+namespace core {
+
+/**
+ * Pluggable backend for the (control path) verbs used by ibnet. Each call
+ * is dispatched either to libibverbs (hardware) or to the software
+ * emulation (IbSoftVerbs) depending on the context the object was created
+ * on. The data path calls (ibv_post_send, ibv_post_srq_recv, ibv_poll_cq,
+ * ibv_req_notify_cq) are dispatched by libibverbs itself using the ops of
+ * the context and can be called directly without any overhead.
+ *
+ * The backend is selected on device open (see IbDevice) using the
+ * environment variable IBNET_VERBS_BACKEND ("hw", default, or "soft").
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 17.10.2018
+ */
+class IbVerbs
+{
+public:
+    /**
+     * Available verbs backends
+     */
+    enum Backend
+    {
+        e_BackendHardware = 0,
+        e_BackendSoft = 1,
+    };
+
+    /**
+     * Get the backend selected by the environment (IBNET_VERBS_BACKEND)
+     */
+    static Backend GetBackend();
+
+    /**
+     * Close a device opened using either backend
+     */
+    static int CloseDevice(ibv_context* ctx);
+
+    /**
+     * ibv_query_device
+     */
+    static int QueryDevice(ibv_context* ctx, ibv_device_attr* attr);
+
+    /**
+     * ibv_query_port
+     */
+    static int QueryPort(ibv_context* ctx, uint8_t portNum, ibv_port_attr* attr);
+
+    /**
+     * ibv_alloc_pd
+     */
+    static ibv_pd* AllocPD(ibv_context* ctx);
+
+    /**
+     * ibv_dealloc_pd
+     */
+    static int DeallocPD(ibv_pd* pd);
+
+    /**
+     * ibv_reg_mr
+     */
+    static ibv_mr* RegMR(ibv_pd* pd, void* addr, size_t length, int access);
+
+    /**
+     * ibv_dereg_mr
+     */
+    static int DeregMR(ibv_mr* mr);
+
+    /**
+     * ibv_create_comp_channel
+     */
+    static ibv_comp_channel* CreateCompChannel(ibv_context* ctx);
+
+    /**
+     * ibv_destroy_comp_channel
+     */
+    static int DestroyCompChannel(ibv_comp_channel* channel);
+
+    /**
+     * ibv_create_cq
+     */
+    static ibv_cq* CreateCQ(ibv_context* ctx, int cqe, void* cqContext, ibv_comp_channel* channel,
+            int compVector);
+
+    /**
+     * ibv_destroy_cq
+     */
+    static int DestroyCQ(ibv_cq* cq);
+
+    /**
+     * ibv_get_cq_event
+     */
+    static int GetCQEvent(ibv_comp_channel* channel, ibv_cq** cq, void** cqContext);
+
+    /**
+     * ibv_ack_cq_events
+     */
+    static void AckCQEvents(ibv_cq* cq, unsigned int numEvents);
+
+    /**
+     * ibv_create_srq
+     */
+    static ibv_srq* CreateSRQ(ibv_pd* pd, ibv_srq_init_attr* attr);
+
+    /**
+     * ibv_destroy_srq
+     */
+    static int DestroySRQ(ibv_srq* srq);
+
+    /**
+     * ibv_create_qp
+     */
+    static ibv_qp* CreateQP(ibv_pd* pd, ibv_qp_init_attr* attr);
+
+    /**
+     * ibv_modify_qp
+     */
+    static int ModifyQP(ibv_qp* qp, ibv_qp_attr* attr, int attrMask);
+
+    /**
+     * ibv_destroy_qp
+     */
+    static int DestroyQP(ibv_qp* qp);
+
+private:
+    IbVerbs() = default;
+
+    ~IbVerbs() = default;
+};
+
+}
+}
+
+#endif // IBNET_CORE_IBVERBS_H
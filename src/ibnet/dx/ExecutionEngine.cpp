@@ -18,17 +18,23 @@
 
 #include "ExecutionEngine.h"
 
+#include <cerrno>
+#include <cstring>
+
 #include "ibnet/sys/IllegalStateException.h"
 
+// max time to block, e.g. to allow stopping the worker
+#define IDLE_WAIT_TIMEOUT_MS 100
+
 namespace ibnet {
 namespace dx {
 
-ExecutionEngine::ExecutionEngine(uint16_t threadCount,
+ExecutionEngine::ExecutionEngine(uint16_t threadCount, uint32_t idleBlockSpinTimeUs,
         stats::StatisticsManager* refStatisticsManager) :
         m_refStatisticsManager(refStatisticsManager)
 {
     for (uint16_t i = 0; i < threadCount; i++) {
-        m_workers.push_back(new Worker(i, refStatisticsManager));
+        m_workers.push_back(new Worker(i, idleBlockSpinTimeUs, refStatisticsManager));
     }
 }
 
@@ -82,17 +88,21 @@ void ExecutionEngine::Stop()
     IBNET_LOG_DEBUG("Execution engine stopped");
 }
 
-ExecutionEngine::Worker::Worker(uint16_t id,
+ExecutionEngine::Worker::Worker(uint16_t id, uint32_t idleBlockSpinTimeUs,
         stats::StatisticsManager* refStatisticsManager) :
         ThreadLoop("ExecutionEngineWorker-" + std::to_string(id)),
         m_id(id),
+        m_idleBlockSpinTimeUs(idleBlockSpinTimeUs),
         m_refStatisticsManager(refStatisticsManager),
         m_executionUnits(),
         m_idleTimer(),
+        m_idleWaitFds(),
+        m_idleWaitPollFds(),
         m_idleCounter(new stats::Unit("EE-Worker-" + std::to_string(id), "Idle")),
         m_activeCounter(new stats::Unit("EE-Worker-" + std::to_string(id), "Active")),
         m_yieldCounter(new stats::Unit("EE-Worker-" + std::to_string(id), "Yield")),
         m_sleepCounter(new stats::Unit("EE-Worker-" + std::to_string(id), "Sleep")),
+        m_blockCounter(new stats::Unit("EE-Worker-" + std::to_string(id), "Block")),
         m_activityRatio(new stats::Ratio("EE-Worker-" + std::to_string(id), "ActivityRatio", m_activeCounter,
                 m_idleCounter))
 {
@@ -100,6 +110,7 @@ ExecutionEngine::Worker::Worker(uint16_t id,
     m_refStatisticsManager->Register(m_activeCounter);
     m_refStatisticsManager->Register(m_yieldCounter);
     m_refStatisticsManager->Register(m_sleepCounter);
+    m_refStatisticsManager->Register(m_blockCounter);
     m_refStatisticsManager->Register(m_activityRatio);
 }
 
@@ -109,12 +120,14 @@ ExecutionEngine::Worker::~Worker()
     m_refStatisticsManager->Deregister(m_activeCounter);
     m_refStatisticsManager->Deregister(m_yieldCounter);
     m_refStatisticsManager->Deregister(m_sleepCounter);
+    m_refStatisticsManager->Deregister(m_blockCounter);
     m_refStatisticsManager->Deregister(m_activityRatio);
 
     delete m_idleCounter;
     delete m_activeCounter;
     delete m_yieldCounter;
     delete m_sleepCounter;
+    delete m_blockCounter;
     delete m_activityRatio;
 }
 
@@ -154,7 +167,10 @@ void ExecutionEngine::Worker::_RunLoop()
             m_idleTimer.Start();
         }
 
-        if (m_idleTimer.GetTimeMs() > 1000.0) {
+        if (m_idleBlockSpinTimeUs > 0 && m_idleTimer.GetTimeUs() > m_idleBlockSpinTimeUs && __IdleWait()) {
+            // back to busy polling after wakeup
+            m_idleTimer.Stop();
+        } else if (m_idleTimer.GetTimeMs() > 1000.0) {
             m_sleepCounter->Inc();
             std::this_thread::sleep_for(std::chrono::nanoseconds(1));
         } else if (m_idleTimer.GetTimeMs() > 500.0) {
@@ -170,5 +186,52 @@ void ExecutionEngine::Worker::_RunLoop()
     }
 }
 
+bool ExecutionEngine::Worker::__IdleWait()
+{
+    bool block = true;
+
+    m_idleWaitFds.clear();
+
+    for (auto& it : m_executionUnits) {
+        if (!it->PrepareIdleWait(m_idleWaitFds)) {
+            block = false;
+            break;
+        }
+    }
+
+    // work arriving before the units were prepared does not trigger any
+    // events on the fds
+    if (block) {
+        for (auto& it : m_executionUnits) {
+            if (it->Dispatch()) {
+                block = false;
+            }
+        }
+    }
+
+    if (block) {
+        m_idleWaitPollFds.resize(m_idleWaitFds.size());
+
+        for (size_t i = 0; i < m_idleWaitFds.size(); i++) {
+            m_idleWaitPollFds[i].fd = m_idleWaitFds[i];
+            m_idleWaitPollFds[i].events = POLLIN;
+            m_idleWaitPollFds[i].revents = 0;
+        }
+
+        m_blockCounter->Inc();
+
+        if (poll(m_idleWaitPollFds.data(), m_idleWaitPollFds.size(), IDLE_WAIT_TIMEOUT_MS) < 0 &&
+                errno != EINTR) {
+            IBNET_LOG_ERROR("Worker %d, polling idle wait fds failed: %s", m_id, strerror(errno));
+        }
+    }
+
+    for (auto& it : m_executionUnits) {
+        it->IdleWaitDone();
+    }
+
+    return block;
+}
+
 }
 }
\ No newline at end of file
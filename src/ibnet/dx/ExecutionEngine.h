@@ -19,6 +19,8 @@
 #ifndef IBNET_DX_EXECUTIONENGINE_H
 #define IBNET_DX_EXECUTIONENGINE_H
 
+#include <poll.h>
+
 #include "ibnet/sys/ThreadLoop.h"
 #include "ibnet/sys/Timer.hpp"
 
@@ -46,9 +48,12 @@ public:
      * Constructor
      *
      * @param threadCount Number of worker threads to spawn
+     * @param idleBlockSpinTimeUs Time (in us) a worker spins with all of its units idle before
+     *        blocking on the file descriptors provided by the units (see
+     *        ExecutionUnit::PrepareIdleWait). 0 to never block (yield and sleep when idle, only)
      * @param refStatisticsManager Pointer to statistics manager (caller has to manage)
      */
-    explicit ExecutionEngine(uint16_t threadCount,
+    ExecutionEngine(uint16_t threadCount, uint32_t idleBlockSpinTimeUs,
             stats::StatisticsManager* refStatisticsManager);
 
     /**
@@ -90,7 +95,7 @@ private:
     class Worker : public sys::ThreadLoop
     {
     public:
-        explicit Worker(uint16_t id,
+        Worker(uint16_t id, uint32_t idleBlockSpinTimeUs,
                 stats::StatisticsManager* refStatisticsManager);
 
         ~Worker() override;
@@ -104,18 +109,25 @@ private:
 
     private:
         const uint16_t m_id;
+        const uint32_t m_idleBlockSpinTimeUs;
         stats::StatisticsManager* m_refStatisticsManager;
 
         std::vector<ExecutionUnit*> m_executionUnits;
 
     private:
         sys::Timer m_idleTimer;
+        std::vector<int> m_idleWaitFds;
+        std::vector<pollfd> m_idleWaitPollFds;
 
         stats::Unit* m_idleCounter;
         stats::Unit* m_activeCounter;
         stats::Unit* m_yieldCounter;
         stats::Unit* m_sleepCounter;
+        stats::Unit* m_blockCounter;
         stats::Ratio* m_activityRatio;
+
+    private:
+        bool __IdleWait();
     };
 
     stats::StatisticsManager* m_refStatisticsManager;
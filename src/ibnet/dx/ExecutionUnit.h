@@ -20,6 +20,7 @@
 #define IBNET_DX_EXECUTIONUNIT_H
 
 #include <string>
+#include <vector>
 
 namespace ibnet {
 namespace dx {
@@ -50,6 +51,31 @@ public:
      */
     virtual bool Dispatch() = 0;
 
+    /**
+     * Prepare blocking the worker on file descriptors when all units of the
+     * worker are idle for a while (e.g. arm completion notifications). The
+     * worker calls Dispatch once more after all units are prepared to catch
+     * any work arriving meanwhile. IdleWaitDone is called on all units after
+     * the worker woke up (or aborted blocking)
+     *
+     * @param fds Vector to add the file descriptors to wait on to (readable)
+     * @return True if the unit supports blocking and is ready to be blocked,
+     *         false if the worker must not block (default)
+     */
+    virtual bool PrepareIdleWait(std::vector<int>& fds)
+    {
+        return false;
+    }
+
+    /**
+     * Called after the worker woke up from blocking or aborted blocking
+     * (see PrepareIdleWait), e.g. to consume the events of the file
+     * descriptors
+     */
+    virtual void IdleWaitDone()
+    {
+    }
+
 protected:
     /**
      * Constructor
@@ -18,6 +18,9 @@
 
 #include "RecvBufferPool.h"
 
+#include <algorithm>
+#include <thread>
+
 #include "ibnet/sys/IllegalStateException.h"
 #include "ibnet/sys/Logger.hpp"
 
@@ -25,24 +28,29 @@ namespace ibnet {
 namespace dx {
 
 RecvBufferPool::RecvBufferPool(uint64_t totalPoolSize,
-        uint32_t recvBufferSize, core::IbProtDom* refProtDom) :
+        uint32_t recvBufferSize, core::IbProtDom* refProtDom, core::IbMemAllocator* refMemAllocator,
+        stats::StatisticsManager* refStatisticsManager) :
         m_bufferPoolSize(
                 static_cast<const uint32_t>(totalPoolSize / recvBufferSize)),
-        m_bufferPoolSizeGapped(m_bufferPoolSize + 1),
         m_bufferSize(recvBufferSize),
+        m_numCaches(std::max(std::thread::hardware_concurrency(), 1U)),
+        m_magazineSize(__CalcMagazineSize(m_bufferPoolSize, m_numCaches)),
         m_refProtDom(refProtDom),
-        m_dataBuffersFront(0),
-        m_dataBuffersBack(m_bufferPoolSize),
-        m_dataBuffersBackRes(m_bufferPoolSize),
-        m_insufficientBufferCounter(0)
+        m_numMagazines(0),
+        m_magazines(nullptr),
+        m_caches(nullptr),
+        m_depotFull(),
+        m_depotEmpty(),
+        m_insufficientBufferCounter(0),
+        m_refStatisticsManager(refStatisticsManager),
+        m_takenBuffers(new stats::Unit("RecvBufferPool", "Taken")),
+        m_returnedBuffers(new stats::Unit("RecvBufferPool", "Returned")),
+        m_insufficientBuffers(new stats::Unit("RecvBufferPool", "Insufficient"))
 {
     // allocate a single region and slice it into multiple buffers for the pool
 
-    m_memoryPool = new core::IbMemReg(
-            aligned_alloc(static_cast<size_t>(getpagesize()),
-                static_cast<uint64_t>(m_bufferPoolSize) * m_bufferSize),
-                static_cast<uint64_t>(m_bufferPoolSize) * m_bufferSize,
-            true);
+    m_memoryPool = new core::IbMemReg(static_cast<uint64_t>(m_bufferPoolSize) * m_bufferSize,
+            refMemAllocator);
 
     IBNET_LOG_INFO("Allocated memory pool region %p, size %d",
             m_memoryPool->GetAddress(), m_memoryPool->GetSize());
@@ -56,26 +64,72 @@ RecvBufferPool::RecvBufferPool(uint64_t totalPoolSize,
     // handing out and returning entries
     m_bufferPool = new core::IbMemReg* [m_bufferPoolSize];
 
-    // size +1: we need a gap entry for the front and back pointers to avoid
-    // overlapping if pool is full. otherwise, we can't determine if a pool
-    // is full or empty. Here: if front == back: pool empty
-    m_dataBuffers = new core::IbMemReg* [m_bufferPoolSizeGapped];
-
     for (uint32_t i = 0; i < m_bufferPoolSize; i++) {
         m_bufferPool[i] = new core::IbMemReg((void*)
                         (((uintptr_t) m_memoryPool->GetAddress()) + static_cast<uint64_t>(i) * recvBufferSize),
                 recvBufferSize, m_memoryPool);
-        m_dataBuffers[i] = m_bufferPool[i];
     }
 
-    // gap, see above
-    m_dataBuffers[m_bufferPoolSize] = nullptr;
+    // Every magazine is either on the full stack (non empty, at most one
+    // partially filled from the initial fill), the empty stack or owned by
+    // a cache (two each). A cache needs an empty magazine from the depot
+    // only after pushing a full one, i.e. while owning a single magazine.
+    // Thus, one additional magazine guarantees the empty stack never runs
+    // dry when a cache requests an empty magazine
+    uint32_t numFullMagazines = (m_bufferPoolSize + m_magazineSize - 1) / m_magazineSize;
+    m_numMagazines = numFullMagazines + m_numCaches * 2 + 1;
+
+    m_magazines = new Magazine* [m_numMagazines];
+
+    m_depotFull.m_head.store(MAGAZINE_INVALID, std::memory_order_relaxed);
+    m_depotEmpty.m_head.store(MAGAZINE_INVALID, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < m_numMagazines; i++) {
+        m_magazines[i] = new Magazine(i);
+    }
+
+    for (uint32_t i = 0; i < m_bufferPoolSize; i++) {
+        Magazine* magazine = m_magazines[i / m_magazineSize];
+        magazine->m_buffers[magazine->m_count++] = m_bufferPool[i];
+    }
+
+    for (uint32_t i = 0; i < numFullMagazines; i++) {
+        __Push(m_depotFull, m_magazines[i]);
+    }
+
+    m_caches = new Cache[m_numCaches];
+
+    for (uint32_t i = 0; i < m_numCaches; i++) {
+        m_caches[i].m_lock.clear();
+        m_caches[i].m_loaded = m_magazines[numFullMagazines + i * 2];
+        m_caches[i].m_previous = m_magazines[numFullMagazines + i * 2 + 1];
+        m_caches[i].m_nonReturnedBuffers = 0;
+    }
 
-    IBNET_LOG_INFO("Allocation finished");
+    __Push(m_depotEmpty, m_magazines[m_numMagazines - 1]);
+
+    IBNET_LOG_INFO("Allocation finished, %d caches, %d magazines with %d buffers each", m_numCaches,
+            m_numMagazines, m_magazineSize);
+
+    if (m_refStatisticsManager) {
+        m_refStatisticsManager->Register(m_takenBuffers);
+        m_refStatisticsManager->Register(m_returnedBuffers);
+        m_refStatisticsManager->Register(m_insufficientBuffers);
+    }
 }
 
 RecvBufferPool::~RecvBufferPool()
 {
+    if (m_refStatisticsManager) {
+        m_refStatisticsManager->Deregister(m_takenBuffers);
+        m_refStatisticsManager->Deregister(m_returnedBuffers);
+        m_refStatisticsManager->Deregister(m_insufficientBuffers);
+    }
+
+    delete m_takenBuffers;
+    delete m_returnedBuffers;
+    delete m_insufficientBuffers;
+
     m_refProtDom->Deregister(m_memoryPool);
     delete m_memoryPool;
 
@@ -83,214 +137,229 @@ RecvBufferPool::~RecvBufferPool()
         delete m_bufferPool[i];
     }
 
+    for (uint32_t i = 0; i < m_numMagazines; i++) {
+        delete m_magazines[i];
+    }
+
     delete[] m_bufferPool;
-    delete[] m_dataBuffers;
+    delete[] m_magazines;
+    delete[] m_caches;
 }
 
 core::IbMemReg* RecvBufferPool::GetBuffer()
 {
-    core::IbMemReg* buffer = nullptr;
+    core::IbMemReg* buffer;
 
-    uint32_t front = m_dataBuffersFront.load(std::memory_order_relaxed);
-    uint32_t back;
+    if (GetBuffers(&buffer, 1) == 0) {
+        return nullptr;
+    }
 
-    while (true) {
-        back = m_dataBuffersBack.load(std::memory_order_relaxed);
+    return buffer;
+}
 
-        if (front == back) {
-            uint64_t counter = m_insufficientBufferCounter.fetch_add(1, std::memory_order_relaxed);
+uint32_t RecvBufferPool::GetBuffers(core::IbMemReg** retBuffers, uint32_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    Cache* cache = __LockCache();
+
+    uint32_t taken = 0;
+
+    while (taken < count) {
+        if (cache->m_loaded->m_count > 0) {
+            Magazine* loaded = cache->m_loaded;
 
-            if (counter % 1000000 == 0) {
-                IBNET_LOG_WARN("Insufficient pooled incoming buffers... "
-                        "waiting for buffers to get returned. If this warning "
-                        "appears periodically and very frequently, consider "
-                        "increasing the receive pool's total size to avoid "
-                        "possible performance penalties, counter: %d", counter);
+            while (taken < count && loaded->m_count > 0) {
+                retBuffers[taken++] = loaded->m_buffers[--loaded->m_count];
             }
 
-            return nullptr;
+            continue;
+        }
+
+        if (cache->m_previous->m_count > 0) {
+            std::swap(cache->m_loaded, cache->m_previous);
+            continue;
         }
 
-        buffer = m_dataBuffers[front];
+        // both magazines of the cache are empty: get a filled one from the depot
+        Magazine* magazine = __Pop(m_depotFull);
+
+        if (magazine == nullptr) {
+            break;
+        }
 
-        m_nonReturnedBuffers.fetch_add(1, std::memory_order_relaxed);
+        if (count - taken >= magazine->m_count) {
+            // consumes the whole magazine, keep the cache's magazines
+            for (uint32_t i = 0; i < magazine->m_count; i++) {
+                retBuffers[taken++] = magazine->m_buffers[i];
+            }
 
-        if (buffer == nullptr) {
-            throw sys::IllegalStateException(
-                    "Got invalid (null) buffer from pool, pos %d", front);
+            magazine->m_count = 0;
+            __Push(m_depotEmpty, magazine);
+        } else {
+            __Push(m_depotEmpty, cache->m_previous);
+            cache->m_previous = cache->m_loaded;
+            cache->m_loaded = magazine;
         }
+    }
+
+    cache->m_nonReturnedBuffers += taken;
 
-        m_dataBuffers[front] = nullptr;
+    __UnlockCache(cache);
 
-        m_dataBuffersFront.store((front + 1) % m_bufferPoolSizeGapped, std::memory_order_release);
+    // sharded counters, safe to update from any thread using the pool
+    IBNET_STATS(m_takenBuffers->Add(taken));
 
-        break;
+    if (taken < count) {
+        __InsufficientBuffers(count - taken);
     }
 
-    return buffer;
+    return taken;
 }
 
-uint32_t RecvBufferPool::GetBuffers(core::IbMemReg** retBuffers, uint32_t count)
+void RecvBufferPool::ReturnBuffer(core::IbMemReg* buffer)
 {
-    if (count == 0) {
-        return 0;
-    }
+    Cache* cache = __LockCache();
 
-    uint32_t front = m_dataBuffersFront.load(std::memory_order_relaxed);
-    uint32_t back;
+    __ReturnBuffer(cache, buffer);
+    cache->m_nonReturnedBuffers--;
 
-    while (true) {
-        back = m_dataBuffersBack.load(std::memory_order_relaxed);
-
-        if (front == back) {
-            uint64_t counter = m_insufficientBufferCounter.fetch_add(1, std::memory_order_relaxed);
-
-            if (counter % 1000000 == 0) {
-                IBNET_LOG_WARN("Insufficient pooled incoming buffers... "
-                        "waiting for buffers to get returned. If this warning "
-                        "appears periodically and very frequently, consider "
-                        "increasing the receive pool's total size to avoid "
-                        "possible performance penalties, front %d, back %d, counter: %d",
-                        front, back, counter);
-            }
+    __UnlockCache(cache);
 
-            return 0;
-        }
+    IBNET_STATS(m_returnedBuffers->Inc());
+}
 
-        uint32_t available;
+void RecvBufferPool::ReturnBuffers(core::IbMemReg** buffers, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
 
-        if (front <= back) {
-            available = back - front;
-        } else {
-            // not pool size gap size which includes the gap/nullptr
-            available = m_bufferPoolSize - front + back;
-        }
+    Cache* cache = __LockCache();
 
-        if (available < count) {
-            count = available;
-        }
+    for (uint32_t i = 0; i < count; i++) {
+        __ReturnBuffer(cache, buffers[i]);
+    }
 
-        for (uint32_t i = 0; i < count; i++) {
-            retBuffers[i] = m_dataBuffers[(front + i) % m_bufferPoolSizeGapped];
+    cache->m_nonReturnedBuffers -= count;
 
-            if (retBuffers[i] == nullptr) {
-                throw sys::IllegalStateException(
-                        "Got invalid (null) buffer from pool, pos %d",
-                        front % m_bufferSize);
-            }
+    __UnlockCache(cache);
 
-            m_dataBuffers[(front + i) % m_bufferPoolSizeGapped] = nullptr;
-        }
+    IBNET_STATS(m_returnedBuffers->Add(count));
+}
 
-        m_nonReturnedBuffers.fetch_add(count, std::memory_order_relaxed);
+RecvBufferPool::Cache* RecvBufferPool::__LockCache()
+{
+    static std::atomic<uint32_t> threadCounter(0);
+    static thread_local uint32_t threadId = threadCounter.fetch_add(1, std::memory_order_relaxed);
 
-        m_dataBuffersFront.store((front + count) % m_bufferPoolSizeGapped, std::memory_order_release);
+    Cache* cache = &m_caches[threadId % m_numCaches];
 
-        break;
+    while (cache->m_lock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
     }
 
-    return count;
+    return cache;
 }
 
-void RecvBufferPool::ReturnBuffer(core::IbMemReg* buffer)
+void RecvBufferPool::__UnlockCache(Cache* cache)
 {
-    uint32_t backRes = m_dataBuffersBackRes.load(std::memory_order_relaxed);
-    uint32_t front;
-
-    while (true) {
-        front = m_dataBuffersFront.load(std::memory_order_relaxed);
+    cache->m_lock.clear(std::memory_order_release);
+}
 
-        if ((backRes + 1) % m_bufferPoolSizeGapped == front) {
-            throw sys::IllegalStateException(
-                    "Pool overflow, this should not happen: backRes %d, front %d",
-                    backRes, front);
-        }
+void RecvBufferPool::__ReturnBuffer(Cache* cache, core::IbMemReg* buffer)
+{
+    if (buffer == nullptr) {
+        throw sys::IllegalStateException("Returning invalid (null) buffer to pool");
+    }
 
-        if (m_dataBuffersBackRes.compare_exchange_weak(backRes, (backRes + 1) % m_bufferPoolSizeGapped,
-                std::memory_order_acquire)) {
-            if (m_dataBuffers[backRes]) {
-                throw sys::IllegalStateException(
-                        "Overwriting existing buffer %p at pos %d with %p",
-                        (void*) m_dataBuffers[backRes], backRes, (void*) buffer);
-            }
+    if (cache->m_loaded->m_count == m_magazineSize) {
+        if (cache->m_previous->m_count == 0) {
+            std::swap(cache->m_loaded, cache->m_previous);
+        } else {
+            // both full: hand one to the depot and continue with an empty one
+            __Push(m_depotFull, cache->m_previous);
+            cache->m_previous = cache->m_loaded;
+            cache->m_loaded = __Pop(m_depotEmpty);
 
-            m_dataBuffers[backRes] = buffer;
-
-            // if two buffers are returned at the same time, the first return
-            // could be interrupt by a second return. the reserve of the first
-            // return is already completed but the back pointer is not updated.
-            // the second return reserves and updates the back pointer. now,
-            // the back pointer is pointing to the first returns reserve which
-            // might not be completed, yet.
-            // solution: the second return has to wait for the first return
-            // to complete, both, the reservation and updating of the back
-            // pointer before it can update the back pointer as well
-            while (!m_dataBuffersBack.compare_exchange_weak(backRes,
-                    (backRes + 1) % m_bufferPoolSizeGapped, std::memory_order_release)) {
-                std::this_thread::yield();
+            if (cache->m_loaded == nullptr) {
+                throw sys::IllegalStateException("Out of empty magazines, pool overflow, this should not happen");
             }
-
-            m_nonReturnedBuffers.fetch_sub(1, std::memory_order_relaxed);
-
-            break;
         }
     }
+
+    cache->m_loaded->m_buffers[cache->m_loaded->m_count++] = buffer;
 }
 
-void RecvBufferPool::ReturnBuffers(core::IbMemReg** buffers, uint32_t count)
+void RecvBufferPool::__Push(Stack& stack, Magazine* magazine)
 {
-    if (count == 0) {
-        return;
-    }
+    uint64_t head = stack.m_head.load(std::memory_order_relaxed);
+    uint64_t newHead;
+
+    do {
+        magazine->m_next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | magazine->m_index;
+    } while (!stack.m_head.compare_exchange_weak(head, newHead, std::memory_order_release,
+            std::memory_order_relaxed));
+}
 
-    uint32_t backRes = m_dataBuffersBackRes.load(std::memory_order_relaxed);
-    uint32_t front;
+RecvBufferPool::Magazine* RecvBufferPool::__Pop(Stack& stack)
+{
+    uint64_t head = stack.m_head.load(std::memory_order_acquire);
 
     while (true) {
-        front = m_dataBuffersFront.load(std::memory_order_relaxed);
+        auto index = static_cast<uint32_t>(head);
+
+        if (index == MAGAZINE_INVALID) {
+            return nullptr;
+        }
+
+        // magazines are never free'd while the pool exists. if the magazine
+        // was popped concurrently, the next index read might be stale but
+        // the tag lets the CAS fail
+        uint32_t next = m_magazines[index]->m_next.load(std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | next;
 
-        if ((backRes + count) % m_bufferPoolSizeGapped == front) {
-            throw sys::IllegalStateException(
-                    "Pool overflow, this should not happen: backRes %d, front %d, "
-                            "count %d", backRes, front, count);
+        if (stack.m_head.compare_exchange_weak(head, newHead, std::memory_order_acquire,
+                std::memory_order_acquire)) {
+            return m_magazines[index];
         }
+    }
+}
 
-        if (m_dataBuffersBackRes.compare_exchange_weak(backRes, (backRes + count) % m_bufferPoolSizeGapped,
-                std::memory_order_relaxed)) {
+void RecvBufferPool::__InsufficientBuffers(uint32_t count)
+{
+    uint64_t counter = m_insufficientBufferCounter.fetch_add(1, std::memory_order_relaxed);
 
-            for (uint32_t i = 0; i < count; i++) {
-                if (m_dataBuffers[(backRes + i) % m_bufferPoolSizeGapped]) {
-                    throw sys::IllegalStateException(
-                            "Overwriting existing buffer %p at pos %d with %p",
-                            (void*) m_dataBuffers[(backRes + i) %
-                                    m_bufferPoolSizeGapped],
-                            (backRes + i) % m_bufferPoolSizeGapped,
-                            (void*) buffers[i]);
-                }
+    IBNET_STATS(m_insufficientBuffers->Add(count));
 
-                m_dataBuffers[(backRes + i) % m_bufferPoolSizeGapped] = buffers[i];
-            }
+    if (counter % 1000000 == 0) {
+        IBNET_LOG_WARN("Insufficient pooled incoming buffers (missing %d)... "
+                "waiting for buffers to get returned. If this warning "
+                "appears periodically and very frequently, consider "
+                "increasing the receive pool's total size to avoid "
+                "possible performance penalties, counter: %d", count, counter);
+    }
+}
 
-            // if two buffers are returned at the same time, the first return
-            // could be interrupt by a second return. the reserve of the first
-            // return is already completed but the back pointer is not updated.
-            // the second return reserves and updates the back pointer. now,
-            // the back pointer is pointing to the first returns reserve which
-            // might not be completed, yet.
-            // solution: the second return has to wait for the first return
-            // to complete, both, the reservation and updating of the back
-            // pointer before it can update the back pointer as well
-            while (!m_dataBuffersBack.compare_exchange_weak(backRes,
-                    (backRes + count) % m_bufferPoolSizeGapped, std::memory_order_release)) {
-                std::this_thread::yield();
-            }
+uint32_t RecvBufferPool::__CalcMagazineSize(uint32_t bufferPoolSize, uint32_t numCaches)
+{
+    // limit the buffers held by (possibly idle) caches which are not
+    // available to other threads to 1/8 of the pool
+    uint32_t size = bufferPoolSize / (numCaches * 2 * 8);
 
-            m_nonReturnedBuffers.fetch_sub(count, std::memory_order_relaxed);
+    if (size < 1) {
+        return 1;
+    }
 
-            break;
-        }
+    if (size > MAGAZINE_MAX_SIZE) {
+        return MAGAZINE_MAX_SIZE;
     }
+
+    return size;
 }
 
 }
-}
\ No newline at end of file
+}
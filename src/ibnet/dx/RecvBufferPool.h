@@ -21,15 +21,28 @@
 
 #include <atomic>
 
+#include "ibnet/core/IbMemAllocator.h"
 #include "ibnet/core/IbProtDom.h"
 
+#include "ibnet/stats/StatisticsManager.h"
+#include "ibnet/stats/Unit.hpp"
+
 namespace ibnet {
 namespace dx {
 
 /**
  * Buffer pool with buffers registered with a protection domain
- * for incoming data. Implements a lock free 1:N (consumer:producer)
- * ring buffer.
+ * for incoming data. MPMC pool: buffers are kept in magazines (small
+ * fixed size arrays of buffers). There is one cache per hardware thread
+ * holding two magazines (loaded and previous) which serve gets and
+ * returns of single buffers. Threads are mapped to the caches round robin
+ * in the order they first use the pool (thread counter modulo number of
+ * caches), i.e. caches are not thread local. Each cache is guarded by a
+ * spinlock (yielding) which is uncontended unless more threads than
+ * caches use the pool. Full and empty magazines are exchanged with a
+ * central depot (two lock free stacks) in batches. This reduces
+ * contention between many application threads returning buffers and
+ * the receive dispatcher(s) getting buffers.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 02.06.2017
  */
@@ -42,9 +55,13 @@ public:
      * @param totalPoolSize Total size of the pool in bytes
      * @param recvBufferSize Size of a single receive buffer in the pool
      * @param protDom Protection domain to register all buffers at (Pointer managed by caller)
+     * @param refMemAllocator Allocator for the pool's memory (Pointer managed by caller)
+     * @param refStatisticsManager Optional, register the pool's statistics (counters of
+     *        buffers taken and returned, updated by any thread using the pool)
      */
     RecvBufferPool(uint64_t totalPoolSize, uint32_t recvBufferSize,
-            core::IbProtDom* refProtDom);
+            core::IbProtDom* refProtDom, core::IbMemAllocator* refMemAllocator,
+            stats::StatisticsManager* refStatisticsManager = nullptr);
 
     /**
      * Destructor
@@ -59,11 +76,10 @@ public:
     }
 
     /**
-     * Get a buffer from the pool. If the pool is empty, this call is blocking with
-     * no new buffers being allocated. The caller is blocked until a buffer is
-     * available to be returend.
+     * Get a buffer from the pool. Non blocking, no new buffers are
+     * allocated if the pool is empty.
      *
-     * @return Buffer from the pool
+     * @return Buffer from the pool or nullptr if no buffers are available, currently
      */
     core::IbMemReg* GetBuffer();
 
@@ -103,44 +119,110 @@ public:
      */
     friend std::ostream& operator<<(std::ostream& os, const RecvBufferPool& o)
     {
-        int64_t nonReturnedBuffers = o.m_nonReturnedBuffers.load(std::memory_order_relaxed);
-
-        uint32_t front = o.m_dataBuffersFront.load(std::memory_order_relaxed);
-        uint32_t back = o.m_dataBuffersBack.load(std::memory_order_relaxed);
-        uint32_t backRes = o.m_dataBuffersBackRes.load(std::memory_order_relaxed);
-
-        uint32_t avail = 0;
+        int64_t nonReturnedBuffers = 0;
+        uint32_t cached = 0;
 
-        if (front <= back) {
-            avail = back - front;
-        } else {
-            avail = o.m_bufferPoolSize - front + back;
+        // racy read of the caches, good enough for statistics
+        for (uint32_t i = 0; i < o.m_numCaches; i++) {
+            nonReturnedBuffers += o.m_caches[i].m_nonReturnedBuffers;
+            cached += o.m_caches[i].m_loaded->m_count + o.m_caches[i].m_previous->m_count;
         }
 
-        os << "nonReturnedBuffers " << nonReturnedBuffers << ", front " << front << ", back " << back <<
-                ", backRes " << backRes << ", avail " << avail;
+        os << "nonReturnedBuffers " << nonReturnedBuffers << ", magazineSize " << o.m_magazineSize <<
+                ", caches " << o.m_numCaches << ", cached " << cached << ", insufficient " <<
+                o.m_insufficientBufferCounter.load(std::memory_order_relaxed);
 
         return os;
     }
 
+private:
+    static const uint32_t MAGAZINE_MAX_SIZE = 64;
+    static const uint32_t MAGAZINE_INVALID = 0xFFFFFFFF;
+
+    /**
+     * Fixed size array of buffers handed between caches and the depot
+     */
+    struct Magazine
+    {
+        const uint32_t m_index;
+        // link to the next magazine when stored on one of the depot's stacks
+        std::atomic<uint32_t> m_next;
+        uint32_t m_count;
+        core::IbMemReg* m_buffers[MAGAZINE_MAX_SIZE];
+
+        explicit Magazine(uint32_t index) :
+                m_index(index),
+                m_next(MAGAZINE_INVALID),
+                m_count(0),
+                m_buffers()
+        {
+        }
+    };
+
+    /**
+     * Cache of one or multiple threads (mapped by thread id). The lock is
+     * uncontended unless more threads than caches are using the pool
+     */
+    struct Cache
+    {
+        std::atomic_flag m_lock;
+        Magazine* m_loaded;
+        Magazine* m_previous;
+        // buffers taken minus buffers returned by the threads of this cache
+        int64_t m_nonReturnedBuffers;
+    } __attribute__((aligned(64)));
+
+    /**
+     * Head of a lock free (Treiber) stack of magazines. Upper 32 bits: tag
+     * incremented on every update to avoid ABA, lower 32 bits: magazine index
+     */
+    struct Stack
+    {
+        std::atomic<uint64_t> m_head;
+    } __attribute__((aligned(64)));
+
 private:
     const uint32_t m_bufferPoolSize;
-    const uint32_t m_bufferPoolSizeGapped;
     const uint32_t m_bufferSize;
+    const uint32_t m_numCaches;
+    const uint32_t m_magazineSize;
 
     core::IbProtDom* m_refProtDom;
 
-    std::atomic<int64_t> m_nonReturnedBuffers;
-
-    std::atomic<uint32_t> m_dataBuffersFront;
-    std::atomic<uint32_t> m_dataBuffersBack;
-    std::atomic<uint32_t> m_dataBuffersBackRes;
-
     core::IbMemReg* m_memoryPool;
     core::IbMemReg** m_bufferPool;
-    core::IbMemReg** m_dataBuffers;
+
+    uint32_t m_numMagazines;
+    Magazine** m_magazines;
+    Cache* m_caches;
+
+    // depot: magazines with buffers and empty magazines
+    Stack m_depotFull;
+    Stack m_depotEmpty;
 
     std::atomic<uint64_t> m_insufficientBufferCounter;
+
+private:
+    stats::StatisticsManager* m_refStatisticsManager;
+
+    stats::Unit* m_takenBuffers;
+    stats::Unit* m_returnedBuffers;
+    stats::Unit* m_insufficientBuffers;
+
+private:
+    Cache* __LockCache();
+
+    void __UnlockCache(Cache* cache);
+
+    void __ReturnBuffer(Cache* cache, core::IbMemReg* buffer);
+
+    void __Push(Stack& stack, Magazine* magazine);
+
+    Magazine* __Pop(Stack& stack);
+
+    void __InsufficientBuffers(uint32_t count);
+
+    static uint32_t __CalcMagazineSize(uint32_t bufferPoolSize, uint32_t numCaches);
 };
 
 }
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "ibnet/sys/Logger.hpp"
+#include "ibnet/sys/Timer.hpp"
+
+#include "ibnet/core/IbDevice.h"
+#include "ibnet/core/IbProtDom.h"
+
+#include "ibnet/dx/RecvBufferPool.h"
+
+static const uint32_t RECV_BUFFER_SIZE = 4096;
+
+static std::atomic<bool> g_start(false);
+
+/**
+ * Get and return buffers (single buffer per call) like an application
+ * thread processing received data
+ *
+ * @param pool Pool to hammer
+ * @param ops Number of get/return operations to execute
+ * @param latenciesNs Vector to store the latency of each get/return pair
+ */
+static void BenchmarkThread(ibnet::dx::RecvBufferPool* pool, uint32_t ops, std::vector<uint64_t>* latenciesNs)
+{
+    ibnet::sys::Timer timer;
+
+    latenciesNs->reserve(ops);
+
+    while (!g_start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    for (uint32_t i = 0; i < ops; i++) {
+        timer.Start();
+
+        ibnet::core::IbMemReg* buffer = pool->GetBuffer();
+
+        if (buffer != nullptr) {
+            pool->ReturnBuffer(buffer);
+        }
+
+        timer.Stop();
+
+        latenciesNs->push_back(timer.GetTimeNs());
+    }
+}
+
+/**
+ * Main entry point
+ *
+ * @param argc Argc
+ * @param argv Argc
+ * @return Exit code
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("Usage: %s <pool size mb> <ops per thread> [max threads, default 64]\n", argv[0]);
+        return -1;
+    }
+
+    auto poolSizeMb = static_cast<uint64_t>(std::atol(argv[1]));
+    auto ops = static_cast<uint32_t>(std::atol(argv[2]));
+    uint32_t maxThreads = 64;
+
+    if (argc > 3) {
+        maxThreads = static_cast<uint32_t>(std::atol(argv[3]));
+    }
+
+    ibnet::sys::Logger::Setup();
+
+    auto* device = new ibnet::core::IbDevice();
+    auto* protDom = new ibnet::core::IbProtDom(*device, "benchmark");
+    auto* memAllocator = new ibnet::core::IbMemAllocator(ibnet::core::IbMemAllocator::e_PageSizeDefault,
+            device->GetNumaNode());
+    auto* pool = new ibnet::dx::RecvBufferPool(poolSizeMb * 1024 * 1024, RECV_BUFFER_SIZE, protDom,
+            memAllocator);
+
+    // powers of two up to (and including) the max thread count
+    std::vector<uint32_t> threadCounts;
+
+    for (uint32_t i = 1; i < maxThreads; i *= 2) {
+        threadCounts.push_back(i);
+    }
+
+    threadCounts.push_back(maxThreads);
+
+    printf("threads, ops/s, avg ns, p50 ns, p99 ns, p99.9 ns, max ns\n");
+
+    for (auto numThreads : threadCounts) {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<uint64_t>> latenciesNs(numThreads);
+        ibnet::sys::Timer totalTimer;
+
+        g_start.store(false, std::memory_order_relaxed);
+
+        for (uint32_t i = 0; i < numThreads; i++) {
+            threads.emplace_back(BenchmarkThread, pool, ops, &latenciesNs[i]);
+        }
+
+        totalTimer.Start();
+        g_start.store(true, std::memory_order_release);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        totalTimer.Stop();
+
+        std::vector<uint64_t> all;
+        uint64_t sum = 0;
+
+        all.reserve(static_cast<uint64_t>(ops) * numThreads);
+
+        for (auto& latencies : latenciesNs) {
+            for (auto latency : latencies) {
+                sum += latency;
+            }
+
+            all.insert(all.end(), latencies.begin(), latencies.end());
+        }
+
+        std::sort(all.begin(), all.end());
+
+        if (all.empty()) {
+            continue;
+        }
+
+        printf("%d, %f, %f, %lu, %lu, %lu, %lu\n", numThreads, all.size() / totalTimer.GetTimeSec(),
+                static_cast<double>(sum) / all.size(), all[all.size() / 2], all[all.size() * 99 / 100],
+                all[all.size() * 999 / 1000], all.back());
+    }
+
+    std::cout << *pool << std::endl;
+
+    delete pool;
+    delete memAllocator;
+    delete protDom;
+    delete device;
+
+    ibnet::sys::Logger::Shutdown();
+
+    return 0;
+}
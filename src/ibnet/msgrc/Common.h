@@ -36,7 +36,13 @@ struct ImmediateData
 {
     con::NodeId m_sourceNodeId;
     uint8_t m_flowControlData;
-    uint8_t m_dummy;
+    union
+    {
+        // slot + 1 of the remote's RDMA receive region written to (RDMA write with immediate)
+        uint8_t m_rdmaSlot;
+        // receive credits returned to the remote (sends, native flow control only, 0 otherwise)
+        uint8_t m_credits;
+    };
 
     /**
      * Overloading << operator for printing to ostreams
@@ -48,7 +54,7 @@ struct ImmediateData
     friend std::ostream& operator<<(std::ostream& os, const ImmediateData& o)
     {
         return os << "m_sourceNodeId " << std::hex << o.m_sourceNodeId << std::dec << ", m_flowControlData " <<
-            static_cast<uint16_t>(o.m_flowControlData) << ", m_dummy " << static_cast<uint16_t>(o.m_dummy);
+            static_cast<uint16_t>(o.m_flowControlData) << ", m_rdmaSlot " << static_cast<uint16_t>(o.m_rdmaSlot);
     }
 } __attribute__((__packed__));
 
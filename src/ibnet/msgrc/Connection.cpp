@@ -18,9 +18,18 @@
 
 #include "Connection.h"
 
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "ibnet/sys/Logger.hpp"
 #include "ibnet/sys/IllegalStateException.h"
 #include "ibnet/sys/Random.h"
+#include "ibnet/sys/SystemException.h"
+
+#include "ibnet/core/IbVerbs.h"
 
 #define DEFAULT_IB_PORT 1
 #define IB_QOS_LEVEL 0
@@ -32,10 +41,14 @@ Connection::Connection(con::NodeId ownNodeId, con::ConnectionId connectionId,
         uint32_t sendBufferSize, uint16_t ibSQSize, ibv_srq* refIbSRQ,
         uint16_t ibSRQSize, ibv_cq* refIbSharedSCQ, uint16_t ibSharedSCQSize,
         ibv_cq* refIbSharedRCQ, uint16_t ibSharedRCQSize, uint16_t maxSGEs,
-        core::IbProtDom* refProtDom) :
+        uint32_t maxInlineData, uint32_t rdmaRecvSlotSize, uint8_t rdmaRecvSlots,
+        uint32_t recvRingSize, bool recvRingShm, uint16_t fcCredits, core::IbProtDom* refProtDom,
+        core::IbMemAllocator* refMemAllocator) :
         con::Connection(ownNodeId, connectionId),
+        m_incarnation(__NextIncarnation()),
         m_sendBufferSize(sendBufferSize),
         m_refProtDom(refProtDom),
+        m_refMemAllocator(refMemAllocator),
         m_sendBuffer(nullptr),
         m_ibQP(nullptr),
         m_ibPhysicalQPId(0xFFFFFFFF),
@@ -48,7 +61,22 @@ Connection::Connection(con::NodeId ownNodeId, con::ConnectionId connectionId,
         m_ibSharedSCQSize(ibSharedSCQSize),
         m_refIbSharedRCQ(refIbSharedRCQ),
         m_ibSharedRCQSize(ibSharedRCQSize),
-        m_maxSGEs(maxSGEs)
+        m_maxSGEs(maxSGEs),
+        m_maxInlineData(maxInlineData),
+        m_rdmaRecvSlotSize(rdmaRecvSlotSize),
+        m_rdmaRecvSlots(rdmaRecvSlots),
+        m_rdmaRecvRegion(nullptr),
+        m_rdmaSlotsWritten(0),
+        m_recvRingSize(recvRingSize),
+        m_recvRing(nullptr),
+        m_recvRingShmName(),
+        m_remoteRecvRingMapped(nullptr),
+        m_recvRingDelivered(0),
+        m_recvRingFcDelivered(0),
+        m_recvRingWritten(0),
+        m_recvRingFcWritten(0),
+        m_sendCredits(fcCredits),
+        m_creditsToReturn(0)
 {
     IBNET_LOG_TRACE_FUNC;
 
@@ -57,7 +85,7 @@ Connection::Connection(con::NodeId ownNodeId, con::ConnectionId connectionId,
         __SetInitStateQP();
     } catch (...) {
         if (m_ibQP) {
-            ibv_destroy_qp(m_ibQP);
+            core::IbVerbs::DestroyQP(m_ibQP);
         }
 
         throw;
@@ -66,25 +94,72 @@ Connection::Connection(con::NodeId ownNodeId, con::ConnectionId connectionId,
     IBNET_LOG_DEBUG("Allocate send buffer, size %d for connection id 0x%X",
             m_sendBufferSize, connectionId);
 
-    m_sendBuffer = new core::IbMemReg(
-            aligned_alloc(static_cast<size_t>(getpagesize()), m_sendBufferSize),
-            m_sendBufferSize, true);
+    m_sendBuffer = new core::IbMemReg(m_sendBufferSize, m_refMemAllocator);
 
     m_refProtDom->Register(m_sendBuffer);
 
+    // region for incoming RDMA writes: header with the consumed counter
+    // (also read remotely) followed by the slots. the header is always
+    // allocated to read the remote's counter to. if RDMA writes are not
+    // accepted, the remote doesn't access it
+    uint64_t rdmaRecvRegionSize = sizeof(RdmaRecvRegionHeader) +
+            static_cast<uint64_t>(m_rdmaRecvSlots) * m_rdmaRecvSlotSize;
+
+    m_rdmaRecvRegion = new core::IbMemReg(rdmaRecvRegionSize, m_refMemAllocator);
+
+    memset(m_rdmaRecvRegion->GetAddress(), 0, sizeof(RdmaRecvRegionHeader));
+
+    m_refProtDom->Register(m_rdmaRecvRegion, m_rdmaRecvSlots > 0 ?
+            IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE : IBV_ACCESS_LOCAL_WRITE);
+
+    // receive ring for one-sided messaging: header with the tail (written
+    // remotely) and head (read remotely) followed by the ring's data. the
+    // header is always allocated to read the remote's head to. without a
+    // ring, the remote doesn't access it
+    uint64_t recvRingRegionSize = sizeof(RecvRingHeader) + m_recvRingSize;
+
+    if (recvRingShm) {
+        __CreateRecvRingShm(recvRingRegionSize);
+    } else {
+        m_recvRing = new core::IbMemReg(recvRingRegionSize, m_refMemAllocator);
+    }
+
+    memset(m_recvRing->GetAddress(), 0, sizeof(RecvRingHeader));
+
+    m_refProtDom->Register(m_recvRing, m_recvRingSize > 0 ?
+            IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE : IBV_ACCESS_LOCAL_WRITE);
+
     IBNET_LOG_DEBUG("Created QP, qpNum 0x%X", m_ibPhysicalQPId);
 }
 
 Connection::~Connection()
 {
     if (m_ibQP) {
-        ibv_destroy_qp(m_ibQP);
+        core::IbVerbs::DestroyQP(m_ibQP);
     }
 
     if (m_sendBuffer) {
         m_refProtDom->Deregister(m_sendBuffer);
         delete m_sendBuffer;
     }
+
+    if (m_rdmaRecvRegion) {
+        m_refProtDom->Deregister(m_rdmaRecvRegion);
+        delete m_rdmaRecvRegion;
+    }
+
+    if (m_recvRing) {
+        m_refProtDom->Deregister(m_recvRing);
+
+        if (!m_recvRingShmName.empty()) {
+            munmap(m_recvRing->GetAddress(), m_recvRing->GetSize());
+            shm_unlink(m_recvRingShmName.c_str());
+        }
+
+        delete m_recvRing;
+    }
+
+    __UnmapRemoteRecvRing();
 }
 
 void Connection::CreateConnectionExchangeData(void* connectionDataBuffer,
@@ -98,6 +173,16 @@ void Connection::CreateConnectionExchangeData(void* connectionDataBuffer,
 
     data->m_physicalQPId = m_ibPhysicalQPId;
     data->m_psn = m_ibPsn;
+    data->m_rdmaRecvAddr = (uintptr_t) m_rdmaRecvRegion->GetAddress();
+    data->m_rdmaRecvRKey = m_rdmaRecvRegion->GetRKey();
+    data->m_rdmaRecvSlotSize = m_rdmaRecvSlotSize;
+    data->m_rdmaRecvSlots = m_rdmaRecvSlots;
+    data->m_recvRingAddr = (uintptr_t) m_recvRing->GetAddress();
+    data->m_recvRingRKey = m_recvRing->GetRKey();
+    data->m_recvRingSize = m_recvRingSize;
+
+    memset(data->m_recvRingShmName, 0, sizeof(data->m_recvRingShmName));
+    strncpy(data->m_recvRingShmName, m_recvRingShmName.c_str(), sizeof(data->m_recvRingShmName) - 1);
 
     *connectionDataActualSize = sizeof(RemoteConnectionData);
 }
@@ -112,9 +197,17 @@ void Connection::Connect(
 
     auto* data = static_cast<const RemoteConnectionData*>(remoteConnectionData);
 
+    // unmap the previous mapping on reconnect, its size depends on the old
+    // remote data
+    __UnmapRemoteRecvRing();
+
     m_remoteConnectionHeader = remoteConnectionHeader;
     m_remoteConnectionData = *data;
 
+    if (m_remoteConnectionData.m_recvRingShmName[0] != '\0') {
+        __MapRemoteRecvRing();
+    }
+
     // ready to recv must be set first
     __SetReadyToRecv();
     __SetReadyToSend();
@@ -127,6 +220,90 @@ void Connection::Close(bool force)
     // TODO state change to not ready send and receive?
 }
 
+uint32_t Connection::__NextIncarnation()
+{
+    // 0 is never a valid incarnation
+    static std::atomic<uint32_t> counter(1);
+
+    return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Connection::__CreateRecvRingShm(uint64_t size)
+{
+    static std::atomic<uint32_t> counter(0);
+
+    m_recvRingShmName = "/ibnet-ring-" + std::to_string(getpid()) + "-" +
+            std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+
+    int fd = shm_open(m_recvRingShmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0) {
+        throw sys::SystemException("Creating shared memory segment %s for receive ring failed: %s",
+                m_recvRingShmName, strerror(errno));
+    }
+
+    void* addr = MAP_FAILED;
+
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    int err = errno;
+
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        shm_unlink(m_recvRingShmName.c_str());
+
+        throw sys::SystemException("Mapping shared memory segment %s (size %d) for receive ring failed: %s",
+                m_recvRingShmName, size, strerror(err));
+    }
+
+    // registered as well, the remote falls back to RDMA writes if it
+    // can't map the segment (e.g. different IPC namespace)
+    m_recvRing = new core::IbMemReg(addr, size, false);
+
+    IBNET_LOG_DEBUG("Created receive ring in shared memory segment %s, size %d", m_recvRingShmName, size);
+}
+
+void Connection::__MapRemoteRecvRing()
+{
+    const char* name = m_remoteConnectionData.m_recvRingShmName;
+    size_t size = sizeof(RecvRingHeader) + m_remoteConnectionData.m_recvRingSize;
+
+    int fd = shm_open(name, O_RDWR, 0);
+
+    if (fd < 0) {
+        IBNET_LOG_WARN("Opening shared memory segment %s of remote receive ring failed, using RDMA writes: %s",
+                name, strerror(errno));
+        return;
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        IBNET_LOG_WARN("Mapping shared memory segment %s of remote receive ring failed, using RDMA writes: %s",
+                name, strerror(err));
+        return;
+    }
+
+    m_remoteRecvRingMapped = addr;
+
+    IBNET_LOG_INFO("Mapped receive ring of co-located node 0x%X (%s), size %d", GetRemoteNodeId(), name,
+            m_remoteConnectionData.m_recvRingSize);
+}
+
+void Connection::__UnmapRemoteRecvRing()
+{
+    if (m_remoteRecvRingMapped) {
+        munmap(m_remoteRecvRingMapped, sizeof(RecvRingHeader) + m_remoteConnectionData.m_recvRingSize);
+        m_remoteRecvRingMapped = nullptr;
+    }
+}
+
 void Connection::__CreateQP()
 {
     IBNET_LOG_TRACE_FUNC;
@@ -144,12 +321,12 @@ void Connection::__CreateQP()
     qp_init_attr.cap.max_recv_wr = m_ibSRQSize;
     qp_init_attr.cap.max_send_sge = m_maxSGEs;
     qp_init_attr.cap.max_recv_sge = m_maxSGEs;
-    qp_init_attr.cap.max_inline_data = 0;
+    qp_init_attr.cap.max_inline_data = m_maxInlineData;
     // only generate CQ elements on requested WQ elements
     qp_init_attr.sq_sig_all = 0;
 
     IBNET_LOG_TRACE("ibv_create_qp");
-    m_ibQP = ibv_create_qp(m_refProtDom->GetIBProtDom(), &qp_init_attr);
+    m_ibQP = core::IbVerbs::CreateQP(m_refProtDom->GetIBProtDom(), &qp_init_attr);
 
     if (m_ibQP == nullptr) {
         throw core::IbException("Creating queue pair failed: %s",
@@ -172,11 +349,13 @@ void Connection::__SetInitStateQP()
     qp_attr.qp_state = IBV_QPS_INIT;
     qp_attr.pkey_index = 0;
     qp_attr.port_num = DEFAULT_IB_PORT;
-    qp_attr.qp_access_flags = IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE;
+    // remote read for the consumed counters of the RDMA receive region and
+    // receive ring
+    qp_attr.qp_access_flags = IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE;
 
     // modify queue pair attributes
     IBNET_LOG_TRACE("ibv_modify_qp");
-    result = ibv_modify_qp(m_ibQP, &qp_attr,
+    result = core::IbVerbs::ModifyQP(m_ibQP, &qp_attr,
             IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS);
 
     if (result != 0) {
@@ -214,7 +393,7 @@ void Connection::__SetReadyToSend()
     attr.max_rd_atomic = 1;
 
     IBNET_LOG_TRACE("ibv_modify_qp");
-    result = ibv_modify_qp(m_ibQP, &attr,
+    result = core::IbVerbs::ModifyQP(m_ibQP, &attr,
             IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT | IBV_QP_RNR_RETRY |
                     IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC);
 
@@ -261,7 +440,7 @@ void Connection::__SetReadyToRecv()
 
     // do the state change on the qp
     IBNET_LOG_TRACE("ibv_modify_qp");
-    result = ibv_modify_qp(m_ibQP, &attr,
+    result = core::IbVerbs::ModifyQP(m_ibQP, &attr,
             IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN |
                     IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER);
 
@@ -19,8 +19,13 @@
 #ifndef IBNET_MSGRC_CONNECTION_H
 #define IBNET_MSGRC_CONNECTION_H
 
+#include <atomic>
+#include <cstddef>
+#include <string>
+
 #include <infiniband/verbs.h>
 
+#include "ibnet/core/IbMemAllocator.h"
 #include "ibnet/core/IbProtDom.h"
 
 #include "ibnet/con/Connection.h"
@@ -50,13 +55,26 @@ public:
      * @param refIbSharedRCQ Pointer to the shared receive completion queue (memory managed by caller)
      * @param ibSharedRCQSize Size of the shared receive completion queue
      * @param maxSGEs Max number of SGEs used for a single work request
+     * @param maxInlineData Max size of data (in bytes) of a send WRQ posted inline
+     * @param rdmaRecvSlotSize Size of a single slot of the region for incoming RDMA writes
+     * @param rdmaRecvSlots Number of slots of the region for incoming RDMA writes (0 to disable)
+     * @param recvRingSize Size of the receive ring (in bytes) written to by the remote using
+     *        one-sided RDMA writes (0 to disable)
+     * @param recvRingShm Allocate the receive ring in a shared memory segment the remote maps
+     *        and writes to directly if it runs on the same host
+     * @param fcCredits Number of receive WRQs of the remote's SRQ reserved for the connection
+     *        (native flow control, 0 to disable)
      * @param refProtDom Pointer to the IbProtDom (memory managed by caller)
+     * @param refMemAllocator Pointer to the allocator for the send buffer and
+     *        the regions for incoming RDMA writes (memory managed by caller)
      */
     Connection(con::NodeId ownNodeId, con::ConnectionId connectionId,
             uint32_t sendBufferSize, uint16_t ibSQSize, ibv_srq* refIbSRQ,
             uint16_t ibSRQSize, ibv_cq* refIbSharedSCQ, uint16_t ibSharedSCQSize,
             ibv_cq* refIbSharedRCQ, uint16_t ibSharedRCQSize, uint16_t maxSGEs,
-            core::IbProtDom* refProtDom);
+            uint32_t maxInlineData, uint32_t rdmaRecvSlotSize, uint8_t rdmaRecvSlots,
+            uint32_t recvRingSize, bool recvRingShm, uint16_t fcCredits, core::IbProtDom* refProtDom,
+            core::IbMemAllocator* refMemAllocator);
 
     /**
      * Destructor
@@ -82,6 +100,17 @@ public:
      */
     void Close(bool force) override;
 
+    /**
+     * Assign a connection id to a connection created in advance (see the
+     * QP pool of the ConnectionManager) once it is used for a remote
+     *
+     * @param connectionId Connection id to assign
+     */
+    void AssignConnectionId(con::ConnectionId connectionId)
+    {
+        m_connectionId = connectionId;
+    }
+
     /**
      * Get the pointer to the send buffer memory region
      * (caller does not have to manage memory)
@@ -91,6 +120,15 @@ public:
         return m_sendBuffer;
     }
 
+    /**
+     * Get the incarnation of the connection. Unique for every connection
+     * object, i.e. differs after a node reconnected. Never 0
+     */
+    uint32_t GetIncarnation() const
+    {
+        return m_incarnation;
+    }
+
     /**
      * Get the ibv_qp of the connection
      */
@@ -99,16 +137,478 @@ public:
         return m_ibQP;
     }
 
+    /**
+     * Get the address of a slot of the (local) region for incoming RDMA writes
+     *
+     * @param slot Slot index
+     */
+    void* GetRdmaRecvSlotAddress(uint8_t slot) const
+    {
+        return (void*) ((uintptr_t) m_rdmaRecvRegion->GetAddress() + sizeof(RdmaRecvRegionHeader) +
+                static_cast<uint64_t>(slot) * m_rdmaRecvSlotSize);
+    }
+
+    /**
+     * Release a slot of the (local) region for incoming RDMA writes once the
+     * data was processed. Slots are released in order of arrival. Called by
+     * the receive dispatcher of the connection, only
+     */
+    void ReleaseRdmaRecvSlot()
+    {
+        auto* header = static_cast<RdmaRecvRegionHeader*>(m_rdmaRecvRegion->GetAddress());
+
+        // read by the remote using RDMA reads
+        __atomic_store_n(&header->m_slotsConsumed, header->m_slotsConsumed + 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Get the number of slots of the remote's region for incoming RDMA writes
+     * (0 if the remote does not accept RDMA writes)
+     */
+    uint8_t GetRemoteRdmaRecvSlots() const
+    {
+        return m_remoteConnectionData.m_rdmaRecvSlots;
+    }
+
+    /**
+     * Get the slot size of the remote's region for incoming RDMA writes
+     */
+    uint32_t GetRemoteRdmaRecvSlotSize() const
+    {
+        return m_remoteConnectionData.m_rdmaRecvSlotSize;
+    }
+
+    /**
+     * Get the rkey of the remote's region for incoming RDMA writes
+     */
+    uint32_t GetRemoteRdmaRecvRKey() const
+    {
+        return m_remoteConnectionData.m_rdmaRecvRKey;
+    }
+
+    /**
+     * Get the (remote) address of a slot of the remote's region for incoming
+     * RDMA writes
+     *
+     * @param slot Slot index
+     */
+    uint64_t GetRemoteRdmaRecvSlotAddress(uint8_t slot) const
+    {
+        return m_remoteConnectionData.m_rdmaRecvAddr + sizeof(RdmaRecvRegionHeader) +
+                static_cast<uint64_t>(slot) * m_remoteConnectionData.m_rdmaRecvSlotSize;
+    }
+
+    /**
+     * Get the (remote) address of the counter of slots consumed by the
+     * remote (target for RDMA reads)
+     */
+    uint64_t GetRemoteRdmaSlotsConsumedAddress() const
+    {
+        return m_remoteConnectionData.m_rdmaRecvAddr + offsetof(RdmaRecvRegionHeader, m_slotsConsumed);
+    }
+
+    /**
+     * Get the local buffer the remote's counter of consumed slots is read to
+     */
+    uint64_t* GetRdmaRemoteSlotsConsumedBuffer() const
+    {
+        return &static_cast<RdmaRecvRegionHeader*>(m_rdmaRecvRegion->GetAddress())->m_remoteSlotsConsumed;
+    }
+
+    /**
+     * Get the lkey of the local region for RDMA writes and reads
+     */
+    uint32_t GetRdmaRecvRegionLKey() const
+    {
+        return m_rdmaRecvRegion->GetLKey();
+    }
+
+    /**
+     * Check if a slot of the remote's region is available for an RDMA write,
+     * i.e. the data previously written to it was consumed by the remote
+     * (according to the last read of the remote's counter). Send dispatcher
+     * of the connection, only
+     */
+    bool IsRemoteRdmaSlotAvailable() const
+    {
+        uint64_t consumed = __atomic_load_n(GetRdmaRemoteSlotsConsumedBuffer(), __ATOMIC_ACQUIRE);
+
+        return m_rdmaSlotsWritten - consumed < m_remoteConnectionData.m_rdmaRecvSlots;
+    }
+
+    /**
+     * Get the next slot of the remote's region to write to and mark it used.
+     * Send dispatcher of the connection, only
+     */
+    uint8_t NextRemoteRdmaSlot()
+    {
+        return static_cast<uint8_t>(m_rdmaSlotsWritten++ % m_remoteConnectionData.m_rdmaRecvSlots);
+    }
+
+    /**
+     * Get the size of the (local) receive ring
+     */
+    uint32_t GetRecvRingSize() const
+    {
+        return m_recvRingSize;
+    }
+
+    /**
+     * Get the address of a position of the (local) receive ring
+     *
+     * @param pos Absolute position (total number of bytes written to the ring)
+     */
+    void* GetRecvRingAddress(uint64_t pos) const
+    {
+        return (void*) ((uintptr_t) m_recvRing->GetAddress() + sizeof(RecvRingHeader) + pos % m_recvRingSize);
+    }
+
+    /**
+     * Check if an address is located in the (local) receive ring
+     */
+    bool IsRecvRingAddress(const void* addr) const
+    {
+        auto start = (uintptr_t) m_recvRing->GetAddress() + sizeof(RecvRingHeader);
+
+        return (uintptr_t) addr >= start && (uintptr_t) addr < start + m_recvRingSize;
+    }
+
+    /**
+     * Get the total number of bytes written to the (local) receive ring by the
+     * remote. The data up to this position is valid
+     */
+    uint64_t GetRecvRingTail() const
+    {
+        return __atomic_load_n(&static_cast<RecvRingHeader*>(m_recvRing->GetAddress())->m_tail, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * Get the total amount of FC data written to the (local) receive ring
+     * header by the remote
+     */
+    uint64_t GetRecvRingFcTotal() const
+    {
+        return __atomic_load_n(&static_cast<RecvRingHeader*>(m_recvRing->GetAddress())->m_fcTotal,
+                __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * Get the position of the (local) receive ring up to which data was handed
+     * to the receive handler. Receive dispatcher of the connection, only
+     */
+    uint64_t GetRecvRingDelivered() const
+    {
+        return m_recvRingDelivered;
+    }
+
+    /**
+     * Get the total amount of FC data of the (local) receive ring handed to the
+     * receive handler. Receive dispatcher of the connection, only
+     */
+    uint64_t GetRecvRingFcDelivered() const
+    {
+        return m_recvRingFcDelivered;
+    }
+
+    /**
+     * Set the data and FC data of the (local) receive ring handed to the
+     * receive handler. Receive dispatcher of the connection, only
+     *
+     * @param pos Position up to which data was delivered
+     * @param fcTotal Total amount of FC data delivered
+     */
+    void SetRecvRingDelivered(uint64_t pos, uint64_t fcTotal)
+    {
+        m_recvRingDelivered = pos;
+        m_recvRingFcDelivered = fcTotal;
+    }
+
+    /**
+     * Release data of the (local) receive ring once it was processed. Data is
+     * released in order of arrival. Receive dispatcher of the connection, only
+     *
+     * @param length Number of bytes to release
+     */
+    void ReleaseRecvRing(uint32_t length)
+    {
+        auto* header = static_cast<RecvRingHeader*>(m_recvRing->GetAddress());
+
+        // read by the remote using RDMA reads
+        __atomic_store_n(&header->m_head, header->m_head + length, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Get the size of the remote's receive ring (0 if the remote does not
+     * provide a receive ring)
+     */
+    uint32_t GetRemoteRecvRingSize() const
+    {
+        return m_remoteConnectionData.m_recvRingSize;
+    }
+
+    /**
+     * Get the rkey of the remote's receive ring
+     */
+    uint32_t GetRemoteRecvRingRKey() const
+    {
+        return m_remoteConnectionData.m_recvRingRKey;
+    }
+
+    /**
+     * Get the (remote) address of a position of the remote's receive ring
+     *
+     * @param pos Absolute position (total number of bytes written to the ring)
+     */
+    uint64_t GetRemoteRecvRingAddress(uint64_t pos) const
+    {
+        return m_remoteConnectionData.m_recvRingAddr + sizeof(RecvRingHeader) +
+                pos % m_remoteConnectionData.m_recvRingSize;
+    }
+
+    /**
+     * Get the (remote) address of the tail and FC total of the remote's
+     * receive ring (target for the RDMA write updating both)
+     */
+    uint64_t GetRemoteRecvRingTailAddress() const
+    {
+        return m_remoteConnectionData.m_recvRingAddr + offsetof(RecvRingHeader, m_tail);
+    }
+
+    /**
+     * Get the (remote) address of the head (bytes consumed) of the remote's
+     * receive ring (target for RDMA reads)
+     */
+    uint64_t GetRemoteRecvRingHeadAddress() const
+    {
+        return m_remoteConnectionData.m_recvRingAddr + offsetof(RecvRingHeader, m_head);
+    }
+
+    /**
+     * Get the local buffer the head of the remote's receive ring is read to
+     */
+    uint64_t* GetRecvRingRemoteHeadBuffer() const
+    {
+        return &static_cast<RecvRingHeader*>(m_recvRing->GetAddress())->m_remoteHead;
+    }
+
+    /**
+     * Get the lkey of the (local) receive ring
+     */
+    uint32_t GetRecvRingLKey() const
+    {
+        return m_recvRing->GetLKey();
+    }
+
+    /**
+     * Get the free space of the remote's receive ring (according to the last
+     * read of the remote's head). Send dispatcher of the connection, only
+     */
+    uint32_t GetRemoteRecvRingFree() const
+    {
+        uint64_t head = __atomic_load_n(GetRecvRingRemoteHeadBuffer(), __ATOMIC_ACQUIRE);
+
+        return static_cast<uint32_t>(m_remoteConnectionData.m_recvRingSize - (m_recvRingWritten - head));
+    }
+
+    /**
+     * Get the total number of bytes written to the remote's receive ring.
+     * Send dispatcher of the connection, only
+     */
+    uint64_t GetRemoteRecvRingWritten() const
+    {
+        return m_recvRingWritten;
+    }
+
+    /**
+     * Get the total amount of FC data written to the remote's receive ring.
+     * Send dispatcher of the connection, only
+     */
+    uint64_t GetRemoteRecvRingFcWritten() const
+    {
+        return m_recvRingFcWritten;
+    }
+
+    /**
+     * Account data and FC data written to the remote's receive ring. Send
+     * dispatcher of the connection, only
+     *
+     * @param length Number of bytes written
+     * @param fcData FC data written
+     */
+    void RemoteRecvRingWritten(uint32_t length, uint8_t fcData)
+    {
+        m_recvRingWritten += length;
+        m_recvRingFcWritten += fcData;
+    }
+
+    /**
+     * Check if the remote's receive ring is mapped to the local address space
+     * (shared memory, remote runs on the same host). Data is copied to the ring
+     * directly instead of using RDMA writes
+     */
+    bool IsRemoteRecvRingMapped() const
+    {
+        return m_remoteRecvRingMapped != nullptr;
+    }
+
+    /**
+     * Get the (local) address of a position of the remote's mapped receive ring
+     *
+     * @param pos Absolute position (total number of bytes written to the ring)
+     */
+    void* GetRemoteRecvRingMappedAddress(uint64_t pos) const
+    {
+        return (void*) ((uintptr_t) m_remoteRecvRingMapped + sizeof(RecvRingHeader) +
+                pos % m_remoteConnectionData.m_recvRingSize);
+    }
+
+    /**
+     * Get the free space of the remote's mapped receive ring. Send dispatcher of
+     * the connection, only
+     */
+    uint32_t GetRemoteRecvRingMappedFree() const
+    {
+        uint64_t head = __atomic_load_n(&static_cast<RecvRingHeader*>(m_remoteRecvRingMapped)->m_head,
+                __ATOMIC_ACQUIRE);
+
+        return static_cast<uint32_t>(m_remoteConnectionData.m_recvRingSize - (m_recvRingWritten - head));
+    }
+
+    /**
+     * Publish the data and FC data written to the remote's mapped receive ring
+     * (see RemoteRecvRingWritten) by updating the ring's tail. Send dispatcher of
+     * the connection, only
+     */
+    void PublishRemoteRecvRingMapped()
+    {
+        auto* header = static_cast<RecvRingHeader*>(m_remoteRecvRingMapped);
+
+        // data copied before, polled by the remote's receive dispatcher
+        __atomic_store_n(&header->m_fcTotal, m_recvRingFcWritten, __ATOMIC_RELEASE);
+        __atomic_store_n(&header->m_tail, m_recvRingWritten, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Get the number of WRQs which can be posted consuming a receive WRQ of
+     * the remote (sends and RDMA writes with immediate) without risking a
+     * RNR NAK. Native flow control only
+     */
+    uint16_t GetSendCredits() const
+    {
+        return m_sendCredits.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Consume send credits for WRQs posted. Send dispatcher of the
+     * connection, only
+     *
+     * @param credits Number of credits to consume
+     */
+    void ConsumeSendCredits(uint16_t credits)
+    {
+        m_sendCredits.fetch_sub(credits, std::memory_order_relaxed);
+    }
+
+    /**
+     * Add send credits returned by the remote. Receive dispatcher of the
+     * connection, only
+     *
+     * @param credits Number of credits returned
+     */
+    void AddSendCredits(uint16_t credits)
+    {
+        m_sendCredits.fetch_add(credits, std::memory_order_release);
+    }
+
+    /**
+     * Get the number of credits to return to the remote
+     */
+    uint16_t GetCreditsToReturn() const
+    {
+        return m_creditsToReturn.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Add credits to return to the remote once receive WRQs consumed by it
+     * are posted again (receive dispatcher of the connection) or taken
+     * credits were not posted (send dispatcher of the connection)
+     *
+     * @param credits Number of credits to add
+     * @return Total number of credits to return
+     */
+    uint16_t AddCreditsToReturn(uint16_t credits)
+    {
+        return static_cast<uint16_t>(m_creditsToReturn.fetch_add(credits, std::memory_order_relaxed) + credits);
+    }
+
+    /**
+     * Take credits to return to the remote with the immediate data of a
+     * send. Send dispatcher of the connection, only
+     *
+     * @return Number of credits taken (max 255)
+     */
+    uint8_t TakeCreditsToReturn()
+    {
+        uint16_t credits = m_creditsToReturn.load(std::memory_order_relaxed);
+        uint16_t taken;
+
+        do {
+            taken = credits > 0xFF ? static_cast<uint16_t>(0xFF) : credits;
+        } while (taken > 0 && !m_creditsToReturn.compare_exchange_weak(credits,
+                static_cast<uint16_t>(credits - taken), std::memory_order_relaxed));
+
+        return static_cast<uint8_t>(taken);
+    }
+
 private:
     struct RemoteConnectionData
     {
         uint32_t m_physicalQPId;
         uint32_t m_psn;
+        uint64_t m_rdmaRecvAddr;
+        uint32_t m_rdmaRecvRKey;
+        uint32_t m_rdmaRecvSlotSize;
+        uint8_t m_rdmaRecvSlots;
+        uint64_t m_recvRingAddr;
+        uint32_t m_recvRingRKey;
+        uint32_t m_recvRingSize;
+        // name of the shared memory segment of the receive ring (empty if
+        // not shared)
+        char m_recvRingShmName[32];
     } __attribute__((__packed__));
 
+    /**
+     * Header of the region for incoming RDMA writes, followed by the slots
+     */
+    struct RdmaRecvRegionHeader
+    {
+        // slots of the local region consumed, read by the remote
+        uint64_t m_slotsConsumed;
+        // target for reading the remote's m_slotsConsumed
+        uint64_t m_remoteSlotsConsumed;
+    } __attribute__((aligned(64)));
+
+    /**
+     * Header of the receive ring, followed by the ring's data
+     */
+    struct RecvRingHeader
+    {
+        // bytes and FC data written to the ring, updated by the remote
+        // with a single RDMA write after the data was written
+        uint64_t m_tail;
+        uint64_t m_fcTotal;
+        // bytes of the ring consumed, read by the remote (separate cache
+        // line, written locally)
+        uint64_t m_head __attribute__((aligned(64)));
+        // target for reading the remote's m_head
+        uint64_t m_remoteHead;
+    } __attribute__((aligned(64)));
+
 private:
+    const uint32_t m_incarnation;
     const uint32_t m_sendBufferSize;
     core::IbProtDom* m_refProtDom;
+    core::IbMemAllocator* m_refMemAllocator;
     core::IbMemReg* m_sendBuffer;
 
     ibv_qp* m_ibQP;
@@ -129,8 +629,31 @@ private:
     const uint16_t m_ibSharedRCQSize;
 
     const uint16_t m_maxSGEs;
+    const uint32_t m_maxInlineData;
+
+    const uint32_t m_rdmaRecvSlotSize;
+    const uint8_t m_rdmaRecvSlots;
+    core::IbMemReg* m_rdmaRecvRegion;
+
+    uint64_t m_rdmaSlotsWritten;
+
+    const uint32_t m_recvRingSize;
+    core::IbMemReg* m_recvRing;
+    std::string m_recvRingShmName;
+    void* m_remoteRecvRingMapped;
+
+    uint64_t m_recvRingDelivered;
+    uint64_t m_recvRingFcDelivered;
+
+    uint64_t m_recvRingWritten;
+    uint64_t m_recvRingFcWritten;
+
+    std::atomic<uint16_t> m_sendCredits;
+    std::atomic<uint16_t> m_creditsToReturn;
 
 private:
+    static uint32_t __NextIncarnation();
+
     void __CreateQP();
 
     void __SetInitStateQP();
@@ -138,6 +661,12 @@ private:
     void __SetReadyToSend();
 
     void __SetReadyToRecv();
+
+    void __CreateRecvRingShm(uint64_t size);
+
+    void __MapRemoteRecvRing();
+
+    void __UnmapRemoteRecvRing();
 };
 
 }
@@ -18,6 +18,10 @@
 
 #include "ConnectionManager.h"
 
+#include <algorithm>
+
+#include <fcntl.h>
+
 #include "ibnet/core/IbQueueFullException.h"
 
 #include "Connection.h"
@@ -27,25 +31,46 @@ namespace msgrc {
 
 ConnectionManager::ConnectionManager(con::NodeId ownNodeId,
         const con::NodeConf& nodeConf, uint32_t connectionCreationTimeoutMs,
-        uint32_t maxNumConnections, core::IbDevice* refDevice,
+        uint32_t maxNumConnections, uint8_t numSetupWorkers, core::IbDevice* refDevice,
         core::IbProtDom* refProtDom, con::ExchangeManager* refExchangeManager,
         con::JobManager* refJobManager,
         con::DiscoveryManager* refDiscoveryManager, uint32_t sendBufferSize,
         uint16_t ibSQSize, uint16_t ibSRQSize, uint16_t ibSharedSCQSize,
-        uint16_t ibSharedRCQSize, uint16_t maxSGEs) :
+        uint8_t numSendShards, uint16_t ibSharedRCQSize,
+        uint8_t numRecvShards, uint16_t maxSGEs, uint32_t inlineThreshold,
+        uint32_t rdmaRecvSlotSize, uint8_t rdmaRecvSlots,
+        uint32_t recvRingSize, uint32_t intraHostRingSize,
+        uint16_t qpPoolSize, uint16_t fcCredits, core::IbMemAllocator* refMemAllocator) :
         con::ConnectionManager("MsgRC", ownNodeId, nodeConf,
-                connectionCreationTimeoutMs, maxNumConnections, refDevice, refProtDom,
+                connectionCreationTimeoutMs, maxNumConnections, numSetupWorkers, refDevice, refProtDom,
                 refExchangeManager, refJobManager, refDiscoveryManager),
         m_sendBufferSize(sendBufferSize),
         m_maxSGEs(maxSGEs),
+        m_inlineThreshold(inlineThreshold),
+        m_rdmaRecvSlotSize(rdmaRecvSlotSize),
+        m_rdmaRecvSlots(rdmaRecvSlots),
+        m_recvRingSize(recvRingSize),
+        m_intraHostRingSize(intraHostRingSize),
+        m_fcCredits(fcCredits),
+        m_refMemAllocator(refMemAllocator),
         m_ibSQSize(ibSQSize),
-        m_ibSRQ(__CreateSRQ(ibSRQSize)),
+        m_ibSRQs(),
         m_ibSRQSize(ibSRQSize),
-        m_ibSharedSCQ(__CreateCQ(ibSharedSCQSize)),
+        m_ibSharedSCQs(),
+        m_ibSharedSCQChannels(),
         m_ibSharedSCQSize(ibSharedSCQSize),
-        m_ibSharedRCQ(__CreateCQ(ibSharedRCQSize)),
+        m_ibSharedRCQs(),
+        m_ibSharedRCQChannels(),
         m_ibSharedRCQSize(ibSharedRCQSize),
-        m_initialSRQFill(true)
+        m_initialSRQFill(true),
+        m_recvRingNodesLock(),
+        m_recvRingNodes(),
+        m_numRecvRingNodes(nullptr),
+        m_qpPoolSize(qpPoolSize),
+        m_qpPoolLock(),
+        m_qpPool(),
+        m_qpPoolRefillPending(false),
+        m_qpPoolRefillJobType(con::JobQueue::JOB_TYPE_INVALID)
 {
     // using a SRQ, we have to check against that max as well because max sge and max srq sge can actually
     // have different values
@@ -53,21 +78,258 @@ ConnectionManager::ConnectionManager(con::NodeId ownNodeId,
         throw core::IbException("Invalid maxSGEs (%d), limits: max sge %d, max srq sge %d", maxSGEs,
                 refDevice->GetMaxSGEs(), refDevice->GetMaxSGEsSRQ());
     }
+
+    if (inlineThreshold > refDevice->GetMaxInlineData()) {
+        throw core::IbException("Invalid inlineThreshold (%d), limit: max inline data %d", inlineThreshold,
+                refDevice->GetMaxInlineData());
+    }
+
+    // slot index + 1 is transferred with the immediate data (8 bit)
+    if (rdmaRecvSlots == 0xFF) {
+        throw core::IbException("Invalid number of RDMA recv slots: %d", rdmaRecvSlots);
+    }
+
+    // tail and FC data of the receive ring are updated with a 16 byte
+    // inline RDMA write (fallback for shared memory rings as well)
+    if (HasRecvRings() && refDevice->GetMaxInlineData() < 2 * sizeof(uint64_t)) {
+        throw core::IbException("Receive ring not supported, max inline data %d too small",
+                refDevice->GetMaxInlineData());
+    }
+
+    if (numSendShards == 0) {
+        throw core::IbException("Invalid number of send shards: %d", numSendShards);
+    }
+
+    if (numRecvShards == 0) {
+        throw core::IbException("Invalid number of recv shards: %d", numRecvShards);
+    }
+
+    // the credits of all connections of a receive shard must be backed by
+    // the shard's SRQ, plus slack for the (uncredited) credit returns
+    if (fcCredits > 0) {
+        uint32_t connsPerShard = (maxNumConnections + numRecvShards - 1) / numRecvShards;
+
+        if (static_cast<uint64_t>(connsPerShard) * (fcCredits + 2) > ibSRQSize) {
+            throw core::IbException("SRQ size %d too small for %d flow control credits and up to %d connections "
+                    "per receive shard", ibSRQSize, fcCredits, connsPerShard);
+        }
+    }
+
+    // the completion channels allow the dispatchers to block when idle
+    for (uint8_t i = 0; i < numSendShards; i++) {
+        m_ibSharedSCQChannels.push_back(__CreateCompChannel());
+        m_ibSharedSCQs.push_back(__CreateCQ(ibSharedSCQSize, m_ibSharedSCQChannels.back()));
+    }
+
+    // a SRQ per receive shard: posted receive work requests and their
+    // completions are tracked by a single receive dispatcher, only
+    for (uint8_t i = 0; i < numRecvShards; i++) {
+        m_ibSRQs.push_back(__CreateSRQ(ibSRQSize));
+        m_ibSharedRCQChannels.push_back(__CreateCompChannel());
+        m_ibSharedRCQs.push_back(__CreateCQ(ibSharedRCQSize, m_ibSharedRCQChannels.back()));
+    }
+
+    m_numRecvRingNodes = new std::atomic<uint16_t>[numRecvShards];
+
+    for (uint8_t i = 0; i < numRecvShards; i++) {
+        m_numRecvRingNodes[i].store(0, std::memory_order_relaxed);
+
+        // max number of node ids assigned to a shard
+        if (HasRecvRings()) {
+            m_recvRingNodes.push_back(new con::NodeId[con::NODE_ID_MAX_NUM_NODES / numRecvShards + 1]);
+        }
+    }
+
+    // initial fill in the background as well
+    if (m_qpPoolSize > 0) {
+        m_qpPool.resize(static_cast<size_t>(numSendShards) * numRecvShards);
+
+        m_qpPoolRefillJobType = _GetRefJobManager()->GenerateJobTypeId();
+        _GetRefJobManager()->AddDispatcher(m_qpPoolRefillJobType, this);
+
+        __AddJobRefillQPPool();
+    }
 }
 
 ConnectionManager::~ConnectionManager()
 {
-    ibv_destroy_srq(m_ibSRQ);
-    ibv_destroy_cq(m_ibSharedSCQ);
-    ibv_destroy_cq(m_ibSharedRCQ);
+    // QPs of the connections use the shared SRQs and CQs destroyed below
+    _CloseAllConnections();
+
+    if (m_qpPoolSize > 0) {
+        // waits for a refill in progress
+        _GetRefJobManager()->RemoveDispatcher(m_qpPoolRefillJobType, this);
+
+        for (auto& pool : m_qpPool) {
+            for (auto& it : pool) {
+                delete it;
+            }
+        }
+    }
+
+    for (auto& it : m_ibSRQs) {
+        core::IbVerbs::DestroySRQ(it);
+    }
+
+    for (auto& it : m_ibSharedSCQs) {
+        core::IbVerbs::DestroyCQ(it);
+    }
+
+    for (auto& it : m_ibSharedRCQs) {
+        core::IbVerbs::DestroyCQ(it);
+    }
+
+    // after the CQs using them
+    for (auto& it : m_ibSharedSCQChannels) {
+        core::IbVerbs::DestroyCompChannel(it);
+    }
+
+    for (auto& it : m_ibSharedRCQChannels) {
+        core::IbVerbs::DestroyCompChannel(it);
+    }
+
+    for (auto& it : m_recvRingNodes) {
+        delete[] it;
+    }
+
+    delete[] m_numRecvRingNodes;
 }
 
 con::Connection* ConnectionManager::_CreateConnection(
-        con::ConnectionId connectionId)
+        con::ConnectionId connectionId, con::NodeId remoteNodeId)
+{
+    // send and receive completions of the connection are polled by the
+    // dispatchers of the shards the remote node is assigned to
+    uint8_t sendShardId = GetSendShardId(remoteNodeId);
+    uint8_t recvShardId = GetRecvShardId(remoteNodeId);
+
+    // co-located nodes write to a receive ring in shared memory
+    bool intraHost = m_intraHostRingSize > 0 && _GetRefDiscoveryManager()->IsColocated(remoteNodeId);
+
+    // the rings in shared memory are created per remote, not pooled
+    if (m_qpPoolSize > 0 && !intraHost) {
+        Connection* connection = __TakeFromQPPool(sendShardId, recvShardId);
+
+        if (connection) {
+            connection->AssignConnectionId(connectionId);
+            return connection;
+        }
+    }
+
+    return __NewConnection(connectionId, sendShardId, recvShardId, intraHost);
+}
+
+void ConnectionManager::_DispatchJob(const con::JobQueue::Job* job)
+{
+    if (job->m_type == m_qpPoolRefillJobType) {
+        __RefillQPPool();
+    } else {
+        con::ConnectionManager::_DispatchJob(job);
+    }
+}
+
+Connection* ConnectionManager::__NewConnection(con::ConnectionId connectionId,
+        uint8_t sendShardId, uint8_t recvShardId, bool intraHost)
 {
     return new msgrc::Connection(_GetOwnNodeId(), connectionId,
-            m_sendBufferSize, m_ibSQSize, m_ibSRQ, m_ibSRQSize, m_ibSharedSCQ,
-            m_ibSharedSCQSize, m_ibSharedRCQ, m_ibSharedRCQSize, m_maxSGEs, _GetRefProtDom());
+            m_sendBufferSize, m_ibSQSize, m_ibSRQs[recvShardId], m_ibSRQSize,
+            m_ibSharedSCQs[sendShardId],
+            m_ibSharedSCQSize, m_ibSharedRCQs[recvShardId], m_ibSharedRCQSize,
+            // the receive ring's tail is updated using an inline RDMA write
+            m_maxSGEs, HasRecvRings() ? std::max<uint32_t>(m_inlineThreshold, 2 * sizeof(uint64_t)) :
+                    m_inlineThreshold,
+            m_rdmaRecvSlotSize, m_rdmaRecvSlots, intraHost ? m_intraHostRingSize : m_recvRingSize, intraHost,
+            m_fcCredits, _GetRefProtDom(), m_refMemAllocator);
+}
+
+Connection* ConnectionManager::__TakeFromQPPool(uint8_t sendShardId, uint8_t recvShardId)
+{
+    Connection* connection = nullptr;
+
+    {
+        std::lock_guard<std::mutex> l(m_qpPoolLock);
+
+        std::vector<Connection*>& pool = m_qpPool[sendShardId * m_ibSharedRCQs.size() + recvShardId];
+
+        if (!pool.empty()) {
+            connection = pool.back();
+            pool.pop_back();
+        }
+    }
+
+    if (!connection) {
+        IBNET_LOG_DEBUG("QP pool of shards %d/%d empty, creating connection on demand",
+                sendShardId, recvShardId);
+    }
+
+    __AddJobRefillQPPool();
+
+    return connection;
+}
+
+void ConnectionManager::__AddJobRefillQPPool()
+{
+    // a single refill job in flight is enough, it refills all pools
+    if (m_qpPoolRefillPending.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    _GetRefJobManager()->AddJob(new con::JobQueue::Job(m_qpPoolRefillJobType));
+}
+
+void ConnectionManager::__RefillQPPool()
+{
+    // clear before refilling to not lose requests for connections taken
+    // while refilling
+    m_qpPoolRefillPending.store(false, std::memory_order_release);
+
+    size_t numRecvShards = m_ibSharedRCQs.size();
+
+    for (size_t i = 0; i < m_qpPool.size(); i++) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> l(m_qpPoolLock);
+
+                if (m_qpPool[i].size() >= m_qpPoolSize) {
+                    break;
+                }
+            }
+
+            // expensive part (QP creation and memory registration) outside
+            // of the lock
+            Connection* connection = __NewConnection(con::CONNECTION_ID_INVALID,
+                    static_cast<uint8_t>(i / numRecvShards),
+                    static_cast<uint8_t>(i % numRecvShards), false);
+
+            std::lock_guard<std::mutex> l(m_qpPoolLock);
+            m_qpPool[i].push_back(connection);
+        }
+    }
+
+    IBNET_LOG_TRACE("QP pool refilled");
+}
+
+void ConnectionManager::_ConnectionOpened(con::Connection& connection)
+{
+    if (static_cast<msgrc::Connection&>(connection).GetRecvRingSize() == 0) {
+        return;
+    }
+
+    uint8_t shardId = GetRecvShardId(connection.GetRemoteNodeId());
+
+    std::lock_guard<std::mutex> l(m_recvRingNodesLock);
+
+    uint16_t numNodes = m_numRecvRingNodes[shardId].load(std::memory_order_relaxed);
+
+    // reconnect, node is already polled by the receive dispatcher
+    for (uint16_t i = 0; i < numNodes; i++) {
+        if (m_recvRingNodes[shardId][i] == connection.GetRemoteNodeId()) {
+            return;
+        }
+    }
+
+    m_recvRingNodes[shardId][numNodes] = connection.GetRemoteNodeId();
+    m_numRecvRingNodes[shardId].store(static_cast<uint16_t>(numNodes + 1), std::memory_order_release);
 }
 
 ibv_srq* ConnectionManager::__CreateSRQ(uint16_t size)
@@ -81,7 +343,7 @@ ibv_srq* ConnectionManager::__CreateSRQ(uint16_t size)
     attr.attr.max_wr = size;
 
     IBNET_LOG_TRACE("ibv_create_srq, size %d", size);
-    srq = ibv_create_srq(_GetRefProtDom()->GetIBProtDom(), &attr);
+    srq = core::IbVerbs::CreateSRQ(_GetRefProtDom()->GetIBProtDom(), &attr);
 
     if (srq == nullptr) {
         throw core::IbException("Creating shared receive queue failed: %s",
@@ -91,12 +353,12 @@ ibv_srq* ConnectionManager::__CreateSRQ(uint16_t size)
     return srq;
 }
 
-ibv_cq* ConnectionManager::__CreateCQ(uint16_t size)
+ibv_cq* ConnectionManager::__CreateCQ(uint16_t size, ibv_comp_channel* channel)
 {
     ibv_cq* cq;
 
     IBNET_LOG_TRACE("ibv_create_cq, size %d", size);
-    cq = ibv_create_cq(_GetRefDevice()->GetIBCtx(), size, nullptr, nullptr, 0);
+    cq = core::IbVerbs::CreateCQ(_GetRefDevice()->GetIBCtx(), size, nullptr, channel, 0);
 
     if (cq == nullptr) {
         throw core::IbException("Creating completion queue failed: %s",
@@ -106,5 +368,28 @@ ibv_cq* ConnectionManager::__CreateCQ(uint16_t size)
     return cq;
 }
 
+ibv_comp_channel* ConnectionManager::__CreateCompChannel()
+{
+    IBNET_LOG_TRACE("ibv_create_comp_channel");
+    ibv_comp_channel* channel = core::IbVerbs::CreateCompChannel(_GetRefDevice()->GetIBCtx());
+
+    if (channel == nullptr) {
+        throw core::IbException("Creating completion channel failed: %s",
+                strerror(errno));
+    }
+
+    // events are consumed after waking up from polling the fd, never block
+    // on consuming
+    int flags = fcntl(channel->fd, F_GETFL);
+
+    if (flags < 0 || fcntl(channel->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        core::IbVerbs::DestroyCompChannel(channel);
+        throw core::IbException("Setting completion channel non blocking failed: %s",
+                strerror(errno));
+    }
+
+    return channel;
+}
+
+}
 }
-}
\ No newline at end of file
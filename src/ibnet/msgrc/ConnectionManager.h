@@ -19,13 +19,21 @@
 #ifndef IBNET_MSGRC_CONNECTIONMANAGER_H
 #define IBNET_MSGRC_CONNECTIONMANAGER_H
 
+#include <mutex>
+#include <vector>
+
 #include "ibnet/con/ConnectionManager.h"
 
+#include "ibnet/core/IbVerbs.h"
+
 #include "ibnet/dx/RecvBufferPool.h"
 
 namespace ibnet {
 namespace msgrc {
 
+// forward declaration
+class Connection;
+
 /**
  * Connection manager for reliable messaging using RC queue pairs
  *
@@ -41,6 +49,8 @@ public:
      * @param nodeConf Node config to use
      * @param connectionCreationTimeoutMs Timeout for connection creation in ms
      * @param maxNumConnections Max number of connections to manage
+     * @param numSetupWorkers Number of threads creating, connecting and
+     *        closing connections (concurrently for different nodes)
      * @param refDevice Pointer to the IbDevice (managed by caller)
      * @param refProtDom Pointer to the IbProtDom (managed by caller)
      * @param refExchangeManager Pointer to exchange manager to use for
@@ -51,19 +61,53 @@ public:
      *        (managed by caller)
      * @param sendBufferSize Size of the send (ring) buffer in bytes
      * @param ibSQSize Size of the send queue
-     * @param ibSRQSize Size of the shared receive queue
-     * @param ibSharedSCQSize Size of the shared send completion queue
-     * @param ibSharedRCQSize Size of the shared receive completion queue
+     * @param ibSRQSize Size of a shared receive queue
+     * @param ibSharedSCQSize Size of a shared send completion queue
+     * @param numSendShards Number of send shards. Each shard gets a separate
+     *        shared send completion queue and is assigned a disjoint set of
+     *        remote node ids (see GetSendShardId)
+     * @param ibSharedRCQSize Size of a shared receive completion queue
+     * @param numRecvShards Number of receive shards. Each shard gets a
+     *        separate shared receive queue and shared receive completion
+     *        queue and is assigned a disjoint set of remote node ids (see
+     *        GetRecvShardId)
      * @param maxSGEs Max number of SGEs used for a single work request
+     * @param inlineThreshold Max size of data (in bytes) of a send WRQ to
+     *        be posted inline (0 to disable inline sends, must not exceed
+     *        the device's limit)
+     * @param rdmaRecvSlotSize Size of a single slot of the region for
+     *        incoming RDMA writes (per connection)
+     * @param rdmaRecvSlots Number of slots of the region for incoming RDMA
+     *        writes (per connection, 0 to not accept RDMA writes)
+     * @param recvRingSize Size of the receive ring (per connection) for
+     *        one-sided messaging using RDMA writes (0 to use messaging
+     *        verbs, instead)
+     * @param intraHostRingSize Size of the receive ring (per connection)
+     *        for remote nodes running on the same host. The ring is allocated
+     *        in shared memory and written to by the remote directly (0 to
+     *        handle co-located nodes like any other node)
+     * @param qpPoolSize Number of connections (QP in INIT state and
+     *        registered buffers) created in advance per pair of send and
+     *        receive shard. Connections are taken from the pool on creation
+     *        and the pool is refilled by the job manager (0 to disable)
+     * @param fcCredits Number of receive WRQs of the remote's SRQ each
+     *        connection may consume before the remote returns credits
+     *        (native flow control, 0 to disable)
+     * @param refMemAllocator Pointer to the allocator for the (registered)
+     *        buffers of the connections (managed by caller)
      */
     ConnectionManager(con::NodeId ownNodeId, const con::NodeConf& nodeConf,
             uint32_t connectionCreationTimeoutMs, uint32_t maxNumConnections,
-            core::IbDevice* refDevice, core::IbProtDom* refProtDom,
+            uint8_t numSetupWorkers, core::IbDevice* refDevice, core::IbProtDom* refProtDom,
             con::ExchangeManager* refExchangeManager,
             con::JobManager* refJobManager,
             con::DiscoveryManager* refDiscoveryManager, uint32_t sendBufferSize,
             uint16_t ibSQSize, uint16_t ibSRQSize, uint16_t ibSharedSCQSize,
-            uint16_t ibSharedRCQSize, uint16_t maxSGEs);
+            uint8_t numSendShards, uint16_t ibSharedRCQSize,
+            uint8_t numRecvShards, uint16_t maxSGEs, uint32_t inlineThreshold,
+            uint32_t rdmaRecvSlotSize, uint8_t rdmaRecvSlots,
+            uint32_t recvRingSize, uint32_t intraHostRingSize,
+            uint16_t qpPoolSize, uint16_t fcCredits, core::IbMemAllocator* refMemAllocator);
 
     /**
      * Destructor
@@ -79,15 +123,47 @@ public:
     }
 
     /**
-     * Get the shared receive queue
+     * Get the number of credits (receive WRQs of the remote's SRQ) of a
+     * connection for native flow control (0 if disabled)
+     */
+    uint16_t GetFcCredits() const
+    {
+        return m_fcCredits;
+    }
+
+    /**
+     * Get the number of receive shards
+     */
+    uint8_t GetNumRecvShards() const
+    {
+        return static_cast<uint8_t>(m_ibSharedRCQs.size());
+    }
+
+    /**
+     * Get the receive shard a remote node is assigned to. All data received
+     * from that node is delivered to the shard's shared receive queue and
+     * receive completion queue, i.e. order is kept per remote node
+     *
+     * @param nodeId Node id of the remote
+     * @return Id of the receive shard the node is assigned to
+     */
+    uint8_t GetRecvShardId(con::NodeId nodeId) const
+    {
+        return static_cast<uint8_t>(nodeId % m_ibSharedRCQs.size());
+    }
+
+    /**
+     * Get the shared receive queue of a receive shard
+     *
+     * @param shardId Id of the receive shard
      */
-    ibv_srq* GetIbSRQ() const
+    ibv_srq* GetIbSRQ(uint8_t shardId) const
     {
-        return m_ibSRQ;
+        return m_ibSRQs[shardId];
     }
 
     /**
-     * Get the size of the shared receive queue
+     * Get the size of a shared receive queue
      */
     uint16_t GetIbSRQSize() const
     {
@@ -95,15 +171,66 @@ public:
     }
 
     /**
-     * Get the shared send completion queue
+     * Get the number of send shards
      */
-    ibv_cq* GetIbSharedSCQ() const
+    uint8_t GetNumSendShards() const
     {
-        return m_ibSharedSCQ;
+        return static_cast<uint8_t>(m_ibSharedSCQs.size());
     }
 
     /**
-     * Get the size of the shared send completion queue
+     * Get the send shard a remote node is assigned to. All send work
+     * requests to that node must be posted and polled by the shard's
+     * SendDispatcher
+     *
+     * @param nodeId Node id of the remote
+     * @return Id of the send shard the node is assigned to
+     */
+    uint8_t GetSendShardId(con::NodeId nodeId) const
+    {
+        return static_cast<uint8_t>(nodeId % m_ibSharedSCQs.size());
+    }
+
+    /**
+     * Get the shared send completion queue of a send shard
+     *
+     * @param shardId Id of the send shard
+     */
+    ibv_cq* GetIbSharedSCQ(uint8_t shardId) const
+    {
+        return m_ibSharedSCQs[shardId];
+    }
+
+    /**
+     * Get the completion channel of the shared send completion queue of a
+     * send shard (non blocking fd, to wait for completion notifications)
+     *
+     * @param shardId Id of the send shard
+     */
+    ibv_comp_channel* GetIbSharedSCQChannel(uint8_t shardId) const
+    {
+        return m_ibSharedSCQChannels[shardId];
+    }
+
+    /**
+     * Consume (and acknowledge) all pending completion events of a completion
+     * channel. Call after the channel's fd was signaled to re-arm notifications
+     *
+     * @param channel Completion channel of a shared completion queue
+     */
+    static void ConsumeCQEvents(ibv_comp_channel* channel)
+    {
+        ibv_cq* cq;
+        void* ctx;
+
+        // non blocking fd, fails with EAGAIN if no events are left
+        while (core::IbVerbs::GetCQEvent(channel, &cq, &ctx) == 0) {
+            core::IbVerbs::AckCQEvents(cq, 1);
+        }
+    }
+
+    /**
+     * Get the size of a shared send completion queue
      */
     uint16_t GetIbSharedSCQSize() const
     {
@@ -111,15 +238,28 @@ public:
     }
 
     /**
-     * Get the shared receive completion queue
+     * Get the shared receive completion queue of a receive shard
+     *
+     * @param shardId Id of the receive shard
      */
-    ibv_cq* GetIbSharedRCQ() const
+    ibv_cq* GetIbSharedRCQ(uint8_t shardId) const
     {
-        return m_ibSharedRCQ;
+        return m_ibSharedRCQs[shardId];
     }
 
     /**
-     * Get the size of the shared receive completion queue
+     * Get the completion channel of the shared receive completion queue of a
+     * receive shard (non blocking fd, to wait for completion notifications)
+     *
+     * @param shardId Id of the receive shard
+     */
+    ibv_comp_channel* GetIbSharedRCQChannel(uint8_t shardId) const
+    {
+        return m_ibSharedRCQChannels[shardId];
+    }
+
+    /**
+     * Get the size of a shared receive completion queue
      */
     uint16_t GetIbSharedRCQSize() const
     {
@@ -134,31 +274,124 @@ public:
         return m_maxSGEs;
     }
 
+    /**
+     * Get the max size of data (in bytes) of a send WRQ to be posted inline
+     */
+    uint32_t GetInlineThreshold() const
+    {
+        return m_inlineThreshold;
+    }
+
+    /**
+     * Get the size of the receive ring for one-sided messaging (0 if disabled)
+     */
+    uint32_t GetRecvRingSize() const
+    {
+        return m_recvRingSize;
+    }
+
+    /**
+     * Get the size of the receive ring for co-located nodes (0 if disabled)
+     */
+    uint32_t GetIntraHostRingSize() const
+    {
+        return m_intraHostRingSize;
+    }
+
+    /**
+     * Check if connections might provide a receive ring, i.e. one-sided
+     * messaging or the shared memory rings for co-located nodes are enabled
+     */
+    bool HasRecvRings() const
+    {
+        return m_recvRingSize > 0 || m_intraHostRingSize > 0;
+    }
+
+    /**
+     * Get the number of nodes of a receive shard which (ever) connected and
+     * provide a receive ring to poll. The list only grows, check if the
+     * connection of a node is available before using it
+     *
+     * @param shardId Id of the receive shard
+     */
+    uint16_t GetNumRecvRingNodes(uint8_t shardId) const
+    {
+        return m_numRecvRingNodes[shardId].load(std::memory_order_acquire);
+    }
+
+    /**
+     * Get a node of the list of nodes of a receive shard with a receive ring
+     *
+     * @param shardId Id of the receive shard
+     * @param idx Index in the list (< GetNumRecvRingNodes)
+     */
+    con::NodeId GetRecvRingNode(uint8_t shardId, uint16_t idx) const
+    {
+        return m_recvRingNodes[shardId][idx];
+    }
+
 protected:
-    con::Connection* _CreateConnection(con::ConnectionId connectionId) override;
+    con::Connection* _CreateConnection(con::ConnectionId connectionId,
+            con::NodeId remoteNodeId) override;
+
+    void _ConnectionOpened(con::Connection& connection) override;
+
+    void _DispatchJob(const con::JobQueue::Job* job) override;
 
 private:
     const uint32_t m_sendBufferSize;
     const uint16_t m_maxSGEs;
+    const uint32_t m_inlineThreshold;
+    const uint32_t m_rdmaRecvSlotSize;
+    const uint8_t m_rdmaRecvSlots;
+    const uint32_t m_recvRingSize;
+    const uint32_t m_intraHostRingSize;
+    const uint16_t m_fcCredits;
+    core::IbMemAllocator* m_refMemAllocator;
 
     const uint16_t m_ibSQSize;
 
-    ibv_srq* m_ibSRQ;
+    std::vector<ibv_srq*> m_ibSRQs;
     const uint16_t m_ibSRQSize;
 
-    ibv_cq* m_ibSharedSCQ;
+    std::vector<ibv_cq*> m_ibSharedSCQs;
+    std::vector<ibv_comp_channel*> m_ibSharedSCQChannels;
     const uint16_t m_ibSharedSCQSize;
 
-    ibv_cq* m_ibSharedRCQ;
+    std::vector<ibv_cq*> m_ibSharedRCQs;
+    std::vector<ibv_comp_channel*> m_ibSharedRCQChannels;
     const uint16_t m_ibSharedRCQSize;
 
 private:
     std::atomic<bool> m_initialSRQFill;
 
+    std::mutex m_recvRingNodesLock;
+    std::vector<con::NodeId*> m_recvRingNodes;
+    std::atomic<uint16_t>* m_numRecvRingNodes;
+
+    const uint16_t m_qpPoolSize;
+    // per pair of send and receive shard (send shard * num recv shards +
+    // recv shard)
+    std::mutex m_qpPoolLock;
+    std::vector<std::vector<Connection*>> m_qpPool;
+    std::atomic<bool> m_qpPoolRefillPending;
+    con::JobQueue::JobType m_qpPoolRefillJobType;
+
 private:
+    Connection* __NewConnection(con::ConnectionId connectionId, uint8_t sendShardId,
+            uint8_t recvShardId, bool intraHost);
+
+    Connection* __TakeFromQPPool(uint8_t sendShardId, uint8_t recvShardId);
+
+    void __AddJobRefillQPPool();
+
+    void __RefillQPPool();
+
     ibv_srq* __CreateSRQ(uint16_t size);
 
-    ibv_cq* __CreateCQ(uint16_t size);
+    ibv_cq* __CreateCQ(uint16_t size, ibv_comp_channel* channel);
+
+    ibv_comp_channel* __CreateCompChannel();
 };
 
 }
@@ -107,6 +107,10 @@ private:
     RingBuffer* m_buffer;
 };
 
+// layout accessed by the Java side using raw pointers, bump IBNET_VERSION
+// and update the README on changes
+static_assert(sizeof(IncomingRingBuffer::RingBuffer::Entry) == 24, "Layout of RingBuffer::Entry changed");
+
 }
 }
 
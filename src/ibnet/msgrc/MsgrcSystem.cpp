@@ -19,6 +19,8 @@
 #include <ibnet/sys/IllegalStateException.h>
 #include "MsgrcSystem.h"
 
+#include "ibnet/stats/CsvExporter.h"
+#include "ibnet/stats/JsonExporter.h"
 #include "ibnet/sys/Random.h"
 #include "ibnet/sys/SystemInfo.h"
 
@@ -30,14 +32,18 @@ MsgrcSystem::MsgrcSystem() :
         m_signalHandler(nullptr),
         m_device(nullptr),
         m_protDom(nullptr),
+        m_memRegCache(nullptr),
+        m_memAllocator(nullptr),
         m_discoveryManager(nullptr),
         m_exchangeManager(nullptr),
         m_jobManager(nullptr),
         m_recvBufferPool(nullptr),
         m_statisticsManager(nullptr),
+        m_statisticsExporters(),
+        m_prometheusEndpoint(nullptr),
         m_connectionManager(nullptr),
-        m_recvDispatcher(nullptr),
-        m_sendDispatcher(nullptr),
+        m_recvDispatchers(),
+        m_sendDispatchers(),
         m_executionEngine(nullptr)
 {
 
@@ -54,6 +60,18 @@ void MsgrcSystem::Init()
         throw sys::IllegalStateException("Configuration null");
     }
 
+    if (m_configuration->m_numSendDispatchers == 0) {
+        throw sys::IllegalStateException("Number of send dispatchers must be at least 1");
+    }
+
+    if (m_configuration->m_numRecvDispatchers == 0) {
+        throw sys::IllegalStateException("Number of recv dispatchers must be at least 1");
+    }
+
+    if (m_configuration->m_sendSignalInterval == 0) {
+        throw sys::IllegalStateException("Send signal interval must be at least 1");
+    }
+
     // setup foundation
     if (m_configuration->m_enableSignalHandler) {
         m_signalHandler = new backward::SignalHandling();
@@ -75,8 +93,18 @@ void MsgrcSystem::Init()
 
     IBNET_LOG_DEBUG("Protection domain:\n%s", *m_protDom);
 
+    m_memRegCache = new ibnet::core::IbMemRegCache(m_protDom,
+            m_configuration->m_memRegCacheMaxRegions);
+
+    // backing memory of the receive buffer pool and the connection's buffers
+    m_memAllocator = new ibnet::core::IbMemAllocator(
+            static_cast<ibnet::core::IbMemAllocator::PageSize>(m_configuration->m_hugePageSizeMb),
+            m_configuration->m_numaLocalMemory ? m_device->GetNumaNode() : -1);
+
     m_exchangeManager = new con::ExchangeManager(
-            m_configuration->m_ownNodeId, m_configuration->m_portDiscMan);
+            m_configuration->m_ownNodeId, m_configuration->m_portDiscMan,
+            m_configuration->m_bindAddrDiscMan.empty() ? 0 :
+                    sys::AddressIPV4(m_configuration->m_bindAddrDiscMan).GetAddress());
     m_jobManager = new con::JobManager();
 
     m_discoveryManager = new con::DiscoveryManager(
@@ -84,47 +112,99 @@ void MsgrcSystem::Init()
             m_exchangeManager, m_jobManager);
     m_discoveryManager->SetListener(this);
 
-    m_recvBufferPool = new dx::RecvBufferPool(
-            m_configuration->m_recvBufferPoolSizeBytes,
-            m_configuration->m_recvBufferSize, m_protDom);
+    if (!m_configuration->m_statisticsJsonFile.empty()) {
+        m_statisticsExporters.push_back(new stats::JsonExporter(m_configuration->m_statisticsJsonFile));
+    }
+
+    if (!m_configuration->m_statisticsCsvFile.empty()) {
+        m_statisticsExporters.push_back(new stats::CsvExporter(m_configuration->m_statisticsCsvFile));
+    }
 
     m_statisticsManager = new stats::StatisticsManager(
-            m_configuration->m_statisticsThreadPrintIntervalMs, m_device);
+            m_configuration->m_statisticsThreadPrintIntervalMs,
+            m_statisticsExporters.empty() ? 0 : m_configuration->m_statisticsExportIntervalMs,
+            m_configuration->m_statisticsRollingWindows, m_device);
+
+    for (auto& it : m_statisticsExporters) {
+        m_statisticsManager->AddExporter(it);
+    }
+
+    m_recvBufferPool = new dx::RecvBufferPool(
+            m_configuration->m_recvBufferPoolSizeBytes,
+            m_configuration->m_recvBufferSize, m_protDom, m_memAllocator,
+            m_statisticsManager);
 
     m_connectionManager = new ConnectionManager(
             m_configuration->m_ownNodeId, m_configuration->m_nodeConfig,
             m_configuration->m_connectionCreationTimeoutMs,
-            m_configuration->m_maxNumConnections, m_device, m_protDom,
+            m_configuration->m_maxNumConnections,
+            m_configuration->m_numConnectionSetupWorkers, m_device, m_protDom,
             m_exchangeManager, m_jobManager, m_discoveryManager,
             m_configuration->m_sendBufferSize, m_configuration->m_SQSize,
             m_configuration->m_SRQSize, m_configuration->m_sharedSCQSize,
-            m_configuration->m_sharedRCQSize, m_configuration->m_maxSGEs);
+            m_configuration->m_numSendDispatchers,
+            m_configuration->m_sharedRCQSize,
+            m_configuration->m_numRecvDispatchers, m_configuration->m_maxSGEs,
+            m_configuration->m_inlineThreshold,
+            m_configuration->m_rdmaRecvSlotSize,
+            m_configuration->m_rdmaRecvSlots,
+            m_configuration->m_recvRingSize,
+            m_configuration->m_intraHostRingSize,
+            m_configuration->m_qpPoolSize,
+            m_configuration->m_fcCredits, m_memAllocator);
 
     m_connectionManager->SetListener(this);
 
-    m_recvDispatcher = new RecvDispatcher(m_connectionManager,
-            m_recvBufferPool, m_statisticsManager, this);
+    // one recv dispatcher per recv shard (returning flow control credits
+    // with the send dispatchers created next)
+    for (uint8_t i = 0; i < m_configuration->m_numRecvDispatchers; i++) {
+        m_recvDispatchers.push_back(new RecvDispatcher(i, m_connectionManager,
+                m_recvBufferPool, m_statisticsManager, &m_sendDispatchers, this));
+    }
+
+    // one send dispatcher per send shard
+    for (uint8_t i = 0; i < m_configuration->m_numSendDispatchers; i++) {
+        m_sendDispatchers.push_back(new SendDispatcher(i,
+                m_configuration->m_recvBufferSize,
+                m_configuration->m_sendSignalInterval,
+                m_configuration->m_rdmaWriteThreshold, m_connectionManager,
+                m_statisticsManager, this));
+    }
 
-    m_sendDispatcher = new SendDispatcher(
-            m_configuration->m_recvBufferSize, m_connectionManager,
-            m_statisticsManager, this);
+    // workers 0 to n - 1: send dispatchers, workers n to n + m - 1: recv
+    // dispatchers
+    auto numSendWorkers = static_cast<uint16_t>(m_sendDispatchers.size());
+    auto numWorkers = static_cast<uint16_t>(numSendWorkers + m_recvDispatchers.size());
 
-    m_executionEngine = new dx::ExecutionEngine(2, m_statisticsManager);
+    m_executionEngine = new dx::ExecutionEngine(numWorkers, m_configuration->m_idleBlockSpinTimeUs,
+            m_statisticsManager);
 
-    m_executionEngine->AddExecutionUnit(0, m_sendDispatcher);
-    m_executionEngine->AddExecutionUnit(1, m_recvDispatcher);
+    for (uint16_t i = 0; i < m_sendDispatchers.size(); i++) {
+        m_executionEngine->AddExecutionUnit(i, m_sendDispatchers[i]);
+    }
+
+    for (uint16_t i = 0; i < m_recvDispatchers.size(); i++) {
+        m_executionEngine->AddExecutionUnit(numSendWorkers + i, m_recvDispatchers[i]);
+    }
 
     if (m_configuration->m_pinSendRecvThreads) {
-        m_executionEngine->PinWorker(0, 0);
-        m_executionEngine->PinWorker(1, 1);
+        for (uint16_t i = 0; i < numWorkers; i++) {
+            m_executionEngine->PinWorker(i, i);
+        }
     }
 
     m_executionEngine->Start();
 
-    if (m_configuration->m_statisticsThreadPrintIntervalMs > 0) {
+    if (__IsStatisticsThreadEnabled()) {
         m_statisticsManager->Start();
     }
 
+    if (m_configuration->m_statisticsPrometheusPort > 0) {
+        m_prometheusEndpoint = new stats::PrometheusEndpoint(m_configuration->m_statisticsPrometheusPort,
+                m_statisticsManager);
+        m_prometheusEndpoint->Start();
+    }
+
     _PostInit();
 
     IBNET_LOG_DEBUG("Initializing done");
@@ -139,27 +219,52 @@ void MsgrcSystem::Shutdown()
     m_connectionManager->SetListener(nullptr);
     m_discoveryManager->SetListener(nullptr);
 
-    if (m_configuration->m_statisticsThreadPrintIntervalMs > 0) {
+    if (m_prometheusEndpoint) {
+        m_prometheusEndpoint->Stop();
+        delete m_prometheusEndpoint;
+        m_prometheusEndpoint = nullptr;
+    }
+
+    if (__IsStatisticsThreadEnabled()) {
         m_statisticsManager->Stop();
     }
 
     m_statisticsManager->PrintStatistics();
+    // final state on shutdown
+    m_statisticsManager->ExportStatistics();
 
     delete m_executionEngine;
 
-    delete m_sendDispatcher;
-    delete m_recvDispatcher;
+    for (auto& it : m_sendDispatchers) {
+        delete it;
+    }
+
+    m_sendDispatchers.clear();
+
+    for (auto& it : m_recvDispatchers) {
+        delete it;
+    }
+
+    m_recvDispatchers.clear();
 
     delete m_connectionManager;
 
+    delete m_recvBufferPool;
+
     delete m_statisticsManager;
 
-    delete m_recvBufferPool;
+    for (auto& it : m_statisticsExporters) {
+        delete it;
+    }
+
+    m_statisticsExporters.clear();
 
     delete m_discoveryManager;
     delete m_jobManager;
     delete m_exchangeManager;
 
+    delete m_memAllocator;
+    delete m_memRegCache;
     delete m_protDom;
     delete m_device;
 
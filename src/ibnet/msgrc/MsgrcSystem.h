@@ -22,6 +22,8 @@
 #include "ibnet/sys/IllegalStateException.h"
 
 #include "ibnet/core/IbDevice.h"
+#include "ibnet/core/IbMemAllocator.h"
+#include "ibnet/core/IbMemRegCache.h"
 #include "ibnet/core/IbProtDom.h"
 
 #include "ibnet/con/ConnectionListener.h"
@@ -34,6 +36,7 @@
 #include "ibnet/dx/ExecutionEngine.h"
 #include "ibnet/dx/RecvBufferPool.h"
 
+#include "ibnet/stats/PrometheusEndpoint.h"
 #include "ibnet/stats/StatisticsManager.h"
 
 #include "ibnet/msgrc/ConnectionManager.h"
@@ -63,20 +66,42 @@ public:
         bool m_pinSendRecvThreads = true;
         bool m_enableSignalHandler = true;
         uint32_t m_statisticsThreadPrintIntervalMs = 0;
+        uint32_t m_statisticsExportIntervalMs = 1000;
+        std::string m_statisticsJsonFile = "";
+        std::string m_statisticsCsvFile = "";
+        uint16_t m_statisticsPrometheusPort = 0;
+        bool m_statisticsRollingWindows = false;
         con::NodeId m_ownNodeId = ibnet::con::NODE_ID_INVALID;
         uint16_t m_portDiscMan = 5730;
+        std::string m_bindAddrDiscMan = "";
         ibnet::con::NodeConf m_nodeConfig = {};
         uint32_t m_connectionCreationTimeoutMs = 5000;
         uint16_t m_maxNumConnections = 100;
+        uint8_t m_numConnectionSetupWorkers = 4;
         uint16_t m_SQSize = 20;
         uint16_t m_SRQSize = m_maxNumConnections * m_SQSize;
         uint16_t m_sharedSCQSize = m_SRQSize;
+        uint8_t m_numSendDispatchers = 1;
         uint16_t m_sharedRCQSize = m_SRQSize;
+        uint8_t m_numRecvDispatchers = 1;
         uint32_t m_sendBufferSize = 1024 * 1024 * 4;
         uint64_t m_recvBufferPoolSizeBytes =
                 static_cast<uint64_t>(1024 * 1024 * 1024 * 2ll);
         uint32_t m_recvBufferSize = 1024 * 16;
         uint16_t m_maxSGEs = 2;
+        uint32_t m_inlineThreshold = 0;
+        uint16_t m_sendSignalInterval = 1;
+        uint32_t m_memRegCacheMaxRegions = 1024;
+        uint32_t m_rdmaWriteThreshold = 0;
+        uint32_t m_rdmaRecvSlotSize = 1024 * 1024;
+        uint8_t m_rdmaRecvSlots = 0;
+        uint32_t m_recvRingSize = 0;
+        uint32_t m_intraHostRingSize = 0;
+        uint16_t m_qpPoolSize = 0;
+        uint16_t m_fcCredits = 0;
+        uint32_t m_idleBlockSpinTimeUs = 0;
+        uint32_t m_hugePageSizeMb = 0;
+        bool m_numaLocalMemory = true;
 
         friend std::ostream& operator<<(std::ostream& os,
                 const Configuration& o)
@@ -88,21 +113,46 @@ public:
                     std::endl <<
                     "m_statisticsThreadPrintIntervalMs: " <<
                     o.m_statisticsThreadPrintIntervalMs << std::endl <<
+                    "m_statisticsExportIntervalMs: " << o.m_statisticsExportIntervalMs << std::endl <<
+                    "m_statisticsJsonFile: " << o.m_statisticsJsonFile << std::endl <<
+                    "m_statisticsCsvFile: " << o.m_statisticsCsvFile << std::endl <<
+                    "m_statisticsPrometheusPort: " << o.m_statisticsPrometheusPort << std::endl <<
+                    "m_statisticsRollingWindows: " << o.m_statisticsRollingWindows << std::endl <<
                     "m_ownNodeId: " << std::hex << o.m_ownNodeId << std::endl <<
                     "m_portDiscMan: " << std::dec << o.m_portDiscMan << std::endl <<
+                    "m_bindAddrDiscMan: " << o.m_bindAddrDiscMan << std::endl <<
                     "m_nodeConfig: " << o.m_nodeConfig << std::endl <<
                     "m_connectionCreationTimeoutMs: " <<
                     o.m_connectionCreationTimeoutMs << std::endl <<
                     "m_maxNumConnections: " << o.m_maxNumConnections << std::endl <<
+                    "m_numConnectionSetupWorkers: " << static_cast<uint16_t>(o.m_numConnectionSetupWorkers) <<
+                    std::endl <<
                     "m_SQSize: " << o.m_SQSize << std::endl <<
                     "m_SRQSize: " << o.m_SRQSize << std::endl <<
                     "m_sharedSCQSize: " << o.m_sharedSCQSize << std::endl <<
+                    "m_numSendDispatchers: " <<
+                    static_cast<uint16_t>(o.m_numSendDispatchers) << std::endl <<
                     "m_sharedRCQSize: " << o.m_sharedRCQSize << std::endl <<
+                    "m_numRecvDispatchers: " <<
+                    static_cast<uint16_t>(o.m_numRecvDispatchers) << std::endl <<
                     "m_sendBufferSize: " << o.m_sendBufferSize << std::endl <<
                     "m_recvBufferPoolSizeBytes: " << o.m_recvBufferPoolSizeBytes <<
                     std::endl <<
                     "m_recvBufferSize: " << o.m_recvBufferSize << std::endl <<
-                    "m_maxSGEs: " << o.m_maxSGEs << std::endl;
+                    "m_maxSGEs: " << o.m_maxSGEs << std::endl <<
+                    "m_inlineThreshold: " << o.m_inlineThreshold << std::endl <<
+                    "m_sendSignalInterval: " << o.m_sendSignalInterval << std::endl <<
+                    "m_memRegCacheMaxRegions: " << o.m_memRegCacheMaxRegions << std::endl <<
+                    "m_rdmaWriteThreshold: " << o.m_rdmaWriteThreshold << std::endl <<
+                    "m_rdmaRecvSlotSize: " << o.m_rdmaRecvSlotSize << std::endl <<
+                    "m_rdmaRecvSlots: " << static_cast<uint16_t>(o.m_rdmaRecvSlots) << std::endl <<
+                    "m_recvRingSize: " << o.m_recvRingSize << std::endl <<
+                    "m_intraHostRingSize: " << o.m_intraHostRingSize << std::endl <<
+                    "m_qpPoolSize: " << o.m_qpPoolSize << std::endl <<
+                    "m_fcCredits: " << o.m_fcCredits << std::endl <<
+                    "m_idleBlockSpinTimeUs: " << o.m_idleBlockSpinTimeUs << std::endl <<
+                    "m_hugePageSizeMb: " << o.m_hugePageSizeMb << std::endl <<
+                    "m_numaLocalMemory: " << o.m_numaLocalMemory << std::endl;
         }
     };
 
@@ -127,6 +177,27 @@ public:
      */
     void Shutdown();
 
+    /**
+     * Get the registration cache for user buffers to send (zero copy, see
+     * SendHandler::GetNextUserBufferToSend). Available after Init
+     */
+    ibnet::core::IbMemRegCache* GetMemRegCache() const
+    {
+        return m_memRegCache;
+    }
+
+    /**
+     * Wake up the send dispatcher serving a node if its worker is blocked
+     * because it was idle. Call this after data for the node was made
+     * available to send if m_idleBlockSpinTimeUs is enabled. Thread safe
+     *
+     * @param nodeId Node id of the target the new data is available for
+     */
+    void KickSendDispatcher(con::NodeId nodeId)
+    {
+        m_sendDispatchers[m_connectionManager->GetSendShardId(nodeId)]->Kick();
+    }
+
 protected:
     Configuration* m_configuration;
 
@@ -148,6 +219,8 @@ protected:
 
     ibnet::core::IbDevice* m_device;
     ibnet::core::IbProtDom* m_protDom;
+    ibnet::core::IbMemRegCache* m_memRegCache;
+    ibnet::core::IbMemAllocator* m_memAllocator;
 
     ibnet::con::DiscoveryManager* m_discoveryManager;
     ibnet::con::ExchangeManager* m_exchangeManager;
@@ -156,12 +229,21 @@ protected:
     ibnet::dx::RecvBufferPool* m_recvBufferPool;
 
     ibnet::stats::StatisticsManager* m_statisticsManager;
+    std::vector<ibnet::stats::Exporter*> m_statisticsExporters;
+    ibnet::stats::PrometheusEndpoint* m_prometheusEndpoint;
 
     ibnet::msgrc::ConnectionManager* m_connectionManager;
-    ibnet::msgrc::RecvDispatcher* m_recvDispatcher;
-    ibnet::msgrc::SendDispatcher* m_sendDispatcher;
+    std::vector<ibnet::msgrc::RecvDispatcher*> m_recvDispatchers;
+    std::vector<ibnet::msgrc::SendDispatcher*> m_sendDispatchers;
 
     ibnet::dx::ExecutionEngine* m_executionEngine;
+
+private:
+    bool __IsStatisticsThreadEnabled() const
+    {
+        return m_configuration->m_statisticsThreadPrintIntervalMs > 0 || !m_statisticsExporters.empty() ||
+                m_configuration->m_statisticsRollingWindows;
+    }
 };
 
 }
@@ -18,6 +18,8 @@
 
 #include "RecvDispatcher.h"
 
+#include <algorithm>
+
 #include "ibnet/sys/IllegalStateException.h"
 
 #include "ibnet/core/IbCommon.h"
@@ -26,21 +28,28 @@
 #include "ibnet/con/DisconnectedException.h"
 
 #include "Common.h"
+#include "Connection.h"
+#include "SendDispatcher.h"
 
 namespace ibnet {
 namespace msgrc {
 
-RecvDispatcher::RecvDispatcher(ConnectionManager* refConnectionManager,
+RecvDispatcher::RecvDispatcher(uint8_t shardId, ConnectionManager* refConnectionManager,
         dx::RecvBufferPool* refRecvBufferPool,
         stats::StatisticsManager* refStatisticsManager,
+        const std::vector<SendDispatcher*>* refSendDispatchers,
         RecvHandler* refRecvHandler) :
-        ExecutionUnit("MsgRCRecv"),
+        ExecutionUnit("MsgRCRecv" + std::to_string(shardId)),
+        m_shardId(shardId),
+        m_statsCategory(__GetStatsCategory(shardId, refConnectionManager->GetNumRecvShards())),
         m_refConnectionManager(refConnectionManager),
         m_refRecvBufferPool(refRecvBufferPool),
         m_refStatisticsManager(refStatisticsManager),
+        m_refSendDispatchers(refSendDispatchers),
         m_refRecvHandler(refRecvHandler),
         // TODO the ring buffer can hold more elements than just the IBQ size * SGEs -> make configurable?
         m_ringBuffer(new IncomingRingBuffer(refConnectionManager->GetIbSRQSize() * refConnectionManager->GetMaxSGEs())),
+        m_entryIncarnations(new uint32_t[m_ringBuffer->GetRingBuffer()->m_size]),
         m_workComps(static_cast<ibv_wc*>(
                 aligned_alloc(static_cast<size_t>(getpagesize()), sizeof(ibv_wc) * refConnectionManager->GetIbSRQSize()))),
         m_received(0),
@@ -49,43 +58,55 @@ RecvDispatcher::RecvDispatcher(ConnectionManager* refConnectionManager,
         // TODO now with the IRB, this can be more than just what fits into the SRQ -> make configurable?
         m_recvWRPool(
                 new RecvWorkRequestPool(refConnectionManager->GetIbSRQSize() * 2, refConnectionManager->GetMaxSGEs())),
-        m_totalTime(new stats::Time("RecvDispatcher", "Total")),
-        m_pollTime(new stats::Time("RecvDispatcher", "Poll")),
-        m_processRecvTotalTime(new stats::Time("RecvDispatcher", "ProcessRecvTotal")),
-        m_processRecvAvailTime(new stats::Time("RecvDispatcher", "ProcessRecvAvail")),
-        m_processRecvHandleTime(new stats::Time("RecvDispatcher", "ProcessRecvHandle")),
-        m_refillAvailTime(new stats::Time("RecvDispatcher", "RefillAvail")),
-        m_refillGetBuffersTime(new stats::Time("RecvDispatcher", "RefillGetBuffers")),
-        m_refillPostTime(new stats::Time("RecvDispatcher", "RefillPost")),
-        m_eeSchedTime(new stats::Time("RecvDispatcher", "EESched")),
-        m_postedWRQs(new stats::Unit("RecvDispatcher", "WRQsPosted", stats::Unit::e_Base10)),
-        m_polledWRQs(new stats::Unit("RecvDispatcher", "WRQsPolled", stats::Unit::e_Base10)),
-        m_queueEmptied(new stats::Unit("RecvDispatcher", "QueueEmptied", stats::Unit::e_Base10)),
-        m_irbFull(new stats::Unit("RecvDispatcher", "IRBFull", stats::Unit::e_Base10)),
-        m_receivedData(new stats::Unit("RecvDispatcher", "Data", stats::Unit::e_Base2)),
-        m_receivedFC(new stats::Unit("RecvDispatcher", "FC", stats::Unit::e_Base10)),
-        m_handlerNoProcess(new stats::Unit("RecvDispatcher", "HandlerNoProcess", stats::Unit::e_Base10)),
-        m_refillInsufficientBuffers(new stats::Unit("RecvDispatcher", "RefillInsufficientBuffers",
+        m_fcCredits(refConnectionManager->GetFcCredits()),
+        // same threshold as the send dispatchers
+        m_fcCreditsReturnThreshold(std::max<uint16_t>(1, static_cast<uint16_t>(m_fcCredits / 2))),
+        m_creditNodes(m_fcCredits > 0 ? new con::NodeId[refConnectionManager->GetIbSRQSize()] : nullptr),
+        m_creditNodesFront(0),
+        m_creditNodesCount(0),
+        m_totalTime(new stats::Time(m_statsCategory, "Total")),
+        // histograms on the sections with latency spikes (e.g. polling, posting)
+        m_pollTime(new stats::Time(m_statsCategory, "Poll", true)),
+        m_pollRecvRingsTime(new stats::Time(m_statsCategory, "PollRecvRings")),
+        m_processRecvTotalTime(new stats::Time(m_statsCategory, "ProcessRecvTotal")),
+        m_processRecvAvailTime(new stats::Time(m_statsCategory, "ProcessRecvAvail")),
+        m_processRecvHandleTime(new stats::Time(m_statsCategory, "ProcessRecvHandle", true)),
+        m_refillAvailTime(new stats::Time(m_statsCategory, "RefillAvail")),
+        m_refillGetBuffersTime(new stats::Time(m_statsCategory, "RefillGetBuffers", true)),
+        m_refillPostTime(new stats::Time(m_statsCategory, "RefillPost", true)),
+        m_eeSchedTime(new stats::Time(m_statsCategory, "EESched")),
+        m_postedWRQs(new stats::Unit(m_statsCategory, "WRQsPosted", stats::Unit::e_Base10)),
+        m_polledWRQs(new stats::Unit(m_statsCategory, "WRQsPolled", stats::Unit::e_Base10)),
+        m_queueEmptied(new stats::Unit(m_statsCategory, "QueueEmptied", stats::Unit::e_Base10)),
+        m_irbFull(new stats::Unit(m_statsCategory, "IRBFull", stats::Unit::e_Base10)),
+        m_receivedData(new stats::Unit(m_statsCategory, "Data", stats::Unit::e_Base2)),
+        m_receivedFC(new stats::Unit(m_statsCategory, "FC", stats::Unit::e_Base10)),
+        m_receivedRdmaWriteData(new stats::Unit(m_statsCategory, "RdmaWriteData", stats::Unit::e_Base2)),
+        m_receivedRecvRingData(new stats::Unit(m_statsCategory, "RecvRingData", stats::Unit::e_Base2)),
+        m_handlerNoProcess(new stats::Unit(m_statsCategory, "HandlerNoProcess", stats::Unit::e_Base10)),
+        m_refillInsufficientBuffers(new stats::Unit(m_statsCategory, "RefillInsufficientBuffers",
                 stats::Unit::e_Base10)),
-        m_bufferUtilization(new stats::Ratio("RecvDispatcher", "BufferUtilization")),
-        m_fragmentedLastBuffer(new stats::Ratio("RecvDispatcher", "FragmentedLastBuffer")),
-        m_fragmentedSGEs(new stats::Ratio("RecvDispatcher", "FragmentedSGEs")),
-        m_throughputReceivedData(new stats::Throughput("RecvDispatcher", "ThroughputData",
+        m_receivedCredits(new stats::Unit(m_statsCategory, "Credits", stats::Unit::e_Base10)),
+        m_bufferUtilization(new stats::Ratio(m_statsCategory, "BufferUtilization")),
+        m_fragmentedLastBuffer(new stats::Ratio(m_statsCategory, "FragmentedLastBuffer")),
+        m_fragmentedSGEs(new stats::Ratio(m_statsCategory, "FragmentedSGEs")),
+        m_throughputReceivedData(new stats::Throughput(m_statsCategory, "ThroughputData",
                 m_receivedData, m_totalTime)),
-        m_throughputReceivedFC(new stats::Throughput("RecvDispatcher", "ThroughputFC",
+        m_throughputReceivedFC(new stats::Throughput(m_statsCategory, "ThroughputFC",
                 m_receivedFC, m_totalTime)),
         m_privateStats(new Stats(this))
 {
-    m_refStatisticsManager->Register(m_totalTime);
-
-    m_refStatisticsManager->Register(m_pollTime);
-    m_refStatisticsManager->Register(m_processRecvTotalTime);
-    m_refStatisticsManager->Register(m_processRecvAvailTime);
-    m_refStatisticsManager->Register(m_processRecvHandleTime);
-    m_refStatisticsManager->Register(m_refillAvailTime);
-    m_refStatisticsManager->Register(m_refillGetBuffersTime);
-    m_refStatisticsManager->Register(m_refillPostTime);
-    m_refStatisticsManager->Register(m_eeSchedTime);
+    m_refStatisticsManager->Register(m_totalTime, stats::e_LevelCoarse);
+
+    m_refStatisticsManager->Register(m_pollTime, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_pollRecvRingsTime, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_processRecvTotalTime, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_processRecvAvailTime, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_processRecvHandleTime, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_refillAvailTime, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_refillGetBuffersTime, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_refillPostTime, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_eeSchedTime, stats::e_LevelFull);
 
     m_refStatisticsManager->Register(m_postedWRQs);
     m_refStatisticsManager->Register(m_polledWRQs);
@@ -93,15 +114,19 @@ RecvDispatcher::RecvDispatcher(ConnectionManager* refConnectionManager,
     m_refStatisticsManager->Register(m_irbFull);
     m_refStatisticsManager->Register(m_receivedData);
     m_refStatisticsManager->Register(m_receivedFC);
+    m_refStatisticsManager->Register(m_receivedRdmaWriteData);
+    m_refStatisticsManager->Register(m_receivedRecvRingData);
     m_refStatisticsManager->Register(m_handlerNoProcess);
     m_refStatisticsManager->Register(m_refillInsufficientBuffers);
+    m_refStatisticsManager->Register(m_receivedCredits);
 
     m_refStatisticsManager->Register(m_bufferUtilization);
     m_refStatisticsManager->Register(m_fragmentedLastBuffer);
     m_refStatisticsManager->Register(m_fragmentedSGEs);
 
-    m_refStatisticsManager->Register(m_throughputReceivedData);
-    m_refStatisticsManager->Register(m_throughputReceivedFC);
+    // throughput is calculated from the total time
+    m_refStatisticsManager->Register(m_throughputReceivedData, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_throughputReceivedFC, stats::e_LevelCoarse);
 
     m_refStatisticsManager->Register(m_privateStats);
 }
@@ -109,10 +134,13 @@ RecvDispatcher::RecvDispatcher(ConnectionManager* refConnectionManager,
 RecvDispatcher::~RecvDispatcher()
 {
     delete m_ringBuffer;
+    delete[] m_entryIncarnations;
+    delete[] m_creditNodes;
 
     m_refStatisticsManager->Deregister(m_totalTime);
 
     m_refStatisticsManager->Deregister(m_pollTime);
+    m_refStatisticsManager->Deregister(m_pollRecvRingsTime);
     m_refStatisticsManager->Deregister(m_processRecvTotalTime);
     m_refStatisticsManager->Deregister(m_processRecvAvailTime);
     m_refStatisticsManager->Deregister(m_processRecvHandleTime);
@@ -127,8 +155,11 @@ RecvDispatcher::~RecvDispatcher()
     m_refStatisticsManager->Deregister(m_irbFull);
     m_refStatisticsManager->Deregister(m_receivedData);
     m_refStatisticsManager->Deregister(m_receivedFC);
+    m_refStatisticsManager->Deregister(m_receivedRdmaWriteData);
+    m_refStatisticsManager->Deregister(m_receivedRecvRingData);
     m_refStatisticsManager->Deregister(m_handlerNoProcess);
     m_refStatisticsManager->Deregister(m_refillInsufficientBuffers);
+    m_refStatisticsManager->Deregister(m_receivedCredits);
 
     m_refStatisticsManager->Deregister(m_bufferUtilization);
     m_refStatisticsManager->Deregister(m_fragmentedLastBuffer);
@@ -142,6 +173,7 @@ RecvDispatcher::~RecvDispatcher()
     delete m_totalTime;
 
     delete m_pollTime;
+    delete m_pollRecvRingsTime;
     delete m_processRecvTotalTime;
     delete m_processRecvAvailTime;
     delete m_processRecvHandleTime;
@@ -156,8 +188,11 @@ RecvDispatcher::~RecvDispatcher()
     delete m_irbFull;
     delete m_receivedData;
     delete m_receivedFC;
+    delete m_receivedRdmaWriteData;
+    delete m_receivedRecvRingData;
     delete m_handlerNoProcess;
     delete m_refillInsufficientBuffers;
+    delete m_receivedCredits;
 
     delete m_bufferUtilization;
     delete m_fragmentedLastBuffer;
@@ -171,13 +206,16 @@ RecvDispatcher::~RecvDispatcher()
 
 bool RecvDispatcher::Dispatch()
 {
-    IBNET_STATS(m_eeSchedTime->Stop());
-
-    if (m_totalTime->GetCounter() == 0) {
-        IBNET_STATS(m_totalTime->Start());
-    } else {
-        IBNET_STATS(m_totalTime->Stop());
-        IBNET_STATS(m_totalTime->Start());
+    IBNET_STATS_FULL(m_eeSchedTime->Stop());
+
+    // don't sum up the counter shards if the timing is not compiled
+    if constexpr (stats::IsLevelEnabled(stats::e_LevelCoarse)) {
+        if (m_totalTime->GetCounter() == 0) {
+            m_totalTime->Start();
+        } else {
+            m_totalTime->Stop();
+            m_totalTime->Start();
+        }
     }
 
     bool activity;
@@ -185,13 +223,47 @@ bool RecvDispatcher::Dispatch()
     activity = __Poll();
     activity = __Refill() || activity;
     activity = __ProcessCompletions() || activity;
+
+    if (m_refConnectionManager->HasRecvRings()) {
+        activity = __PollRecvRings() || activity;
+    }
+
     activity = __DispatchReceived() || activity;
 
-    IBNET_STATS(m_eeSchedTime->Start());
+    IBNET_STATS_FULL(m_eeSchedTime->Start());
 
     return activity;
 }
 
+bool RecvDispatcher::PrepareIdleWait(std::vector<int>& fds)
+{
+    // receive rings are written without generating completions
+    if (m_refConnectionManager->HasRecvRings()) {
+        return false;
+    }
+
+    // handler could not process everything, retry
+    if (!m_ringBuffer->IsEmpty()) {
+        return false;
+    }
+
+    int ret = ibv_req_notify_cq(m_refConnectionManager->GetIbSharedRCQ(m_shardId), 0);
+
+    if (ret != 0) {
+        IBNET_LOG_ERROR("Requesting completion notification failed: %s", strerror(ret));
+        return false;
+    }
+
+    fds.push_back(m_refConnectionManager->GetIbSharedRCQChannel(m_shardId)->fd);
+
+    return true;
+}
+
+void RecvDispatcher::IdleWaitDone()
+{
+    ConnectionManager::ConsumeCQEvents(m_refConnectionManager->GetIbSharedRCQChannel(m_shardId));
+}
+
 bool RecvDispatcher::__Poll()
 {
     uint32_t ringBufferFree = m_ringBuffer->NumFreeEntries();
@@ -200,7 +272,7 @@ bool RecvDispatcher::__Poll()
     ringBufferFree /= m_refConnectionManager->GetMaxSGEs();
 
     if (ringBufferFree > 0) {
-        IBNET_STATS(m_pollTime->Start());
+        IBNET_STATS_COARSE(m_pollTime->Start());
 
         // if we have more free space than completion queue size, cap
         if (ringBufferFree > m_refConnectionManager->GetIbSRQSize()) {
@@ -208,7 +280,7 @@ bool RecvDispatcher::__Poll()
         }
 
         // poll in batches to reduce overhead and increase utilization
-        int ret = ibv_poll_cq(m_refConnectionManager->GetIbSharedRCQ(), ringBufferFree, m_workComps);
+        int ret = ibv_poll_cq(m_refConnectionManager->GetIbSharedRCQ(m_shardId), ringBufferFree, m_workComps);
 
         if (ret < 0) {
             __ThrowDetailedException<core::IbException>(ret, "Polling completion queue failed");
@@ -219,12 +291,31 @@ bool RecvDispatcher::__Poll()
 
         m_recvQueuePending -= m_received;
 
+        // credits of the consumed WRQs are returned once they are posted
+        // again (see __Refill), in order of completion
+        if (m_fcCredits > 0) {
+            for (uint32_t i = 0; i < m_received; i++) {
+                auto* immedData = (ImmediateData*) &m_workComps[i].imm_data;
+                con::NodeId nodeId = immedData->m_sourceNodeId;
+
+                // failed or credit return only, no credit consumed
+                if (m_workComps[i].status != IBV_WC_SUCCESS || (m_workComps[i].opcode == IBV_WC_RECV &&
+                        m_workComps[i].byte_len == 0 && immedData->m_flowControlData == 0)) {
+                    nodeId = con::NODE_ID_INVALID;
+                }
+
+                m_creditNodes[(m_creditNodesFront + m_creditNodesCount) % m_refConnectionManager->GetIbSRQSize()] =
+                        nodeId;
+                m_creditNodesCount++;
+            }
+        }
+
         // track if queue was emptied to get a indication of possible pipeline stalls (naks)
         if (m_recvQueuePending == 0) {
             IBNET_STATS(m_queueEmptied->Inc());
         }
 
-        IBNET_STATS(m_pollTime->Stop());
+        IBNET_STATS_COARSE(m_pollTime->Stop());
     } else {
         // can't receive, no space in ring buffer. leave possible completions in CQ
         IBNET_STATS(m_irbFull->Inc());
@@ -238,14 +329,14 @@ bool RecvDispatcher::__Poll()
 bool RecvDispatcher::__Refill()
 {
     if (m_recvQueuePending < m_refConnectionManager->GetIbSRQSize()) {
-        IBNET_STATS(m_refillAvailTime->Start());
+        IBNET_STATS_COARSE(m_refillAvailTime->Start());
 
         // TODO refill in limited batches to ensure that at least a few buffers are as fast as possible
         // back in the RQ -> e.g. batches of 10?
 
         uint32_t toQueueElems = m_refConnectionManager->GetIbSRQSize() - m_recvQueuePending;
 
-        IBNET_STATS(m_refillGetBuffersTime->Start());
+        IBNET_STATS_FULL(m_refillGetBuffersTime->Start());
 
         RecvWorkRequest* recvWRs[toQueueElems];
         core::IbMemReg* refsMemReg[toQueueElems * m_refConnectionManager->GetMaxSGEs()];
@@ -257,7 +348,7 @@ bool RecvDispatcher::__Refill()
         uint32_t numBufs = m_refRecvBufferPool->GetBuffers(&refsMemReg[0],
             toQueueElems * m_refConnectionManager->GetMaxSGEs());
 
-        IBNET_STATS(m_refillGetBuffersTime->Stop());
+        IBNET_STATS_FULL(m_refillGetBuffersTime->Stop());
 
         uint32_t queuedElems = 0;
         uint32_t buffersPos = 0;
@@ -297,11 +388,12 @@ bool RecvDispatcher::__Refill()
             // first failed work request
             ibv_recv_wr* bad_wr;
 
-            IBNET_STATS(m_refillPostTime->Start());
+            IBNET_STATS_FULL(m_refillPostTime->Start());
 
-            int ret = ibv_post_srq_recv(m_refConnectionManager->GetIbSRQ(), &recvWRs[0]->m_recvWr, &bad_wr);
+            int ret = ibv_post_srq_recv(m_refConnectionManager->GetIbSRQ(m_shardId), &recvWRs[0]->m_recvWr,
+                    &bad_wr);
 
-            IBNET_STATS(m_refillPostTime->Stop());
+            IBNET_STATS_FULL(m_refillPostTime->Stop());
 
             if (ret != 0) {
                 switch (ret) {
@@ -328,9 +420,13 @@ bool RecvDispatcher::__Refill()
             IBNET_STATS(m_postedWRQs->Add(queuedElems));
 
             m_recvQueuePending += queuedElems;
+
+            if (m_fcCredits > 0) {
+                __ReturnCredits(queuedElems);
+            }
         }
 
-        IBNET_STATS(m_refillAvailTime->Stop());
+        IBNET_STATS_COARSE(m_refillAvailTime->Stop());
 
         return true;
     } else {
@@ -338,10 +434,65 @@ bool RecvDispatcher::__Refill()
     }
 }
 
+void RecvDispatcher::__ReturnCredits(uint32_t numPosted)
+{
+    // the initial fill of the SRQ does not return any credits
+    uint32_t count = std::min(numPosted, m_creditNodesCount);
+
+    while (count > 0) {
+        con::NodeId nodeId = m_creditNodes[m_creditNodesFront];
+        uint16_t credits = 0;
+
+        // aggregate consecutive WRQs of the same node
+        while (count > 0 && m_creditNodes[m_creditNodesFront] == nodeId) {
+            m_creditNodesFront = (m_creditNodesFront + 1) % m_refConnectionManager->GetIbSRQSize();
+            m_creditNodesCount--;
+            count--;
+            credits++;
+        }
+
+        // closed in the meantime, the credits are gone with the connection
+        if (nodeId == con::NODE_ID_INVALID || !m_refConnectionManager->IsConnectionAvailable(nodeId)) {
+            continue;
+        }
+
+        auto* connection = (Connection*) m_refConnectionManager->GetConnection(nodeId);
+
+        uint16_t total = connection->AddCreditsToReturn(credits);
+
+        m_refConnectionManager->ReturnConnection(connection);
+
+        // piggybacked on the next send to the node. if there is nothing to
+        // send, return them explicitly before the remote runs out of credits
+        if (total >= m_fcCreditsReturnThreshold && total - credits < m_fcCreditsReturnThreshold) {
+            (*m_refSendDispatchers)[m_refConnectionManager->GetSendShardId(nodeId)]->QueueCreditReturn(nodeId);
+        }
+    }
+}
+
+void RecvDispatcher::__ReceivedCredits(con::NodeId nodeId, uint8_t credits)
+{
+    // closed in the meantime, the credits are gone with the connection
+    if (!m_refConnectionManager->IsConnectionAvailable(nodeId)) {
+        return;
+    }
+
+    auto* connection = (Connection*) m_refConnectionManager->GetConnection(nodeId);
+
+    connection->AddSendCredits(credits);
+
+    m_refConnectionManager->ReturnConnection(connection);
+
+    IBNET_STATS(m_receivedCredits->Add(credits));
+
+    // data held back due to missing credits can be sent now
+    (*m_refSendDispatchers)[m_refConnectionManager->GetSendShardId(nodeId)]->Kick();
+}
+
 bool RecvDispatcher::__ProcessCompletions()
 {
     if (m_received > 0) {
-        IBNET_STATS(m_processRecvAvailTime->Start());
+        IBNET_STATS_COARSE(m_processRecvAvailTime->Start());
 
         // iterate work completions and check for errors
         for (uint32_t i = 0; i < m_received; i++) {
@@ -383,35 +534,84 @@ bool RecvDispatcher::__ProcessCompletions()
             uint32_t dataRecvLen = m_workComps[i].byte_len;
 
             // evaluate data
-            // we might receive 0 bytes which indicates that flow control only data was sent
-            // and no SGEs were used on the remote sender
-            if (dataRecvLen == 0) {
-                // SGE buffers are unused, return them to pool
+            // data written to a slot of the RDMA receive region of the connection, the
+            // receive buffers of the WRQ are not used
+            if (m_workComps[i].opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
                 m_refRecvBufferPool->ReturnBuffers(recvWorkReq->m_sgls.m_refsMemReg,
                         recvWorkReq->m_sgls.m_numUsedElems);
 
                 m_recvWRPool->Push(recvWorkReq);
 
-                // sanity check
-                if (!immedData->m_flowControlData) {
+                if (immedData->m_rdmaSlot == 0) {
                     __ThrowDetailedException<sys::IllegalStateException>(
-                        "Zero length data received but no flow control data");
+                            "RDMA write received from 0x%X without slot", immedData->m_sourceNodeId);
                 }
 
-                // process flow control data once and add it to a single recv package
+                auto* connection = (Connection*) m_refConnectionManager->GetConnection(immedData->m_sourceNodeId);
+
                 IncomingRingBuffer::RingBuffer::Entry* entry = m_ringBuffer->Back();
 
                 entry->m_sourceNodeId = immedData->m_sourceNodeId;
                 entry->m_fcData = immedData->m_flowControlData;
                 entry->m_padding = 0xFF;
+                // no buffer of the pool, slot is released once the entry is processed
                 entry->m_data = nullptr;
-                entry->m_dataRaw = nullptr;
-                entry->m_dataLength = 0;
+                entry->m_dataRaw = connection->GetRdmaRecvSlotAddress(
+                        static_cast<uint8_t>(immedData->m_rdmaSlot - 1));
+                entry->m_dataLength = dataRecvLen;
 
-                IBNET_STATS(m_receivedFC->Inc());
+                m_entryIncarnations[m_ringBuffer->GetRingBuffer()->m_back] = connection->GetIncarnation();
+
+                m_refConnectionManager->ReturnConnection(connection);
+
+                if (entry->m_fcData) {
+                    IBNET_STATS(m_receivedFC->Inc());
+                }
+
+                IBNET_STATS(m_receivedData->Add(dataRecvLen));
+                IBNET_STATS(m_receivedRdmaWriteData->Add(dataRecvLen));
 
                 m_ringBuffer->PushBack();
+            } else if (dataRecvLen == 0) {
+                // we might receive 0 bytes which indicates that flow control only data was sent
+                // and no SGEs were used on the remote sender
+                // SGE buffers are unused, return them to pool
+                m_refRecvBufferPool->ReturnBuffers(recvWorkReq->m_sgls.m_refsMemReg,
+                        recvWorkReq->m_sgls.m_numUsedElems);
+
+                m_recvWRPool->Push(recvWorkReq);
+
+                // sanity check
+                if (!immedData->m_flowControlData && (m_fcCredits == 0 || !immedData->m_credits)) {
+                    __ThrowDetailedException<sys::IllegalStateException>(
+                        "Zero length data received but no flow control data");
+                }
+
+                if (m_fcCredits > 0 && immedData->m_credits > 0) {
+                    __ReceivedCredits(immedData->m_sourceNodeId, immedData->m_credits);
+                }
+
+                // credit return only, nothing for the handler
+                if (immedData->m_flowControlData) {
+                    // process flow control data once and add it to a single recv package
+                    IncomingRingBuffer::RingBuffer::Entry* entry = m_ringBuffer->Back();
+
+                    entry->m_sourceNodeId = immedData->m_sourceNodeId;
+                    entry->m_fcData = immedData->m_flowControlData;
+                    entry->m_padding = 0xFF;
+                    entry->m_data = nullptr;
+                    entry->m_dataRaw = nullptr;
+                    entry->m_dataLength = 0;
+
+                    IBNET_STATS(m_receivedFC->Inc());
+
+                    m_ringBuffer->PushBack();
+                }
             } else {
+                if (m_fcCredits > 0 && immedData->m_credits > 0) {
+                    __ReceivedCredits(immedData->m_sourceNodeId, immedData->m_credits);
+                }
+
                 uint32_t dataRecvLenTmp = dataRecvLen;
                 uint32_t sgesUsed = 0;
                 uint32_t remainderDataOfLastBuffer = 0;
@@ -489,17 +689,97 @@ bool RecvDispatcher::__ProcessCompletions()
             }
         }
 
-        IBNET_STATS(m_processRecvAvailTime->Stop());
+        IBNET_STATS_COARSE(m_processRecvAvailTime->Stop());
         return true;
     } else {
         return false;
     }
 }
 
+bool RecvDispatcher::__PollRecvRings()
+{
+    IBNET_STATS_COARSE(m_pollRecvRingsTime->Start());
+
+    bool activity = false;
+    uint16_t numNodes = m_refConnectionManager->GetNumRecvRingNodes(m_shardId);
+
+    for (uint16_t i = 0; i < numNodes && !m_ringBuffer->IsFull(); i++) {
+        con::NodeId nodeId = m_refConnectionManager->GetRecvRingNode(m_shardId, i);
+
+        // don't trigger re-creation of closed connections
+        if (!m_refConnectionManager->IsConnectionAvailable(nodeId)) {
+            continue;
+        }
+
+        auto* connection = (Connection*) m_refConnectionManager->GetConnection(nodeId);
+
+        uint64_t tail = connection->GetRecvRingTail();
+        uint64_t fcTotal = connection->GetRecvRingFcTotal();
+        uint64_t pos = connection->GetRecvRingDelivered();
+        uint64_t fcPos = connection->GetRecvRingFcDelivered();
+
+        // data up to the end of the ring per entry, i.e. split on wrap around.
+        // no buffers of the pool, the ring's data is released once the entries
+        // are processed
+        while ((pos != tail || fcPos != fcTotal) && !m_ringBuffer->IsFull()) {
+            IncomingRingBuffer::RingBuffer::Entry* entry = m_ringBuffer->Back();
+
+            uint32_t length = 0;
+            uint8_t fcData = 0;
+
+            if (pos != tail) {
+                uint32_t offset = static_cast<uint32_t>(pos % connection->GetRecvRingSize());
+
+                length = connection->GetRecvRingSize() - offset;
+
+                if (length > tail - pos) {
+                    length = static_cast<uint32_t>(tail - pos);
+                }
+            }
+
+            if (fcTotal - fcPos > 0xFF) {
+                fcData = 0xFF;
+            } else {
+                fcData = static_cast<uint8_t>(fcTotal - fcPos);
+            }
+
+            entry->m_sourceNodeId = nodeId;
+            entry->m_fcData = fcData;
+            entry->m_padding = 0xFF;
+            entry->m_data = nullptr;
+            entry->m_dataRaw = length > 0 ? connection->GetRecvRingAddress(pos) : nullptr;
+            entry->m_dataLength = length;
+
+            m_entryIncarnations[m_ringBuffer->GetRingBuffer()->m_back] = connection->GetIncarnation();
+
+            m_ringBuffer->PushBack();
+
+            if (fcData) {
+                IBNET_STATS(m_receivedFC->Inc());
+            }
+
+            IBNET_STATS(m_receivedData->Add(length));
+            IBNET_STATS(m_receivedRecvRingData->Add(length));
+
+            pos += length;
+            fcPos += fcData;
+            activity = true;
+        }
+
+        connection->SetRecvRingDelivered(pos, fcPos);
+
+        m_refConnectionManager->ReturnConnection(connection);
+    }
+
+    IBNET_STATS_COARSE(m_pollRecvRingsTime->Stop());
+
+    return activity;
+}
+
 bool RecvDispatcher::__DispatchReceived()
 {
     if (!m_ringBuffer->IsEmpty()) {
-        IBNET_STATS(m_processRecvHandleTime->Start());
+        IBNET_STATS_FULL(m_processRecvHandleTime->Start());
 
         // buffers are returned to recv buffer pool async
         uint32_t processed = m_refRecvHandler->Received(m_ringBuffer->GetRingBuffer());
@@ -515,6 +795,8 @@ bool RecvDispatcher::__DispatchReceived()
 //                processed = m_refRecvHandler->Received(m_recvPackage);
 //            }
 
+        __ReleaseRdmaRecvData(processed);
+
         m_ringBuffer->PopFront(processed);
 
         if (processed == 0) {
@@ -522,7 +804,7 @@ bool RecvDispatcher::__DispatchReceived()
             IBNET_STATS(m_handlerNoProcess->Inc());
         }
 
-        IBNET_STATS(m_processRecvHandleTime->Stop());
+        IBNET_STATS_FULL(m_processRecvHandleTime->Stop());
 
         return true;
     } else {
@@ -530,5 +812,50 @@ bool RecvDispatcher::__DispatchReceived()
     }
 }
 
+void RecvDispatcher::__ReleaseRdmaRecvData(uint32_t processed)
+{
+    const IncomingRingBuffer::RingBuffer* ringBuffer = m_ringBuffer->GetRingBuffer();
+
+    for (uint32_t i = 0; i < processed; i++) {
+        uint32_t index = (ringBuffer->m_front + i) % ringBuffer->m_size;
+        const IncomingRingBuffer::RingBuffer::Entry& entry = ringBuffer->m_entries[index];
+
+        // entries with data but no buffer of the pool are RDMA receive slots
+        // or receive ring data
+        if (entry.m_data == nullptr && entry.m_dataLength > 0) {
+            // closed in the meantime, the slots and ring data are gone with the
+            // connection. don't trigger re-creation of closed connections
+            if (!m_refConnectionManager->IsConnectionAvailable(entry.m_sourceNodeId)) {
+                continue;
+            }
+
+            auto* connection = (Connection*) m_refConnectionManager->GetConnection(entry.m_sourceNodeId);
+
+            // don't release slots or ring data of a new connection if the node
+            // reconnected while the entry was processed
+            if (connection->GetIncarnation() == m_entryIncarnations[index]) {
+                // slots and ring data are consumed in order of arrival
+                if (connection->IsRecvRingAddress(entry.m_dataRaw)) {
+                    connection->ReleaseRecvRing(entry.m_dataLength);
+                } else {
+                    connection->ReleaseRdmaRecvSlot();
+                }
+            }
+
+            m_refConnectionManager->ReturnConnection(connection);
+        }
+    }
+}
+
+std::string RecvDispatcher::__GetStatsCategory(uint8_t shardId, uint8_t numShards)
+{
+    // keep the plain category name if not sharded
+    if (numShards == 1) {
+        return "RecvDispatcher";
+    }
+
+    return "RecvDispatcher-" + std::to_string(shardId);
+}
+
 }
 }
\ No newline at end of file
@@ -19,6 +19,8 @@
 #ifndef IBNET_DX_MSGRCRECVDISPATCHER_H
 #define IBNET_DX_MSGRCRECVDISPATCHER_H
 
+#include <vector>
+
 #include "ibnet/dx/ExecutionUnit.h"
 #include "ibnet/dx/RecvBufferPool.h"
 
@@ -35,8 +37,13 @@
 namespace ibnet {
 namespace msgrc {
 
+class SendDispatcher;
+
 /**
- * Execution unit dispatching incoming data for the RC messaging subsystem
+ * Execution unit dispatching incoming data for the RC messaging subsystem.
+ * Multiple instances can be run on separate workers, each serving a receive
+ * shard, i.e. a separate shared receive queue and shared receive completion
+ * queue with a disjoint set of source nodes.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 30.01.2018
  */
@@ -46,14 +53,18 @@ public:
     /**
      * Constructor
      *
+     * @param shardId Id of the receive shard to serve
      * @param refConnectionManager Pointer to the connection manager (managed by caller)
      * @param refRecvBufferPool Pointer to the receive buffer pool used for incoming data (managed by caller)
      * @param refStatisticsManager Pointer to the statistics manager (managed by caller)
+     * @param refSendDispatchers Pointer to the list of send dispatchers (one per send shard) returning
+     *        flow control credits to the remotes (managed by caller)
      * @param refRecvHandler Pointer to the receive handler to dispatch the received data to (managed by caller)
      */
-    RecvDispatcher(ConnectionManager* refConnectionManager,
+    RecvDispatcher(uint8_t shardId, ConnectionManager* refConnectionManager,
             dx::RecvBufferPool* refRecvBufferPool,
             stats::StatisticsManager* refStatisticsManager,
+            const std::vector<SendDispatcher*>* refSendDispatchers,
             RecvHandler* refRecvHandler);
 
     /**
@@ -66,14 +77,31 @@ public:
      */
     bool Dispatch() override;
 
+    /**
+     * Overriding virtual function
+     */
+    bool PrepareIdleWait(std::vector<int>& fds) override;
+
+    /**
+     * Overriding virtual function
+     */
+    void IdleWaitDone() override;
+
 private:
+    const uint8_t m_shardId;
+    const std::string m_statsCategory;
+
     ConnectionManager* m_refConnectionManager;
     dx::RecvBufferPool* m_refRecvBufferPool;
     stats::StatisticsManager* m_refStatisticsManager;
+    const std::vector<SendDispatcher*>* m_refSendDispatchers;
     RecvHandler* m_refRecvHandler;
 
 private:
     IncomingRingBuffer* m_ringBuffer;
+    // incarnation of the connection of each entry of the ring buffer with
+    // RDMA receive slot or receive ring data (see Connection::GetIncarnation)
+    uint32_t* m_entryIncarnations;
     ibv_wc* m_workComps;
     uint32_t m_received;
     uint32_t m_recvQueuePending;
@@ -82,32 +110,51 @@ private:
 
     RecvWorkRequestPool* m_recvWRPool;
 
+    const uint16_t m_fcCredits;
+    const uint16_t m_fcCreditsReturnThreshold;
+    // source nodes of the consumed receive WRQs in order of completion
+    // (native flow control, NODE_ID_INVALID if no credit was consumed)
+    con::NodeId* m_creditNodes;
+    uint32_t m_creditNodesFront;
+    uint32_t m_creditNodesCount;
+
 private:
     bool __Poll();
 
     bool __Refill();
 
+    void __ReturnCredits(uint32_t numPosted);
+
+    void __ReceivedCredits(con::NodeId nodeId, uint8_t credits);
+
     bool __ProcessCompletions();
 
+    bool __PollRecvRings();
+
     bool __DispatchReceived();
 
+    void __ReleaseRdmaRecvData(uint32_t processed);
+
+    static std::string __GetStatsCategory(uint8_t shardId, uint8_t numShards);
+
     template <typename ExceptionType, typename... Args>
     void __ThrowDetailedException(const std::string& reason, Args... args)
     {
         throw ExceptionType(reason + "\n"
-                        "SendDispatcher state:\n"
+                        "RecvDispatcher (shard %d) state:\n"
                         "m_recvQueuePending: %d\n"
                         "m_totalTime: %s\n"
                         "m_receivedData: %s\n"
                         "m_receivedFC: %s\n"
                         "m_throughputReceivedData: %s\n"
                         "m_throughputReceivedFC: %s", args...,
+                static_cast<uint16_t>(m_shardId),
                 m_recvQueuePending,
-                *m_totalTime,
-                *m_receivedData,
-                *m_receivedFC,
-                *m_throughputReceivedData,
-                *m_throughputReceivedFC);
+                m_totalTime->ToString(),
+                m_receivedData->ToString(),
+                m_receivedFC->ToString(),
+                m_throughputReceivedData->ToString(),
+                m_throughputReceivedFC->ToString());
     };
 
     template <typename ExceptionType, typename... Args>
@@ -123,7 +170,7 @@ private:
     {
     public:
         Stats(RecvDispatcher* refParent) :
-                Operation("RecvDispatcher", "State"),
+                Operation(refParent->m_statsCategory, "State"),
                 m_refParent(refParent)
         {
         }
@@ -136,6 +183,11 @@ private:
                     *m_refParent->m_refRecvBufferPool << ", m_recvWRPool " << *m_refParent->m_recvWRPool;
         }
 
+        void GetFields(std::vector<stats::Snapshot::Field>& fields) const override
+        {
+            fields.emplace_back("recvQueuePending", static_cast<uint64_t>(m_refParent->m_recvQueuePending));
+        }
+
     private:
         RecvDispatcher* m_refParent;
     };
@@ -144,6 +196,7 @@ private:
     stats::Time* m_totalTime;
 
     stats::Time* m_pollTime;
+    stats::Time* m_pollRecvRingsTime;
     stats::Time* m_processRecvTotalTime;
     stats::Time* m_processRecvAvailTime;
     stats::Time* m_processRecvHandleTime;
@@ -158,8 +211,11 @@ private:
     stats::Unit* m_irbFull;
     stats::Unit* m_receivedData;
     stats::Unit* m_receivedFC;
+    stats::Unit* m_receivedRdmaWriteData;
+    stats::Unit* m_receivedRecvRingData;
     stats::Unit* m_handlerNoProcess;
     stats::Unit* m_refillInsufficientBuffers;
+    stats::Unit* m_receivedCredits;
 
     stats::Ratio* m_bufferUtilization;
     stats::Ratio* m_fragmentedLastBuffer;
@@ -39,7 +39,16 @@ class RecvHandler
 {
 public:
     /**
-     * Called when new buffer or FC data was received
+     * Called when new buffer or FC data was received. If multiple
+     * RecvDispatchers are running (receive shards), this is called
+     * concurrently by each dispatcher with its own ring buffer. Data of a
+     * single source node is always delivered by the same dispatcher (see
+     * ConnectionManager::GetRecvShardId).
+     * Entries without a buffer (m_data null) but with data contain data
+     * written to the RDMA receive region or receive ring of the connection
+     * (m_dataRaw).
+     * The data is valid until the entry is marked processed (return value)
+     * and must not be returned to the buffer pool.
      *
      * @param ringBuffer Pointer to a ring buffer struct with information about any received data
      *        (memory managed by caller)
@@ -18,6 +18,11 @@
 
 #include "SendDispatcher.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <sys/eventfd.h>
+
 #include "ibnet/sys/IllegalStateException.h"
 #include "ibnet/sys/TimeoutException.h"
 
@@ -31,12 +36,22 @@
 namespace ibnet {
 namespace msgrc {
 
-SendDispatcher::SendDispatcher(uint32_t recvBufferSize,
+SendDispatcher::SendDispatcher(uint8_t shardId, uint32_t recvBufferSize, uint16_t signalInterval,
+        uint32_t rdmaWriteThreshold,
         ConnectionManager* refConectionManager,
         stats::StatisticsManager* refStatisticsManager,
         SendHandler* refSendHandler) :
-        ExecutionUnit("MsgRCSend"),
+        ExecutionUnit("MsgRCSend" + std::to_string(shardId)),
+        m_shardId(shardId),
         m_recvBufferSize(recvBufferSize),
+        m_inlineThreshold(refConectionManager->GetInlineThreshold()),
+        m_signalInterval(signalInterval),
+        m_rdmaWriteThreshold(rdmaWriteThreshold),
+        m_recvRingSize(refConectionManager->GetRecvRingSize()),
+        m_fcCredits(refConectionManager->GetFcCredits()),
+        // return credits explicitly once half of them are pending
+        m_fcCreditsReturnThreshold(std::max<uint16_t>(1, static_cast<uint16_t>(m_fcCredits / 2))),
+        m_statsCategory(__GetStatsCategory(shardId, refConectionManager->GetNumSendShards())),
         m_refConnectionManager(refConectionManager),
         m_refStatisticsManager(refStatisticsManager),
         m_refSendHandler(refSendHandler),
@@ -45,8 +60,10 @@ SendDispatcher::SendDispatcher(uint32_t recvBufferSize,
         m_completionList(static_cast<SendHandler::CompletedWorkList*>(
                 aligned_alloc(static_cast<size_t>(getpagesize()),
                         SendHandler::CompletedWorkList::Sizeof(refConectionManager->GetMaxNumConnections())))),
+        m_completionListIndex(new uint16_t[refConectionManager->GetMaxNumConnections()]),
         m_completionsPending(0),
-        m_sendQueuePending(),
+        m_sendQueuePending(new uint16_t[refConectionManager->GetMaxNumConnections()]),
+        m_rdmaReadPending(new uint32_t[refConectionManager->GetMaxNumConnections()]),
         m_firstWc(true),
         m_ignoreFlushErrOnPendingCompletions(0),
         m_sgeLists(static_cast<ibv_sge*>(
@@ -60,48 +77,77 @@ SendDispatcher::SendDispatcher(uint32_t recvBufferSize,
                 aligned_alloc(static_cast<size_t>(getpagesize()),
                         sizeof(ibv_wc) * m_refConnectionManager->GetIbSharedSCQSize()))),
         m_workRequestCtxPool(new SendWorkRequestCtxPool(m_refConnectionManager->GetIbSharedSCQSize())),
-        m_totalTime(new stats::Time("SendDispatcher", "Total")),
-        m_getNextDataToSendTime(new stats::Time("SendDispatcher", "GetNextDataToSend")),
-        m_pollCompletionsTotalTime(new stats::Time("SendDispatcher", "PollCompletionsTotal")),
-        m_pollCompletionsActiveTime(new stats::Time("SendDispatcher", "PollCompletions")),
-        m_getConnectionTime(new stats::Time("SendDispatcher", "GetConnection")),
-        m_sendDataTotalTime(new stats::Time("SendDispatcher", "SendDataTotal")),
-        m_sendDataProcessingTime(new stats::Time("SendDispatcher", "SendDataProcessing")),
-        m_sendDataPostingTime(new stats::Time("SendDispatcher", "SendDataPosting")),
-        m_eeScheduleTime(new stats::Time("SendDispatcher", "EESchedule")),
-        m_totalTimeline(new stats::TimelineFragmented("SendDispatcher", "Total", m_totalTime, {m_getNextDataToSendTime,
+        m_userBufferActive(false),
+        m_userBuffer(),
+        m_userBufferPosted(0),
+        m_recvRingTailUpdate(),
+        m_sendBlockTimer(),
+        m_kickFd(eventfd(0, EFD_NONBLOCK)),
+        m_idleWaiting(false),
+        m_creditReturnsLock(),
+        m_creditReturns(),
+        m_creditReturnsProcessing(),
+        m_creditReturnsPending(false),
+        m_totalTime(new stats::Time(m_statsCategory, "Total")),
+        // histograms on the sections with latency spikes (e.g. polling, posting)
+        m_getNextDataToSendTime(new stats::Time(m_statsCategory, "GetNextDataToSend", true)),
+        m_pollCompletionsTotalTime(new stats::Time(m_statsCategory, "PollCompletionsTotal")),
+        m_pollCompletionsActiveTime(new stats::Time(m_statsCategory, "PollCompletions", true)),
+        m_getConnectionTime(new stats::Time(m_statsCategory, "GetConnection", true)),
+        m_sendDataTotalTime(new stats::Time(m_statsCategory, "SendDataTotal")),
+        m_sendDataProcessingTime(new stats::Time(m_statsCategory, "SendDataProcessing", true)),
+        m_sendDataPostingTime(new stats::Time(m_statsCategory, "SendDataPosting", true)),
+        m_eeScheduleTime(new stats::Time(m_statsCategory, "EESchedule")),
+        m_totalTimeline(new stats::TimelineFragmented(m_statsCategory, "Total", m_totalTime, {m_getNextDataToSendTime,
                 m_pollCompletionsTotalTime, m_getConnectionTime, m_sendDataTotalTime, m_eeScheduleTime})),
-        m_pollTimeline(new stats::TimelineFragmented("SendDispatcher", "Poll", m_pollCompletionsTotalTime,
+        m_pollTimeline(new stats::TimelineFragmented(m_statsCategory, "Poll", m_pollCompletionsTotalTime,
                 {m_pollCompletionsActiveTime})),
-        m_sendTimeline(new stats::TimelineFragmented("SendDispatcher", "Send", m_sendDataTotalTime,
+        m_sendTimeline(new stats::TimelineFragmented(m_statsCategory, "Send", m_sendDataTotalTime,
                 {m_sendDataProcessingTime, m_sendDataPostingTime})),
-        m_postedWRQs(new stats::Unit("SendDispatcher", "WRQsPosted", stats::Unit::e_Base10)),
-        m_postedDataChunk(new stats::Unit("SendDispatcher", "PostedDataChunk", stats::Unit::e_Base2)),
-        m_postedDataRemainderChunk(new stats::Unit("SendDispatcher", "PostedDataRemainderChunk", stats::Unit::e_Base2)),
-        m_sendType(new stats::Distribution("SendDispatcher", "SendType", 8)),
-        m_sentData(new stats::Unit("SendDispatcher", "Data", stats::Unit::e_Base2)),
-        m_sentFC(new stats::Unit("SendDispatcher", "FC", stats::Unit::e_Base10)),
-        m_sendBlock100ms(new stats::Unit("SendDispatcher", "SendBlock100ms", stats::Unit::e_Base10)),
-        m_sendBlock250ms(new stats::Unit("SendDispatcher", "SendBlock250ms", stats::Unit::e_Base10)),
-        m_sendBlock500ms(new stats::Unit("SendDispatcher", "SendBlock500ms", stats::Unit::e_Base10)),
-        m_emptyNextWorkPackage(new stats::Unit("SendDispatcher", "EmptyNextWorkPackage")),
-        m_nonEmptyNextWorkPackage(new stats::Unit("SendDispatcher", "NonEmptyNextWorkPackage")),
-        m_sendDataFullBuffers(new stats::Unit("SendDispatcher", "DataFullBuffers")),
-        m_sendDataNonFullBuffers(new stats::Unit("SendDispatcher", "DataNonFullBuffers")),
-        m_sendQueueFull(new stats::Unit("SendDispatcher", "QueueFull")),
-        m_emptyCompletionPolls(new stats::Unit("SendDispatcher", "EmptyCompletionPolls")),
-        m_nonEmptyCompletionPolls(new stats::Unit("SendDispatcher", "NonEmptyCompletionPolls")),
-        m_completionBatches(new stats::Unit("SendDispatcher", "CompletionBatches")),
-        m_nextWorkPackageRatio(new stats::Ratio("SendDispatcher", "NextWorkPackageRatio",
+        m_postedWRQs(new stats::Unit(m_statsCategory, "WRQsPosted", stats::Unit::e_Base10)),
+        m_signaledWRQs(new stats::Unit(m_statsCategory, "WRQsSignaled", stats::Unit::e_Base10)),
+        m_postedDataChunk(new stats::Unit(m_statsCategory, "PostedDataChunk", stats::Unit::e_Base2)),
+        m_postedDataRemainderChunk(new stats::Unit(m_statsCategory, "PostedDataRemainderChunk", stats::Unit::e_Base2)),
+        m_sendType(new stats::Distribution(m_statsCategory, "SendType", 8)),
+        // 0: inline, 1: not inline, units record the send sizes
+        m_sendInline(new stats::Distribution(m_statsCategory, "SendInline", 2)),
+        m_sentData(new stats::Unit(m_statsCategory, "Data", stats::Unit::e_Base2)),
+        m_sentFC(new stats::Unit(m_statsCategory, "FC", stats::Unit::e_Base10)),
+        m_sentUserBufferData(new stats::Unit(m_statsCategory, "UserBufferData", stats::Unit::e_Base2)),
+        m_sentRdmaWriteData(new stats::Unit(m_statsCategory, "RdmaWriteData", stats::Unit::e_Base2)),
+        m_rdmaSlotsExhausted(new stats::Unit(m_statsCategory, "RdmaSlotsExhausted", stats::Unit::e_Base10)),
+        m_sentRecvRingData(new stats::Unit(m_statsCategory, "RecvRingData", stats::Unit::e_Base2)),
+        m_sentRecvRingMappedData(new stats::Unit(m_statsCategory, "RecvRingMappedData", stats::Unit::e_Base2)),
+        m_recvRingFull(new stats::Unit(m_statsCategory, "RecvRingFull", stats::Unit::e_Base10)),
+        m_completedUserBuffers(new stats::Unit(m_statsCategory, "UserBuffersCompleted", stats::Unit::e_Base10)),
+        m_sendCreditsExhausted(new stats::Unit(m_statsCategory, "SendCreditsExhausted", stats::Unit::e_Base10)),
+        m_sentCreditReturns(new stats::Unit(m_statsCategory, "CreditReturns", stats::Unit::e_Base10)),
+        m_sendBlock100ms(new stats::Unit(m_statsCategory, "SendBlock100ms", stats::Unit::e_Base10)),
+        m_sendBlock250ms(new stats::Unit(m_statsCategory, "SendBlock250ms", stats::Unit::e_Base10)),
+        m_sendBlock500ms(new stats::Unit(m_statsCategory, "SendBlock500ms", stats::Unit::e_Base10)),
+        m_emptyNextWorkPackage(new stats::Unit(m_statsCategory, "EmptyNextWorkPackage")),
+        m_nonEmptyNextWorkPackage(new stats::Unit(m_statsCategory, "NonEmptyNextWorkPackage")),
+        m_sendDataFullBuffers(new stats::Unit(m_statsCategory, "DataFullBuffers")),
+        m_sendDataNonFullBuffers(new stats::Unit(m_statsCategory, "DataNonFullBuffers")),
+        m_sendQueueFull(new stats::Unit(m_statsCategory, "QueueFull")),
+        m_emptyCompletionPolls(new stats::Unit(m_statsCategory, "EmptyCompletionPolls")),
+        m_nonEmptyCompletionPolls(new stats::Unit(m_statsCategory, "NonEmptyCompletionPolls")),
+        m_completionBatches(new stats::Unit(m_statsCategory, "CompletionBatches")),
+        m_nextWorkPackageRatio(new stats::Ratio(m_statsCategory, "NextWorkPackageRatio",
                 m_nonEmptyNextWorkPackage, m_emptyNextWorkPackage)),
-        m_sendDataFullBuffersRatio(new stats::Ratio("SendDispatcher", "DataFullBuffersRatio",
+        m_sendDataFullBuffersRatio(new stats::Ratio(m_statsCategory, "DataFullBuffersRatio",
                 m_nonEmptyNextWorkPackage, m_emptyNextWorkPackage)),
-        m_emptyCompletionPollsRatio(new stats::Ratio("SendDispatcher", "EmptyCompletionPollsRatio",
+        m_emptyCompletionPollsRatio(new stats::Ratio(m_statsCategory, "EmptyCompletionPollsRatio",
                 m_nonEmptyCompletionPolls, m_emptyCompletionPolls)),
-        m_throughputSentData(new stats::Throughput("SendDispatcher", "ThroughputData", m_sentData, m_totalTime)),
-        m_throughputSentFC(new stats::Throughput("SendDispatcher", "ThroughputFC", m_sentFC, m_totalTime)),
+        m_throughputSentData(new stats::Throughput(m_statsCategory, "ThroughputData", m_sentData, m_totalTime)),
+        m_throughputSentFC(new stats::Throughput(m_statsCategory, "ThroughputFC", m_sentFC, m_totalTime)),
         m_privateStats(new Stats(this))
 {
+    if (m_kickFd < 0) {
+        throw core::IbException("Creating eventfd for send dispatcher %d failed: %s",
+                static_cast<uint16_t>(shardId), strerror(errno));
+    }
+
     memset(static_cast<void*>(m_prevWorkPackageResults), 0, sizeof(SendHandler::PrevWorkPackageResults));
     memset(static_cast<void*>(m_completionList), 0,
             SendHandler::CompletedWorkList::Sizeof(refConectionManager->GetMaxNumConnections()));
@@ -110,23 +156,44 @@ SendDispatcher::SendDispatcher(uint32_t recvBufferSize,
     m_prevWorkPackageResults->Reset();
     m_completionList->Reset();
 
-    memset(m_sendQueuePending, 0, sizeof(uint16_t) * con::NODE_ID_MAX_NUM_NODES);
+    memset(m_completionListIndex, 0, sizeof(uint16_t) * m_refConnectionManager->GetMaxNumConnections());
+    memset(m_sendQueuePending, 0, sizeof(uint16_t) * m_refConnectionManager->GetMaxNumConnections());
+    memset(m_rdmaReadPending, 0, sizeof(uint32_t) * m_refConnectionManager->GetMaxNumConnections());
 
     memset(m_sgeLists, 0, sizeof(ibv_sge) * m_refConnectionManager->GetIbSQSize() * 2);
     memset(m_sendWrs, 0, sizeof(ibv_send_wr) * m_refConnectionManager->GetIbSQSize());
     memset(m_workComp, 0, sizeof(ibv_wc) * m_refConnectionManager->GetIbSharedSCQSize());
 
-    m_refStatisticsManager->Register(m_totalTimeline);
-    m_refStatisticsManager->Register(m_pollTimeline);
-    m_refStatisticsManager->Register(m_sendTimeline);
+    m_refStatisticsManager->Register(m_totalTimeline, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_pollTimeline, stats::e_LevelFull);
+    m_refStatisticsManager->Register(m_sendTimeline, stats::e_LevelFull);
+
+    // coarse timings only: no timelines, print the timings on their own
+    if (!stats::IsLevelEnabled(stats::e_LevelFull)) {
+        m_refStatisticsManager->Register(m_totalTime, stats::e_LevelCoarse);
+        m_refStatisticsManager->Register(m_getNextDataToSendTime, stats::e_LevelCoarse);
+        m_refStatisticsManager->Register(m_pollCompletionsTotalTime, stats::e_LevelCoarse);
+        m_refStatisticsManager->Register(m_sendDataTotalTime, stats::e_LevelCoarse);
+    }
 
     m_refStatisticsManager->Register(m_postedWRQs);
+    m_refStatisticsManager->Register(m_signaledWRQs);
     m_refStatisticsManager->Register(m_postedDataChunk);
     m_refStatisticsManager->Register(m_postedDataRemainderChunk);
     m_refStatisticsManager->Register(m_sendType);
+    m_refStatisticsManager->Register(m_sendInline);
 
     m_refStatisticsManager->Register(m_sentData);
     m_refStatisticsManager->Register(m_sentFC);
+    m_refStatisticsManager->Register(m_sentUserBufferData);
+    m_refStatisticsManager->Register(m_sentRdmaWriteData);
+    m_refStatisticsManager->Register(m_rdmaSlotsExhausted);
+    m_refStatisticsManager->Register(m_sentRecvRingData);
+    m_refStatisticsManager->Register(m_sentRecvRingMappedData);
+    m_refStatisticsManager->Register(m_recvRingFull);
+    m_refStatisticsManager->Register(m_completedUserBuffers);
+    m_refStatisticsManager->Register(m_sendCreditsExhausted);
+    m_refStatisticsManager->Register(m_sentCreditReturns);
 
     m_refStatisticsManager->Register(m_sendBlock100ms);
     m_refStatisticsManager->Register(m_sendBlock250ms);
@@ -147,8 +214,9 @@ SendDispatcher::SendDispatcher(uint32_t recvBufferSize,
     m_refStatisticsManager->Register(m_sendDataFullBuffersRatio);
     m_refStatisticsManager->Register(m_emptyCompletionPollsRatio);
 
-    m_refStatisticsManager->Register(m_throughputSentData);
-    m_refStatisticsManager->Register(m_throughputSentFC);
+    // throughput is calculated from the total time
+    m_refStatisticsManager->Register(m_throughputSentData, stats::e_LevelCoarse);
+    m_refStatisticsManager->Register(m_throughputSentFC, stats::e_LevelCoarse);
 
     m_refStatisticsManager->Register(m_privateStats);
 }
@@ -159,13 +227,29 @@ SendDispatcher::~SendDispatcher()
     m_refStatisticsManager->Deregister(m_pollTimeline);
     m_refStatisticsManager->Deregister(m_sendTimeline);
 
+    m_refStatisticsManager->Deregister(m_totalTime);
+    m_refStatisticsManager->Deregister(m_getNextDataToSendTime);
+    m_refStatisticsManager->Deregister(m_pollCompletionsTotalTime);
+    m_refStatisticsManager->Deregister(m_sendDataTotalTime);
+
     m_refStatisticsManager->Deregister(m_postedWRQs);
+    m_refStatisticsManager->Deregister(m_signaledWRQs);
     m_refStatisticsManager->Deregister(m_postedDataChunk);
     m_refStatisticsManager->Deregister(m_postedDataRemainderChunk);
     m_refStatisticsManager->Deregister(m_sendType);
+    m_refStatisticsManager->Deregister(m_sendInline);
 
     m_refStatisticsManager->Deregister(m_sentData);
     m_refStatisticsManager->Deregister(m_sentFC);
+    m_refStatisticsManager->Deregister(m_sentUserBufferData);
+    m_refStatisticsManager->Deregister(m_sentRdmaWriteData);
+    m_refStatisticsManager->Deregister(m_rdmaSlotsExhausted);
+    m_refStatisticsManager->Deregister(m_sentRecvRingData);
+    m_refStatisticsManager->Deregister(m_sentRecvRingMappedData);
+    m_refStatisticsManager->Deregister(m_recvRingFull);
+    m_refStatisticsManager->Deregister(m_completedUserBuffers);
+    m_refStatisticsManager->Deregister(m_sendCreditsExhausted);
+    m_refStatisticsManager->Deregister(m_sentCreditReturns);
 
     m_refStatisticsManager->Deregister(m_sendBlock100ms);
     m_refStatisticsManager->Deregister(m_sendBlock250ms);
@@ -193,6 +277,9 @@ SendDispatcher::~SendDispatcher()
 
     free(m_prevWorkPackageResults);
     free(m_completionList);
+    delete[] m_completionListIndex;
+    delete[] m_sendQueuePending;
+    delete[] m_rdmaReadPending;
 
     free(m_sgeLists);
     free(m_sendWrs);
@@ -200,6 +287,8 @@ SendDispatcher::~SendDispatcher()
 
     delete (m_workRequestCtxPool);
 
+    close(m_kickFd);
+
     delete m_totalTime;
     delete m_pollTimeline;
     delete m_sendTimeline;
@@ -216,12 +305,23 @@ SendDispatcher::~SendDispatcher()
     delete m_totalTimeline;
 
     delete m_postedWRQs;
+    delete m_signaledWRQs;
     delete m_postedDataChunk;
     delete m_postedDataRemainderChunk;
     delete m_sendType;
+    delete m_sendInline;
 
     delete m_sentData;
     delete m_sentFC;
+    delete m_sentUserBufferData;
+    delete m_sentRdmaWriteData;
+    delete m_rdmaSlotsExhausted;
+    delete m_sentRecvRingData;
+    delete m_sentRecvRingMappedData;
+    delete m_recvRingFull;
+    delete m_completedUserBuffers;
+    delete m_sendCreditsExhausted;
+    delete m_sentCreditReturns;
 
     delete m_sendBlock100ms;
     delete m_sendBlock250ms;
@@ -250,21 +350,24 @@ SendDispatcher::~SendDispatcher()
 
 bool SendDispatcher::Dispatch()
 {
-    IBNET_STATS(m_eeScheduleTime->Stop());
+    IBNET_STATS_FULL(m_eeScheduleTime->Stop());
 
-    if (m_totalTime->GetCounter() == 0) {
-        IBNET_STATS(m_totalTime->Start());
-    } else {
-        IBNET_STATS(m_totalTime->Stop());
-        IBNET_STATS(m_totalTime->Start());
+    // don't sum up the counter shards if the timing is not compiled
+    if constexpr (stats::IsLevelEnabled(stats::e_LevelCoarse)) {
+        if (m_totalTime->GetCounter() == 0) {
+            m_totalTime->Start();
+        } else {
+            m_totalTime->Stop();
+            m_totalTime->Start();
+        }
     }
 
-    IBNET_STATS(m_getNextDataToSendTime->Start());
+    IBNET_STATS_COARSE(m_getNextDataToSendTime->Start());
 
-    const SendHandler::NextWorkPackage* workPackage = m_refSendHandler->GetNextDataToSend(m_prevWorkPackageResults,
-            m_completionList);
+    const SendHandler::NextWorkPackage* workPackage = m_refSendHandler->GetNextDataToSend(m_shardId,
+            m_prevWorkPackageResults, m_completionList);
 
-    IBNET_STATS(m_getNextDataToSendTime->Stop());
+    IBNET_STATS_COARSE(m_getNextDataToSendTime->Stop());
 
     if (workPackage == nullptr) {
         __ThrowDetailedException<sys::IllegalStateException>("Work package null");
@@ -284,12 +387,19 @@ bool SendDispatcher::Dispatch()
         } else {
             IBNET_STATS(m_nonEmptyNextWorkPackage->Inc());
 
-            IBNET_STATS(m_getConnectionTime->Start());
+            // the completions of the connection are delivered to another shard's CQ
+            if (m_refConnectionManager->GetSendShardId(workPackage->m_nodeId) != m_shardId) {
+                __ThrowDetailedException<sys::IllegalStateException>(
+                        "Work package for node 0x%X not assigned to send shard %d", workPackage->m_nodeId,
+                        static_cast<uint16_t>(m_shardId));
+            }
+
+            IBNET_STATS_FULL(m_getConnectionTime->Start());
 
             connection = (Connection*) m_refConnectionManager->GetConnection(workPackage->m_nodeId);
 
-            IBNET_STATS(m_getConnectionTime->Stop());
-            IBNET_STATS(m_sendDataTotalTime->Start());
+            IBNET_STATS_FULL(m_getConnectionTime->Stop());
+            IBNET_STATS_COARSE(m_sendDataTotalTime->Start());
 
             // send data
             ret = __SendData(connection, workPackage);
@@ -297,26 +407,38 @@ bool SendDispatcher::Dispatch()
             IBNET_STATS(m_sentData->Add(m_prevWorkPackageResults->m_numBytesPosted));
             IBNET_STATS(m_sentFC->Add(m_prevWorkPackageResults->m_fcDataPosted));
 
-            IBNET_STATS(m_sendDataTotalTime->Stop());
+            IBNET_STATS_COARSE(m_sendDataTotalTime->Stop());
+
+            // native flow control: report the credits left to the handler
+            if (m_fcCredits > 0) {
+                m_prevWorkPackageResults->m_sendCredits = connection->GetSendCredits();
+            }
 
             m_refConnectionManager->ReturnConnection(connection);
+            connection = nullptr;
+        }
+
+        ret = __SendUserBuffer() || ret;
+
+        if (m_fcCredits > 0) {
+            ret = __SendCreditReturns() || ret;
         }
 
-        IBNET_STATS(m_pollCompletionsTotalTime->Start());
+        IBNET_STATS_COARSE(m_pollCompletionsTotalTime->Start());
 
         ret = __PollCompletions() || ret;
 
-        IBNET_STATS(m_pollCompletionsTotalTime->Stop());
+        IBNET_STATS_COARSE(m_pollCompletionsTotalTime->Stop());
     } catch (sys::TimeoutException& e) {
         IBNET_LOG_WARN("Timeout: %s", e.what());
 
-        IBNET_STATS(m_pollCompletionsTotalTime->Start());
+        IBNET_STATS_COARSE(m_pollCompletionsTotalTime->Start());
 
         // timeout on initial connection creation
         // try polling work completions and return
         ret = __PollCompletions();
 
-        IBNET_STATS(m_pollCompletionsTotalTime->Stop());
+        IBNET_STATS_COARSE(m_pollCompletionsTotalTime->Stop());
     } catch (con::DisconnectedException& e) {
         IBNET_LOG_WARN("Disconnected: %s", e.what());
 
@@ -327,30 +449,77 @@ bool SendDispatcher::Dispatch()
 
         m_refConnectionManager->CloseConnection(e.getNodeId(), true);
 
+        // abort user buffer in progress. any WRQs of it already posted are flushed
+        if (m_userBufferActive && m_userBuffer.m_nodeId == e.getNodeId()) {
+            m_userBufferActive = false;
+            __CompleteUserBuffer(&m_userBuffer, false);
+        }
+
         // reset due to failure
         m_prevWorkPackageResults->Reset();
 
         m_ignoreFlushErrOnPendingCompletions += m_completionsPending;
 
-        IBNET_STATS(m_eeScheduleTime->Start());
+        IBNET_STATS_FULL(m_eeScheduleTime->Start());
 
         ret = true;
     }
 
-    IBNET_STATS(m_eeScheduleTime->Start());
+    IBNET_STATS_FULL(m_eeScheduleTime->Start());
 
     return ret;
 }
 
+bool SendDispatcher::PrepareIdleWait(std::vector<int>& fds)
+{
+    m_idleWaiting.store(true, std::memory_order_relaxed);
+
+    // pairs with the fence in Kick: either the producer sees the flag or the
+    // worker sees the new data when dispatching again before blocking
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    fds.push_back(m_kickFd);
+
+    // completions of posted WRQs wake up the worker as well
+    if (m_completionsPending > 0) {
+        int ret = ibv_req_notify_cq(m_refConnectionManager->GetIbSharedSCQ(m_shardId), 0);
+
+        if (ret != 0) {
+            IBNET_LOG_ERROR("Requesting completion notification failed: %s", strerror(ret));
+            m_idleWaiting.store(false, std::memory_order_relaxed);
+            return false;
+        }
+
+        fds.push_back(m_refConnectionManager->GetIbSharedSCQChannel(m_shardId)->fd);
+    }
+
+    return true;
+}
+
+void SendDispatcher::IdleWaitDone()
+{
+    m_idleWaiting.store(false, std::memory_order_relaxed);
+
+    uint64_t val;
+
+    // reset the eventfd's counter, fails with EAGAIN if not kicked (non blocking)
+    if (read(m_kickFd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+        IBNET_LOG_ERROR("Reading eventfd of send dispatcher %d failed: %s", static_cast<uint16_t>(m_shardId),
+                strerror(errno));
+    }
+
+    ConnectionManager::ConsumeCQEvents(m_refConnectionManager->GetIbSharedSCQChannel(m_shardId));
+}
+
 bool SendDispatcher::__PollCompletions()
 {
     // anything to poll from the shared completion queue
     if (m_completionsPending > 0) {
-        IBNET_STATS(m_pollCompletionsActiveTime->Start());
+        IBNET_STATS_FULL(m_pollCompletionsActiveTime->Start());
 
         // poll in batches
-        int ret = ibv_poll_cq(m_refConnectionManager->GetIbSharedSCQ(), m_refConnectionManager->GetIbSharedSCQSize(),
-                m_workComp);
+        int ret = ibv_poll_cq(m_refConnectionManager->GetIbSharedSCQ(m_shardId),
+                m_refConnectionManager->GetIbSharedSCQSize(), m_workComp);
 
         if (ret < 0) {
             __ThrowDetailedException<core::IbException>(ret, "Polling completion queue failed");
@@ -371,24 +540,57 @@ bool SendDispatcher::__PollCompletions()
             IBNET_STATS(m_nonEmptyCompletionPolls->Inc());
             IBNET_STATS(m_completionBatches->Add(static_cast<uint64_t>(ret)));
 
+            // node of a failed work completion. the disconnect is reported after
+            // processing the whole batch, the remaining completions are lost otherwise
+            con::NodeId disconnectedNodeId = con::NODE_ID_INVALID;
+
             for (uint32_t i = 0; i < static_cast<uint32_t>(ret); i++) {
-                auto ctx = (SendWorkRequestCtx*) m_workComp[i].wr_id;
+                SendWorkRequestCtx* ctx = nullptr;
+                con::NodeId nodeId;
+
+                // unsignaled WRQs only generate completions on errors (the failed WRQ
+                // and flushes). their contexts are merged into the next signaled WRQ of
+                // the same batch which is flushed, the id identifies the target
+                if (SendWorkRequestCtx::IsUnsignaledWrId(m_workComp[i].wr_id)) {
+                    nodeId = SendWorkRequestCtx::GetUnsignaledWrIdNodeId(m_workComp[i].wr_id);
+                } else {
+                    ctx = (SendWorkRequestCtx*) m_workComp[i].wr_id;
+                    nodeId = ctx->m_targetNodeId;
+                }
 
                 if (m_workComp[i].status != IBV_WC_SUCCESS) {
                     switch (m_workComp[i].status) {
                         case IBV_WC_WR_FLUSH_ERR:
-                            if (m_ignoreFlushErrOnPendingCompletions != 0) {
-                                // some node disconnected/failed and we have
-                                // to ignore any errors for a bit
+                            if (m_ignoreFlushErrOnPendingCompletions != 0 ||
+                                    disconnectedNodeId != con::NODE_ID_INVALID) {
+                                // some node disconnected/failed (possibly earlier
+                                // in this batch) and we have to ignore any errors
+                                // for a bit
                                 break;
                             }
 
-                            // fall through to default error case
+                            // QP in error state (e.g. posted to after the error
+                            // completion was polled), the connection is unusable
+                            if (disconnectedNodeId == con::NODE_ID_INVALID) {
+                                disconnectedNodeId = nodeId;
+                            }
+
+                            break;
 
                         default:
-                            __ThrowDetailedException<core::IbException>(
-                                    "Found failed work completion (%d), ctx: %s, status %s", i,
-                                    *ctx, core::WORK_COMPLETION_STATUS_CODE[m_workComp[i].status]);
+                            // failed WRQ (e.g. remote access error), signaled or
+                            // not: a single peer's failure, close the connection
+                            // to the target instead of failing the dispatcher
+                            if (ctx != nullptr) {
+                                IBNET_LOG_ERROR("Found failed work completion (%d), ctx: %s, status %s", i,
+                                        *ctx, core::WORK_COMPLETION_STATUS_CODE[m_workComp[i].status]);
+                            } else {
+                                IBNET_LOG_ERROR("Found failed work completion (%d) of unsignaled WRQ to 0x%X, "
+                                        "status %s", i, nodeId,
+                                        core::WORK_COMPLETION_STATUS_CODE[m_workComp[i].status]);
+                            }
+
+                            // fall through
 
                         case IBV_WC_RETRY_EXC_ERR:
                             if (m_firstWc) {
@@ -397,31 +599,54 @@ bool SendDispatcher::__PollCompletions()
                                                 " it's very likely your connection "
                                                 "attributes are wrong or the remote"
                                                 " isn't in a state to respond");
-                            } else {
-                                uint16_t nodeId = ctx->m_targetNodeId;
-                                m_workRequestCtxPool->Push(ctx);
-                                throw con::DisconnectedException(nodeId);
                             }
+
+                            if (disconnectedNodeId == con::NODE_ID_INVALID) {
+                                disconnectedNodeId = nodeId;
+                            }
+
+                            break;
+                    }
+
+                    // nothing to retire for unsignaled WRQs
+                    if (ctx == nullptr) {
+                        continue;
                     }
 
                     // node failure/disconnect but still completions to poll
                     // from the cq. Continue decrementing until all failed
                     // completions are processed
 
-                    m_sendQueuePending[ctx->m_targetNodeId]--;
+                    if (ctx->m_userBufferLast) {
+                        __CompleteUserBuffer(&ctx->m_userBuffer, false);
+                    }
+
+                    m_sendQueuePending[ctx->m_connectionId] -= ctx->m_numWRQs;
                     m_completionsPending--;
                 } else {
                     m_firstWc = false;
 
-                    if (m_completionList->m_numBytesWritten[ctx->m_targetNodeId] == 0 &&
-                            m_completionList->m_fcDataWritten[ctx->m_targetNodeId] == 0) {
-                        m_completionList->m_nodeIds[m_completionList->m_numNodes++] = ctx->m_targetNodeId;
+                    // user buffers and RDMA reads don't involve send buffer data
+                    if (ctx->m_sendSize > 0 || ctx->m_fcData > 0) {
+                        __AddCompletedWork(ctx->m_connectionId, ctx->m_targetNodeId, ctx->m_sendSize,
+                                static_cast<uint8_t>(ctx->m_fcData));
                     }
 
-                    m_completionList->m_numBytesWritten[ctx->m_targetNodeId] += ctx->m_sendSize;
-                    m_completionList->m_fcDataWritten[ctx->m_targetNodeId] += ctx->m_fcData;
-                    m_sendQueuePending[ctx->m_targetNodeId]--;
+                    // retires the preceding unsignaled WRQs as well
+                    m_sendQueuePending[ctx->m_connectionId] -= ctx->m_numWRQs;
                     m_completionsPending--;
+
+                    // all WRQs of the user buffer completed (in order on the QP)
+                    if (ctx->m_userBufferLast) {
+                        __CompleteUserBuffer(&ctx->m_userBuffer, true);
+                    }
+                }
+
+                // remote's consumed counter is up to date (or the read failed).
+                // a connection closed meanwhile isn't accessed
+                if (ctx->m_rdmaReadIncarnation != 0 &&
+                        m_rdmaReadPending[ctx->m_connectionId] == ctx->m_rdmaReadIncarnation) {
+                    m_rdmaReadPending[ctx->m_connectionId] = 0;
                 }
 
                 try {
@@ -435,11 +660,18 @@ bool SendDispatcher::__PollCompletions()
                     m_ignoreFlushErrOnPendingCompletions--;
                 }
             }
+
+            if (disconnectedNodeId != con::NODE_ID_INVALID) {
+                IBNET_STATS_FULL(m_pollCompletionsActiveTime->Stop());
+
+                // flush errors of the pending completions are ignored on disconnect
+                throw con::DisconnectedException(disconnectedNodeId);
+            }
         } else {
             IBNET_STATS(m_emptyCompletionPolls->Inc());
         }
 
-        IBNET_STATS(m_pollCompletionsActiveTime->Stop());
+        IBNET_STATS_FULL(m_pollCompletionsActiveTime->Stop());
     }
 
     return m_completionsPending > 0;
@@ -447,16 +679,61 @@ bool SendDispatcher::__PollCompletions()
 
 bool SendDispatcher::__SendData(Connection* connection, const SendHandler::NextWorkPackage* workPackage)
 {
-    IBNET_STATS(m_sendDataProcessingTime->Start());
-    uint32_t chunks = __SendDataPrepareWorkRequests(connection, workPackage);
-    IBNET_STATS(m_sendDataProcessingTime->Stop());
+    IBNET_STATS_FULL(m_sendDataProcessingTime->Start());
+
+    uint32_t chunks = 0;
+
+    // remote runs on the same host: copy the data to its receive ring in
+    // shared memory, no WRQs required
+    if (connection->IsRemoteRecvRingMapped()) {
+        __SendDataRecvRingMapped(connection, workPackage);
+
+        IBNET_STATS_FULL(m_sendDataProcessingTime->Stop());
+
+        return m_prevWorkPackageResults->m_numBytesPosted > 0 || m_prevWorkPackageResults->m_fcDataPosted > 0;
+    }
+
+    // one-sided: all data is written to the remote's receive ring. if only
+    // co-located nodes use receive rings, the remote's ring is written using
+    // RDMA if mapping it failed
+    if (m_recvRingSize > 0 || (m_refConnectionManager->HasRecvRings() && connection->GetRemoteRecvRingSize() > 0)) {
+        chunks = __SendDataPrepareRecvRingWorkRequests(connection, workPackage);
+
+        IBNET_STATS_FULL(m_sendDataProcessingTime->Stop());
+
+        if (chunks > 0) {
+            __SendDataPostWorkRequests(connection, chunks);
+            return true;
+        } else {
+            IBNET_STATS(m_sendQueueFull->Inc());
+            return false;
+        }
+    }
+
+    // large amounts of data are written to the remote's RDMA receive region
+    // with a single WRQ instead of splitting them into receive buffer sized
+    // sends
+    if (m_rdmaWriteThreshold > 0) {
+        chunks = __SendDataPrepareRdmaWorkRequest(connection, workPackage);
+    }
+
+    if (chunks == 0) {
+        chunks = __SendDataPrepareWorkRequests(connection, workPackage);
+    }
+
+    IBNET_STATS_FULL(m_sendDataProcessingTime->Stop());
 
     // no data available
     if (chunks > 0) {
         __SendDataPostWorkRequests(connection, chunks);
         return true;
     } else {
-        IBNET_STATS(m_sendQueueFull->Inc());
+        if (__GetSendCredits(connection) == 0) {
+            IBNET_STATS(m_sendCreditsExhausted->Inc());
+        } else {
+            IBNET_STATS(m_sendQueueFull->Inc());
+        }
+
         return false;
     }
 }
@@ -482,6 +759,9 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
 
     uint32_t totalBytesToProcess = 0;
 
+    // each send consumes a receive WRQ of the remote
+    const uint32_t credits = __GetSendCredits(connection);
+
     // determine max amount of data available to send
     // wrap around
     if (posBack > posFront) {
@@ -490,20 +770,23 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
         totalBytesToProcess = posFront - posBack;
     }
 
-    while (m_sendQueuePending[nodeId] + chunksPos < m_refConnectionManager->GetIbSQSize() &&
-            (posBack != posFront || fcData)) {
+    while (m_sendQueuePending[connection->GetConnectionId()] + chunksPos < m_refConnectionManager->GetIbSQSize() &&
+            chunksPos < credits && (posBack != posFront || fcData)) {
         // fc data only branch
         if (posBack == posFront && fcData) {
             // context used on completion to identify completed work request
             SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
             m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
             ctx->m_targetNodeId = nodeId;
+            ctx->m_connectionId = connection->GetConnectionId();
             ctx->m_fcData = fcData;
             ctx->m_sendSize = 0;
             ctx->m_posFront = 0;
             ctx->m_posBack = 0;
             ctx->m_posEnd = 0;
             ctx->m_debug = 0;
+            ctx->m_userBufferLast = false;
+            ctx->m_rdmaReadIncarnation = 0;
 
             m_sendWrs[chunksPos].sg_list = nullptr;
             m_sendWrs[chunksPos].num_sge = 0;
@@ -511,12 +794,16 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
             auto immedData = (ImmediateData*) &m_sendWrs[chunksPos].imm_data;
             immedData->m_sourceNodeId = connection->GetSourceNodeId();
             immedData->m_flowControlData = fcData;
+            immedData->m_rdmaSlot = 0;
 
             m_sendWrs[chunksPos].opcode = IBV_WR_SEND_WITH_IMM;
-            m_sendWrs[chunksPos].send_flags = 0;
+            // no payload, posting inline keeps the WQE self contained
+            m_sendWrs[chunksPos].send_flags = m_inlineThreshold > 0 ? IBV_SEND_INLINE : 0;
             // list is connected further down
             m_sendWrs[chunksPos].next = nullptr;
 
+            IBNET_STATS(m_sendInline->GetUnit(static_cast<size_t>(m_inlineThreshold > 0 ? 0 : 1)).Add(0));
+
             chunksPos++;
 
             totalFcDataProcessed = fcData;
@@ -525,6 +812,7 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
             break;
         } else {
             uint8_t debug = 0;
+            uint32_t sendSize;
 
             // we got data (and probably FC data as well)
 
@@ -587,12 +875,15 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
                 SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
                 m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
                 ctx->m_targetNodeId = nodeId;
+                ctx->m_connectionId = connection->GetConnectionId();
                 ctx->m_fcData = fcData;
                 ctx->m_sendSize = length;
                 ctx->m_posFront = posFront;
                 ctx->m_posBack = posBack;
                 ctx->m_posEnd = posEnd;
                 ctx->m_debug = static_cast<uint8_t>(debug + 10);
+                ctx->m_userBufferLast = false;
+                ctx->m_rdmaReadIncarnation = 0;
 
                 m_sgeLists[sgeListPos].addr = (uintptr_t) refSendBuffer->GetAddress() + posBack;
                 m_sgeLists[sgeListPos].length = length;
@@ -610,9 +901,11 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
                 auto immedData = (ImmediateData*) &m_sendWrs[chunksPos].imm_data;
                 immedData->m_sourceNodeId = connection->GetSourceNodeId();
                 immedData->m_flowControlData = fcData;
+                immedData->m_rdmaSlot = 0;
 
                 sgeListPos++;
 
+                sendSize = length;
                 totalBytesProcessed += length;
             } else {
                 // wrap around with 2 SGEs
@@ -651,22 +944,39 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
                 SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
                 m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
                 ctx->m_targetNodeId = nodeId;
+                ctx->m_connectionId = connection->GetConnectionId();
                 ctx->m_fcData = fcData;
                 ctx->m_sendSize = totalLength;
                 ctx->m_posFront = posFront;
                 ctx->m_posBack = posBack;
                 ctx->m_posEnd = posEnd;
                 ctx->m_debug = static_cast<uint8_t>(debug + 20);
+                ctx->m_userBufferLast = false;
+                ctx->m_rdmaReadIncarnation = 0;
 
                 auto immedData = (ImmediateData*) &m_sendWrs[chunksPos].imm_data;
                 immedData->m_sourceNodeId = connection->GetSourceNodeId();
                 immedData->m_flowControlData = fcData;
+                immedData->m_rdmaSlot = 0;
 
+                sendSize = totalLength;
                 totalBytesProcessed += totalLength;
             }
 
             m_sendWrs[chunksPos].opcode = IBV_WR_SEND_WITH_IMM;
-            m_sendWrs[chunksPos].send_flags = 0;
+
+            // small payloads are copied to the WQE by the CPU on posting
+            // which saves the HCA a DMA read of the send buffer. the data
+            // is still kept in the ORB until completion to keep the ORB
+            // management identical for both paths
+            if (sendSize <= m_inlineThreshold) {
+                m_sendWrs[chunksPos].send_flags = IBV_SEND_INLINE;
+                IBNET_STATS(m_sendInline->GetUnit(static_cast<size_t>(0)).Add(sendSize));
+            } else {
+                m_sendWrs[chunksPos].send_flags = 0;
+                IBNET_STATS(m_sendInline->GetUnit(static_cast<size_t>(1)).Add(sendSize));
+            }
+
             // list is connected further down
             m_sendWrs[chunksPos].next = nullptr;
 
@@ -721,21 +1031,71 @@ uint32_t SendDispatcher::__SendDataPrepareWorkRequests(Connection* connection,
 
 void SendDispatcher::__SendDataPostWorkRequests(Connection* connection, uint32_t chunks)
 {
-    IBNET_STATS(m_sendDataPostingTime->Start());
+    IBNET_STATS_FULL(m_sendDataPostingTime->Start());
 
     // connect all work requests
     for (uint16_t i = 0; i < chunks - 1; i++) {
         m_sendWrs[i].next = &m_sendWrs[i + 1];
     }
 
-    // note: some tests have shown that it seems like ack'ing every nth
-    // work request is a bad idea and increases overall latency. polling
-    // in batches already deals with generating completions
-    // for every work request quite well
+    // signal every nth work request and always the last one of the batch.
+    // the contexts of unsignaled work requests are merged into the next
+    // signaled one and returned to the pool right away. this way, a single
+    // completion retires all of them and no unsignaled work request is
+    // left pending after the batch. with an interval of 1, every work
+    // request is signaled
+    uint32_t signaled = 0;
+    uint32_t unsignaledSendSize = 0;
+    uint16_t unsignaledFcData = 0;
+    uint16_t unsignaledWRQs = 0;
+
+    // native flow control: WRQs consuming a receive WRQ of the remote
+    uint16_t creditsConsumed = 0;
+    bool creditsReturned = false;
+    uint8_t creditsTaken = 0;
+
     for (uint16_t i = 0; i < chunks; i++) {
-        // Just signal all work requests, seems like this
-        // doesn't make any difference performance wise
-        m_sendWrs[i].send_flags = IBV_SEND_SIGNALED;
+        auto ctx = (SendWorkRequestCtx*) m_sendWrs[i].wr_id;
+
+        if (m_fcCredits > 0 && (m_sendWrs[i].opcode == IBV_WR_SEND_WITH_IMM ||
+                m_sendWrs[i].opcode == IBV_WR_RDMA_WRITE_WITH_IMM)) {
+            auto immedData = (ImmediateData*) &m_sendWrs[i].imm_data;
+
+            // credit returns (no data, no FC data) are not covered by credits
+            if (m_sendWrs[i].num_sge > 0 || immedData->m_flowControlData > 0) {
+                creditsConsumed++;
+            }
+
+            // piggyback the credits to return on the first send. the
+            // immediate data of RDMA writes carries the slot instead
+            if (!creditsReturned && m_sendWrs[i].opcode == IBV_WR_SEND_WITH_IMM) {
+                creditsTaken = connection->TakeCreditsToReturn();
+                immedData->m_credits = creditsTaken;
+                creditsReturned = true;
+            }
+        }
+
+        // completion of the last WRQ of a user buffer returns it to the caller
+        if ((i + 1) % m_signalInterval == 0 || i == chunks - 1 || ctx->m_userBufferLast) {
+            ctx->m_sendSize += unsignaledSendSize;
+            ctx->m_fcData += unsignaledFcData;
+            ctx->m_numWRQs = static_cast<uint16_t>(unsignaledWRQs + 1);
+
+            unsignaledSendSize = 0;
+            unsignaledFcData = 0;
+            unsignaledWRQs = 0;
+
+            m_sendWrs[i].send_flags |= IBV_SEND_SIGNALED;
+            signaled++;
+        } else {
+            unsignaledSendSize += ctx->m_sendSize;
+            unsignaledFcData += ctx->m_fcData;
+            unsignaledWRQs++;
+
+            // identifies the target if the WRQ fails
+            m_sendWrs[i].wr_id = SendWorkRequestCtx::GetUnsignaledWrId(ctx->m_targetNodeId, ctx->m_connectionId);
+            m_workRequestCtxPool->Push(ctx);
+        }
     }
 
     ibv_send_wr* firstBadWr;
@@ -744,10 +1104,20 @@ void SendDispatcher::__SendDataPostWorkRequests(Connection* connection, uint32_t
     int ret = ibv_post_send(connection->GetQP(), &m_sendWrs[0], &firstBadWr);
 
     if (ret != 0) {
+        // the credits taken never reach the remote, return them later.
+        // otherwise, the remote runs out of credits eventually
+        if (creditsTaken > 0) {
+            uint16_t total = connection->AddCreditsToReturn(creditsTaken);
+
+            if (total >= m_fcCreditsReturnThreshold) {
+                QueueCreditReturn(connection->GetRemoteNodeId());
+            }
+        }
+
         switch (ret) {
             case ENOMEM:
                 __ThrowDetailedException<core::IbQueueFullException>(
-                        "Send queue full: %d", m_sendQueuePending[connection->GetRemoteNodeId()]);
+                        "Send queue full: %d", m_sendQueuePending[connection->GetConnectionId()]);
 
             default:
                 __ThrowDetailedException<core::IbException>(ret,
@@ -758,12 +1128,704 @@ void SendDispatcher::__SendDataPostWorkRequests(Connection* connection, uint32_t
     m_sendBlockTimer.Start();
 
     IBNET_STATS(m_postedWRQs->Add(chunks));
+    IBNET_STATS(m_signaledWRQs->Add(signaled));
+
+    m_sendQueuePending[connection->GetConnectionId()] += chunks;
+    // completion queue shared among all connections of this shard, only
+    // signaled WRQs generate completions
+    m_completionsPending += signaled;
+
+    if (creditsConsumed > 0) {
+        connection->ConsumeSendCredits(creditsConsumed);
+    }
+
+    IBNET_STATS_FULL(m_sendDataPostingTime->Stop());
+}
+
+uint32_t SendDispatcher::__SendDataPrepareRdmaWorkRequest(Connection* connection,
+        const SendHandler::NextWorkPackage* workPackage)
+{
+    // remote does not accept RDMA writes
+    if (connection->GetRemoteRdmaRecvSlots() == 0) {
+        return 0;
+    }
+
+    const core::IbMemReg* refSendBuffer = connection->GetRefSendBuffer();
+
+    const con::NodeId nodeId = workPackage->m_nodeId;
+    const uint32_t posFront = workPackage->m_posFrontRel;
+    const uint32_t posBack = workPackage->m_posBackRel;
+
+    uint32_t totalBytesToProcess;
+
+    // wrap around
+    if (posBack > posFront) {
+        totalBytesToProcess = refSendBuffer->GetSizeBuffer() - posBack + posFront;
+    } else {
+        totalBytesToProcess = posFront - posBack;
+    }
+
+    if (totalBytesToProcess < m_rdmaWriteThreshold) {
+        return 0;
+    }
+
+    // the write with immediate consumes a receive WRQ of the remote
+    if (__GetSendCredits(connection) == 0) {
+        return 0;
+    }
+
+    // the RDMA read might need a slot of the queue as well
+    if (m_sendQueuePending[connection->GetConnectionId()] + 1 >= m_refConnectionManager->GetIbSQSize()) {
+        return 0;
+    }
+
+    if (!connection->IsRemoteRdmaSlotAvailable()) {
+        IBNET_STATS(m_rdmaSlotsExhausted->Inc());
+
+        // refresh the remote's counter of consumed slots, the data is sent
+        // using sends meanwhile
+        if (m_rdmaReadPending[connection->GetConnectionId()] != connection->GetIncarnation()) {
+            __SendRdmaReadSlotsConsumed(connection);
+        }
+
+        return 0;
+    }
+
+    uint8_t slot = connection->NextRemoteRdmaSlot();
+    uint32_t length = totalBytesToProcess;
+
+    if (length > connection->GetRemoteRdmaRecvSlotSize()) {
+        length = connection->GetRemoteRdmaRecvSlotSize();
+    }
+
+    uint32_t posEnd;
+
+    m_sgeLists[0].addr = (uintptr_t) refSendBuffer->GetAddress() + posBack;
+    m_sgeLists[0].lkey = refSendBuffer->GetLKey();
+
+    if (posBack + length <= refSendBuffer->GetSizeBuffer()) {
+        m_sgeLists[0].length = length;
+        m_sendWrs[0].num_sge = 1;
+
+        posEnd = posBack + length;
+
+        // handle wrap around exactly on buffer size
+        if (posEnd == refSendBuffer->GetSizeBuffer()) {
+            posEnd = 0;
+        }
+    } else {
+        // wrap around with 2 SGEs
+        m_sgeLists[0].length = refSendBuffer->GetSizeBuffer() - posBack;
+
+        posEnd = length - m_sgeLists[0].length;
+
+        m_sgeLists[1].addr = (uintptr_t) refSendBuffer->GetAddress();
+        m_sgeLists[1].length = posEnd;
+        m_sgeLists[1].lkey = refSendBuffer->GetLKey();
+
+        m_sendWrs[0].num_sge = 2;
+    }
+
+    // context used on completion to identify completed work request
+    SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+    m_sendWrs[0].wr_id = (uint64_t) ctx;
+    ctx->m_targetNodeId = nodeId;
+    ctx->m_connectionId = connection->GetConnectionId();
+    ctx->m_fcData = workPackage->m_flowControlData;
+    ctx->m_sendSize = length;
+    ctx->m_posFront = posFront;
+    ctx->m_posBack = posBack;
+    ctx->m_posEnd = posEnd;
+    ctx->m_debug = 40;
+    ctx->m_userBufferLast = false;
+    ctx->m_rdmaReadIncarnation = 0;
+
+    m_sendWrs[0].sg_list = &m_sgeLists[0];
+
+    auto immedData = (ImmediateData*) &m_sendWrs[0].imm_data;
+    immedData->m_sourceNodeId = connection->GetSourceNodeId();
+    immedData->m_flowControlData = workPackage->m_flowControlData;
+    immedData->m_rdmaSlot = static_cast<uint8_t>(slot + 1);
+
+    m_sendWrs[0].opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+    m_sendWrs[0].wr.rdma.remote_addr = connection->GetRemoteRdmaRecvSlotAddress(slot);
+    m_sendWrs[0].wr.rdma.rkey = connection->GetRemoteRdmaRecvRKey();
+    m_sendWrs[0].send_flags = 0;
+    m_sendWrs[0].next = nullptr;
+
+    // prepare work package results
+    m_prevWorkPackageResults->m_nodeId = nodeId;
+    m_prevWorkPackageResults->m_fcDataNotPosted = 0;
+    m_prevWorkPackageResults->m_fcDataPosted = workPackage->m_flowControlData;
+    m_prevWorkPackageResults->m_numBytesPosted = length;
+    m_prevWorkPackageResults->m_numBytesNotPosted = totalBytesToProcess - length;
+
+    IBNET_STATS(m_postedDataChunk->Add(length));
+    IBNET_STATS(m_postedDataRemainderChunk->Add(totalBytesToProcess - length));
+    IBNET_STATS(m_sentRdmaWriteData->Add(length));
+
+    return 1;
+}
+
+void SendDispatcher::__SendRdmaReadSlotsConsumed(Connection* connection)
+{
+    SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+    m_sendWrs[0].wr_id = (uint64_t) ctx;
+    ctx->m_targetNodeId = connection->GetRemoteNodeId();
+    ctx->m_connectionId = connection->GetConnectionId();
+    ctx->m_fcData = 0;
+    ctx->m_sendSize = 0;
+    ctx->m_posFront = 0;
+    ctx->m_posBack = 0;
+    ctx->m_posEnd = 0;
+    ctx->m_debug = 41;
+    ctx->m_userBufferLast = false;
+    ctx->m_rdmaReadIncarnation = connection->GetIncarnation();
+
+    m_sgeLists[0].addr = (uintptr_t) connection->GetRdmaRemoteSlotsConsumedBuffer();
+    m_sgeLists[0].length = sizeof(uint64_t);
+    m_sgeLists[0].lkey = connection->GetRdmaRecvRegionLKey();
+
+    m_sendWrs[0].sg_list = &m_sgeLists[0];
+    m_sendWrs[0].num_sge = 1;
+    m_sendWrs[0].opcode = IBV_WR_RDMA_READ;
+    m_sendWrs[0].wr.rdma.remote_addr = connection->GetRemoteRdmaSlotsConsumedAddress();
+    m_sendWrs[0].wr.rdma.rkey = connection->GetRemoteRdmaRecvRKey();
+    m_sendWrs[0].send_flags = 0;
+    m_sendWrs[0].next = nullptr;
+
+    // single WRQ, always signaled
+    __SendDataPostWorkRequests(connection, 1);
+
+    // posted, otherwise no completion ever resets it
+    m_rdmaReadPending[connection->GetConnectionId()] = connection->GetIncarnation();
+}
+
+uint32_t SendDispatcher::__SendDataPrepareRecvRingWorkRequests(Connection* connection,
+        const SendHandler::NextWorkPackage* workPackage)
+{
+    if (connection->GetRemoteRecvRingSize() == 0) {
+        __ThrowDetailedException<sys::IllegalStateException>(
+                "Remote 0x%X does not provide a receive ring, one-sided messaging must be enabled on all nodes",
+                workPackage->m_nodeId);
+    }
+
+    const core::IbMemReg* refSendBuffer = connection->GetRefSendBuffer();
+
+    const con::NodeId nodeId = workPackage->m_nodeId;
+    const uint32_t posFront = workPackage->m_posFrontRel;
+    const uint32_t posBack = workPackage->m_posBackRel;
+    const uint8_t fcData = workPackage->m_flowControlData;
+
+    uint32_t totalBytesToProcess;
+
+    // wrap around
+    if (posBack > posFront) {
+        totalBytesToProcess = refSendBuffer->GetSizeBuffer() - posBack + posFront;
+    } else {
+        totalBytesToProcess = posFront - posBack;
+    }
+
+    uint32_t length = totalBytesToProcess;
+    uint32_t ringFree = connection->GetRemoteRecvRingFree();
+
+    if (length > ringFree) {
+        length = ringFree;
 
-    m_sendQueuePending[connection->GetRemoteNodeId()] += chunks;
-    // completion queue shared among all connections
-    m_completionsPending += chunks;
+        IBNET_STATS(m_recvRingFull->Inc());
 
-    IBNET_STATS(m_sendDataPostingTime->Stop());
+        // refresh the remote's head, the data not fitting is sent once space
+        // is available
+        if (m_rdmaReadPending[connection->GetConnectionId()] != connection->GetIncarnation() &&
+                m_sendQueuePending[connection->GetConnectionId()] < m_refConnectionManager->GetIbSQSize()) {
+            __SendRdmaReadRecvRingHead(connection);
+        }
+    }
+
+    uint32_t chunksPos = 0;
+
+    // max 3 WRQs for data (wrap around on the ORB and remote ring) + the
+    // tail update
+    if ((length > 0 || fcData > 0) && m_sendQueuePending[connection->GetConnectionId()] + 4 <= m_refConnectionManager->GetIbSQSize()) {
+        uint32_t srcPos = posBack;
+        uint64_t dstPos = connection->GetRemoteRecvRingWritten();
+        uint32_t remaining = length;
+
+        while (remaining > 0) {
+            uint32_t chunk = remaining;
+
+            if (srcPos + chunk > refSendBuffer->GetSizeBuffer()) {
+                chunk = refSendBuffer->GetSizeBuffer() - srcPos;
+            }
+
+            uint32_t dstOffset = static_cast<uint32_t>(dstPos % connection->GetRemoteRecvRingSize());
+
+            if (dstOffset + chunk > connection->GetRemoteRecvRingSize()) {
+                chunk = connection->GetRemoteRecvRingSize() - dstOffset;
+            }
+
+            // context used on completion to identify completed work request
+            SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+            m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
+            ctx->m_targetNodeId = nodeId;
+            ctx->m_connectionId = connection->GetConnectionId();
+            ctx->m_fcData = 0;
+            ctx->m_sendSize = chunk;
+            ctx->m_posFront = posFront;
+            ctx->m_posBack = srcPos;
+            ctx->m_posEnd = srcPos + chunk;
+            ctx->m_debug = 50;
+            ctx->m_userBufferLast = false;
+            ctx->m_rdmaReadIncarnation = 0;
+
+            m_sgeLists[chunksPos].addr = (uintptr_t) refSendBuffer->GetAddress() + srcPos;
+            m_sgeLists[chunksPos].length = chunk;
+            m_sgeLists[chunksPos].lkey = refSendBuffer->GetLKey();
+
+            m_sendWrs[chunksPos].sg_list = &m_sgeLists[chunksPos];
+            m_sendWrs[chunksPos].num_sge = 1;
+            m_sendWrs[chunksPos].opcode = IBV_WR_RDMA_WRITE;
+            m_sendWrs[chunksPos].wr.rdma.remote_addr = connection->GetRemoteRecvRingAddress(dstPos);
+            m_sendWrs[chunksPos].wr.rdma.rkey = connection->GetRemoteRecvRingRKey();
+            m_sendWrs[chunksPos].send_flags = chunk <= m_inlineThreshold ? IBV_SEND_INLINE : 0;
+            // list is connected further down
+            m_sendWrs[chunksPos].next = nullptr;
+
+            chunksPos++;
+
+            srcPos += chunk;
+
+            // handle wrap around exactly on buffer size
+            if (srcPos == refSendBuffer->GetSizeBuffer()) {
+                srcPos = 0;
+            }
+
+            dstPos += chunk;
+            remaining -= chunk;
+        }
+
+        connection->RemoteRecvRingWritten(length, fcData);
+
+        // the remote polls the tail. RDMA writes of a QP are executed in order,
+        // i.e. the data is written once the tail update arrives. posted inline,
+        // the value is copied on posting and the buffer can be reused right away
+        m_recvRingTailUpdate[0] = connection->GetRemoteRecvRingWritten();
+        m_recvRingTailUpdate[1] = connection->GetRemoteRecvRingFcWritten();
+
+        SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+        m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
+        ctx->m_targetNodeId = nodeId;
+        ctx->m_connectionId = connection->GetConnectionId();
+        ctx->m_fcData = fcData;
+        ctx->m_sendSize = 0;
+        ctx->m_posFront = 0;
+        ctx->m_posBack = 0;
+        ctx->m_posEnd = 0;
+        ctx->m_debug = 51;
+        ctx->m_userBufferLast = false;
+        ctx->m_rdmaReadIncarnation = 0;
+
+        m_sgeLists[chunksPos].addr = (uintptr_t) m_recvRingTailUpdate;
+        m_sgeLists[chunksPos].length = sizeof(m_recvRingTailUpdate);
+        m_sgeLists[chunksPos].lkey = 0;
+
+        m_sendWrs[chunksPos].sg_list = &m_sgeLists[chunksPos];
+        m_sendWrs[chunksPos].num_sge = 1;
+        m_sendWrs[chunksPos].opcode = IBV_WR_RDMA_WRITE;
+        m_sendWrs[chunksPos].wr.rdma.remote_addr = connection->GetRemoteRecvRingTailAddress();
+        m_sendWrs[chunksPos].wr.rdma.rkey = connection->GetRemoteRecvRingRKey();
+        m_sendWrs[chunksPos].send_flags = IBV_SEND_INLINE;
+        m_sendWrs[chunksPos].next = nullptr;
+
+        chunksPos++;
+    } else {
+        length = 0;
+    }
+
+    // prepare work package results
+    m_prevWorkPackageResults->m_nodeId = nodeId;
+    m_prevWorkPackageResults->m_fcDataNotPosted = chunksPos > 0 ? 0 : fcData;
+    m_prevWorkPackageResults->m_fcDataPosted = chunksPos > 0 ? fcData : 0;
+    m_prevWorkPackageResults->m_numBytesPosted = length;
+    m_prevWorkPackageResults->m_numBytesNotPosted = totalBytesToProcess - length;
+
+    IBNET_STATS(m_postedDataChunk->Add(length));
+    IBNET_STATS(m_postedDataRemainderChunk->Add(totalBytesToProcess - length));
+    IBNET_STATS(m_sentRecvRingData->Add(length));
+
+    return chunksPos;
+}
+
+void SendDispatcher::__SendDataRecvRingMapped(Connection* connection,
+        const SendHandler::NextWorkPackage* workPackage)
+{
+    const core::IbMemReg* refSendBuffer = connection->GetRefSendBuffer();
+
+    const con::NodeId nodeId = workPackage->m_nodeId;
+    const uint32_t posFront = workPackage->m_posFrontRel;
+    const uint32_t posBack = workPackage->m_posBackRel;
+    const uint8_t fcData = workPackage->m_flowControlData;
+
+    uint32_t totalBytesToProcess;
+
+    // wrap around
+    if (posBack > posFront) {
+        totalBytesToProcess = refSendBuffer->GetSizeBuffer() - posBack + posFront;
+    } else {
+        totalBytesToProcess = posFront - posBack;
+    }
+
+    uint32_t length = totalBytesToProcess;
+    uint32_t ringFree = connection->GetRemoteRecvRingMappedFree();
+
+    // the data not fitting is sent once the remote consumed enough
+    if (length > ringFree) {
+        length = ringFree;
+
+        IBNET_STATS(m_recvRingFull->Inc());
+    }
+
+    uint32_t srcPos = posBack;
+    uint64_t dstPos = connection->GetRemoteRecvRingWritten();
+    uint32_t remaining = length;
+
+    while (remaining > 0) {
+        uint32_t chunk = remaining;
+
+        if (srcPos + chunk > refSendBuffer->GetSizeBuffer()) {
+            chunk = refSendBuffer->GetSizeBuffer() - srcPos;
+        }
+
+        uint32_t dstOffset = static_cast<uint32_t>(dstPos % connection->GetRemoteRecvRingSize());
+
+        if (dstOffset + chunk > connection->GetRemoteRecvRingSize()) {
+            chunk = connection->GetRemoteRecvRingSize() - dstOffset;
+        }
+
+        memcpy(connection->GetRemoteRecvRingMappedAddress(dstPos),
+                (void*) ((uintptr_t) refSendBuffer->GetAddress() + srcPos), chunk);
+
+        srcPos += chunk;
+
+        // handle wrap around exactly on buffer size
+        if (srcPos == refSendBuffer->GetSizeBuffer()) {
+            srcPos = 0;
+        }
+
+        dstPos += chunk;
+        remaining -= chunk;
+    }
+
+    if (length > 0 || fcData > 0) {
+        connection->RemoteRecvRingWritten(length, fcData);
+        connection->PublishRemoteRecvRingMapped();
+
+        // copying is synchronous, the data is posted and completed at once
+        __AddCompletedWork(connection->GetConnectionId(), nodeId, length, fcData);
+    }
+
+    // prepare work package results
+    m_prevWorkPackageResults->m_nodeId = nodeId;
+    m_prevWorkPackageResults->m_fcDataNotPosted = 0;
+    m_prevWorkPackageResults->m_fcDataPosted = fcData;
+    m_prevWorkPackageResults->m_numBytesPosted = length;
+    m_prevWorkPackageResults->m_numBytesNotPosted = totalBytesToProcess - length;
+
+    IBNET_STATS(m_postedDataChunk->Add(length));
+    IBNET_STATS(m_postedDataRemainderChunk->Add(totalBytesToProcess - length));
+    IBNET_STATS(m_sentRecvRingMappedData->Add(length));
+}
+
+void SendDispatcher::__SendRdmaReadRecvRingHead(Connection* connection)
+{
+    SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+    m_sendWrs[0].wr_id = (uint64_t) ctx;
+    ctx->m_targetNodeId = connection->GetRemoteNodeId();
+    ctx->m_connectionId = connection->GetConnectionId();
+    ctx->m_fcData = 0;
+    ctx->m_sendSize = 0;
+    ctx->m_posFront = 0;
+    ctx->m_posBack = 0;
+    ctx->m_posEnd = 0;
+    ctx->m_debug = 52;
+    ctx->m_userBufferLast = false;
+    ctx->m_rdmaReadIncarnation = connection->GetIncarnation();
+
+    m_sgeLists[0].addr = (uintptr_t) connection->GetRecvRingRemoteHeadBuffer();
+    m_sgeLists[0].length = sizeof(uint64_t);
+    m_sgeLists[0].lkey = connection->GetRecvRingLKey();
+
+    m_sendWrs[0].sg_list = &m_sgeLists[0];
+    m_sendWrs[0].num_sge = 1;
+    m_sendWrs[0].opcode = IBV_WR_RDMA_READ;
+    m_sendWrs[0].wr.rdma.remote_addr = connection->GetRemoteRecvRingHeadAddress();
+    m_sendWrs[0].wr.rdma.rkey = connection->GetRemoteRecvRingRKey();
+    m_sendWrs[0].send_flags = 0;
+    m_sendWrs[0].next = nullptr;
+
+    // single WRQ, always signaled
+    __SendDataPostWorkRequests(connection, 1);
+
+    // posted, otherwise no completion ever resets it and the remote's head
+    // is never refreshed again
+    m_rdmaReadPending[connection->GetConnectionId()] = connection->GetIncarnation();
+}
+
+bool SendDispatcher::__SendUserBuffer()
+{
+    if (!m_userBufferActive) {
+        const SendHandler::UserBufferWorkPackage* workPackage =
+                m_refSendHandler->GetNextUserBufferToSend(m_shardId);
+
+        if (workPackage == nullptr) {
+            return false;
+        }
+
+        if (m_refConnectionManager->GetSendShardId(workPackage->m_nodeId) != m_shardId) {
+            __ThrowDetailedException<sys::IllegalStateException>(
+                    "User buffer for node 0x%X not assigned to send shard %d", workPackage->m_nodeId,
+                    static_cast<uint16_t>(m_shardId));
+        }
+
+        if (workPackage->m_length == 0 ||
+                workPackage->m_offset + workPackage->m_length > workPackage->m_memReg->GetSize()) {
+            __ThrowDetailedException<sys::IllegalStateException>(
+                    "Invalid user buffer range %d + %d, size %d", workPackage->m_offset,
+                    workPackage->m_length, workPackage->m_memReg->GetSize());
+        }
+
+        // copy, valid for the call only
+        m_userBuffer = *workPackage;
+        m_userBufferPosted = 0;
+        m_userBufferActive = true;
+    }
+
+    IBNET_STATS_COARSE(m_sendDataTotalTime->Start());
+    IBNET_STATS_FULL(m_getConnectionTime->Start());
+
+    auto connection = (Connection*) m_refConnectionManager->GetConnection(m_userBuffer.m_nodeId);
+
+    IBNET_STATS_FULL(m_getConnectionTime->Stop());
+
+    bool ret = false;
+
+    try {
+        IBNET_STATS_FULL(m_sendDataProcessingTime->Start());
+        uint32_t chunks = __SendUserBufferPrepareWorkRequests(connection);
+        IBNET_STATS_FULL(m_sendDataProcessingTime->Stop());
+
+        if (chunks > 0) {
+            __SendDataPostWorkRequests(connection, chunks);
+            ret = true;
+        } else if (__GetSendCredits(connection) == 0) {
+            IBNET_STATS(m_sendCreditsExhausted->Inc());
+        } else {
+            IBNET_STATS(m_sendQueueFull->Inc());
+        }
+    } catch (...) {
+        m_refConnectionManager->ReturnConnection(connection);
+        IBNET_STATS_COARSE(m_sendDataTotalTime->Stop());
+        throw;
+    }
+
+    m_refConnectionManager->ReturnConnection(connection);
+
+    IBNET_STATS_COARSE(m_sendDataTotalTime->Stop());
+
+    // all posted, get the next user buffer on the next call
+    if (m_userBufferPosted == m_userBuffer.m_length) {
+        m_userBufferActive = false;
+    }
+
+    return ret;
+}
+
+bool SendDispatcher::__SendCreditReturns()
+{
+    if (!m_creditReturnsPending.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(m_creditReturnsLock);
+
+        m_creditReturnsPending.store(false, std::memory_order_relaxed);
+        m_creditReturnsProcessing.swap(m_creditReturns);
+    }
+
+    bool activity = false;
+
+    for (size_t i = 0; i < m_creditReturnsProcessing.size(); i++) {
+        con::NodeId nodeId = m_creditReturnsProcessing[i];
+
+        // closed in the meantime, the credits are gone with the connection
+        if (!m_refConnectionManager->IsConnectionAvailable(nodeId)) {
+            continue;
+        }
+
+        auto connection = (Connection*) m_refConnectionManager->GetConnection(nodeId);
+
+        try {
+            // returned with a send to the node in the meantime
+            if (connection->GetCreditsToReturn() < m_fcCreditsReturnThreshold) {
+                m_refConnectionManager->ReturnConnection(connection);
+                continue;
+            }
+
+            // retry on the next dispatch
+            if (m_sendQueuePending[connection->GetConnectionId()] >= m_refConnectionManager->GetIbSQSize()) {
+                m_refConnectionManager->ReturnConnection(connection);
+
+                std::lock_guard<std::mutex> l(m_creditReturnsLock);
+                m_creditReturns.push_back(nodeId);
+                m_creditReturnsPending.store(true, std::memory_order_relaxed);
+
+                activity = true;
+                continue;
+            }
+
+            // context used on completion to identify completed work request
+            SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+            m_sendWrs[0].wr_id = (uint64_t) ctx;
+            ctx->m_targetNodeId = nodeId;
+            ctx->m_connectionId = connection->GetConnectionId();
+            ctx->m_fcData = 0;
+            ctx->m_sendSize = 0;
+            ctx->m_posFront = 0;
+            ctx->m_posBack = 0;
+            ctx->m_posEnd = 0;
+            ctx->m_debug = 60;
+            ctx->m_userBufferLast = false;
+            ctx->m_rdmaReadIncarnation = 0;
+
+            m_sendWrs[0].sg_list = nullptr;
+            m_sendWrs[0].num_sge = 0;
+
+            // credits are added when posting
+            auto immedData = (ImmediateData*) &m_sendWrs[0].imm_data;
+            immedData->m_sourceNodeId = connection->GetSourceNodeId();
+            immedData->m_flowControlData = 0;
+            immedData->m_credits = 0;
+
+            m_sendWrs[0].opcode = IBV_WR_SEND_WITH_IMM;
+            m_sendWrs[0].send_flags = m_inlineThreshold > 0 ? IBV_SEND_INLINE : 0;
+            m_sendWrs[0].next = nullptr;
+
+            // single WRQ, always signaled
+            __SendDataPostWorkRequests(connection, 1);
+        } catch (...) {
+            m_refConnectionManager->ReturnConnection(connection);
+
+            // keep the remaining returns for the next dispatch
+            std::lock_guard<std::mutex> l(m_creditReturnsLock);
+            m_creditReturns.insert(m_creditReturns.end(), m_creditReturnsProcessing.begin() + i + 1,
+                    m_creditReturnsProcessing.end());
+            m_creditReturnsPending.store(true, std::memory_order_relaxed);
+            m_creditReturnsProcessing.clear();
+
+            throw;
+        }
+
+        m_refConnectionManager->ReturnConnection(connection);
+
+        IBNET_STATS(m_sentCreditReturns->Inc());
+
+        activity = true;
+    }
+
+    m_creditReturnsProcessing.clear();
+
+    return activity;
+}
+
+uint32_t SendDispatcher::__SendUserBufferPrepareWorkRequests(Connection* connection)
+{
+    con::NodeId nodeId = connection->GetRemoteNodeId();
+    const uint32_t credits = __GetSendCredits(connection);
+    uint32_t chunksPos = 0;
+    uint32_t totalBytesProcessed = 0;
+
+    // each WRQ must fit into a single receive buffer on the remote
+    while (m_sendQueuePending[connection->GetConnectionId()] + chunksPos < m_refConnectionManager->GetIbSQSize() &&
+            chunksPos < credits && m_userBufferPosted < m_userBuffer.m_length) {
+        uint32_t length = m_userBuffer.m_length - m_userBufferPosted;
+
+        if (length > m_recvBufferSize) {
+            length = m_recvBufferSize;
+        }
+
+        // context used on completion to identify completed work request. no send buffer
+        // data involved, i.e. don't report any bytes to the handler on completion
+        SendWorkRequestCtx* ctx = m_workRequestCtxPool->Pop();
+        m_sendWrs[chunksPos].wr_id = (uint64_t) ctx;
+        ctx->m_targetNodeId = nodeId;
+        ctx->m_connectionId = connection->GetConnectionId();
+        ctx->m_fcData = 0;
+        ctx->m_sendSize = 0;
+        ctx->m_posFront = 0;
+        ctx->m_posBack = 0;
+        ctx->m_posEnd = 0;
+        ctx->m_debug = 30;
+        ctx->m_userBufferLast = m_userBufferPosted + length == m_userBuffer.m_length;
+        ctx->m_rdmaReadIncarnation = 0;
+
+        if (ctx->m_userBufferLast) {
+            ctx->m_userBuffer = m_userBuffer;
+        }
+
+        m_sgeLists[chunksPos].addr = (uintptr_t) m_userBuffer.m_memReg->GetAddress() + m_userBuffer.m_offset +
+                m_userBufferPosted;
+        m_sgeLists[chunksPos].length = length;
+        m_sgeLists[chunksPos].lkey = m_userBuffer.m_memReg->GetLKey();
+
+        m_sendWrs[chunksPos].sg_list = &m_sgeLists[chunksPos];
+        m_sendWrs[chunksPos].num_sge = 1;
+
+        auto immedData = (ImmediateData*) &m_sendWrs[chunksPos].imm_data;
+        immedData->m_sourceNodeId = connection->GetSourceNodeId();
+        immedData->m_flowControlData = 0;
+        immedData->m_rdmaSlot = 0;
+
+        m_sendWrs[chunksPos].opcode = IBV_WR_SEND_WITH_IMM;
+        m_sendWrs[chunksPos].send_flags = length <= m_inlineThreshold ? IBV_SEND_INLINE : 0;
+        // list is connected further down
+        m_sendWrs[chunksPos].next = nullptr;
+
+        m_userBufferPosted += length;
+        totalBytesProcessed += length;
+        chunksPos++;
+    }
+
+    IBNET_STATS(m_sentUserBufferData->Add(totalBytesProcessed));
+
+    return chunksPos;
+}
+
+void SendDispatcher::__CompleteUserBuffer(const SendHandler::UserBufferWorkPackage* workPackage, bool success)
+{
+    IBNET_STATS(m_completedUserBuffers->Inc());
+
+    m_refSendHandler->UserBufferSent(m_shardId, workPackage, success);
+}
+
+void SendDispatcher::__AddCompletedWork(con::ConnectionId connectionId, con::NodeId nodeId,
+        uint32_t numBytes, uint8_t fcData)
+{
+    uint16_t index = m_completionListIndex[connectionId];
+
+    // index is stale if the node is not in the list of the current round,
+    // yet. no need to reset the index on every round
+    if (index >= m_completionList->m_numNodes || m_completionList->m_entries[index].m_nodeId != nodeId) {
+        index = m_completionList->m_numNodes++;
+        m_completionListIndex[connectionId] = index;
+
+        m_completionList->m_entries[index].m_nodeId = nodeId;
+        m_completionList->m_entries[index].m_numBytesWritten = 0;
+        m_completionList->m_entries[index].m_fcDataWritten = 0;
+    }
+
+    m_completionList->m_entries[index].m_numBytesWritten += numBytes;
+    m_completionList->m_entries[index].m_fcDataWritten += fcData;
 }
 
 void SendDispatcher::__DebugLogWorkReqList(uint32_t numElems)
@@ -776,5 +1838,15 @@ void SendDispatcher::__DebugLogWorkReqList(uint32_t numElems)
     }
 }
 
+std::string SendDispatcher::__GetStatsCategory(uint8_t shardId, uint8_t numShards)
+{
+    // keep the plain category name if not sharded
+    if (numShards == 1) {
+        return "SendDispatcher";
+    }
+
+    return "SendDispatcher-" + std::to_string(shardId);
+}
+
 }
 }
\ No newline at end of file
@@ -19,7 +19,12 @@
 #ifndef IBNET_DX_MSGRCSENDDISPATCHER_H
 #define IBNET_DX_MSGRCSENDDISPATCHER_H
 
+#include <atomic>
+#include <mutex>
 #include <sstream>
+#include <vector>
+
+#include <unistd.h>
 
 #include "ibnet/dx/ExecutionUnit.h"
 
@@ -40,7 +45,9 @@ namespace msgrc {
 /**
  * Execution unit getting new data to be sent from a SendHandler and
  * sending it to the specified target using reliable queue pairs and
- * messaging verbs.
+ * messaging verbs. Multiple instances can be run on separate workers,
+ * each serving a send shard, i.e. a disjoint set of target nodes with
+ * a separate shared send completion queue.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 30.01.2018
  */
@@ -50,12 +57,16 @@ public:
     /**
      * Constructor
      *
+     * @param shardId Id of the send shard to serve
      * @param recvBufferSize Size of a single receive buffer (from the RecvBufferPool)
+     * @param signalInterval Signal every nth WRQ posted (the last WRQ of a batch is always signaled)
+     * @param rdmaWriteThreshold Min amount of data (in bytes) available to send to a node to send it
+     *        using a RDMA write to a slot of the remote's RDMA receive region (0 to disable)
      * @param refConnectionManager Pointer to the connection manager (memory managed by caller)
      * @param refStatisticsManager Pointer to the statistics manager (memory managed by caller)
      * @param refSendHandler Pointer to a send handler which provides data to be sent (memory managed by caller)
      */
-    SendDispatcher(uint32_t recvBufferSize,
+    SendDispatcher(uint8_t shardId, uint32_t recvBufferSize, uint16_t signalInterval, uint32_t rdmaWriteThreshold,
             ConnectionManager* refConnectionManager,
             stats::StatisticsManager* refStatisticsManager,
             SendHandler* refSendHandler);
@@ -70,8 +81,68 @@ public:
      */
     bool Dispatch() override;
 
+    /**
+     * Overriding virtual function
+     */
+    bool PrepareIdleWait(std::vector<int>& fds) override;
+
+    /**
+     * Overriding virtual function
+     */
+    void IdleWaitDone() override;
+
+    /**
+     * Wake up the dispatcher if its worker is blocked because it was idle
+     * (see ExecutionEngine). Producers of data to send (SendHandler) must call
+     * this after new data or a user buffer is available if blocking idle
+     * workers are enabled. Cheap if the worker is not blocked. Thread safe
+     */
+    void Kick()
+    {
+        // pairs with the fence after setting the flag before re-checking
+        // for data to send
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_idleWaiting.load(std::memory_order_relaxed)) {
+            uint64_t val = 1;
+
+            if (write(m_kickFd, &val, sizeof(val)) < 0) {
+                IBNET_LOG_ERROR("Kicking send dispatcher %d failed: %s", static_cast<uint16_t>(m_shardId),
+                        strerror(errno));
+            }
+        }
+    }
+
+    /**
+     * Request returning the flow control credits of a node (receive WRQs
+     * consumed by it and posted again) with an explicit message, e.g. if
+     * there is no data to send to the node to piggyback the credits on.
+     * Called by the receive dispatchers. Thread safe
+     *
+     * @param nodeId Node id of the remote to return the credits to
+     */
+    void QueueCreditReturn(con::NodeId nodeId)
+    {
+        {
+            std::lock_guard<std::mutex> l(m_creditReturnsLock);
+            m_creditReturns.push_back(nodeId);
+        }
+
+        m_creditReturnsPending.store(true, std::memory_order_release);
+
+        Kick();
+    }
+
 private:
+    const uint8_t m_shardId;
     const uint32_t m_recvBufferSize;
+    const uint32_t m_inlineThreshold;
+    const uint16_t m_signalInterval;
+    const uint32_t m_rdmaWriteThreshold;
+    const uint32_t m_recvRingSize;
+    const uint16_t m_fcCredits;
+    const uint16_t m_fcCreditsReturnThreshold;
+    const std::string m_statsCategory;
 
     ConnectionManager* m_refConnectionManager;
     stats::StatisticsManager* m_refStatisticsManager;
@@ -80,9 +151,16 @@ private:
 private:
     SendHandler::PrevWorkPackageResults* m_prevWorkPackageResults;
     SendHandler::CompletedWorkList* m_completionList;
+    // connection id -> index of the node's entry in the completion list
+    uint16_t* m_completionListIndex;
 
     uint32_t m_completionsPending;
-    uint16_t m_sendQueuePending[con::NODE_ID_MAX_NUM_NODES];
+    // indexed by connection id
+    uint16_t* m_sendQueuePending;
+    // indexed by connection id: incarnation of the connection with a read of
+    // one of the remote's consumed counters in progress, 0 if none. A read of
+    // a closed connection completing doesn't affect a new one with the same id
+    uint32_t* m_rdmaReadPending;
     bool m_firstWc;
     uint32_t m_ignoreFlushErrOnPendingCompletions;
 
@@ -92,33 +170,83 @@ private:
 
     SendWorkRequestCtxPool* m_workRequestCtxPool;
 
+    bool m_userBufferActive;
+    SendHandler::UserBufferWorkPackage m_userBuffer;
+    uint32_t m_userBufferPosted;
+
+    // source of the inline RDMA write updating a remote receive ring's tail
+    // and FC data (copied on posting)
+    uint64_t m_recvRingTailUpdate[2];
+
     sys::Timer m_sendBlockTimer;
 
+    int m_kickFd;
+    std::atomic<bool> m_idleWaiting;
+
+    std::mutex m_creditReturnsLock;
+    std::vector<con::NodeId> m_creditReturns;
+    std::vector<con::NodeId> m_creditReturnsProcessing;
+    std::atomic<bool> m_creditReturnsPending;
+
 private:
     bool __PollCompletions();
 
+    uint32_t __GetSendCredits(Connection* connection) const
+    {
+        // flow control disabled: don't limit the WRQs posted
+        if (m_fcCredits == 0) {
+            return 0xFFFFFFFF;
+        }
+
+        return connection->GetSendCredits();
+    }
+
+    bool __SendCreditReturns();
+
     bool __SendData(Connection* connection, const SendHandler::NextWorkPackage* workPackage);
 
     uint32_t __SendDataPrepareWorkRequests(Connection* connection, const SendHandler::NextWorkPackage* workPackage);
 
+    uint32_t __SendDataPrepareRdmaWorkRequest(Connection* connection,
+            const SendHandler::NextWorkPackage* workPackage);
+
+    void __SendRdmaReadSlotsConsumed(Connection* connection);
+
+    uint32_t __SendDataPrepareRecvRingWorkRequests(Connection* connection,
+            const SendHandler::NextWorkPackage* workPackage);
+
+    void __SendRdmaReadRecvRingHead(Connection* connection);
+
+    void __SendDataRecvRingMapped(Connection* connection, const SendHandler::NextWorkPackage* workPackage);
+
+    bool __SendUserBuffer();
+
+    uint32_t __SendUserBufferPrepareWorkRequests(Connection* connection);
+
+    void __CompleteUserBuffer(const SendHandler::UserBufferWorkPackage* workPackage, bool success);
+
     void __SendDataPostWorkRequests(Connection* connection, uint32_t chunks);
 
+    void __AddCompletedWork(con::ConnectionId connectionId, con::NodeId nodeId,
+            uint32_t numBytes, uint8_t fcData);
+
     void __DebugLogWorkReqList(uint32_t numElems);
 
+    static std::string __GetStatsCategory(uint8_t shardId, uint8_t numShards);
+
     template <typename ExceptionType, typename... Args>
     void __ThrowDetailedException(const std::string& reason, Args... args)
     {
         std::stringstream sendQueuePending;
 
-        for (uint16_t i = 0; i < con::NODE_ID_MAX_NUM_NODES; i++) {
+        for (uint16_t i = 0; i < m_refConnectionManager->GetMaxNumConnections(); i++) {
             if (m_sendQueuePending[i] > 0) {
-                sendQueuePending << std::hex << i << "|" << std::dec <<
-                        m_sendQueuePending[i] << " ";
+                sendQueuePending << i << "|" << m_sendQueuePending[i] << " ";
             }
         }
 
         throw ExceptionType(reason + "\n"
-                        "SendDispatcher state:\n"
+                        "SendDispatcher (shard %d) state:\n"
                         "m_prevWorkPackageResults: %s\n"
                         "m_completionList: %s\n"
                         "m_completionsPending: %s\n"
@@ -128,22 +256,23 @@ private:
                         "m_sentFC: %s\n"
                         "m_throughputSentData: %s\n"
                         "m_throughputSentFC: %s", args...,
+                static_cast<uint16_t>(m_shardId),
                 *m_prevWorkPackageResults,
                 *m_completionList,
                 m_completionsPending,
                 sendQueuePending.str(),
-                *m_totalTime,
-                *m_sentData,
-                *m_sentFC,
-                *m_throughputSentData,
-                *m_throughputSentFC);
+                m_totalTime->ToString(),
+                m_sentData->ToString(),
+                m_sentFC->ToString(),
+                m_throughputSentData->ToString(),
+                m_throughputSentFC->ToString());
     };
 
     template <typename ExceptionType, typename... Args>
     void __ThrowDetailedException(int ret, const std::string& reason,
             Args... args)
     {
-        __ThrowDetailedException<ExceptionType>(reason + "\nError (%d): %s\n%s",
+        __ThrowDetailedException<ExceptionType>(reason + "\nError (%d): %s",
                 args..., ret, strerror(ret));
     };
 
@@ -152,7 +281,7 @@ private:
     {
     public:
         Stats(SendDispatcher* refParent) :
-                Operation("SendDispatcher", "State"),
+                Operation(refParent->m_statsCategory, "State"),
                 m_refParent(refParent)
         {
         }
@@ -166,14 +295,18 @@ private:
                     << *m_refParent->m_completionList << ", m_completionsPending "
                     << m_refParent->m_completionsPending << ", m_sendQueuePending ";
 
-            for (uint16_t i = 0; i < con::NODE_ID_MAX_NUM_NODES; i++) {
+            for (uint16_t i = 0; i < m_refParent->m_refConnectionManager->GetMaxNumConnections(); i++) {
                 if (m_refParent->m_sendQueuePending[i] > 0) {
-                    os << std::hex << i << "|" << std::dec <<
-                            m_refParent->m_sendQueuePending[i] << " ";
+                    os << i << "|" << m_refParent->m_sendQueuePending[i] << " ";
                 }
             }
         }
 
+        void GetFields(std::vector<stats::Snapshot::Field>& fields) const override
+        {
+            fields.emplace_back("completionsPending", static_cast<uint64_t>(m_refParent->m_completionsPending));
+        }
+
     private:
         SendDispatcher* m_refParent;
     };
@@ -195,12 +328,23 @@ private:
     stats::TimelineFragmented* m_sendTimeline;
 
     stats::Unit* m_postedWRQs;
+    stats::Unit* m_signaledWRQs;
     stats::Unit* m_postedDataChunk;
     stats::Unit* m_postedDataRemainderChunk;
     stats::Distribution* m_sendType;
+    stats::Distribution* m_sendInline;
 
     stats::Unit* m_sentData;
     stats::Unit* m_sentFC;
+    stats::Unit* m_sentUserBufferData;
+    stats::Unit* m_sentRdmaWriteData;
+    stats::Unit* m_rdmaSlotsExhausted;
+    stats::Unit* m_sentRecvRingData;
+    stats::Unit* m_sentRecvRingMappedData;
+    stats::Unit* m_recvRingFull;
+    stats::Unit* m_completedUserBuffers;
+    stats::Unit* m_sendCreditsExhausted;
+    stats::Unit* m_sentCreditReturns;
 
     stats::Unit* m_sendBlock100ms;
     stats::Unit* m_sendBlock250ms;
@@ -23,6 +23,7 @@
 #include <cstring>
 
 #include "ibnet/con/NodeId.h"
+#include "ibnet/core/IbMemReg.h"
 
 namespace ibnet {
 namespace msgrc {
@@ -37,7 +38,8 @@ class SendHandler
 public:
     /**
      * A work request package that defines which data to be sent next.
-     * Returned using a pointer by the callback
+     * Returned using a pointer by the callback. Written by the Java side
+     * (layout see README, "Native structures (JNI)")
      */
     struct NextWorkPackage
     {
@@ -59,7 +61,8 @@ public:
      * Data about the previous work package processed: how much data was processed
      * and if the queue was full, how much data could not be sent out. If the data
      * was processed, it is not guaranteed that it was actually sent. You have to
-     * wait for a work completion to actually know it was sent (see CompletedWorkList)
+     * wait for a work completion to actually know it was sent (see CompletedWorkList).
+     * Read by the Java side (layout see README, "Native structures (JNI)")
      */
     struct PrevWorkPackageResults
     {
@@ -68,13 +71,17 @@ public:
         uint32_t m_numBytesNotPosted;
         uint8_t m_fcDataPosted;
         uint8_t m_fcDataNotPosted;
+        // send credits left after posting (native flow control, 0xFFFF if
+        // disabled). appended to keep the layout of the fields above
+        uint16_t m_sendCredits;
 
         PrevWorkPackageResults() :
                 m_nodeId(con::NODE_ID_INVALID),
                 m_numBytesPosted(0),
                 m_numBytesNotPosted(0),
                 m_fcDataPosted(0),
-                m_fcDataNotPosted(0)
+                m_fcDataNotPosted(0),
+                m_sendCredits(0xFFFF)
         {
         }
 
@@ -85,6 +92,7 @@ public:
             m_numBytesNotPosted = 0;
             m_fcDataPosted = 0;
             m_fcDataNotPosted = 0;
+            m_sendCredits = 0xFFFF;
         }
 
         friend std::ostream& operator<<(std::ostream& os,
@@ -95,37 +103,39 @@ public:
                     ", m_numBytesNotPosted " << o.m_numBytesNotPosted <<
                     ", m_fcDataPosted " << static_cast<uint16_t>(o.m_fcDataPosted)
                     << ", m_fcDataNotPosted " <<
-                    static_cast<uint16_t>(o.m_fcDataNotPosted);
+                    static_cast<uint16_t>(o.m_fcDataNotPosted) <<
+                    ", m_sendCredits " << o.m_sendCredits;
         }
     } __attribute__((packed));
 
     /**
      * List of work completions that arrived confirming that data was
-     * actually sent.
+     * actually sent. One entry per node with completed work, the list
+     * holds up to max number of connections entries. Read by the Java side
+     * (layout see README, "Native structures (JNI)")
      */
     struct CompletedWorkList
     {
-        static size_t Sizeof(uint32_t numNodes)
+        /**
+         * Completed work of a single node
+         */
+        struct Entry
         {
-            return sizeof(uint16_t) +
-                    sizeof(uint32_t) * con::NODE_ID_MAX_NUM_NODES +
-                    sizeof(uint8_t) * con::NODE_ID_MAX_NUM_NODES +
-                    numNodes * sizeof(con::NodeId);
+            con::NodeId m_nodeId;
+            uint32_t m_numBytesWritten;
+            uint8_t m_fcDataWritten;
+        } __attribute__((packed));
+
+        static size_t Sizeof(uint32_t maxNumConnections)
+        {
+            return sizeof(uint16_t) + maxNumConnections * sizeof(Entry);
         }
 
         uint16_t m_numNodes;
-        uint32_t m_numBytesWritten[con::NODE_ID_MAX_NUM_NODES];
-        uint8_t m_fcDataWritten[con::NODE_ID_MAX_NUM_NODES];
-        con::NodeId m_nodeIds[];
+        Entry m_entries[];
 
         void Reset()
         {
-            for (uint16_t i = 0; i < m_numNodes; i++) {
-                m_numBytesWritten[m_nodeIds[i]] = 0;
-                m_fcDataWritten[m_nodeIds[i]] = 0;
-                m_nodeIds[i] = con::NODE_ID_INVALID;
-            }
-
             m_numNodes = 0;
         }
 
@@ -135,19 +145,51 @@ public:
             os << "m_numNodes " << o.m_numNodes << ", m_entries";
 
             for (uint16_t i = 0; i < o.m_numNodes; i++) {
-                os << " " << std::hex << o.m_nodeIds[i] << "|" <<
-                        std::dec << o.m_numBytesWritten[o.m_nodeIds[i]] << "|" <<
-                        static_cast<uint16_t>(o.m_fcDataWritten[o.m_nodeIds[i]]);
+                os << " " << std::hex << o.m_entries[i].m_nodeId << "|" <<
+                        std::dec << o.m_entries[i].m_numBytesWritten << "|" <<
+                        static_cast<uint16_t>(o.m_entries[i].m_fcDataWritten);
             }
 
             return os;
         }
     } __attribute__((packed));
 
+    /**
+     * A user buffer to send without copying it to the send buffer of the
+     * connection first. The data is split into chunks of the size of a
+     * receive buffer, i.e. the receiver gets the data like data from the
+     * send buffer. Returned using a pointer by the callback
+     */
+    struct UserBufferWorkPackage
+    {
+        con::NodeId m_nodeId;
+        // registered memory region, e.g. from an IbMemRegCache
+        core::IbMemReg* m_memReg;
+        uint32_t m_offset;
+        uint32_t m_length;
+        // not used by the SendDispatcher, returned on completion
+        uint64_t m_userId;
+
+        friend std::ostream& operator<<(std::ostream& os,
+                const UserBufferWorkPackage& o)
+        {
+            return os << "m_nodeId " << std::hex << o.m_nodeId << ", m_memReg "
+                    << static_cast<void*>(o.m_memReg) << ", m_offset " <<
+                    std::dec << o.m_offset << ", m_length " << o.m_length <<
+                    ", m_userId " << std::hex << o.m_userId;
+        }
+    };
+
 public:
     /**
-     * Called by the SendDispatcher asking for more data to send
+     * Called by the SendDispatcher asking for more data to send. If multiple
+     * SendDispatchers are running (send shards), this is called concurrently
+     * by each dispatcher with its shard id. A shard must only be given work
+     * packages for node ids assigned to it (see
+     * ConnectionManager::GetSendShardId) and the returned work package must
+     * not be shared with other shards.
      *
+     * @param shardId Id of the send shard calling
      * @param prevResults Pointer to data with information about the previous processed
      *        data (caller is managing memory)
      * @param completionList Pointer to data which informs about completed work requests
@@ -156,10 +198,47 @@ public:
      * @return Return a pointer to a NextWorkPackage structure which includes the data
      *         to be sent. The caller is not managing memory.
      */
-    virtual const NextWorkPackage* GetNextDataToSend(
+    virtual const NextWorkPackage* GetNextDataToSend(uint8_t shardId,
             const PrevWorkPackageResults* prevResults,
             const CompletedWorkList* completionList) = 0;
 
+    /**
+     * Called by the SendDispatcher asking for a user buffer to send (zero
+     * copy). A SendDispatcher processes a single user buffer at a time and
+     * asks for the next one once all data of the current one is posted.
+     * The data is not ordered with data of the send buffer of the same
+     * target node which is posted while the user buffer is in progress.
+     * Don't return send buffer data for the target node until the user
+     * buffer is completed to keep the order (see UserBufferSent).
+     *
+     * @param shardId Id of the send shard calling (the target node must
+     *        be assigned to this shard)
+     * @return Pointer to a user buffer work package (caller is not managing
+     *         memory, copied by the caller) or null if there is no user
+     *         buffer to send. The memory region is owned by the dispatcher
+     *         until UserBufferSent is called for it
+     */
+    virtual const UserBufferWorkPackage* GetNextUserBufferToSend(uint8_t shardId)
+    {
+        return nullptr;
+    }
+
+    /**
+     * Called by the SendDispatcher once all data of a user buffer is sent
+     * (or failed to send). Ownership of the memory region returns to the
+     * caller.
+     *
+     * @param shardId Id of the send shard calling
+     * @param workPackage The user buffer work package completed (memory
+     *        managed by caller, valid for this call only)
+     * @param success True if all data was sent, false on failure (e.g.
+     *        target node disconnected)
+     */
+    virtual void UserBufferSent(uint8_t shardId,
+            const UserBufferWorkPackage* workPackage, bool success)
+    {
+    }
+
 protected:
     /**
      * Constructor
@@ -172,6 +251,12 @@ protected:
     virtual ~SendHandler() = default;
 };
 
+// layouts accessed by the Java side using raw pointers, bump IBNET_VERSION
+// and update the README on changes
+static_assert(sizeof(SendHandler::NextWorkPackage) == 11, "Layout of NextWorkPackage changed");
+static_assert(sizeof(SendHandler::PrevWorkPackageResults) == 14, "Layout of PrevWorkPackageResults changed");
+static_assert(sizeof(SendHandler::CompletedWorkList::Entry) == 7, "Layout of CompletedWorkList changed");
+
 }
 }
 
@@ -24,35 +24,54 @@
 
 #include "ibnet/con/NodeId.h"
 
+#include "Connection.h"
+#include "SendHandler.h"
+
 namespace ibnet {
 namespace msgrc {
 
 /**
- * Context object attached to a work request to deliver information when work request completed on ibv_poll_cq
+ * Context object attached to a work request to deliver information when work request completed on ibv_poll_cq.
+ * With selective signaling, the context of a signaled work request includes the data of all preceding
+ * unsignaled work requests (m_numWRQs) of the same batch
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 24.04.2018
  */
 struct SendWorkRequestCtx
 {
     con::NodeId m_targetNodeId;
+    con::ConnectionId m_connectionId;
     uint16_t m_fcData;
     uint32_t m_sendSize;
     uint32_t m_posFront;
     uint32_t m_posBack;
     uint32_t m_posEnd;
+    uint16_t m_numWRQs;
     uint8_t m_debug;
+    // last WRQ of a user buffer, completion of this WRQ completes the user buffer
+    bool m_userBufferLast;
+    SendHandler::UserBufferWorkPackage m_userBuffer;
+    // RDMA read of one of the remote's consumed counters (RDMA receive slots
+    // or receive ring): incarnation of the connection, 0 otherwise. The
+    // connection might be closed and deleted before the read completes
+    uint32_t m_rdmaReadIncarnation;
 
     /**
      * Constructor
      */
     SendWorkRequestCtx() :
             m_targetNodeId(con::NODE_ID_INVALID),
+            m_connectionId(con::CONNECTION_ID_INVALID),
             m_fcData(0xFFFF),
             m_sendSize(0xFFFFFFFF),
             m_posFront(0xFFFFFFFF),
             m_posBack(0xFFFFFFFF),
             m_posEnd(0xFFFFFFFF),
-            m_debug(0xFF)
+            m_numWRQs(0xFFFF),
+            m_debug(0xFF),
+            m_userBufferLast(false),
+            m_userBuffer(),
+            m_rdmaReadIncarnation(0)
     {
 
     }
@@ -62,23 +81,72 @@ struct SendWorkRequestCtx
      */
     ~SendWorkRequestCtx() = default;
 
+    /**
+     * Get the work request id of an unsignaled work request. Unsignaled work requests don't
+     * carry a context (merged into the next signaled one) but still generate a completion
+     * on errors. The id identifies the target of such a completion. Bit 0 is never set
+     * on a (aligned) context address
+     *
+     * @param nodeId Target node id of the work request
+     * @param connectionId Id of the connection the work request is posted to
+     * @return Work request id
+     */
+    static uint64_t GetUnsignaledWrId(con::NodeId nodeId, con::ConnectionId connectionId)
+    {
+        return (static_cast<uint64_t>(nodeId) << 32) | (static_cast<uint64_t>(connectionId) << 16) | 1;
+    }
+
+    /**
+     * Check if a work request id is an id of an unsignaled work request
+     * (see GetUnsignaledWrId) and not a context address
+     */
+    static bool IsUnsignaledWrId(uint64_t wrId)
+    {
+        return (wrId & 1) != 0;
+    }
+
+    /**
+     * Get the target node id of an unsignaled work request id
+     */
+    static con::NodeId GetUnsignaledWrIdNodeId(uint64_t wrId)
+    {
+        return static_cast<con::NodeId>(wrId >> 32);
+    }
+
+    /**
+     * Get the connection id of an unsignaled work request id
+     */
+    static con::ConnectionId GetUnsignaledWrIdConnectionId(uint64_t wrId)
+    {
+        return static_cast<con::ConnectionId>(wrId >> 16);
+    }
+
     /**
      * Enable output to an out stream
      */
     friend std::ostream& operator<<(std::ostream& os, const SendWorkRequestCtx& o)
     {
         os << "m_targetNodeId " << std::hex << o.m_targetNodeId << std::dec;
+        os << ", m_connectionId " << o.m_connectionId;
         os << ", m_fcData " << o.m_fcData;
         os << ", m_sendSize " << o.m_sendSize;
         os << ", m_posFront " << o.m_posFront;
         os << ", m_posBack " << o.m_posBack;
         os << ", m_posEnd " << o.m_posEnd;
+        os << ", m_numWRQs " << o.m_numWRQs;
         os << ", m_debug " << static_cast<uint16_t>(o.m_debug);
+        os << ", m_userBufferLast " << o.m_userBufferLast;
+
+        if (o.m_userBufferLast) {
+            os << ", m_userBuffer " << o.m_userBuffer;
+        }
 
         return os;
     }
 };
 
+static_assert(alignof(SendWorkRequestCtx) > 1, "Unsignaled work request ids require aligned contexts");
+
 }
 }
 
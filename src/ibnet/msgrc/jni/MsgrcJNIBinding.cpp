@@ -110,3 +110,11 @@ Java_de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding_returnRecvBuffer(JNIEnv* p_env,
 {
     g_system->ReturnRecvBuffer((ibnet::core::IbMemReg*) p_addr);
 }
+
+JNIEXPORT void JNICALL
+Java_de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding_kickSendDispatcher(JNIEnv* p_env,
+        jclass p_class, jshort p_targetNodeId)
+{
+    g_system->KickSendDispatcher(
+            static_cast<ibnet::con::NodeId>(p_targetNodeId));
+}
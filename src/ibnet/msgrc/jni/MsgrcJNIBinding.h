@@ -75,6 +75,14 @@ Java_de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding_getSendBufferAddress
 JNIEXPORT void JNICALL Java_de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding_returnRecvBuffer
         (JNIEnv*, jclass, jlong);
 
+/*
+ * Class:     de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding
+ * Method:    kickSendDispatcher
+ * Signature: (S)V
+ */
+JNIEXPORT void JNICALL Java_de_hhu_bsinfo_dxnet_ib_MsgrcJNIBinding_kickSendDispatcher
+        (JNIEnv*, jclass, jshort);
+
 #ifdef __cplusplus
 }
 #endif
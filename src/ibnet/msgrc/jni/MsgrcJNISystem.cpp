@@ -120,9 +120,10 @@ uint32_t MsgrcJNISystem::Received(const IncomingRingBuffer::RingBuffer* ringBuff
 }
 
 const SendHandler::NextWorkPackage* MsgrcJNISystem::GetNextDataToSend(
-        const SendHandler::PrevWorkPackageResults* prevResults,
+        uint8_t shardId, const SendHandler::PrevWorkPackageResults* prevResults,
         const SendHandler::CompletedWorkList* completionList)
 {
+    // the java side is not shard aware, always single send dispatcher
     return m_callbackHandler.GetNextDataToSend(prevResults, completionList);
 }
 
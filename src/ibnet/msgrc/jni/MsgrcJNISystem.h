@@ -110,7 +110,7 @@ public:
     /**
      * Overriding virtual function
      */
-    const SendHandler::NextWorkPackage* GetNextDataToSend(
+    const SendHandler::NextWorkPackage* GetNextDataToSend(uint8_t shardId,
             const SendHandler::PrevWorkPackageResults* prevResults,
             const SendHandler::CompletedWorkList* completionList) override;
 
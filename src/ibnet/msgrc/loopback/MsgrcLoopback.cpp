@@ -42,6 +42,8 @@ int main(int argc, char** argv)
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
 
+    loopback->PrintReceivedThroughput();
+
     loopback->Shutdown();
 
     delete loopback;
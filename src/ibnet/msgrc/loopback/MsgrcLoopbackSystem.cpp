@@ -18,6 +18,8 @@
 
 #include "MsgrcLoopbackSystem.h"
 
+#include <chrono>
+
 #include <argagg/argagg.hpp>
 
 #include "ibnet/con/InvalidNodeIdException.h"
@@ -33,11 +35,15 @@ MsgrcLoopbackSystem::MsgrcLoopbackSystem(int argc, char** argv) :
         m_sendTargetNodeIds(),
         m_availableTargetNodes(),
         m_targetNodesAvailable(0),
-        m_workPackage(),
-        m_nodeToSendToPos(0)
+        m_sendDispatchersStarted(false),
+        m_shardStates(),
+        m_receivedBytes(0),
+        m_receivedStartNs(0)
 {
     _SetConfiguration(__ProcessCmdArgs(argc, argv));
 
+    m_shardStates.resize(m_configuration->m_numSendDispatchers);
+
     for (bool& it : m_availableTargetNodes) {
         it = false;
     }
@@ -48,7 +54,12 @@ void MsgrcLoopbackSystem::NodeDiscovered(con::NodeId nodeId)
     IBNET_LOG_DEBUG("Node discovered: 0x%X", nodeId);
 
     m_availableTargetNodes[nodeId] = true;
-    m_targetNodesAvailable.fetch_add(1, std::memory_order_release);
+    m_targetNodesAvailable.fetch_add(1, std::memory_order_seq_cst);
+
+    // kicked by _PostInit otherwise
+    if (m_sendDispatchersStarted.load(std::memory_order_seq_cst)) {
+        __KickSendDispatchers();
+    }
 }
 
 void MsgrcLoopbackSystem::NodeInvalidated(con::NodeId nodeId)
@@ -69,52 +80,98 @@ void MsgrcLoopbackSystem::NodeDisconnected(con::NodeId nodeId)
     m_availableTargetNodes[nodeId] = false;
 }
 
+void MsgrcLoopbackSystem::PrintReceivedThroughput() const
+{
+    int64_t startNs = m_receivedStartNs.load(std::memory_order_relaxed);
+    uint64_t bytes = m_receivedBytes.load(std::memory_order_relaxed);
+
+    if (startNs == 0) {
+        IBNET_LOG_INFO("Received no data");
+        return;
+    }
+
+    double sec = (std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count() - startNs) / 1000.0 / 1000.0 / 1000.0;
+
+    IBNET_LOG_INFO("Received %d bytes in %f sec: %f MB/sec", bytes, sec, bytes / sec / 1024.0 / 1024.0);
+}
+
 uint32_t MsgrcLoopbackSystem::Received(const IncomingRingBuffer::RingBuffer* ringBuffer)
 {
+    uint64_t bytes = 0;
+
     // just return buffers back to pool
     for (uint32_t i = 0; i < ringBuffer->m_usedEntries; i++) {
-        m_recvBufferPool->ReturnBuffer(ringBuffer->m_entries[(ringBuffer->m_front + i) % ringBuffer->m_size].m_data);
+        const IncomingRingBuffer::RingBuffer::Entry& entry =
+                ringBuffer->m_entries[(ringBuffer->m_front + i) % ringBuffer->m_size];
+
+        bytes += entry.m_dataLength;
+
+        // FC only or RDMA receive slot (released on return)
+        if (entry.m_data != nullptr) {
+            m_recvBufferPool->ReturnBuffer(entry.m_data);
+        }
+    }
+
+    if (bytes > 0) {
+        // start measuring with the first data received (after connecting)
+        if (m_receivedStartNs.load(std::memory_order_relaxed) == 0) {
+            int64_t expected = 0;
+            m_receivedStartNs.compare_exchange_strong(expected,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count(),
+                    std::memory_order_relaxed);
+        }
+
+        m_receivedBytes.fetch_add(bytes, std::memory_order_relaxed);
     }
 
     return ringBuffer->m_usedEntries;
 }
 
-const SendHandler::NextWorkPackage* MsgrcLoopbackSystem::GetNextDataToSend(
+const SendHandler::NextWorkPackage* MsgrcLoopbackSystem::GetNextDataToSend(uint8_t shardId,
         const PrevWorkPackageResults* prevResults,
         const SendHandler::CompletedWorkList* completionList)
 {
+    ShardState& state = m_shardStates[shardId];
+
+    // default: nothing to send
+    state.m_workPackage.m_posBackRel = 0;
+    state.m_workPackage.m_posFrontRel = 0;
+    state.m_workPackage.m_flowControlData = 0;
+    state.m_workPackage.m_nodeId = con::NODE_ID_INVALID;
+
     // wait for all send target nodes to be available
     if (m_sendTargetNodeIds.size() > 0 &&
             m_targetNodesAvailable.load(std::memory_order_acquire) >=
                     m_sendTargetNodeIds.size()) {
 
-        if (m_availableTargetNodes[m_sendTargetNodeIds[m_nodeToSendToPos]]) {
-            // always send full send buffer
-            m_workPackage.m_posBackRel = 0;
-            m_workPackage.m_posFrontRel = m_configuration->m_sendBufferSize;
-            m_workPackage.m_flowControlData = 0;
-            m_workPackage.m_nodeId = m_sendTargetNodeIds[m_nodeToSendToPos];
-        } else {
-            // node not discovered, don't send anything
-            m_workPackage.m_posBackRel = 0;
-            m_workPackage.m_posFrontRel = 0;
-            m_workPackage.m_flowControlData = 0;
-            m_workPackage.m_nodeId = con::NODE_ID_INVALID;
-        }
+        // round robin over the target nodes assigned to the calling shard
+        for (size_t i = 0; i < m_sendTargetNodeIds.size(); i++) {
+            con::NodeId nodeId = m_sendTargetNodeIds[state.m_nodeToSendToPos];
 
-        m_nodeToSendToPos++;
+            state.m_nodeToSendToPos++;
 
-        if (m_nodeToSendToPos >= m_sendTargetNodeIds.size()) {
-            m_nodeToSendToPos = 0;
+            if (state.m_nodeToSendToPos >= m_sendTargetNodeIds.size()) {
+                state.m_nodeToSendToPos = 0;
+            }
+
+            if (m_connectionManager->GetSendShardId(nodeId) != shardId) {
+                continue;
+            }
+
+            // don't send anything if node not discovered
+            if (m_availableTargetNodes[nodeId]) {
+                // always send full send buffer
+                state.m_workPackage.m_posFrontRel = m_configuration->m_sendBufferSize;
+                state.m_workPackage.m_nodeId = nodeId;
+            }
+
+            break;
         }
-    } else {
-        m_workPackage.m_posBackRel = 0;
-        m_workPackage.m_posFrontRel = 0;
-        m_workPackage.m_flowControlData = 0;
-        m_workPackage.m_nodeId = con::NODE_ID_INVALID;
     }
 
-    return &m_workPackage;
+    return &state.m_workPackage;
 }
 
 void MsgrcLoopbackSystem::_PostInit()
@@ -126,6 +183,17 @@ void MsgrcLoopbackSystem::_PostInit()
     }
 
     IBNET_LOG_INFO("Send target node ids: %s", str);
+
+    // nodes discovered before the dispatchers were started
+    m_sendDispatchersStarted.store(true, std::memory_order_seq_cst);
+    __KickSendDispatchers();
+}
+
+void MsgrcLoopbackSystem::__KickSendDispatchers()
+{
+    for (auto& it : m_sendTargetNodeIds) {
+        KickSendDispatcher(it);
+    }
 }
 
 MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
@@ -179,6 +247,40 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                             "(for debugging). 0 to disable.",
                     1
             },
+            {
+                    "statisticsExportIntervalMs",
+                    {"-E", "--statisticsExportIntervalMs"},
+                    "export snapshots of the statistics every X ms to the JSON and/or CSV "
+                            "file",
+                    1
+            },
+            {
+                    "statisticsJsonFile",
+                    {"-J", "--statisticsJsonFile"},
+                    "append snapshots of the statistics as JSON lines to this file",
+                    1
+            },
+            {
+                    "statisticsCsvFile",
+                    {"-C", "--statisticsCsvFile"},
+                    "append snapshots of the statistics as CSV time series to this "
+                            "file",
+                    1
+            },
+            {
+                    "statisticsRollingWindows",
+                    {"-L", "--statisticsRollingWindows"},
+                    "sample the statistics every second to provide deltas and rates "
+                            "of the last 1, 10 and 60 seconds",
+                    0
+            },
+            {
+                    "statisticsPrometheusPort",
+                    {"-M", "--statisticsPrometheusPort"},
+                    "serve the statistics in the Prometheus text format on "
+                            "127.0.0.1:X. 0 to disable.",
+                    1
+            },
             {
                     "portDiscMan",
                     {"-p", "--portDiscMan"},
@@ -186,6 +288,13 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                             "identical with other instances)",
                     1
             },
+            {
+                    "bindAddrDiscMan",
+                    {"-A", "--bindAddrDiscMan"},
+                    "bind the UDP socket of the DiscoveryManager to this local address "
+                            "(e.g. 127.0.0.2 to run multiple instances on a single host)",
+                    1
+            },
             {
                     "connectionCreationTimeoutMs",
                     {"-t", "--connectionCreationTimeoutMs"},
@@ -199,6 +308,13 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                     "Max number of simultaneous opened connections allowed",
                     1
             },
+            {
+                    "numConnectionSetupWorkers",
+                    {"-W", "--numConnectionSetupWorkers"},
+                    "Number of threads creating and connecting connections. "
+                            "Nodes are sharded among them by node id",
+                    1
+            },
             {
                     "sqSize",
                     {"-s", "--sqSize"},
@@ -248,6 +364,109 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                     "Max number of SGEs to use for WRQs (for receiving)",
                     1
             },
+            {
+                    "numSendDispatchers",
+                    {"-k", "--numSendDispatchers"},
+                    "Number of send dispatchers (threads). Target nodes are "
+                            "sharded among them by node id",
+                    1
+            },
+            {
+                    "numRecvDispatchers",
+                    {"-l", "--numRecvDispatchers"},
+                    "Number of recv dispatchers (threads). Source nodes are "
+                            "sharded among them by node id",
+                    1
+            },
+            {
+                    "inlineThreshold",
+                    {"-o", "--inlineThreshold"},
+                    "Max size of data (in bytes) of a send WRQ to be posted "
+                            "inline. 0 to disable.",
+                    1
+            },
+            {
+                    "sendSignalInterval",
+                    {"-q", "--sendSignalInterval"},
+                    "Signal every nth send WRQ (the last WRQ of a batch is "
+                            "always signaled). 1 to signal all WRQs.",
+                    1
+            },
+            {
+                    "rdmaWriteThreshold",
+                    {"-y", "--rdmaWriteThreshold"},
+                    "Min amount of data (in bytes) to send to a node with a single "
+                            "RDMA write to the remote's RDMA receive region. 0 to "
+                            "disable.",
+                    1
+            },
+            {
+                    "rdmaRecvSlots",
+                    {"-z", "--rdmaRecvSlots"},
+                    "Number of slots of the RDMA receive region per connection for "
+                            "incoming RDMA writes. 0 to not accept RDMA writes.",
+                    1
+            },
+            {
+                    "rdmaRecvSlotSize",
+                    {"-x", "--rdmaRecvSlotSize"},
+                    "Size of a single slot of the RDMA receive region (in bytes)",
+                    1
+            },
+            {
+                    "recvRingSize",
+                    {"-v", "--recvRingSize"},
+                    "Size of the receive ring per connection (in bytes) for "
+                            "one-sided messaging using RDMA writes. 0 to use "
+                            "sends. Must be enabled on all nodes.",
+                    1
+            },
+            {
+                    "intraHostRingSize",
+                    {"-R", "--intraHostRingSize"},
+                    "Size of the receive ring per connection (in bytes) in "
+                            "shared memory for nodes running on the same "
+                            "host. 0 to disable.",
+                    1
+            },
+            {
+                    "qpPoolSize",
+                    {"-P", "--qpPoolSize"},
+                    "Number of connections (QPs and buffers) created in "
+                            "advance per pair of send and receive "
+                            "dispatcher. 0 to disable.",
+                    1
+            },
+            {
+                    "fcCredits",
+                    {"-F", "--fcCredits"},
+                    "Number of flow control credits (receive WRQs of the "
+                            "remote's SRQ) per connection. 0 to disable. "
+                            "Must be the same on all nodes.",
+                    1
+            },
+            {
+                    "idleBlockSpinTimeUs",
+                    {"-I", "--idleBlockSpinTimeUs"},
+                    "Time (in us) a worker spins idle before blocking on "
+                            "completion events. 0 to never block.",
+                    1
+            },
+            {
+                    "hugePageSize",
+                    {"-H", "--hugePageSize"},
+                    "Size (in MB) of the huge pages to back the receive buffer "
+                            "pool and connection buffers with (2 or 1024). 0 "
+                            "to use default pages.",
+                    1
+            },
+            {
+                    "numaLocalMemory",
+                    {"-N", "--numaLocalMemory"},
+                    "Bind the receive buffer pool and connection buffers to "
+                            "the NUMA node of the InfiniBand device.",
+                    1
+            },
     }};
 
     argagg::parser_results args = argparser.parse(argc, argv);
@@ -313,11 +532,40 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                         config->m_statisticsThreadPrintIntervalMs);
     }
 
+    if (args["statisticsExportIntervalMs"]) {
+        config->m_statisticsExportIntervalMs =
+                args["statisticsExportIntervalMs"].as<uint32_t>(
+                        config->m_statisticsExportIntervalMs);
+    }
+
+    if (args["statisticsJsonFile"]) {
+        config->m_statisticsJsonFile = args["statisticsJsonFile"].as<std::string>();
+    }
+
+    if (args["statisticsCsvFile"]) {
+        config->m_statisticsCsvFile = args["statisticsCsvFile"].as<std::string>();
+    }
+
+    if (args["statisticsRollingWindows"]) {
+        config->m_statisticsRollingWindows =
+                args["statisticsRollingWindows"].as<bool>(config->m_statisticsRollingWindows);
+    }
+
+    if (args["statisticsPrometheusPort"]) {
+        config->m_statisticsPrometheusPort =
+                args["statisticsPrometheusPort"].as<uint16_t>(
+                        config->m_statisticsPrometheusPort);
+    }
+
     if (args["portDiscMan"]) {
         config->m_portDiscMan =
                 args["portDiscMan"].as<uint16_t>(config->m_portDiscMan);
     }
 
+    if (args["bindAddrDiscMan"]) {
+        config->m_bindAddrDiscMan = args["bindAddrDiscMan"].as<std::string>();
+    }
+
     if (args["connectionCreationTimeoutMs"]) {
         config->m_connectionCreationTimeoutMs =
                 args["connectionCreationTimeoutMs"].as<uint32_t>(
@@ -329,6 +577,12 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
                 args["maxNumConnections"].as<uint16_t>(config->m_maxNumConnections);
     }
 
+    if (args["numConnectionSetupWorkers"]) {
+        config->m_numConnectionSetupWorkers = static_cast<uint8_t>(
+                args["numConnectionSetupWorkers"].as<uint16_t>(
+                        config->m_numConnectionSetupWorkers));
+    }
+
     if (args["sqSize"]) {
         config->m_SQSize =
                 args["sqSize"].as<uint16_t>(config->m_SQSize);
@@ -369,6 +623,83 @@ MsgrcSystem::Configuration* MsgrcLoopbackSystem::__ProcessCmdArgs(
         config->m_maxSGEs = args["maxSge"].as<uint16_t>(config->m_maxSGEs);
     }
 
+    if (args["numSendDispatchers"]) {
+        config->m_numSendDispatchers = static_cast<uint8_t>(
+                args["numSendDispatchers"].as<uint16_t>(
+                        config->m_numSendDispatchers));
+    }
+
+    if (args["numRecvDispatchers"]) {
+        config->m_numRecvDispatchers = static_cast<uint8_t>(
+                args["numRecvDispatchers"].as<uint16_t>(
+                        config->m_numRecvDispatchers));
+    }
+
+    if (args["inlineThreshold"]) {
+        config->m_inlineThreshold =
+                args["inlineThreshold"].as<uint32_t>(config->m_inlineThreshold);
+    }
+
+    if (args["sendSignalInterval"]) {
+        config->m_sendSignalInterval =
+                args["sendSignalInterval"].as<uint16_t>(
+                        config->m_sendSignalInterval);
+    }
+
+    if (args["rdmaWriteThreshold"]) {
+        config->m_rdmaWriteThreshold =
+                args["rdmaWriteThreshold"].as<uint32_t>(
+                        config->m_rdmaWriteThreshold);
+    }
+
+    if (args["rdmaRecvSlots"]) {
+        config->m_rdmaRecvSlots = static_cast<uint8_t>(
+                args["rdmaRecvSlots"].as<uint16_t>(config->m_rdmaRecvSlots));
+    }
+
+    if (args["rdmaRecvSlotSize"]) {
+        config->m_rdmaRecvSlotSize =
+                args["rdmaRecvSlotSize"].as<uint32_t>(
+                        config->m_rdmaRecvSlotSize);
+    }
+
+    if (args["recvRingSize"]) {
+        config->m_recvRingSize =
+                args["recvRingSize"].as<uint32_t>(config->m_recvRingSize);
+    }
+
+    if (args["intraHostRingSize"]) {
+        config->m_intraHostRingSize =
+                args["intraHostRingSize"].as<uint32_t>(
+                        config->m_intraHostRingSize);
+    }
+
+    if (args["qpPoolSize"]) {
+        config->m_qpPoolSize =
+                args["qpPoolSize"].as<uint16_t>(config->m_qpPoolSize);
+    }
+
+    if (args["fcCredits"]) {
+        config->m_fcCredits =
+                args["fcCredits"].as<uint16_t>(config->m_fcCredits);
+    }
+
+    if (args["idleBlockSpinTimeUs"]) {
+        config->m_idleBlockSpinTimeUs =
+                args["idleBlockSpinTimeUs"].as<uint32_t>(
+                        config->m_idleBlockSpinTimeUs);
+    }
+
+    if (args["hugePageSize"]) {
+        config->m_hugePageSizeMb =
+                args["hugePageSize"].as<uint32_t>(config->m_hugePageSizeMb);
+    }
+
+    if (args["numaLocalMemory"]) {
+        config->m_numaLocalMemory =
+                args["numaLocalMemory"].as<bool>(config->m_numaLocalMemory);
+    }
+
     if (config->m_ownNodeId == con::NODE_ID_INVALID) {
         throw con::InvalidNodeIdException(config->m_ownNodeId,
                 "Provide a valid one via cmd args");
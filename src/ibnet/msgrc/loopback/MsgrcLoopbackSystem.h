@@ -19,6 +19,8 @@
 #ifndef IBNET_MSGRC_MSGRCLOOPBACKSYSTEM_H
 #define IBNET_MSGRC_MSGRCLOOPBACKSYSTEM_H
 
+#include <atomic>
+
 #include "ibnet/msgrc/MsgrcSystem.h"
 
 namespace ibnet {
@@ -47,6 +49,14 @@ public:
      */
     ~MsgrcLoopbackSystem() override = default;
 
+    /**
+     * Print the amount of data received and the throughput since the
+     * first data was received. Counted independently of the statistics,
+     * i.e. available with statistics disabled (IBNET_STATS_LEVEL 0) as
+     * well to compare builds
+     */
+    void PrintReceivedThroughput() const;
+
     /**
      * Overriding virtual function
      */
@@ -75,23 +85,46 @@ public:
     /**
      * Overriding virtual function
      */
-    const SendHandler::NextWorkPackage* GetNextDataToSend(
+    const SendHandler::NextWorkPackage* GetNextDataToSend(uint8_t shardId,
             const PrevWorkPackageResults* prevResults,
             const SendHandler::CompletedWorkList* completionList) override;
 
 protected:
     void _PostInit() override;
 
+private:
+    /**
+     * State of a single send shard. Aligned to avoid false sharing with
+     * other shards (separate send threads)
+     */
+    struct ShardState
+    {
+        SendHandler::NextWorkPackage m_workPackage;
+        size_t m_nodeToSendToPos;
+    } __attribute__((aligned(64)));
+
 private:
     Configuration* __ProcessCmdArgs(int argc, char** argv);
 
+    /**
+     * Wake up the send dispatchers of all target nodes (blocked if idle
+     * blocking is enabled). Data to send is available once all target nodes
+     * are discovered (see GetNextDataToSend)
+     */
+    void __KickSendDispatchers();
+
 private:
     std::vector<con::NodeId> m_sendTargetNodeIds;
     bool m_availableTargetNodes[con::NODE_ID_MAX_NUM_NODES];
     std::atomic<con::NodeId> m_targetNodesAvailable;
+    // nodes might be discovered before the send dispatchers are created
+    std::atomic<bool> m_sendDispatchersStarted;
+
+    std::vector<ShardState> m_shardStates;
 
-    SendHandler::NextWorkPackage m_workPackage;
-    con::NodeId m_nodeToSendToPos;
+    // updated by the recv dispatchers, once per received batch
+    std::atomic<uint64_t> m_receivedBytes;
+    std::atomic<int64_t> m_receivedStartNs;
 };
 
 }
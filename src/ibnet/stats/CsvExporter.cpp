@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "CsvExporter.h"
+
+#include <cstring>
+
+#include "ibnet/sys/SystemException.h"
+
+namespace ibnet {
+namespace stats {
+
+CsvExporter::CsvExporter(const std::string& path) :
+        m_file(path, std::ios::out | std::ios::app)
+{
+    if (!m_file.is_open()) {
+        throw sys::SystemException("Opening file %s for exporting statistics failed: %s", path,
+                strerror(errno));
+    }
+
+    m_file.seekp(0, std::ios::end);
+
+    if (m_file.tellp() == 0) {
+        m_file << "timestamp_ms,category,name,window,field,value" << std::endl;
+    }
+}
+
+void CsvExporter::Export(const Snapshot& snapshot)
+{
+    std::streamsize precision = m_file.precision(9);
+
+    for (auto& entry : snapshot.m_entries) {
+        __WriteRows(snapshot.m_timestampMs, entry, "", entry.m_fields);
+
+        for (auto& window : entry.m_windows) {
+            __WriteRows(snapshot.m_timestampMs, entry, window.m_name, window.m_fields);
+        }
+    }
+
+    m_file.precision(precision);
+
+    // flush every snapshot to allow tailing the file
+    m_file.flush();
+}
+
+void CsvExporter::__WriteRows(uint64_t timestampMs, const Snapshot::Entry& entry, const std::string& window,
+        const std::vector<Snapshot::Field>& fields)
+{
+    for (auto& field : fields) {
+        m_file << timestampMs << ',';
+        __WriteString(m_file, entry.m_category);
+        m_file << ',';
+        __WriteString(m_file, entry.m_name);
+        m_file << ',' << window << ',';
+        __WriteString(m_file, field.m_name);
+        m_file << ',';
+
+        if (field.m_type == Snapshot::Field::e_TypeUInt64) {
+            m_file << field.m_uint64;
+        } else {
+            m_file << field.m_double;
+        }
+
+        m_file << '\n';
+    }
+}
+
+void CsvExporter::__WriteString(std::ostream& os, const std::string& str)
+{
+    if (str.find_first_of(",\"\n") == std::string::npos) {
+        os << str;
+        return;
+    }
+
+    os << '"';
+
+    for (char c : str) {
+        if (c == '"') {
+            os << '"';
+        }
+
+        os << c;
+    }
+
+    os << '"';
+}
+
+}
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_CSVEXPORTER_H
+#define IBNET_STATS_CSVEXPORTER_H
+
+#include <fstream>
+
+#include "Exporter.hpp"
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Exporter appending each snapshot to a CSV time series with one row per
+ * field: timestamp_ms,category,name,window,field,value. The window is empty
+ * for the cumulative values. The long format keeps the columns stable when
+ * operations are (de-)registered at runtime
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class CsvExporter : public Exporter
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param path Path to the file to append the snapshots to. The header
+     *        is written if the file is empty
+     */
+    explicit CsvExporter(const std::string& path);
+
+    /**
+     * Destructor
+     */
+    ~CsvExporter() override = default;
+
+    /**
+     * Overriding virtual method
+     */
+    void Export(const Snapshot& snapshot) override;
+
+private:
+    std::ofstream m_file;
+
+private:
+    void __WriteRows(uint64_t timestampMs, const Snapshot::Entry& entry, const std::string& window,
+            const std::vector<Snapshot::Field>& fields);
+
+    static void __WriteString(std::ostream& os, const std::string& str);
+};
+
+}
+}
+
+#endif //IBNET_STATS_CSVEXPORTER_H
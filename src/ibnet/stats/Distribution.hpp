@@ -47,14 +47,19 @@ public:
             Operation(category, name)
     {
         for (uint32_t i = 0; i < numUnits; i++) {
-            m_units.push_back(Unit(category, name + "-DistUnit" + std::to_string(i)));
+            m_units.push_back(new Unit(category, name + "-DistUnit" + std::to_string(i)));
         }
     }
 
     /**
      * Destructor
      */
-    ~Distribution() override = default;
+    ~Distribution() override
+    {
+        for (auto& it : m_units) {
+            delete it;
+        }
+    }
 
     /**
      * Get a unit from the distribution
@@ -64,7 +69,7 @@ public:
      */
     Unit& GetUnit(size_t idx)
     {
-        return m_units[idx];
+        return *m_units[idx];
     }
 
     Unit& GetUnit(float dist)
@@ -75,7 +80,7 @@ public:
             idx = m_units.size() - 1;
         }
 
-        return m_units[idx];
+        return *m_units[idx];
     }
 
     /**
@@ -87,8 +92,8 @@ public:
         uint64_t total = 0;
 
         for (auto& it : m_units) {
-            counter += it.GetCounter();
-            total += it.GetTotalValue();
+            counter += it->GetCounter();
+            total += it->GetTotalValue();
         }
 
         if (counter == 0) {
@@ -100,17 +105,17 @@ public:
         }
 
         for (uint32_t i = 0; i < m_units.size(); i++) {
-            os << indent << '(' << i << ") " << m_units[i].GetName();
+            os << indent << '(' << i << ") " << m_units[i]->GetName();
 
             std::ios::fmtflags f(os.flags());
 
             os << ": dist " << std::setprecision(3) << std::fixed;
-            os << ((double) m_units[i].GetCounter() / counter * 100.0) << "% ";
-            os << ((double) m_units[i].GetTotalValue() / total * 100.0) << "%;";
+            os << ((double) m_units[i]->GetCounter() / counter * 100.0) << "% ";
+            os << ((double) m_units[i]->GetTotalValue() / total * 100.0) << "%;";
 
             os.flags(f);
 
-            m_units[i].WriteOstream(os, "");
+            m_units[i]->WriteOstream(os, "");
 
             if (i + 1 < m_units.size()) {
                 os << std::endl;
@@ -118,8 +123,28 @@ public:
         }
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        for (uint32_t i = 0; i < m_units.size(); i++) {
+            fields.emplace_back(std::to_string(i) + "_counter", m_units[i]->GetCounter());
+            fields.emplace_back(std::to_string(i) + "_total", m_units[i]->GetTotalValue());
+        }
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        _GetDeltaFields(prev, cur, fields);
+    }
+
 private:
-    std::vector<stats::Unit> m_units;
+    std::vector<stats::Unit*> m_units;
 };
 
 }
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_EXPORTER_HPP
+#define IBNET_STATS_EXPORTER_HPP
+
+#include "Snapshot.hpp"
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Interface for exporters writing snapshots of the statistics in a machine
+ * readable format. Called periodically by the StatisticsManager
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class Exporter
+{
+public:
+    /**
+     * Constructor
+     */
+    Exporter() = default;
+
+    /**
+     * Destructor
+     */
+    virtual ~Exporter() = default;
+
+    /**
+     * Export a snapshot
+     *
+     * @param snapshot Snapshot of all registered operations
+     */
+    virtual void Export(const Snapshot& snapshot) = 0;
+};
+
+}
+}
+
+#endif //IBNET_STATS_EXPORTER_HPP
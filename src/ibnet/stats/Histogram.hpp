@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_HISTOGRAM_HPP
+#define IBNET_STATS_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Log-linear bucketed histogram (HdrHistogram-like) for recording
+ * latencies with a fixed amount of memory and O(1) recording. Values
+ * below 2^SUB_BUCKET_BITS are recorded exactly. Above, each power of two
+ * range is split into 2^SUB_BUCKET_BITS linear sub-buckets, i.e. the
+ * relative error of a value reported is below 1 / 2^SUB_BUCKET_BITS
+ * (~3%) over the full 64 bit range. Histograms can be merged, e.g.
+ * snapshots of multiple instances or intervals.
+ *
+ * A single thread records (plain loads and stores of relaxed atomics)
+ * unless recording shared, snapshots can be taken concurrently by copying
+ * (see Time::GetHistogram)
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class Histogram
+{
+public:
+    static const uint32_t SUB_BUCKET_BITS = 5;
+    static const uint32_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    // one group of sub-buckets for the exact values plus one per power of
+    // two above
+    static const uint32_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+public:
+    /**
+     * Constructor
+     */
+    Histogram() :
+            m_count(0),
+            m_max(0),
+            m_buckets()
+    {
+        Reset();
+    }
+
+    /**
+     * Copy constructor (snapshot)
+     */
+    Histogram(const Histogram& other) :
+            m_count(0),
+            m_max(0),
+            m_buckets()
+    {
+        *this = other;
+    }
+
+    /**
+     * Destructor
+     */
+    ~Histogram() = default;
+
+    /**
+     * Assignment operator (snapshot)
+     */
+    Histogram& operator=(const Histogram& other)
+    {
+        if (this != &other) {
+            Reset();
+            Merge(other);
+        }
+
+        return *this;
+    }
+
+    /**
+     * Record a single value
+     *
+     * @param value Value to record
+     * @param shared True if other threads record to the histogram as well
+     *        (atomic RMW), false if the calling thread is the only one
+     */
+    inline void Record(uint64_t value, bool shared = false)
+    {
+        std::atomic<uint64_t>& bucket = m_buckets[__GetBucketIndex(value)];
+
+        if (shared) {
+            bucket.fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+
+            while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+        } else {
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (value > m_max.load(std::memory_order_relaxed)) {
+                m_max.store(value, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Merge the values recorded by another histogram into this one (not
+     * thread safe for this instance)
+     *
+     * @param other Histogram to merge
+     */
+    void Merge(const Histogram& other)
+    {
+        for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+            m_buckets[i].store(m_buckets[i].load(std::memory_order_relaxed) +
+                    other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        m_count.store(m_count.load(std::memory_order_relaxed) + other.m_count.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+
+        if (other.m_max.load(std::memory_order_relaxed) > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(other.m_max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Clear all recorded values (not thread safe)
+     */
+    void Reset()
+    {
+        for (auto& it : m_buckets) {
+            it.store(0, std::memory_order_relaxed);
+        }
+
+        m_count.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the number of values recorded
+     */
+    uint64_t GetCount() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the max value recorded (exact)
+     */
+    uint64_t GetMax() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the value at a percentile, i.e. the highest value of the bucket
+     * the percentile falls into (capped by the max value recorded)
+     *
+     * @param percentile Percentile to get the value of (0.0 - 100.0)
+     * @return Value at the percentile, 0 if no values were recorded
+     */
+    uint64_t GetValueAtPercentile(double percentile) const
+    {
+        uint64_t count = GetCount();
+        uint64_t max = GetMax();
+
+        if (count == 0) {
+            return 0;
+        }
+
+        if (percentile > 100.0) {
+            percentile = 100.0;
+        }
+
+        // rank of the value, at least the first one
+        auto rank = static_cast<uint64_t>(percentile / 100.0 * count + 0.5);
+
+        if (rank == 0) {
+            rank = 1;
+        }
+
+        uint64_t total = 0;
+
+        for (uint32_t i = 0; i < BUCKET_COUNT; i++) {
+            total += m_buckets[i].load(std::memory_order_relaxed);
+
+            if (total >= rank) {
+                uint64_t value = __GetBucketHighestValue(i);
+                return value < max ? value : max;
+            }
+        }
+
+        return max;
+    }
+
+private:
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_max;
+    std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+
+private:
+    static inline uint32_t __GetBucketIndex(uint64_t value)
+    {
+        if (value < SUB_BUCKET_COUNT) {
+            return static_cast<uint32_t>(value);
+        }
+
+        // position of the highest bit set, >= SUB_BUCKET_BITS
+        auto exp = static_cast<uint32_t>(63 - __builtin_clzll(value));
+        uint32_t shift = exp - SUB_BUCKET_BITS;
+
+        // the top SUB_BUCKET_BITS + 1 bits select the sub-bucket
+        return (shift + 1) * SUB_BUCKET_COUNT + static_cast<uint32_t>(value >> shift) - SUB_BUCKET_COUNT;
+    }
+
+    static inline uint64_t __GetBucketHighestValue(uint32_t index)
+    {
+        if (index < SUB_BUCKET_COUNT) {
+            return index;
+        }
+
+        uint32_t shift = index / SUB_BUCKET_COUNT - 1;
+        uint64_t subBucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+
+        return ((subBucket + 1) << shift) - 1;
+    }
+};
+
+}
+}
+
+#endif //IBNET_STATS_HISTOGRAM_HPP
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "JsonExporter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "ibnet/sys/SystemException.h"
+
+namespace ibnet {
+namespace stats {
+
+JsonExporter::JsonExporter(const std::string& path) :
+        m_file(path, std::ios::out | std::ios::app)
+{
+    if (!m_file.is_open()) {
+        throw sys::SystemException("Opening file %s for exporting statistics failed: %s", path,
+                strerror(errno));
+    }
+}
+
+void JsonExporter::Export(const Snapshot& snapshot)
+{
+    m_file << "{\"timestamp_ms\":" << snapshot.m_timestampMs << ",\"operations\":[";
+
+    for (size_t i = 0; i < snapshot.m_entries.size(); i++) {
+        const Snapshot::Entry& entry = snapshot.m_entries[i];
+
+        if (i > 0) {
+            m_file << ',';
+        }
+
+        m_file << "{\"category\":";
+        __WriteString(m_file, entry.m_category);
+        m_file << ",\"name\":";
+        __WriteString(m_file, entry.m_name);
+        m_file << ",\"fields\":";
+        __WriteFields(m_file, entry.m_fields);
+
+        if (!entry.m_windows.empty()) {
+            m_file << ",\"windows\":{";
+
+            for (size_t j = 0; j < entry.m_windows.size(); j++) {
+                if (j > 0) {
+                    m_file << ',';
+                }
+
+                __WriteString(m_file, entry.m_windows[j].m_name);
+                m_file << ':';
+                __WriteFields(m_file, entry.m_windows[j].m_fields);
+            }
+
+            m_file << '}';
+        }
+
+        m_file << '}';
+    }
+
+    // flush every snapshot to allow tailing the file
+    m_file << "]}" << std::endl;
+}
+
+void JsonExporter::__WriteString(std::ostream& os, const std::string& str)
+{
+    os << '"';
+
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[7];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            os << buf;
+        } else {
+            os << c;
+        }
+    }
+
+    os << '"';
+}
+
+void JsonExporter::__WriteFields(std::ostream& os, const std::vector<Snapshot::Field>& fields)
+{
+    os << '{';
+
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) {
+            os << ',';
+        }
+
+        __WriteString(os, fields[i].m_name);
+        os << ':';
+        __WriteField(os, fields[i]);
+    }
+
+    os << '}';
+}
+
+void JsonExporter::__WriteField(std::ostream& os, const Snapshot::Field& field)
+{
+    if (field.m_type == Snapshot::Field::e_TypeUInt64) {
+        os << field.m_uint64;
+    } else if (!std::isfinite(field.m_double)) {
+        // e.g. throughput without any time measured
+        os << "null";
+    } else {
+        std::streamsize precision = os.precision(9);
+        os << field.m_double;
+        os.precision(precision);
+    }
+}
+
+}
+}
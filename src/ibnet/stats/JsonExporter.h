@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_JSONEXPORTER_H
+#define IBNET_STATS_JSONEXPORTER_H
+
+#include <fstream>
+
+#include "Exporter.hpp"
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Exporter appending each snapshot as a single JSON object (JSON lines)
+ * to a file:
+ * {"timestamp_ms":...,"operations":[{"category":...,"name":...,
+ * "fields":{"counter":...},"windows":{"10s":{"counter":...}}}, ...]}
+ * The windows are omitted if not available
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class JsonExporter : public Exporter
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param path Path to the file to append the snapshots to
+     */
+    explicit JsonExporter(const std::string& path);
+
+    /**
+     * Destructor
+     */
+    ~JsonExporter() override = default;
+
+    /**
+     * Overriding virtual method
+     */
+    void Export(const Snapshot& snapshot) override;
+
+private:
+    std::ofstream m_file;
+
+private:
+    static void __WriteString(std::ostream& os, const std::string& str);
+
+    static void __WriteField(std::ostream& os, const Snapshot::Field& field);
+
+    static void __WriteFields(std::ostream& os, const std::vector<Snapshot::Field>& fields);
+};
+
+}
+}
+
+#endif //IBNET_STATS_JSONEXPORTER_H
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_LEVEL_HPP
+#define IBNET_STATS_LEVEL_HPP
+
+#include "ibnet/Config.h"
+
+#ifndef IBNET_STATS_LEVEL
+#ifdef IBNET_DISABLE_STATISTICS
+#define IBNET_STATS_LEVEL 0
+#else
+#define IBNET_STATS_LEVEL 3
+#endif
+#endif
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Levels of statistics selectable at compile time (IBNET_STATS_LEVEL).
+ * Each level includes the ones below. Statistics of a level not enabled
+ * compile to nothing:
+ * - counters: units, ratios and distributions (a few relaxed atomic stores
+ *   per operation, no timer reads)
+ * - coarse: additionally times the main sections of the dispatchers' loops
+ * - full: additionally times all sub sections and the timelines breaking
+ *   them down
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+enum Level
+{
+    e_LevelOff = 0,
+    e_LevelCounters = 1,
+    e_LevelCoarse = 2,
+    e_LevelFull = 3,
+};
+
+/**
+ * Level compiled
+ */
+constexpr Level LEVEL = static_cast<Level>(IBNET_STATS_LEVEL);
+
+/**
+ * Check if statistics of a level are compiled
+ *
+ * @param level Level to check
+ * @return True if enabled, false otherwise
+ */
+constexpr bool IsLevelEnabled(Level level)
+{
+    return level != e_LevelOff && level <= LEVEL;
+}
+
+/**
+ * Get the name of a level (e.g. for logging)
+ *
+ * @param level Level
+ * @return Name of the level
+ */
+constexpr const char* GetLevelName(Level level)
+{
+    return level == e_LevelOff ? "off" : level == e_LevelCounters ? "counters" :
+            level == e_LevelCoarse ? "coarse" : "full";
+}
+
+}
+}
+
+#endif //IBNET_STATS_LEVEL_HPP
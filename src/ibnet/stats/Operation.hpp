@@ -20,13 +20,23 @@
 #define IBNET_STATS_OPERATION_HPP
 
 #include <ostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
-#ifdef IBNET_DISABLE_STATISTICS
-#define IBNET_STATS(...)
-#else
-#define IBNET_STATS(x) x
-#endif
+#include "Level.hpp"
+#include "Snapshot.hpp"
+
+// the statement is discarded at compile time if the level is not enabled
+#define IBNET_STATS_IF(level, ...) \
+    do { if constexpr (ibnet::stats::IsLevelEnabled(level)) { __VA_ARGS__; } } while (false)
+
+// counters (e.g. Unit::Add/Inc)
+#define IBNET_STATS(...) IBNET_STATS_IF(ibnet::stats::e_LevelCounters, __VA_ARGS__)
+// timings of the main sections
+#define IBNET_STATS_COARSE(...) IBNET_STATS_IF(ibnet::stats::e_LevelCoarse, __VA_ARGS__)
+// timings of all sub sections
+#define IBNET_STATS_FULL(...) IBNET_STATS_IF(ibnet::stats::e_LevelFull, __VA_ARGS__)
 
 namespace ibnet {
 namespace stats {
@@ -79,6 +89,44 @@ public:
      */
     virtual void WriteOstream(std::ostream& os, const std::string& indent) const = 0;
 
+    /**
+     * Get the current state of the operation as typed fields (machine
+     * readable counterpart of WriteOstream). Operations without any
+     * fields are text output only
+     *
+     * @param fields Vector to append the fields to
+     */
+    virtual void GetFields(std::vector<Snapshot::Field>& fields) const
+    {
+    }
+
+    /**
+     * Get the state of the operation within an interval, e.g. deltas and
+     * rates, from its fields at the start and end of the interval (see
+     * GetFields). Operations without any interval fields are cumulative only
+     *
+     * @param prev Fields at the start of the interval
+     * @param cur Fields at the end of the interval
+     * @param intervalSec Length of the interval in seconds
+     * @param fields Vector to append the interval fields to
+     */
+    virtual void GetIntervalFields(const std::vector<Snapshot::Field>& prev,
+            const std::vector<Snapshot::Field>& cur, double intervalSec,
+            std::vector<Snapshot::Field>& fields) const
+    {
+    }
+
+    /**
+     * Get the output of the << operator as a string, e.g. for exception
+     * messages (operations are not copyable)
+     */
+    std::string ToString() const
+    {
+        std::stringstream ss;
+        ss << *this;
+        return ss.str();
+    }
+
     /**
      * Overloading << operator for printing to ostreams
      *
@@ -93,6 +141,75 @@ public:
         return os;
     }
 
+protected:
+    /**
+     * Get the delta of a cumulative integer field
+     *
+     * @param prev Fields at the start of the interval
+     * @param cur Fields at the end of the interval
+     * @param name Name of the field
+     * @return Delta or the current value if the field was reset in between
+     */
+    static uint64_t _GetDelta(const std::vector<Snapshot::Field>& prev,
+            const std::vector<Snapshot::Field>& cur, const std::string& name)
+    {
+        const Snapshot::Field* prevField = Snapshot::GetField(prev, name);
+        const Snapshot::Field* curField = Snapshot::GetField(cur, name);
+
+        if (!curField) {
+            return 0;
+        }
+
+        if (!prevField || prevField->m_uint64 > curField->m_uint64) {
+            return curField->m_uint64;
+        }
+
+        return curField->m_uint64 - prevField->m_uint64;
+    }
+
+    /**
+     * Get the delta of a cumulative floating point field
+     *
+     * @param prev Fields at the start of the interval
+     * @param cur Fields at the end of the interval
+     * @param name Name of the field
+     * @return Delta or the current value if the field was reset in between
+     */
+    static double _GetDeltaDouble(const std::vector<Snapshot::Field>& prev,
+            const std::vector<Snapshot::Field>& cur, const std::string& name)
+    {
+        const Snapshot::Field* prevField = Snapshot::GetField(prev, name);
+        const Snapshot::Field* curField = Snapshot::GetField(cur, name);
+
+        if (!curField) {
+            return 0.0;
+        }
+
+        if (!prevField || prevField->m_double > curField->m_double) {
+            return curField->m_double;
+        }
+
+        return curField->m_double - prevField->m_double;
+    }
+
+    /**
+     * Get the deltas of all integer fields, for operations with cumulative
+     * integer fields only
+     *
+     * @param prev Fields at the start of the interval
+     * @param cur Fields at the end of the interval
+     * @param fields Vector to append the deltas to
+     */
+    static void _GetDeltaFields(const std::vector<Snapshot::Field>& prev,
+            const std::vector<Snapshot::Field>& cur, std::vector<Snapshot::Field>& fields)
+    {
+        for (auto& it : cur) {
+            if (it.m_type == Snapshot::Field::e_TypeUInt64) {
+                fields.emplace_back(it.m_name, _GetDelta(prev, cur, it.m_name));
+            }
+        }
+    }
+
 private:
     const std::string m_categoryName;
     const std::string m_name;
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "PrometheusEndpoint.h"
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ibnet/sys/Logger.hpp"
+#include "ibnet/sys/SystemException.h"
+
+namespace ibnet {
+namespace stats {
+
+PrometheusEndpoint::PrometheusEndpoint(uint16_t port, StatisticsManager* refStatisticsManager) :
+        ThreadLoop("PrometheusEndpoint"),
+        m_port(port),
+        m_refStatisticsManager(refStatisticsManager),
+        m_socket(-1)
+{
+    m_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (m_socket == -1) {
+        throw sys::SystemException("Opening socket for prometheus endpoint failed: %s", strerror(errno));
+    }
+
+    int reuse = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    // never expose the statistics beyond the local host
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(m_socket, (const sockaddr*) &addr, sizeof(addr)) == -1 || listen(m_socket, 8) == -1) {
+        int err = errno;
+        close(m_socket);
+        throw sys::SystemException("Binding prometheus endpoint to port %d failed: %s", port, strerror(err));
+    }
+
+    IBNET_LOG_INFO("Prometheus endpoint listening on 127.0.0.1:%d", port);
+}
+
+PrometheusEndpoint::~PrometheusEndpoint()
+{
+    close(m_socket);
+}
+
+std::string PrometheusEndpoint::Format(const Snapshot& snapshot)
+{
+    // all samples of a metric must be grouped
+    std::map<std::string, std::stringstream> metrics;
+
+    for (auto& entry : snapshot.m_entries) {
+        std::string labels = "category=\"" + __EscapeLabelValue(entry.m_category) + "\"";
+
+        for (auto& field : entry.m_fields) {
+            __AddSample(metrics[__GetMetricName(entry.m_name, field.m_name)], labels, field);
+        }
+
+        // separate metrics to not mix the values of the windows with the
+        // cumulative ones
+        for (auto& window : entry.m_windows) {
+            std::string windowLabels = labels + ",window=\"" + window.m_name + "\"";
+
+            for (auto& field : window.m_fields) {
+                __AddSample(metrics[__GetMetricName(entry.m_name, field.m_name) + "_window"], windowLabels, field);
+            }
+        }
+    }
+
+    std::stringstream out;
+
+    for (auto& it : metrics) {
+        std::string samples = it.second.str();
+        size_t pos = 0;
+
+        out << "# TYPE " << it.first << " untyped\n";
+
+        // prefix each sample line with the metric name
+        while (pos < samples.size()) {
+            size_t end = samples.find('\n', pos);
+
+            out << it.first << samples.substr(pos, end - pos + 1);
+            pos = end + 1;
+        }
+    }
+
+    return out.str();
+}
+
+void PrometheusEndpoint::__AddSample(std::stringstream& sstr, const std::string& labels,
+        const Snapshot::Field& field)
+{
+    sstr << '{' << labels << "} ";
+
+    if (field.m_type == Snapshot::Field::e_TypeUInt64) {
+        sstr << field.m_uint64;
+    } else if (std::isnan(field.m_double)) {
+        sstr << "NaN";
+    } else if (std::isinf(field.m_double)) {
+        sstr << (field.m_double > 0 ? "+Inf" : "-Inf");
+    } else {
+        sstr.precision(9);
+        sstr << field.m_double;
+    }
+
+    sstr << '\n';
+}
+
+void PrometheusEndpoint::_RunLoop()
+{
+    pollfd pfd = {};
+    pfd.fd = m_socket;
+    pfd.events = POLLIN;
+
+    // timeout to check for the thread being stopped
+    if (poll(&pfd, 1, 100) <= 0) {
+        return;
+    }
+
+    int socket = accept(m_socket, nullptr, nullptr);
+
+    if (socket == -1) {
+        IBNET_LOG_WARN("Accepting connection on prometheus endpoint failed: %s", strerror(errno));
+        return;
+    }
+
+    __HandleRequest(socket);
+
+    close(socket);
+}
+
+void PrometheusEndpoint::__HandleRequest(int socket)
+{
+    timeval timeout = {};
+    timeout.tv_sec = 1;
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // the request line is sufficient, ignore the headers
+    char buffer[1024];
+    ssize_t ret = recv(socket, buffer, sizeof(buffer) - 1, 0);
+
+    if (ret <= 0) {
+        return;
+    }
+
+    buffer[ret] = '\0';
+
+    std::string response;
+
+    if (strncmp(buffer, "GET ", 4) == 0) {
+        Snapshot snapshot;
+        m_refStatisticsManager->GetSnapshot(snapshot);
+
+        std::string body = Format(snapshot);
+
+        response = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n" + body;
+    } else {
+        response = "HTTP/1.1 405 Method Not Allowed\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: close\r\n\r\n";
+    }
+
+    size_t sent = 0;
+
+    while (sent < response.size()) {
+        ret = send(socket, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+
+        if (ret <= 0) {
+            IBNET_LOG_WARN("Sending response on prometheus endpoint failed: %s", strerror(errno));
+            return;
+        }
+
+        sent += ret;
+    }
+}
+
+std::string PrometheusEndpoint::__GetMetricName(const std::string& name, const std::string& field)
+{
+    std::string metric = "ibnet_" + name + "_" + field;
+
+    for (auto& c : metric) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            c = '_';
+        }
+    }
+
+    return metric;
+}
+
+std::string PrometheusEndpoint::__EscapeLabelValue(const std::string& value)
+{
+    std::string escaped;
+
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+}
+}
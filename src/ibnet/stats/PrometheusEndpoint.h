@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_PROMETHEUSENDPOINT_H
+#define IBNET_STATS_PROMETHEUSENDPOINT_H
+
+#include <sstream>
+
+#include "ibnet/sys/ThreadLoop.h"
+
+#include "StatisticsManager.h"
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Minimal HTTP endpoint on localhost serving a fresh snapshot of all
+ * registered statistics in the Prometheus text exposition format on every
+ * GET request. Each field of an operation is exported as
+ * ibnet_<name>_<field>{category="<category>"}, the fields of the rolling
+ * windows as ibnet_<name>_<field>_window{category="...",window="10s"}
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class PrometheusEndpoint : public sys::ThreadLoop
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param port Port to listen on (bound to 127.0.0.1)
+     * @param refStatisticsManager Statistics manager to get the snapshots
+     *        from (managed by caller)
+     */
+    PrometheusEndpoint(uint16_t port, StatisticsManager* refStatisticsManager);
+
+    /**
+     * Destructor
+     */
+    ~PrometheusEndpoint() override;
+
+    /**
+     * Format a snapshot in the Prometheus text exposition format
+     *
+     * @param snapshot Snapshot to format
+     * @return Snapshot formatted as string
+     */
+    static std::string Format(const Snapshot& snapshot);
+
+protected:
+    void _RunLoop() override;
+
+private:
+    const uint16_t m_port;
+    StatisticsManager* m_refStatisticsManager;
+
+    int m_socket;
+
+private:
+    void __HandleRequest(int socket);
+
+    static void __AddSample(std::stringstream& sstr, const std::string& labels, const Snapshot::Field& field);
+
+    static std::string __GetMetricName(const std::string& name, const std::string& field);
+
+    static std::string __EscapeLabelValue(const std::string& value);
+};
+
+}
+}
+
+#endif //IBNET_STATS_PROMETHEUSENDPOINT_H
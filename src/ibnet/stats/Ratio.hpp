@@ -143,6 +143,37 @@ public:
         os.flags(flags);
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        fields.emplace_back("counter", GetRatioCounter());
+        fields.emplace_back("total", GetRatioTotalValue());
+        fields.emplace_back("min", GetRatioMinValue());
+        fields.emplace_back("max", GetRatioMaxValue());
+        // raw values for interval ratios
+        fields.emplace_back("numerator_counter", m_unit1->GetCounter());
+        fields.emplace_back("numerator_total", m_unit1->GetTotalValue());
+        fields.emplace_back("denominator_counter", m_unit2->GetCounter());
+        fields.emplace_back("denominator_total", m_unit2->GetTotalValue());
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        double denominatorCounter = _GetDelta(prev, cur, "denominator_counter");
+        double denominatorTotal = _GetDelta(prev, cur, "denominator_total");
+
+        fields.emplace_back("counter", _GetDelta(prev, cur, "numerator_counter") /
+                (denominatorCounter == 0.0 ? 1.0 : denominatorCounter));
+        fields.emplace_back("total", _GetDelta(prev, cur, "numerator_total") /
+                (denominatorTotal == 0.0 ? 1.0 : denominatorTotal));
+    }
+
 private:
     const bool m_refs;
     Unit* m_unit1;
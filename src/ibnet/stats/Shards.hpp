@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_SHARDS_HPP
+#define IBNET_STATS_SHARDS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "ibnet/sys/ThreadIndex.h"
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Per-thread shards of the state of a statistic operation. Each thread
+ * updates its own shard (allocated on first use, cache line aligned by
+ * the shard type) and the shards are aggregated when reading, i.e. any
+ * thread can update an operation without shared atomic RMW and without
+ * cache line bouncing. Threads exceeding sys::ThreadIndex::MAX_THREADS
+ * share a single shard which must be updated using atomic RMW (shared
+ * flag).
+ *
+ * A shard type provides its values as relaxed atomics which are written
+ * with plain loads and stores by the single owner (no RMW) to not tear
+ * any value read by a concurrent snapshot.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+template<typename ShardType>
+class Shards
+{
+public:
+    /**
+     * Constructor
+     */
+    Shards() :
+            m_shards()
+    {
+        for (auto& it : m_shards) {
+            it.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Destructor
+     */
+    ~Shards()
+    {
+        for (auto& it : m_shards) {
+            delete it.load(std::memory_order_relaxed);
+        }
+    }
+
+    Shards(const Shards&) = delete;
+
+    Shards& operator=(const Shards&) = delete;
+
+    /**
+     * Get the shard of the calling thread
+     *
+     * @param shared Set to true if the shard is shared with other threads
+     *        (atomic RMW required), false if exclusive to the calling thread
+     * @return Shard of the calling thread
+     */
+    inline ShardType& Get(bool& shared)
+    {
+        uint16_t index = sys::ThreadIndex::Get();
+        ShardType* shard = m_shards[index].load(std::memory_order_acquire);
+
+        shared = index == sys::ThreadIndex::MAX_THREADS;
+
+        if (shard == nullptr) {
+            shard = __Allocate(index);
+        }
+
+        return *shard;
+    }
+
+    /**
+     * Call a function for every shard allocated (aggregating)
+     *
+     * @param func Function to call with a const reference to the shard
+     */
+    template<typename Func>
+    void ForEach(Func func) const
+    {
+        for (auto& it : m_shards) {
+            const ShardType* shard = it.load(std::memory_order_acquire);
+
+            if (shard) {
+                func(*shard);
+            }
+        }
+    }
+
+    /**
+     * Add to a shard's value
+     *
+     * @param value Value of a shard to add to
+     * @param val Value to add
+     * @param shared True if the shard is shared with other threads
+     */
+    static inline void Add(std::atomic<uint64_t>& value, uint64_t val, bool shared)
+    {
+        if (shared) {
+            value.fetch_add(val, std::memory_order_relaxed);
+        } else {
+            value.store(value.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Lower a shard's value to a new min
+     *
+     * @param value Value of a shard to update
+     * @param val Candidate for the new min
+     * @param shared True if the shard is shared with other threads
+     */
+    static inline void Min(std::atomic<uint64_t>& value, uint64_t val, bool shared)
+    {
+        uint64_t cur = value.load(std::memory_order_relaxed);
+
+        if (shared) {
+            while (val < cur && !value.compare_exchange_weak(cur, val, std::memory_order_relaxed)) {}
+        } else if (val < cur) {
+            value.store(val, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Raise a shard's value to a new max
+     *
+     * @param value Value of a shard to update
+     * @param val Candidate for the new max
+     * @param shared True if the shard is shared with other threads
+     */
+    static inline void Max(std::atomic<uint64_t>& value, uint64_t val, bool shared)
+    {
+        uint64_t cur = value.load(std::memory_order_relaxed);
+
+        if (shared) {
+            while (val > cur && !value.compare_exchange_weak(cur, val, std::memory_order_relaxed)) {}
+        } else if (val > cur) {
+            value.store(val, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    // one per thread index plus the shared one
+    std::atomic<ShardType*> m_shards[sys::ThreadIndex::MAX_THREADS + 1];
+
+private:
+    ShardType* __Allocate(uint16_t index)
+    {
+        auto* shard = new ShardType();
+        ShardType* expected = nullptr;
+
+        // only the shared shard can be raced for, the exclusive ones are
+        // re-used by the next thread getting the index
+        if (!m_shards[index].compare_exchange_strong(expected, shard, std::memory_order_acq_rel)) {
+            delete shard;
+            return expected;
+        }
+
+        return shard;
+    }
+};
+
+}
+}
+
+#endif //IBNET_STATS_SHARDS_HPP
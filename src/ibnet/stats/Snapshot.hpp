@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_STATS_SNAPSHOT_HPP
+#define IBNET_STATS_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ibnet {
+namespace stats {
+
+/**
+ * Machine readable state of all registered statistic operations at a
+ * single point in time (e.g. for exporting)
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+struct Snapshot
+{
+    /**
+     * Single typed value of an operation, e.g. the total of a unit
+     */
+    struct Field
+    {
+        enum Type
+        {
+            e_TypeUInt64 = 0,
+            e_TypeDouble = 1,
+        };
+
+        std::string m_name;
+        Type m_type;
+        // valid for e_TypeUInt64, only
+        uint64_t m_uint64;
+        // valid for both types
+        double m_double;
+
+        /**
+         * Constructor for an integer field
+         *
+         * @param name Name of the field
+         * @param value Value of the field
+         */
+        Field(const std::string& name, uint64_t value) :
+                m_name(name),
+                m_type(e_TypeUInt64),
+                m_uint64(value),
+                m_double(static_cast<double>(value))
+        {
+        }
+
+        /**
+         * Constructor for a floating point field
+         *
+         * @param name Name of the field
+         * @param value Value of the field
+         */
+        Field(const std::string& name, double value) :
+                m_name(name),
+                m_type(e_TypeDouble),
+                m_uint64(0),
+                m_double(value)
+        {
+        }
+    };
+
+    /**
+     * State of an operation within a rolling window, e.g. deltas and rates
+     * of the last 10 seconds
+     */
+    struct Window
+    {
+        // e.g. "10s"
+        std::string m_name;
+        uint32_t m_lengthMs;
+        std::vector<Field> m_fields;
+    };
+
+    /**
+     * State of a single operation
+     */
+    struct Entry
+    {
+        std::string m_category;
+        std::string m_name;
+        // cumulative since start
+        std::vector<Field> m_fields;
+        // only if rolling windows are enabled and enough samples available
+        std::vector<Window> m_windows;
+    };
+
+    // wall clock time (ms since epoch) the snapshot was taken
+    uint64_t m_timestampMs = 0;
+    std::vector<Entry> m_entries;
+
+    /**
+     * Find a field by name
+     *
+     * @param fields Fields to search
+     * @param name Name of the field
+     * @return Pointer to the field or nullptr if not available
+     */
+    static const Field* GetField(const std::vector<Field>& fields, const std::string& name)
+    {
+        for (auto& it : fields) {
+            if (it.m_name == name) {
+                return &it;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+}
+}
+
+#endif //IBNET_STATS_SNAPSHOT_HPP
@@ -19,13 +19,30 @@
 #include "StatisticsManager.h"
 #include "IbPerfLib/Exception/IbPerfException.h"
 
+#include <algorithm>
+#include <iomanip>
+
 namespace ibnet {
 namespace stats {
 
-StatisticsManager::StatisticsManager(uint32_t printIntervalMs, ibnet::core::IbDevice* refDevice) :
+const uint32_t StatisticsManager::WINDOW_SAMPLE_INTERVAL_MS = 1000;
+const uint32_t StatisticsManager::WINDOW_LENGTHS_MS[] = {1000, 10000, 60000};
+const char* StatisticsManager::WINDOW_NAMES[] = {"1s", "10s", "60s"};
+const size_t StatisticsManager::WINDOW_COUNT = 3;
+
+StatisticsManager::StatisticsManager(uint32_t printIntervalMs, uint32_t exportIntervalMs, bool rollingWindows,
+        ibnet::core::IbDevice* refDevice) :
         m_printIntervalMs(printIntervalMs),
+        m_exportIntervalMs(exportIntervalMs),
+        m_rollingWindows(rollingWindows),
+        m_nextPrint(),
+        m_nextExport(),
+        m_nextSample(),
         m_mutex(),
         m_operations(),
+        m_exporters(),
+        m_prevPrint(),
+        m_windowSamples(),
         m_perfCounter(refDevice->GetPerfCounter()),
         m_diagPerfCounter(refDevice->GetDiagPerfCounter()),
         m_totalTime(new Time("PerformanceCounters", "TotalTime")),
@@ -76,9 +93,7 @@ StatisticsManager::StatisticsManager(uint32_t printIntervalMs, ibnet::core::IbDe
                 new Unit("DiagnosticPerformanceCounters", "SqTransportRetriesExceededErrors")),
         m_sqCompletionQueueEntryErrors(new Unit("DiagnosticPerformanceCounters", "SqCompletionQueueEntryErrors"))
 {
-#ifdef IBNET_DISABLE_STATISTICS
-    IBNET_LOG_INFO("Preprocessor flag to disable some statistics active");
-#endif
+    IBNET_LOG_INFO("Statistics level: %s", GetLevelName(LEVEL));
 
     Register(m_rawXmitData);
     Register(m_rawRcvData);
@@ -250,8 +265,13 @@ StatisticsManager::~StatisticsManager() {
 }
 
 
-void StatisticsManager::Register(const Operation* refOperation)
+void StatisticsManager::Register(const Operation* refOperation, Level level)
 {
+    // don't print operations which are never updated
+    if (!IsLevelEnabled(level)) {
+        return;
+    }
+
     std::lock_guard<std::mutex> l(m_mutex);
 
     auto it = m_operations.find(refOperation->GetCategoryName());
@@ -278,39 +298,162 @@ void StatisticsManager::Deregister(const Operation* refOperation)
             }
         }
     }
+
+    // don't compare against samples of a new operation at the same address
+    m_prevPrint.m_fields.erase(refOperation);
+
+    for (auto& it2 : m_windowSamples) {
+        it2.m_fields.erase(refOperation);
+    }
+}
+
+void StatisticsManager::AddExporter(Exporter* refExporter)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    m_exporters.push_back(refExporter);
 }
 
 void StatisticsManager::PrintStatistics()
 {
     std::cout << "================= Statistics =================" << std::endl;
 
-#ifdef IBNET_DISABLE_STATISTICS
-    std::cout << "DISABLED DISABLED DISABLED DISABLED DISABLED" << std::endl;
-#endif
+    if (LEVEL == e_LevelOff) {
+        std::cout << "DISABLED DISABLED DISABLED DISABLED DISABLED" << std::endl;
+    } else if (LEVEL != e_LevelFull) {
+        std::cout << "Level: " << GetLevelName(LEVEL) << std::endl;
+    }
 
     std::stringstream sstr;
+    Sample sample;
 
     m_mutex.lock();
 
-    RefreshPerformanceCounters();
+    __TakeSample(sample);
+
+    double intervalSec = (sample.m_timeMs - m_prevPrint.m_timeMs) / 1000.0;
 
     for (auto& it : m_operations) {
         sstr << ">>> " << it.first << std::endl;
 
         for (auto& it2 : it.second) {
             sstr << *it2 << std::endl;
+
+            const std::vector<Snapshot::Field>& cur = sample.m_fields[it2];
+            auto prev = m_prevPrint.m_fields.find(it2);
+
+            // deltas since the previous print
+            if (prev != m_prevPrint.m_fields.end() && intervalSec > 0.0) {
+                std::stringstream label;
+                std::vector<Snapshot::Field> fields;
+
+                label << "interval " << std::setprecision(3) << std::fixed << intervalSec << " s";
+
+                it2->GetIntervalFields(prev->second, cur, intervalSec, fields);
+                __WriteFields(sstr, label.str(), fields);
+            }
+
+            if (m_rollingWindows) {
+                std::vector<Snapshot::Window> windows;
+
+                __GetWindows(it2, cur, sample.m_timeMs, windows);
+
+                for (auto& it3 : windows) {
+                    __WriteFields(sstr, "window " + it3.m_name, it3.m_fields);
+                }
+            }
         }
     }
 
+    m_prevPrint = std::move(sample);
+
     m_mutex.unlock();
 
     std::cout << sstr.str();
 }
 
+void StatisticsManager::GetSnapshot(Snapshot& snapshot)
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    __GetSnapshot(snapshot);
+}
+
+void StatisticsManager::ExportStatistics()
+{
+    Snapshot snapshot;
+
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    if (m_exporters.empty()) {
+        return;
+    }
+
+    __GetSnapshot(snapshot);
+
+    for (auto& it : m_exporters) {
+        it->Export(snapshot);
+    }
+}
+
+void StatisticsManager::_BeforeRunLoop()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    m_nextPrint = now + std::chrono::milliseconds(m_printIntervalMs);
+    m_nextExport = now + std::chrono::milliseconds(m_exportIntervalMs);
+    // first sample right away
+    m_nextSample = now;
+
+    if (m_printIntervalMs == 0 && m_exportIntervalMs == 0 && !m_rollingWindows) {
+        ExitLoop();
+    }
+}
+
 void StatisticsManager::_RunLoop()
 {
-    _Sleep(m_printIntervalMs);
-    PrintStatistics();
+    auto next = std::chrono::steady_clock::time_point::max();
+
+    if (m_printIntervalMs > 0) {
+        next = std::min(next, m_nextPrint);
+    }
+
+    if (m_exportIntervalMs > 0) {
+        next = std::min(next, m_nextExport);
+    }
+
+    if (m_rollingWindows) {
+        next = std::min(next, m_nextSample);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (next > now) {
+        _Sleep(static_cast<uint32_t>(std::chrono::ceil<std::chrono::milliseconds>(next - now).count()));
+        now = std::chrono::steady_clock::now();
+    }
+
+    // sample before printing/exporting to include the latest sample in
+    // the windows
+    if (m_rollingWindows && now >= m_nextSample) {
+        __SampleWindows();
+        m_nextSample += std::chrono::milliseconds(WINDOW_SAMPLE_INTERVAL_MS);
+
+        // don't catch up on missed samples
+        if (m_nextSample < now) {
+            m_nextSample = now + std::chrono::milliseconds(WINDOW_SAMPLE_INTERVAL_MS);
+        }
+    }
+
+    if (m_printIntervalMs > 0 && now >= m_nextPrint) {
+        PrintStatistics();
+        m_nextPrint = now + std::chrono::milliseconds(m_printIntervalMs);
+    }
+
+    if (m_exportIntervalMs > 0 && now >= m_nextExport) {
+        ExportStatistics();
+        m_nextExport = now + std::chrono::milliseconds(m_exportIntervalMs);
+    }
 }
 
 void StatisticsManager::RefreshPerformanceCounters() {
@@ -408,5 +551,135 @@ void StatisticsManager::RefreshPerformanceCounters() {
     IBNET_STATS(m_totalTime->Start());
 }
 
+void StatisticsManager::__GetSnapshot(Snapshot& snapshot)
+{
+    snapshot.m_timestampMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    snapshot.m_entries.clear();
+
+    uint64_t timeMs = __GetTimeMs();
+
+    RefreshPerformanceCounters();
+
+    for (auto& it : m_operations) {
+        for (auto& it2 : it.second) {
+            snapshot.m_entries.emplace_back();
+
+            Snapshot::Entry& entry = snapshot.m_entries.back();
+            entry.m_category = it2->GetCategoryName();
+            entry.m_name = it2->GetName();
+
+            it2->GetFields(entry.m_fields);
+
+            if (m_rollingWindows) {
+                __GetWindows(it2, entry.m_fields, timeMs, entry.m_windows);
+            }
+        }
+    }
+}
+
+void StatisticsManager::__TakeSample(Sample& sample)
+{
+    sample.m_timeMs = __GetTimeMs();
+
+    RefreshPerformanceCounters();
+
+    for (auto& it : m_operations) {
+        for (auto& it2 : it.second) {
+            it2->GetFields(sample.m_fields[it2]);
+        }
+    }
+}
+
+void StatisticsManager::__SampleWindows()
+{
+    std::lock_guard<std::mutex> l(m_mutex);
+
+    m_windowSamples.emplace_back();
+    __TakeSample(m_windowSamples.back());
+
+    uint64_t latestMs = m_windowSamples.back().m_timeMs;
+
+    // keep the samples covering the longest window
+    while (m_windowSamples.front().m_timeMs + WINDOW_LENGTHS_MS[WINDOW_COUNT - 1] + WINDOW_SAMPLE_INTERVAL_MS <
+            latestMs) {
+        m_windowSamples.pop_front();
+    }
+}
+
+void StatisticsManager::__GetWindows(const Operation* operation, const std::vector<Snapshot::Field>& cur,
+        uint64_t timeMs, std::vector<Snapshot::Window>& windows) const
+{
+    for (size_t i = 0; i < WINDOW_COUNT; i++) {
+        // latest sample at the start of the window (tolerate sampling
+        // jitter), none if the window is not covered, yet
+        const Sample* start = nullptr;
+
+        for (auto it = m_windowSamples.rbegin(); it != m_windowSamples.rend(); it++) {
+            if (it->m_timeMs + WINDOW_LENGTHS_MS[i] <= timeMs + WINDOW_SAMPLE_INTERVAL_MS / 2) {
+                start = &(*it);
+                break;
+            }
+        }
+
+        if (!start || start->m_timeMs >= timeMs) {
+            continue;
+        }
+
+        auto prev = start->m_fields.find(operation);
+
+        if (prev == start->m_fields.end()) {
+            continue;
+        }
+
+        windows.emplace_back();
+
+        Snapshot::Window& window = windows.back();
+        window.m_name = WINDOW_NAMES[i];
+        window.m_lengthMs = WINDOW_LENGTHS_MS[i];
+
+        operation->GetIntervalFields(prev->second, cur, (timeMs - start->m_timeMs) / 1000.0, window.m_fields);
+
+        if (window.m_fields.empty()) {
+            windows.pop_back();
+        }
+    }
+}
+
+void StatisticsManager::__WriteFields(std::ostream& os, const std::string& label,
+        const std::vector<Snapshot::Field>& fields)
+{
+    if (fields.empty()) {
+        return;
+    }
+
+    std::ios::fmtflags f(os.flags());
+
+    os << "    " << label << ": " << std::setprecision(3) << std::fixed;
+
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) {
+            os << ";";
+        }
+
+        os << fields[i].m_name << " ";
+
+        if (fields[i].m_type == Snapshot::Field::e_TypeUInt64) {
+            os << fields[i].m_uint64;
+        } else {
+            os << fields[i].m_double;
+        }
+    }
+
+    os.flags(f);
+    os << std::endl;
+}
+
+uint64_t StatisticsManager::__GetTimeMs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}
 }
-}
\ No newline at end of file
@@ -19,6 +19,8 @@
 #ifndef IBNET_DX_STATISTICSMANAGER_H
 #define IBNET_DX_STATISTICSMANAGER_H
 
+#include <chrono>
+#include <deque>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -27,7 +29,10 @@
 #include "ibnet/Config.h"
 #include "ibnet/sys/ThreadLoop.h"
 
+#include "Exporter.hpp"
+#include "Level.hpp"
 #include "Operation.hpp"
+#include "Snapshot.hpp"
 #include "Unit.hpp"
 #include "Throughput.hpp"
 
@@ -37,7 +42,11 @@ namespace stats {
 
 /**
  * Manager for statistic operations. A dedicated thread prints all registered
- * statistics periodically if enabled.
+ * statistics and/or exports snapshots of them periodically if enabled.
+ * Besides the cumulative values since start, the printed statistics include
+ * the deltas and rates since the previous print. If rolling windows are
+ * enabled, the thread samples all operations every second to provide the
+ * deltas and rates of the last 1, 10 and 60 seconds.
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 01.02.2018
  */
@@ -49,8 +58,12 @@ public:
      *
      * @param printIntervalMs Interval in ms to print all registered
      *        statistics (0 to disable printing)
+     * @param exportIntervalMs Interval in ms to export snapshots to all
+     *        added exporters (0 to disable exporting)
+     * @param rollingWindows True to enable the rolling windows
      */
-    explicit StatisticsManager(uint32_t printIntervalMs, ibnet::core::IbDevice* refDevice);
+    StatisticsManager(uint32_t printIntervalMs, uint32_t exportIntervalMs, bool rollingWindows,
+            ibnet::core::IbDevice* refDevice);
 
     /**
      * Destructor
@@ -61,8 +74,10 @@ public:
      * Register a statistic operation
      *
      * @param refOperation Operation to register (caller has to manage memory)
+     * @param level Statistics level the operation is recorded at. If the level
+     *        is not compiled (IBNET_STATS_LEVEL), the operation is not registered
      */
-    void Register(const Operation* refOperation);
+    void Register(const Operation* refOperation, Level level = e_LevelCounters);
 
     /**
      * Deregister an already registered operation
@@ -73,22 +88,84 @@ public:
      */
     void Deregister(const Operation* refOperation);
 
+    /**
+     * Add an exporter which is called with a snapshot every export interval
+     *
+     * @param refExporter Exporter to add (managed by caller)
+     */
+    void AddExporter(Exporter* refExporter);
+
     /**
      * Print the current state of all registerted statistics to stdout
      */
     void PrintStatistics();
 
+    /**
+     * Get a machine readable snapshot of all registered statistics
+     * (including the rolling windows, if enabled)
+     *
+     * @param snapshot Snapshot to write to
+     */
+    void GetSnapshot(Snapshot& snapshot);
+
+    /**
+     * Export a snapshot of all registered statistics to all added exporters
+     */
+    void ExportStatistics();
+
 protected:
+    void _BeforeRunLoop() override;
+
     void _RunLoop() override;
 
+private:
+    static const uint32_t WINDOW_SAMPLE_INTERVAL_MS;
+    static const uint32_t WINDOW_LENGTHS_MS[];
+    static const char* WINDOW_NAMES[];
+    static const size_t WINDOW_COUNT;
+
+    /**
+     * Fields of all registered operations at a point in time
+     */
+    struct Sample
+    {
+        // steady clock
+        uint64_t m_timeMs = 0;
+        std::unordered_map<const Operation*, std::vector<Snapshot::Field>> m_fields;
+    };
+
 private:
     void RefreshPerformanceCounters();
 
+    void __GetSnapshot(Snapshot& snapshot);
+
+    void __TakeSample(Sample& sample);
+
+    void __SampleWindows();
+
+    void __GetWindows(const Operation* operation, const std::vector<Snapshot::Field>& cur, uint64_t timeMs,
+            std::vector<Snapshot::Window>& windows) const;
+
+    static void __WriteFields(std::ostream& os, const std::string& label,
+            const std::vector<Snapshot::Field>& fields);
+
+    static uint64_t __GetTimeMs();
+
 private:
     const uint32_t m_printIntervalMs;
+    const uint32_t m_exportIntervalMs;
+    const bool m_rollingWindows;
+
+    std::chrono::steady_clock::time_point m_nextPrint;
+    std::chrono::steady_clock::time_point m_nextExport;
+    std::chrono::steady_clock::time_point m_nextSample;
 
     std::mutex m_mutex;
     std::unordered_map<std::string, std::vector<const Operation*>> m_operations;
+    std::vector<Exporter*> m_exporters;
+
+    Sample m_prevPrint;
+    std::deque<Sample> m_windowSamples;
 
     IbPerfLib::IbPerfCounter *m_perfCounter;
     IbPerfLib::IbDiagPerfCounter *m_diagPerfCounter;
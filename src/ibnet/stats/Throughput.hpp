@@ -143,6 +143,29 @@ public:
         }
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        fields.emplace_back("bytes_per_sec", GetThroughput());
+        fields.emplace_back("total", m_unit->GetTotalValue());
+        fields.emplace_back("time_sec", m_time->GetTotalTime());
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t total = _GetDelta(prev, cur, "total");
+        double time = _GetDeltaDouble(prev, cur, "time_sec");
+
+        fields.emplace_back("bytes_per_sec", time == 0.0 ? 0.0 : total / time);
+        fields.emplace_back("total", total);
+    }
+
 private:
     static const char* ms_metricTableNames[];
 
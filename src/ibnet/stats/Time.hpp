@@ -25,13 +25,18 @@
 
 #include "ibnet/sys/Timer.hpp"
 
+#include "Histogram.hpp"
 #include "Operation.hpp"
+#include "Shards.hpp"
 
 namespace ibnet {
 namespace stats {
 
 /**
- * Statistic operation to measure time
+ * Statistic operation to measure time. The measured values are sharded
+ * per thread (see Shards) and aggregated on reading. The timer of Start and
+ * Stop is not, i.e. a single thread at a time must time a section. Use
+ * Record to add times measured concurrently by multiple threads
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 01.02.2018
  */
@@ -55,14 +60,14 @@ public:
      *
      * @param category Name for the category (for sorting), e.g. class name
      * @param name Name of the statistic operation
+     * @param histogram Record each measurement to a histogram to report
+     *        percentiles as well (fixed ~16 kb of memory per instance)
      */
-    explicit Time(const std::string& category, const std::string& name) :
+    explicit Time(const std::string& category, const std::string& name, bool histogram = false) :
             Operation(category, name),
-            m_counter(0),
+            m_histogram(histogram),
             m_timer(),
-            m_total(0),
-            m_best(0xFFFFFFFFFFFFFFFF),
-            m_worst(0)
+            m_shards()
     {
     };
 
@@ -77,7 +82,11 @@ public:
      */
     inline void Start()
     {
-        m_counter++;
+        bool shared;
+        Shard& shard = m_shards.Get(shared);
+
+        Shards<Shard>::Add(shard.m_counter, 1, shared);
+
         m_timer.Start();
     }
 
@@ -88,17 +97,25 @@ public:
     {
         m_timer.Stop();
 
-        uint64_t delta = m_timer.GetTimeNs();
+        bool shared;
+        Shard& shard = m_shards.Get(shared);
 
-        m_total += delta;
+        __Record(shard, m_timer.GetTimeNs(), shared);
+    }
 
-        if (delta < m_best) {
-            m_best = delta;
-        }
+    /**
+     * Add a time measured by the caller, e.g. by multiple threads
+     * concurrently
+     *
+     * @param timeNs Time measured in ns
+     */
+    inline void Record(uint64_t timeNs)
+    {
+        bool shared;
+        Shard& shard = m_shards.Get(shared);
 
-        if (delta > m_worst) {
-            m_worst = delta;
-        }
+        Shards<Shard>::Add(shard.m_counter, 1, shared);
+        __Record(shard, timeNs, shared);
     }
 
     /**
@@ -106,7 +123,13 @@ public:
      */
     inline uint64_t GetCounter() const
     {
-        return m_counter;
+        uint64_t counter = 0;
+
+        m_shards.ForEach([&counter](const Shard& shard) {
+            counter += shard.m_counter.load(std::memory_order_relaxed);
+        });
+
+        return counter;
     }
 
     /**
@@ -118,7 +141,7 @@ public:
      */
     inline double GetTotalTime(Metric metric = e_MetricSec) const
     {
-        return m_total / ms_metricTable[metric];
+        return __GetTotal() / ms_metricTable[metric];
     }
 
     /**
@@ -130,10 +153,12 @@ public:
      */
     inline double GetAverageTime(Metric metric = e_MetricSec) const
     {
-        if (m_counter == 0) {
+        uint64_t counter = GetCounter();
+
+        if (counter == 0) {
             return 0;
         } else {
-            return (m_total / ms_metricTable[metric]) / m_counter;
+            return (__GetTotal() / ms_metricTable[metric]) / counter;
         }
     }
 
@@ -146,7 +171,17 @@ public:
      */
     inline double GetBestTime(Metric metric = e_MetricSec) const
     {
-        return m_best / ms_metricTable[metric];
+        uint64_t best = 0xFFFFFFFFFFFFFFFF;
+
+        m_shards.ForEach([&best](const Shard& shard) {
+            uint64_t val = shard.m_best.load(std::memory_order_relaxed);
+
+            if (val < best) {
+                best = val;
+            }
+        });
+
+        return best / ms_metricTable[metric];
     }
 
     /**
@@ -158,7 +193,44 @@ public:
      */
     inline double GetWorstTime(Metric metric = e_MetricSec) const
     {
-        return m_worst / ms_metricTable[metric];
+        uint64_t worst = 0;
+
+        m_shards.ForEach([&worst](const Shard& shard) {
+            uint64_t val = shard.m_worst.load(std::memory_order_relaxed);
+
+            if (val > worst) {
+                worst = val;
+            }
+        });
+
+        return worst / ms_metricTable[metric];
+    }
+
+    /**
+     * Get a snapshot of the histogram of the measured times (in ns), merged
+     * from all threads. The snapshot can be merged with the ones of other
+     * instances
+     *
+     * @param snapshot Histogram to copy the current state to
+     * @return True if the histogram is enabled, false otherwise
+     */
+    bool GetHistogram(Histogram& snapshot) const
+    {
+        if (!m_histogram) {
+            return false;
+        }
+
+        snapshot.Reset();
+
+        m_shards.ForEach([&snapshot](const Shard& shard) {
+            const Histogram* histogram = shard.m_histogram.load(std::memory_order_acquire);
+
+            if (histogram) {
+                snapshot.Merge(*histogram);
+            }
+        });
+
+        return true;
     }
 
     /**
@@ -171,19 +243,141 @@ public:
         __FormatTime(os, "avg", GetAverageTime(e_MetricNano));
         __FormatTime(os, "best", GetBestTime(e_MetricNano));
         __FormatTime(os, "worst", GetWorstTime(e_MetricNano));
+
+        if (m_histogram) {
+            Histogram histogram;
+            GetHistogram(histogram);
+
+            __FormatTime(os, "p50", histogram.GetValueAtPercentile(50.0));
+            __FormatTime(os, "p90", histogram.GetValueAtPercentile(90.0));
+            __FormatTime(os, "p99", histogram.GetValueAtPercentile(99.0));
+            __FormatTime(os, "p99.9", histogram.GetValueAtPercentile(99.9));
+            __FormatTime(os, "max", histogram.GetMax());
+        }
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t counter = GetCounter();
+
+        fields.emplace_back("counter", counter);
+        fields.emplace_back("total_ns", __GetTotal());
+        fields.emplace_back("avg_ns", GetAverageTime(e_MetricNano));
+        fields.emplace_back("best_ns", counter == 0 ? static_cast<uint64_t>(0) :
+                static_cast<uint64_t>(GetBestTime(e_MetricNano)));
+        fields.emplace_back("worst_ns", static_cast<uint64_t>(GetWorstTime(e_MetricNano)));
+
+        if (m_histogram) {
+            Histogram histogram;
+            GetHistogram(histogram);
+
+            fields.emplace_back("p50_ns", histogram.GetValueAtPercentile(50.0));
+            fields.emplace_back("p90_ns", histogram.GetValueAtPercentile(90.0));
+            fields.emplace_back("p99_ns", histogram.GetValueAtPercentile(99.0));
+            fields.emplace_back("p999_ns", histogram.GetValueAtPercentile(99.9));
+            fields.emplace_back("max_ns", histogram.GetMax());
+        }
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t counter = _GetDelta(prev, cur, "counter");
+        uint64_t total = _GetDelta(prev, cur, "total_ns");
+
+        fields.emplace_back("counter", counter);
+        fields.emplace_back("total_ns", total);
+        fields.emplace_back("avg_ns", counter == 0 ? 0.0 : static_cast<double>(total) / counter);
+        fields.emplace_back("per_sec", counter / intervalSec);
+        // fraction of the interval spent in the timed section
+        fields.emplace_back("busy", total / (intervalSec * ms_metricTable[e_MetricSec]));
     }
 
 private:
     static const double ms_metricTable[e_MetricSec + 1];
 
 private:
-    uint64_t m_counter;
+    /**
+     * State of a single thread
+     */
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> m_counter;
+        std::atomic<uint64_t> m_total;
+        std::atomic<uint64_t> m_best;
+        std::atomic<uint64_t> m_worst;
+        // allocated on the first time recorded if enabled
+        std::atomic<Histogram*> m_histogram;
+
+        Shard() :
+                m_counter(0),
+                m_total(0),
+                m_best(0xFFFFFFFFFFFFFFFF),
+                m_worst(0),
+                m_histogram(nullptr)
+        {
+        }
+
+        ~Shard()
+        {
+            delete m_histogram.load(std::memory_order_relaxed);
+        }
+    };
+
+    const bool m_histogram;
 
     sys::Timer m_timer;
 
-    uint64_t m_total;
-    uint64_t m_best;
-    uint64_t m_worst;
+    Shards<Shard> m_shards;
+
+private:
+    inline void __Record(Shard& shard, uint64_t delta, bool shared)
+    {
+        Shards<Shard>::Add(shard.m_total, delta, shared);
+        Shards<Shard>::Min(shard.m_best, delta, shared);
+        Shards<Shard>::Max(shard.m_worst, delta, shared);
+
+        if (m_histogram) {
+            Histogram* histogram = shard.m_histogram.load(std::memory_order_acquire);
+
+            if (histogram == nullptr) {
+                histogram = __AllocateHistogram(shard);
+            }
+
+            histogram->Record(delta, shared);
+        }
+    }
+
+    static Histogram* __AllocateHistogram(Shard& shard)
+    {
+        auto* histogram = new Histogram();
+        Histogram* expected = nullptr;
+
+        // raced for by the threads of the shared shard, only
+        if (!shard.m_histogram.compare_exchange_strong(expected, histogram, std::memory_order_acq_rel)) {
+            delete histogram;
+            return expected;
+        }
+
+        return histogram;
+    }
+
+    inline uint64_t __GetTotal() const
+    {
+        uint64_t total = 0;
+
+        m_shards.ForEach([&total](const Shard& shard) {
+            total += shard.m_total.load(std::memory_order_relaxed);
+        });
+
+        return total;
+    }
 
 private:
     static inline void __FormatTime(std::ostream& os, const std::string& name,
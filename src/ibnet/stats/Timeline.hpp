@@ -48,7 +48,17 @@ public:
             m_pos(0)
     {
         for (auto& it : sectionNames) {
-            m_times.push_back(Time(category, it));
+            m_times.push_back(new Time(category, it));
+        }
+    }
+
+    /**
+     * Destructor
+     */
+    ~Timeline() override
+    {
+        for (auto& it : m_times) {
+            delete it;
         }
     }
 
@@ -58,7 +68,7 @@ public:
     void Start()
     {
         m_pos = 0;
-        m_times[m_pos].Start();
+        m_times[m_pos]->Start();
     }
 
     /**
@@ -66,14 +76,14 @@ public:
      */
     void NextSection()
     {
-        m_times[m_pos].Stop();
+        m_times[m_pos]->Stop();
         m_pos++;
 
         if (m_pos >= m_times.size()) {
             throw new sys::IllegalStateException("Invalid section index: %d", m_pos);
         }
 
-        m_times[m_pos].Start();
+        m_times[m_pos]->Start();
     }
 
     /**
@@ -85,7 +95,7 @@ public:
             return;
         }
 
-        m_times[m_pos].Stop();
+        m_times[m_pos]->Stop();
     }
 
     /**
@@ -96,7 +106,7 @@ public:
         double totalTime = 0;
 
         for (auto& it : m_times) {
-            totalTime += it.GetTotalTime(Time::Metric::e_MetricNano);
+            totalTime += it->GetTotalTime(Time::Metric::e_MetricNano);
         }
 
         os << indent << "Total time: ";
@@ -114,16 +124,16 @@ public:
         os << std::endl;
 
         for (size_t i = 0; i < m_times.size(); i++) {
-            os << indent << '(' << i << ") " << m_times[i].GetName();
+            os << indent << '(' << i << ") " << m_times[i]->GetName();
 
             std::ios::fmtflags f(os.flags());
 
             os << ": dist " << std::setprecision(2) << std::fixed;
-            os << (m_times[i].GetTotalTime(Time::Metric::e_MetricNano) / totalTime * 100) << " %;";
+            os << (m_times[i]->GetTotalTime(Time::Metric::e_MetricNano) / totalTime * 100) << " %;";
 
             os.flags(f);
 
-            m_times[i].WriteOstream(os, "");
+            m_times[i]->WriteOstream(os, "");
 
             if (i + 1 < m_times.size()) {
                 os << std::endl;
@@ -131,8 +141,36 @@ public:
         }
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t totalTime = 0;
+
+        for (auto& it : m_times) {
+            auto sectionTime = static_cast<uint64_t>(it->GetTotalTime(Time::Metric::e_MetricNano));
+
+            fields.emplace_back(it->GetName() + "_counter", it->GetCounter());
+            fields.emplace_back(it->GetName() + "_total_ns", sectionTime);
+
+            totalTime += sectionTime;
+        }
+
+        fields.emplace_back("total_ns", totalTime);
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        _GetDeltaFields(prev, cur, fields);
+    }
+
 private:
-    std::vector<Time> m_times;
+    std::vector<Time*> m_times;
     size_t m_pos;
 };
 
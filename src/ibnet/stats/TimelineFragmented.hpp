@@ -85,6 +85,29 @@ public:
         }
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        fields.emplace_back("total_ns",
+                static_cast<uint64_t>(m_refTotalTime->GetTotalTime(Time::Metric::e_MetricNano)));
+
+        for (auto& it : m_refTimes) {
+            fields.emplace_back(it->GetName() + "_total_ns",
+                    static_cast<uint64_t>(it->GetTotalTime(Time::Metric::e_MetricNano)));
+        }
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        _GetDeltaFields(prev, cur, fields);
+    }
+
 private:
     const Time* m_refTotalTime;
     std::vector<const Time*> m_refTimes;
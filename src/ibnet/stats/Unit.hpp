@@ -24,12 +24,14 @@
 #include <iomanip>
 
 #include "Operation.hpp"
+#include "Shards.hpp"
 
 namespace ibnet {
 namespace stats {
 
 /**
- * Statistic operation tracking a value/unit
+ * Statistic operation tracking a value/unit. Thread safe, the values are
+ * sharded per thread (see Shards) and aggregated on reading
  *
  * @author Stefan Nothaas, stefan.nothaas@hhu.de, 01.02.2018
  */
@@ -73,10 +75,7 @@ public:
             Operation(category, name),
             m_base(base),
             m_metricTable(),
-            m_counter(0),
-            m_total(0),
-            m_min(0xFFFFFFFFFFFFFFFF),
-            m_max(0)
+            m_shards()
     {
         for (uint8_t i = e_MetricDefault; i < e_MetricMax; i++) {
             m_metricTable[i] = 1;
@@ -107,7 +106,13 @@ public:
      */
     inline uint64_t GetCounter() const
     {
-        return m_counter;
+        uint64_t counter = 0;
+
+        m_shards.ForEach([&counter](const Shard& shard) {
+            counter += shard.m_counter.load(std::memory_order_relaxed);
+        });
+
+        return counter;
     }
 
     /**
@@ -125,7 +130,13 @@ public:
      */
     inline uint64_t GetTotalValue() const
     {
-        return m_total;
+        uint64_t total = 0;
+
+        m_shards.ForEach([&total](const Shard& shard) {
+            total += shard.m_total.load(std::memory_order_relaxed);
+        });
+
+        return total;
     }
 
     /**
@@ -143,7 +154,9 @@ public:
      */
     inline double GetAvgValue() const
     {
-        return m_counter == 0 ? 0.0 : static_cast<double>(m_total) / m_counter;
+        uint64_t counter = GetCounter();
+
+        return counter == 0 ? 0.0 : static_cast<double>(GetTotalValue()) / counter;
     }
 
     /**
@@ -161,7 +174,17 @@ public:
      */
     inline uint64_t GetMinValue() const
     {
-        return m_min;
+        uint64_t min = 0xFFFFFFFFFFFFFFFF;
+
+        m_shards.ForEach([&min](const Shard& shard) {
+            uint64_t val = shard.m_min.load(std::memory_order_relaxed);
+
+            if (val < min) {
+                min = val;
+            }
+        });
+
+        return min;
     }
 
     /**
@@ -179,7 +202,17 @@ public:
      */
     inline uint64_t GetMaxValue() const
     {
-        return m_max;
+        uint64_t max = 0;
+
+        m_shards.ForEach([&max](const Shard& shard) {
+            uint64_t val = shard.m_max.load(std::memory_order_relaxed);
+
+            if (val > max) {
+                max = val;
+            }
+        });
+
+        return max;
     }
 
     /**
@@ -207,16 +240,13 @@ public:
      */
     inline void Add(uint64_t val)
     {
-        m_counter++;
-        m_total += val;
+        bool shared;
+        Shard& shard = m_shards.Get(shared);
 
-        if (m_min > val) {
-            m_min = val;
-        }
-
-        if (m_max < val) {
-            m_max = val;
-        }
+        Shards<Shard>::Add(shard.m_counter, 1, shared);
+        Shards<Shard>::Add(shard.m_total, val, shared);
+        Shards<Shard>::Min(shard.m_min, val, shared);
+        Shards<Shard>::Max(shard.m_max, val, shared);
     }
 
     /**
@@ -231,17 +261,61 @@ public:
         __FormatUnit(os, "max", GetMaxValue());
     }
 
+    /**
+     * Overriding virtual method
+     */
+    void GetFields(std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t counter = GetCounter();
+
+        fields.emplace_back("counter", counter);
+        fields.emplace_back("total", GetTotalValue());
+        fields.emplace_back("avg", GetAvgValue());
+        fields.emplace_back("min", counter == 0 ? static_cast<uint64_t>(0) : GetMinValue());
+        fields.emplace_back("max", GetMaxValue());
+    }
+
+    /**
+     * Overriding virtual method
+     */
+    void GetIntervalFields(const std::vector<Snapshot::Field>& prev, const std::vector<Snapshot::Field>& cur,
+            double intervalSec, std::vector<Snapshot::Field>& fields) const override
+    {
+        uint64_t counter = _GetDelta(prev, cur, "counter");
+        uint64_t total = _GetDelta(prev, cur, "total");
+
+        fields.emplace_back("counter", counter);
+        fields.emplace_back("total", total);
+        fields.emplace_back("avg", counter == 0 ? 0.0 : static_cast<double>(total) / counter);
+        fields.emplace_back("per_sec", total / intervalSec);
+    }
+
 private:
     const Base m_base;
     uint64_t m_metricTable[e_MetricCount];
     static const char* ms_metricTableNames[];
 
 private:
-    uint64_t m_counter;
-    uint64_t m_total;
+    /**
+     * State of a single thread
+     */
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> m_counter;
+        std::atomic<uint64_t> m_total;
+        std::atomic<uint64_t> m_min;
+        std::atomic<uint64_t> m_max;
+
+        Shard() :
+                m_counter(0),
+                m_total(0),
+                m_min(0xFFFFFFFFFFFFFFFF),
+                m_max(0)
+        {
+        }
+    };
 
-    uint64_t m_min;
-    uint64_t m_max;
+    Shards<Shard> m_shards;
 
 private:
     inline void __FormatUnit(std::ostream& os, const std::string& name,
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <pthread.h>
+
+#include "ibnet/sys/Logger.hpp"
+#include "ibnet/sys/Timer.hpp"
+
+#include "ibnet/stats/Level.hpp"
+#include "ibnet/stats/Time.hpp"
+#include "ibnet/stats/Unit.hpp"
+
+// The statistics level is a compile time option. To compare all levels with
+// a single binary, the iteration below is instantiated once per level and
+// executes the statistics operations a send dispatcher loop iteration
+// executes at that level when posting one work package and polling one
+// batch of completions (see SendDispatcher::Dispatch):
+// - counters: 11 unit updates (next work package, sent data/FC, send type,
+//   inline, posted chunk/remainder, posted/signaled WRQs, completion
+//   poll/batch)
+// - coarse: additionally 3 timed sections (get next data to send, send
+//   data total, poll completions total)
+// - full: additionally 5 timed sections (EE schedule, get connection, send
+//   data processing, send data posting, poll completions active)
+
+static const uint32_t NUM_UNITS = 11;
+static const uint32_t NUM_TIMES_COARSE = 3;
+static const uint32_t NUM_TIMES_FULL = 5;
+
+/**
+ * Statistic operations touched by a single dispatcher loop iteration
+ */
+struct Operations
+{
+    std::vector<ibnet::stats::Unit*> m_units;
+    std::vector<ibnet::stats::Time*> m_timesCoarse;
+    std::vector<ibnet::stats::Time*> m_timesFull;
+
+    Operations()
+    {
+        for (uint32_t i = 0; i < NUM_UNITS; i++) {
+            m_units.push_back(new ibnet::stats::Unit("StatsLevelBenchmark", "Unit" + std::to_string(i)));
+        }
+
+        for (uint32_t i = 0; i < NUM_TIMES_COARSE; i++) {
+            m_timesCoarse.push_back(new ibnet::stats::Time("StatsLevelBenchmark",
+                    "TimeCoarse" + std::to_string(i)));
+        }
+
+        for (uint32_t i = 0; i < NUM_TIMES_FULL; i++) {
+            m_timesFull.push_back(new ibnet::stats::Time("StatsLevelBenchmark", "TimeFull" + std::to_string(i)));
+        }
+    }
+
+    ~Operations()
+    {
+        for (auto& it : m_units) {
+            delete it;
+        }
+
+        for (auto& it : m_timesCoarse) {
+            delete it;
+        }
+
+        for (auto& it : m_timesFull) {
+            delete it;
+        }
+    }
+};
+
+// keeps the (otherwise empty) loop body from being optimized away
+static volatile uint64_t g_sink = 0;
+
+/**
+ * Execute the statistics operations of a number of dispatcher loop
+ * iterations at the given level
+ *
+ * @tparam level Level to emulate
+ * @param ops Operations to use
+ * @param iterations Number of loop iterations
+ * @return Average time of a single iteration in ns
+ */
+template<ibnet::stats::Level level>
+static double RunIterations(Operations& ops, uint64_t iterations)
+{
+    ibnet::sys::Timer timer;
+
+    timer.Start();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        if constexpr (level >= ibnet::stats::e_LevelFull) {
+            for (auto& it : ops.m_timesFull) {
+                it->Start();
+            }
+        }
+
+        if constexpr (level >= ibnet::stats::e_LevelCoarse) {
+            for (auto& it : ops.m_timesCoarse) {
+                it->Start();
+            }
+        }
+
+        // stand in for the actual work of the iteration
+        g_sink = g_sink + i;
+
+        if constexpr (level >= ibnet::stats::e_LevelCounters) {
+            for (auto& it : ops.m_units) {
+                it->Add(i & 0xFFF);
+            }
+        }
+
+        if constexpr (level >= ibnet::stats::e_LevelCoarse) {
+            for (auto& it : ops.m_timesCoarse) {
+                it->Stop();
+            }
+        }
+
+        if constexpr (level >= ibnet::stats::e_LevelFull) {
+            for (auto& it : ops.m_timesFull) {
+                it->Stop();
+            }
+        }
+    }
+
+    timer.Stop();
+
+    return static_cast<double>(timer.GetTimeNs()) / iterations;
+}
+
+/**
+ * Measure the cost of single calls to the primitives the levels are built
+ * of: a plain timer read pair (sys::Timer) and the recording on top of it
+ * (stats::Time, stats::Unit)
+ *
+ * @param iterations Number of calls
+ */
+static void RunPrimitives(uint64_t iterations)
+{
+    ibnet::sys::Timer timer;
+    ibnet::sys::Timer plainTimer;
+    ibnet::stats::Unit unit("StatsLevelBenchmark", "Unit");
+    ibnet::stats::Time time("StatsLevelBenchmark", "Time");
+
+    printf("primitive, avg ns/call\n");
+
+    timer.Start();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        unit.Add(i & 0xFFF);
+    }
+
+    timer.Stop();
+    printf("Unit::Add, %f\n", static_cast<double>(timer.GetTimeNs()) / iterations);
+
+    timer.Start();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        plainTimer.Start();
+        plainTimer.Stop();
+    }
+
+    timer.Stop();
+    printf("sys::Timer Start + Stop, %f\n", static_cast<double>(timer.GetTimeNs()) / iterations);
+
+    timer.Start();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        time.Start();
+        time.Stop();
+    }
+
+    timer.Stop();
+    printf("Time::Start + Stop, %f\n", static_cast<double>(timer.GetTimeNs()) / iterations);
+
+    g_sink = g_sink + plainTimer.GetTimeNs();
+}
+
+/**
+ * Run the iterations of a level on fresh operations
+ *
+ * @param level Level to emulate
+ * @param iterations Number of loop iterations
+ * @return Average time of a single iteration in ns
+ */
+static double RunLevel(ibnet::stats::Level level, uint64_t iterations)
+{
+    Operations ops;
+
+    switch (level) {
+        case ibnet::stats::e_LevelOff:
+            return RunIterations<ibnet::stats::e_LevelOff>(ops, iterations);
+        case ibnet::stats::e_LevelCounters:
+            return RunIterations<ibnet::stats::e_LevelCounters>(ops, iterations);
+        case ibnet::stats::e_LevelCoarse:
+            return RunIterations<ibnet::stats::e_LevelCoarse>(ops, iterations);
+        default:
+            return RunIterations<ibnet::stats::e_LevelFull>(ops, iterations);
+    }
+}
+
+/**
+ * Main entry point
+ *
+ * @param argc Argc
+ * @param argv Argc
+ * @return Exit code
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("Usage: %s <iterations per run> <runs> [cpu to pin to, default 0, -1 to not pin]\n", argv[0]);
+        return -1;
+    }
+
+    auto iterations = static_cast<uint64_t>(std::atol(argv[1]));
+    auto runs = static_cast<uint32_t>(std::atol(argv[2]));
+    int cpu = 0;
+
+    if (argc > 3) {
+        cpu = std::atoi(argv[3]);
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t cpuSet;
+
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) != 0) {
+            printf("Pinning to cpu %d failed\n", cpu);
+            return -1;
+        }
+    }
+
+    ibnet::sys::Logger::Setup();
+
+    const ibnet::stats::Level levels[] = {ibnet::stats::e_LevelOff, ibnet::stats::e_LevelCounters,
+            ibnet::stats::e_LevelCoarse, ibnet::stats::e_LevelFull};
+    std::vector<std::vector<double>> results(4);
+
+    // warm up
+    for (auto level : levels) {
+        RunLevel(level, iterations / 10 + 1);
+    }
+
+    // interleave the levels to spread frequency/scheduling noise evenly
+    for (uint32_t i = 0; i < runs; i++) {
+        for (auto level : levels) {
+            results[level].push_back(RunLevel(level, iterations));
+        }
+    }
+
+    RunPrimitives(iterations);
+
+    printf("level, runs, avg ns/iter, stddev ns, min ns, p50 ns, max ns, delta to off ns\n");
+
+    double offAvg = 0;
+
+    for (auto level : levels) {
+        std::vector<double>& res = results[level];
+        double sum = 0;
+        double sumSq = 0;
+
+        std::sort(res.begin(), res.end());
+
+        for (auto val : res) {
+            sum += val;
+        }
+
+        double avg = sum / res.size();
+
+        for (auto val : res) {
+            sumSq += (val - avg) * (val - avg);
+        }
+
+        if (level == ibnet::stats::e_LevelOff) {
+            offAvg = avg;
+        }
+
+        printf("%s, %d, %f, %f, %f, %f, %f, %f\n", ibnet::stats::GetLevelName(level), runs, avg,
+                std::sqrt(sumSq / res.size()), res.front(), res[res.size() / 2], res.back(), avg - offAvg);
+    }
+
+    ibnet::sys::Logger::Shutdown();
+
+    return 0;
+}
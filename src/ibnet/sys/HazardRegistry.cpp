@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include "HazardRegistry.h"
+
+namespace ibnet {
+namespace sys {
+
+std::atomic<HazardRegistry::Record*> HazardRegistry::ms_records(nullptr);
+thread_local HazardRegistry::Record* HazardRegistry::ms_threadRecord = nullptr;
+
+/**
+ * Hands the record of a thread back to the registry once the thread exits
+ */
+struct RecordReleaser
+{
+    HazardRegistry::Record* m_record = nullptr;
+
+    ~RecordReleaser()
+    {
+        if (m_record) {
+            for (auto& it : m_record->m_slots) {
+                it.store(nullptr, std::memory_order_relaxed);
+            }
+
+            m_record->m_inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local RecordReleaser t_recordReleaser;
+
+bool HazardRegistry::IsProtected(const void* object)
+{
+    // pairs with the fence in Acquire
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for (Record* record = ms_records.load(std::memory_order_acquire); record != nullptr;
+            record = record->m_next) {
+        for (auto& it : record->m_slots) {
+            if (it.load(std::memory_order_acquire) == object) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+HazardRegistry::Record* HazardRegistry::__Register()
+{
+    Record* record = nullptr;
+
+    // re-use a record of an exited thread
+    for (Record* it = ms_records.load(std::memory_order_acquire); it != nullptr; it = it->m_next) {
+        bool expected = false;
+
+        if (!it->m_inUse.load(std::memory_order_relaxed) &&
+                it->m_inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            record = it;
+            break;
+        }
+    }
+
+    if (record == nullptr) {
+        record = new Record();
+
+        Record* head = ms_records.load(std::memory_order_relaxed);
+
+        do {
+            record->m_next = head;
+        } while (!ms_records.compare_exchange_weak(head, record, std::memory_order_release,
+                std::memory_order_relaxed));
+    }
+
+    ms_threadRecord = record;
+    t_recordReleaser.m_record = record;
+
+    return record;
+}
+
+}
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#ifndef IBNET_SYS_HAZARDREGISTRY_H
+#define IBNET_SYS_HAZARDREGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace ibnet {
+namespace sys {
+
+/**
+ * Registry of hazard slots to protect shared objects from being torn down
+ * while in use without a shared reference counter. Each thread owns a
+ * record (single cache line) of slots it publishes the objects it is
+ * using in. Acquiring and releasing only write to the thread's own record,
+ * i.e. there is no shared atomic RMW and no cache line bouncing between
+ * threads using the same object. Tearing down an object requires scanning
+ * the records of all threads (see IsProtected) which is expensive but rare.
+ *
+ * The protocol: the reader publishes the object (Acquire) and validates
+ * afterwards that the object is still alive (e.g. checking a state flag).
+ * The writer invalidates the object first and checks IsProtected
+ * afterwards. Either the reader sees the invalidated object or the writer
+ * sees the published slot.
+ *
+ * Records are never freed but re-used by new threads once the owning
+ * thread exited.
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class HazardRegistry
+{
+public:
+    static const uint32_t SLOTS_PER_THREAD = 6;
+
+    /**
+     * Hazard slots of a single thread
+     */
+    struct alignas(64) Record
+    {
+        std::atomic<const void*> m_slots[SLOTS_PER_THREAD];
+        std::atomic<bool> m_inUse;
+        // immutable once the record is added to the registry
+        Record* m_next;
+
+        Record() :
+                m_slots(),
+                m_inUse(true),
+                m_next(nullptr)
+        {
+            for (auto& it : m_slots) {
+                it.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /**
+     * Publish an object in a free slot of the calling thread. The caller
+     * has to validate that the object is still valid afterwards and release
+     * it if not
+     *
+     * @param object Object to protect
+     * @return Slot holding the object or nullptr if all slots of the
+     *         calling thread are in use (caller has to fall back to a
+     *         different scheme)
+     */
+    static std::atomic<const void*>* Acquire(const void* object)
+    {
+        Record* record = __GetRecord();
+
+        for (auto& it : record->m_slots) {
+            if (it.load(std::memory_order_relaxed) == nullptr) {
+                it.store(object, std::memory_order_relaxed);
+
+                // order the publish before the caller's validation,
+                // pairs with the fence in IsProtected
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                return &it;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Release a slot returned by Acquire
+     *
+     * @param slot Slot to release
+     */
+    static void Release(std::atomic<const void*>* slot)
+    {
+        slot->store(nullptr, std::memory_order_release);
+    }
+
+    /**
+     * Release an object protected by the calling thread
+     *
+     * @param object Object to release
+     * @return True if released, false if the calling thread does not hold
+     *         the object in any of its slots
+     */
+    static bool Release(const void* object)
+    {
+        Record* record = ms_threadRecord;
+
+        if (record == nullptr) {
+            return false;
+        }
+
+        for (auto& it : record->m_slots) {
+            if (it.load(std::memory_order_relaxed) == object) {
+                it.store(nullptr, std::memory_order_release);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Check if any thread is protecting an object. Must be called after
+     * the object was invalidated for new readers. Expensive, scans the
+     * records of all threads
+     *
+     * @param object Object to check
+     * @return True if at least one thread holds the object
+     */
+    static bool IsProtected(const void* object);
+
+private:
+    HazardRegistry() = default;
+
+    ~HazardRegistry() = default;
+
+    static Record* __GetRecord()
+    {
+        Record* record = ms_threadRecord;
+
+        if (record == nullptr) {
+            record = __Register();
+        }
+
+        return record;
+    }
+
+    static Record* __Register();
+
+    static std::atomic<Record*> ms_records;
+    static thread_local Record* ms_threadRecord;
+};
+
+}
+}
+
+#endif // IBNET_SYS_HAZARDREGISTRY_H
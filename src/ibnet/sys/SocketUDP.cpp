@@ -20,6 +20,7 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -30,7 +31,7 @@
 namespace ibnet {
 namespace sys {
 
-SocketUDP::SocketUDP(uint16_t port) :
+SocketUDP::SocketUDP(uint16_t port, uint32_t bindIpv4) :
         m_port(port),
         m_socket(-1)
 {
@@ -49,12 +50,12 @@ SocketUDP::SocketUDP(uint16_t port) :
     memset(&addr, 0, sizeof(struct sockaddr_in));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_addr.s_addr = htonl(bindIpv4 != 0 ? bindIpv4 : INADDR_ANY);
 
     if (bind(m_socket, (const sockaddr*) &addr, sizeof(addr)) == -1) {
         close(m_socket);
-        throw SystemException("Binding UDP socket to port %d failed: %s",
-                port, strerror(errno));
+        throw SystemException("Binding UDP socket to %s failed: %s",
+                AddressIPV4(bindIpv4, port).GetAddressStr(true), strerror(errno));
     }
 
     IBNET_LOG_DEBUG("Opened UDP socket on port %d", port);
@@ -117,5 +118,90 @@ ssize_t SocketUDP::Send(void* buffer, size_t size, uint32_t addrIpv4, uint16_t p
     return length;
 }
 
+int SocketUDP::ReceiveBatch(void** buffers, size_t size, size_t* lengths,
+        uint32_t* recvIpv4s, uint32_t count)
+{
+    mmsghdr msgs[MAX_BATCH_SIZE];
+    iovec iovs[MAX_BATCH_SIZE];
+    sockaddr_in recvAddrs[MAX_BATCH_SIZE];
+
+    if (count > MAX_BATCH_SIZE) {
+        count = MAX_BATCH_SIZE;
+    }
+
+    memset(msgs, 0, sizeof(mmsghdr) * count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = size;
+
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &recvAddrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    int ret = recvmmsg(m_socket, msgs, count, 0, nullptr);
+
+    if (ret < 0) {
+        if (errno == EAGAIN) {
+            // no data for non blocking
+            return 0;
+        }
+
+        IBNET_LOG_ERROR("Receiving batch of data failed (%d): %s", ret,
+                strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < ret; i++) {
+        lengths[i] = msgs[i].msg_len;
+        recvIpv4s[i] = ntohl(recvAddrs[i].sin_addr.s_addr);
+    }
+
+    return ret;
+}
+
+int SocketUDP::SendBatch(void** buffers, const size_t* sizes,
+        const uint32_t* addrIpv4s, uint16_t port, uint32_t count)
+{
+    mmsghdr msgs[MAX_BATCH_SIZE];
+    iovec iovs[MAX_BATCH_SIZE];
+    sockaddr_in destAddrs[MAX_BATCH_SIZE];
+
+    if (count > MAX_BATCH_SIZE) {
+        count = MAX_BATCH_SIZE;
+    }
+
+    memset(msgs, 0, sizeof(mmsghdr) * count);
+    memset(destAddrs, 0, sizeof(sockaddr_in) * count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = sizes[i];
+
+        destAddrs[i].sin_family = AF_INET;
+        destAddrs[i].sin_port = htons(port);
+        destAddrs[i].sin_addr.s_addr = htonl(addrIpv4s[i]);
+
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &destAddrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    int ret = sendmmsg(m_socket, msgs, count, 0);
+
+    if (ret < 0) {
+        IBNET_LOG_ERROR("Sending batch of data failed (%d): %s", count,
+                strerror(errno));
+    } else if (ret != static_cast<int>(count)) {
+        // partial send, the caller retries the remaining messages
+        IBNET_LOG_TRACE("Sent batch of data partially (%d/%d)", ret, count);
+    }
+
+    return ret;
+}
+
 }
 }
\ No newline at end of file
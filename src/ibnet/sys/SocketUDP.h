@@ -34,6 +34,13 @@ namespace sys {
  */
 class SocketUDP
 {
+public:
+    /**
+     * Max number of datagrams received/sent with a single call of
+     * ReceiveBatch/SendBatch
+     */
+    static const uint32_t MAX_BATCH_SIZE = 64;
+
 public:
     /**
      * Constructor
@@ -41,8 +48,11 @@ public:
      * Open the socket on the defined port in non-blocking mode
      *
      * @param port Port to open the socket on
+     * @param bindIpv4 Local address to bind the socket to (0 for any). Allows
+     *        multiple instances with the same port on a single host using different
+     *        loopback addresses (127.0.0.x)
      */
-    explicit SocketUDP(uint16_t port);
+    explicit SocketUDP(uint16_t port, uint32_t bindIpv4 = 0);
 
     /**
      * Destructor
@@ -57,6 +67,15 @@ public:
         return m_port;
     }
 
+    /**
+     * Get the file descriptor of the socket, e.g. to wait for incoming data
+     * using poll
+     */
+    int GetFd() const
+    {
+        return m_socket;
+    }
+
     /**
      * Receive data (non-blocking!)
      *
@@ -80,6 +99,36 @@ public:
      */
     ssize_t Send(void* buffer, size_t size, uint32_t addrIpv4, uint16_t port);
 
+    /**
+     * Receive multiple datagrams with a single call (non-blocking!)
+     *
+     * @param buffers Array of allocated buffers, one per datagram
+     * @param size Size of each allocated buffer
+     * @param lengths Array to return the number of bytes received to, one
+     *          per buffer
+     * @param recvIpv4s Array to return the IPV4 of the sender of each
+     *          datagram to
+     * @param count Number of buffers (max MAX_BATCH_SIZE)
+     * @return Number of datagrams received or -1 on error. If 0, no data was
+     *          available.
+     */
+    int ReceiveBatch(void** buffers, size_t size, size_t* lengths,
+            uint32_t* recvIpv4s, uint32_t count);
+
+    /**
+     * Send multiple datagrams with a single call (non-blocking!)
+     *
+     * @param buffers Array of allocated buffers with data to send, one per
+     *          datagram
+     * @param sizes Array with the number of bytes to send of each buffer
+     * @param addrIpv4s Array of destination IPV4s, one per datagram
+     * @param port Destination port (same for all datagrams)
+     * @param count Number of datagrams to send (max MAX_BATCH_SIZE)
+     * @return Number of datagrams sent or -1 on error
+     */
+    int SendBatch(void** buffers, const size_t* sizes, const uint32_t* addrIpv4s,
+            uint16_t port, uint32_t count);
+
 private:
     uint16_t m_port;
     int m_socket;
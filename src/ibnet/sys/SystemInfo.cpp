@@ -18,6 +18,8 @@
 
 #include "SystemInfo.h"
 
+#include <fstream>
+
 #include "ibnet/Version.h"
 
 #include "Logger.hpp"
@@ -57,6 +59,18 @@ void SystemInfo::LogApplicationReport()
             ibnet::VERSION, ibnet::BUILD_DATE, ibnet::GIT_REV);
 }
 
+std::string SystemInfo::GetHostId()
+{
+    std::ifstream file("/proc/sys/kernel/random/boot_id");
+    std::string bootId;
+
+    if (!file.is_open() || !(file >> bootId) || bootId.empty()) {
+        return Network::GetHostname();
+    }
+
+    return bootId;
+}
+
 std::string SystemInfo::__ExecuteCmd(const std::string& cmd)
 {
     FILE* pipe = popen(cmd.c_str(), "r");
@@ -47,6 +47,13 @@ public:
      */
     static void LogApplicationReport();
 
+    /**
+     * Get an id identifying the running kernel instance, i.e. the host (boot id,
+     * falls back to the hostname if not available). Identical for processes
+     * (and containers) running on the same host
+     */
+    static std::string GetHostId();
+
 private:
     /**
      * Constructor
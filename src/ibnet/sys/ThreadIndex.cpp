@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "ThreadIndex.h"
+
+namespace ibnet {
+namespace sys {
+
+std::atomic<bool> ThreadIndex::ms_inUse[MAX_THREADS];
+thread_local uint16_t ThreadIndex::ms_threadIndex = ThreadIndex::INDEX_UNASSIGNED;
+
+/**
+ * Hands the index of a thread back once the thread exits
+ */
+struct IndexReleaser
+{
+    std::atomic<bool>* m_inUse = nullptr;
+
+    ~IndexReleaser()
+    {
+        if (m_inUse) {
+            m_inUse->store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local IndexReleaser t_indexReleaser;
+
+uint16_t ThreadIndex::__Assign()
+{
+    for (uint16_t i = 0; i < MAX_THREADS; i++) {
+        bool expected = false;
+
+        if (!ms_inUse[i].load(std::memory_order_relaxed) &&
+                ms_inUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            ms_threadIndex = i;
+            t_indexReleaser.m_inUse = &ms_inUse[i];
+
+            return i;
+        }
+    }
+
+    // all taken, shared by all further threads
+    ms_threadIndex = MAX_THREADS;
+
+    return MAX_THREADS;
+}
+
+}
+}
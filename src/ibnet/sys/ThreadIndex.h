@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef IBNET_SYS_THREADINDEX_H
+#define IBNET_SYS_THREADINDEX_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace ibnet {
+namespace sys {
+
+/**
+ * Dense index of the calling thread, e.g. to select a per-thread shard of
+ * a data structure without hashing. Indices are assigned on first use and
+ * handed back once the thread exits to be re-used by new threads, i.e. at
+ * most MAX_THREADS threads alive at the same time get a unique index.
+ * Any further thread gets the shared index MAX_THREADS
+ *
+ * @author Stefan Nothaas, stefan.nothaas@hhu.de, 18.10.2018
+ */
+class ThreadIndex
+{
+public:
+    static const uint16_t MAX_THREADS = 128;
+
+    /**
+     * Get the index of the calling thread
+     *
+     * @return Index < MAX_THREADS exclusive to the thread or MAX_THREADS
+     *         if shared with other threads (all indices in use)
+     */
+    static uint16_t Get()
+    {
+        uint16_t index = ms_threadIndex;
+
+        if (index == INDEX_UNASSIGNED) {
+            index = __Assign();
+        }
+
+        return index;
+    }
+
+private:
+    static const uint16_t INDEX_UNASSIGNED = 0xFFFF;
+
+    ThreadIndex() = default;
+
+    ~ThreadIndex() = default;
+
+    static uint16_t __Assign();
+
+    static std::atomic<bool> ms_inUse[MAX_THREADS];
+    static thread_local uint16_t ms_threadIndex;
+};
+
+}
+}
+
+#endif // IBNET_SYS_THREADINDEX_H